@@ -41,11 +41,146 @@ inline gymjot::MetadataList defaultTestExerciseMetadata() {
 #define APRILTAG_MIN_DECISION_MARGIN 12.0
 #define APRILTAG_STABILITY_FRAMES 1
 
+// Decision margin below which the decoder drops a quad early. Kept below
+// APRILTAG_MIN_DECISION_MARGIN, so that near misses are still detected and
+// show up in the low-margin log; they are not accepted.
+#ifndef APRILTAG_DECODE_MIN_MARGIN
+#define APRILTAG_DECODE_MIN_MARGIN (APRILTAG_MIN_DECISION_MARGIN * 0.5)
+#endif
+
+// Region-of-interest tracking. Once a tag is locked, only a box around its
+// last corners (padded by APRILTAG_ROI_PAD_FRACTION of the tag size, at least
+// APRILTAG_ROI_MIN_PAD_PX) is searched. Every miss multiplies the padding by
+// APRILTAG_ROI_GROW_FACTOR; after APRILTAG_ROI_MAX_MISSES misses in a row the
+// next frame is searched in full again.
+#ifndef APRILTAG_ROI_ENABLE
+#define APRILTAG_ROI_ENABLE 1
+#endif
+#define APRILTAG_ROI_PAD_FRACTION 0.5f
+#define APRILTAG_ROI_MIN_PAD_PX 16
+#define APRILTAG_ROI_GROW_FACTOR 2.0f
+#define APRILTAG_ROI_MAX_MISSES 3
+
+// Tag size gating. Once a tag is locked, the quad search drops clusters and
+// quads whose longest edge is not within APRILTAG_SIZE_GATE_TOLERANCE (a
+// fraction) of the last tag's, which is where the tag size, intrinsics and
+// distance put it. Every miss multiplies the tolerance by
+// APRILTAG_SIZE_GATE_GROW_FACTOR; after APRILTAG_SIZE_GATE_MAX_MISSES misses
+// in a row any size is accepted again.
+#ifndef APRILTAG_SIZE_GATE_ENABLE
+#define APRILTAG_SIZE_GATE_ENABLE 1
+#endif
+#define APRILTAG_SIZE_GATE_TOLERANCE 0.5f
+#define APRILTAG_SIZE_GATE_GROW_FACTOR 2.0f
+#define APRILTAG_SIZE_GATE_MAX_MISSES 3
+
+// Adaptive decimation. Each frame quad_decimate is picked from 1, 1.5, 2, 3
+// and 4: the coarsest that keeps the last tag's longest edge at least
+// APRILTAG_DECIMATE_MIN_EDGE_PX long in the decimated image (times
+// APRILTAG_DECIMATE_HYSTERESIS to move to a coarser one). After
+// APRILTAG_DECIMATE_MISS_FRAMES misses in a row the next finer factor is
+// tried, down to 1, and then APRILTAG_QUAD_DECIMATE again.
+#ifndef APRILTAG_ADAPTIVE_DECIMATE
+#define APRILTAG_ADAPTIVE_DECIMATE 1
+#endif
+#define APRILTAG_DECIMATE_MIN_EDGE_PX 12.0f
+#define APRILTAG_DECIMATE_HYSTERESIS 1.25f
+#define APRILTAG_DECIMATE_MISS_FRAMES 4
+// Weight of the latest frame in the detection hit rate reported in the snapshot.
+#define APRILTAG_HIT_RATE_ALPHA 0.1f
+
+// Track-by-verification. While a tag is locked, each frame first re-checks it
+// where it was: its edges are refit within APRILTAG_TRACK_BAND_PX of the last
+// corners and its code is decoded again, unless no corner moved more than
+// APRILTAG_TRACK_REUSE_PX, in which case the last decode is reused. A frame
+// the tag fails to verify in falls back to the ROI / full-frame search, and
+// every APRILTAG_TRACK_REACQUIRE_FRAMES tracked frames the whole frame is
+// searched anyway so a better tag is not missed.
+#ifndef APRILTAG_TRACK_ENABLE
+#define APRILTAG_TRACK_ENABLE 1
+#endif
+#define APRILTAG_TRACK_BAND_PX 4
+#define APRILTAG_TRACK_REUSE_PX 0.5
+#define APRILTAG_TRACK_REACQUIRE_FRAMES 30
+
+// Temporal tile reuse. The camera looks at a mostly still gym, so the
+// threshold of every 4x4 tile whose pixels stayed within
+// APRILTAG_TEMPORAL_TILE_TOLERANCE gray levels (sensor noise) of the frame it
+// was computed on is reused, and so are the quad fits of the edges lying on
+// such tiles. Only searches of the same image size share work: a frame after
+// the ROI or the decimation changed is searched in full.
+#ifndef APRILTAG_TEMPORAL_TILES_ENABLE
+#define APRILTAG_TEMPORAL_TILES_ENABLE 1
+#endif
+#define APRILTAG_TEMPORAL_TILE_TOLERANCE 4
+
+// Decode budget per frame, as a percentage of the controller's frame
+// interval (1 / target fps). Quads are decoded most promising first and the
+// rest are skipped once it is spent, so busy scenes cannot stretch a frame.
+// 0 decodes every quad.
+#ifndef APRILTAG_DEADLINE_PERCENT
+#define APRILTAG_DEADLINE_PERCENT 60
+#endif
+
 // Sharpening factor during decode; higher can help at distance but increases noise
 #ifndef APRILTAG_DECODE_SHARPENING
 #define APRILTAG_DECODE_SHARPENING 0.50f
 #endif
 
+// Distance from the closed-form IPPE pose (estimate_tag_pose_fast) instead of
+// orthogonal iteration (estimate_tag_pose). Within 1% of it on real corners, at
+// a small fraction of the time and without heap allocations; set to 0 for the
+// iterative solver.
+#ifndef APRILTAG_POSE_FAST
+#define APRILTAG_POSE_FAST 1
+#endif
+
+// With the iterative solver (APRILTAG_POSE_FAST 0), refine each tag's pose
+// from its previous frame (estimate_tag_pose_track) with a few iterations,
+// searching both poses again only for new tags or when the reprojection
+// error jumps. Poses are kept for APRILTAG_POSE_TRACK_SLOTS tag ids. The
+// fast solver has nothing to refine, so this defaults to on only without it
+// and the two cannot be enabled together.
+#ifndef APRILTAG_POSE_TRACK
+#define APRILTAG_POSE_TRACK (!APRILTAG_POSE_FAST)
+#endif
+#if APRILTAG_POSE_FAST && APRILTAG_POSE_TRACK
+#error "APRILTAG_POSE_TRACK refines the iterative pose; set APRILTAG_POSE_FAST to 0 to use it"
+#endif
+
+// Tag ids whose pose track, or size-mode full-pose schedule (below), is
+// kept; the least recently seen id gives its slot to a new one.
+#ifndef APRILTAG_POSE_TRACK_SLOTS
+#define APRILTAG_POSE_TRACK_SLOTS 4
+#endif
+
+// How tag distances are measured:
+//  - APRILTAG_DISTANCE_MODE_POSE: a full pose every frame, with the solver
+//    chosen above.
+//  - APRILTAG_DISTANCE_MODE_SIZE: the tag's apparent size every frame
+//    (estimate_tag_distance), corrected by a table learned from the full
+//    iterative pose (estimate_tag_pose) of the first frame of each tag and of
+//    every APRILTAG_DISTANCE_FULL_POSE_INTERVAL-th frame after it, for distances
+//    from APRILTAG_DISTANCE_CALIB_MIN_M to APRILTAG_DISTANCE_CALIB_MAX_M.
+//    With DISTANCE_STREAM_DEBUG each full pose logs the table's error. This
+//    mode does not use APRILTAG_POSE_FAST or APRILTAG_POSE_TRACK.
+// The default is _SIZE: rep counting only needs the distance, and the table
+// keeps it tied to the accurate iterative pose.
+#define APRILTAG_DISTANCE_MODE_POSE 0
+#define APRILTAG_DISTANCE_MODE_SIZE 1
+#ifndef APRILTAG_DISTANCE_MODE
+#define APRILTAG_DISTANCE_MODE APRILTAG_DISTANCE_MODE_SIZE
+#endif
+#ifndef APRILTAG_DISTANCE_FULL_POSE_INTERVAL
+#define APRILTAG_DISTANCE_FULL_POSE_INTERVAL 30
+#endif
+#ifndef APRILTAG_DISTANCE_CALIB_MIN_M
+#define APRILTAG_DISTANCE_CALIB_MIN_M 0.10
+#endif
+#ifndef APRILTAG_DISTANCE_CALIB_MAX_M
+#define APRILTAG_DISTANCE_CALIB_MAX_M 3.0
+#endif
+
 // Optional distance calibration
 // After pose estimation, distances are scaled and offset to improve accuracy.
 // Measure at a known distance and adjust:
@@ -83,10 +218,14 @@ inline gymjot::MetadataList defaultTestExerciseMetadata() {
 #endif
 
 // AprilTag decoder error-correction limit.
-// Warning: values >0 dramatically increase RAM use due to the quick-decode table.
-// On ESP32 with limited heap, prefer 0 for large families like tagStandard41h12.
+// The library is built with the compact decode index (APRILTAG_COMPACT_DECODE_INDEX
+// in library.json), which needs max(bits+1, 2) * (ncodes + dir_size + 1) * 2
+// bytes per family, dir_size being about ncodes rounded up to a power of two
+// (apriltag_family_decode_index_bytes reports the exact figure):
+// ~37 KB for tagStandard41h12 at 2 bits. Without it, values >0 need tens to
+// hundreds of MB for the larger families.
 #ifndef APRILTAG_MAX_BITS_CORRECTED
-#define APRILTAG_MAX_BITS_CORRECTED 0
+#define APRILTAG_MAX_BITS_CORRECTED 2
 #endif
 
 // Allocate AprilTag quick-decode table in PSRAM (ESP32) when available.
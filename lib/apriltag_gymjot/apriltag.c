@@ -69,7 +69,33 @@ static inline long int random(void)
 
 #define APRILTAG_U64_ONE ((uint64_t) 1)
 
-extern zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im);
+// Default of apriltag_detector_t.decode_float; builds for cores without a
+// double-precision FPU set it to 1.
+#ifndef APRILTAG_DECODE_FLOAT
+#define APRILTAG_DECODE_FLOAT 0
+#endif
+
+// Default of apriltag_detector_t.compact_decode_index.
+#ifndef APRILTAG_COMPACT_DECODE_INDEX
+#define APRILTAG_COMPACT_DECODE_INDEX 0
+#endif
+
+// 0 leaves out the per-layout decoders of td->specialized_decode.
+#ifndef APRILTAG_SPECIALIZED_DECODE
+#define APRILTAG_SPECIALIZED_DECODE 1
+#endif
+
+extern zarray_t *apriltag_quad_thresh_minmax(apriltag_detector_t *td, image_u8_t *im,
+                                             uint8_t *im_max, uint8_t *im_min, bool temporal);
+extern void thresh_history_destroy(struct thresh_history *hist);
+extern image_u8_t *decimate_minmax(apriltag_detector_t *td, image_u8_t *im,
+                                   uint8_t **im_max, uint8_t **im_min);
+
+typedef struct quad_thresh_stream quad_thresh_stream_t;
+extern bool quad_thresh_stream_supported(apriltag_detector_t *td);
+extern quad_thresh_stream_t *quad_thresh_stream_begin(apriltag_detector_t *td, image_u8_t *im);
+extern void quad_thresh_stream_rows(quad_thresh_stream_t *qs, int nrows);
+extern zarray_t *quad_thresh_stream_finish(quad_thresh_stream_t *qs, image_u8_t **quad_im);
 
 // Regresses a model of the form:
 // intensity(x,y) = C0*x + C1*y + CC2
@@ -125,10 +151,40 @@ struct quick_decode_entry
     uint8_t rotation; // number of rotations [0, 3]
 };
 
+// The decode index of a family is either a hash table of every code
+// within maxhamming bits of a valid code (entries), keyed by the
+// smallest of the code's four rotations so that a query needs a single
+// probe sequence whatever the tag's orientation, or, for
+// td->compact_decode_index, a table of the valid codes only: the code
+// is split into at least maxhamming+1 bit fields, and a code with at
+// most maxhamming errors matches a valid code exactly on at least one
+// of them. chunk_ids holds, for each field, the code ids sorted by that
+// field, and chunk_dir the start of each run of ids sharing the top
+// dir_bits of the field; the few candidates of a bucket are checked by
+// popcount.
+#define QUICK_DECODE_MAX_CHUNKS 4
+
+// a single-precision payload decoder; see quad_decode_float().
+typedef float (*quad_decode_float_fn)(apriltag_detector_t* td, apriltag_family_t *family, image_u8_t *im,
+                                      struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples);
+static quad_decode_float_fn quad_decode_float_for(const apriltag_family_t *family);
+
 struct quick_decode
 {
+    int nbits;
     int nentries;
-    struct quick_decode_entry *entries;
+    struct quick_decode_entry *entries; // rcode: canonical code, rotation: to canonical
+
+    int maxhamming;
+    int nchunks;
+    int chunk_shift[QUICK_DECODE_MAX_CHUNKS];
+    uint32_t chunk_mask[QUICK_DECODE_MAX_CHUNKS];
+    int dir_shift[QUICK_DECODE_MAX_CHUNKS];
+    int dir_size;
+    uint16_t *chunk_ids; // nchunks * ncodes
+    uint16_t *chunk_dir; // nchunks * (dir_size + 1)
+
+    quad_decode_float_fn decode_float; // for the family's layout
 };
 
 /**
@@ -148,38 +204,46 @@ static uint64_t rotate90(uint64_t w, int numBits)
     return w;
 }
 
-static void quad_destroy(struct quad *quad)
+// The smallest of the four rotations of code. rots receives the
+// rotations, *rotation the first one that is canonical and *period the
+// rotational period of the code (1, 2 or 4).
+static inline uint64_t canonical_rotation(uint64_t code, int nbits, uint64_t rots[4],
+                                          int *rotation, int *period)
 {
-    if (!quad)
-        return;
-
-    matd_destroy(quad->H);
-    matd_destroy(quad->Hinv);
-    free(quad);
-}
+    rots[0] = code;
+    rots[1] = rotate90(rots[0], nbits);
+    rots[2] = rotate90(rots[1], nbits);
+    rots[3] = rotate90(rots[2], nbits);
+
+    uint64_t best = rots[0];
+    int k = 0;
+    for (int r = 1; r < 4; r++) {
+        int less = rots[r] < best;
+        best = less ? rots[r] : best;
+        k = less ? r : k;
+    }
 
-static struct quad *quad_copy(struct quad *quad)
-{
-    struct quad *q = calloc(1, sizeof(struct quad));
-    memcpy(q, quad, sizeof(struct quad));
-    if (quad->H)
-        q->H = matd_copy(quad->H);
-    if (quad->Hinv)
-        q->Hinv = matd_copy(quad->Hinv);
-    return q;
+    *rotation = k;
+    *period = rots[1] == code ? 1 : rots[2] == code ? 2 : 4;
+    return best;
 }
 
 static void quick_decode_add(struct quick_decode *qd, uint64_t code, int id, int hamming)
 {
-    uint32_t bucket = code % qd->nentries;
+    uint64_t rots[4];
+    int rotation, period;
+    uint64_t canonical = canonical_rotation(code, qd->nbits, rots, &rotation, &period);
+
+    uint32_t bucket = canonical % qd->nentries;
 
     while (qd->entries[bucket].rcode != UINT64_MAX) {
         bucket = (bucket + 1) % qd->nentries;
     }
 
-    qd->entries[bucket].rcode = code;
+    qd->entries[bucket].rcode = canonical;
     qd->entries[bucket].id = id;
     qd->entries[bucket].hamming = hamming;
+    qd->entries[bucket].rotation = rotation;
 }
 
 static void quick_decode_uninit(apriltag_family_t *fam)
@@ -189,6 +253,8 @@ static void quick_decode_uninit(apriltag_family_t *fam)
 
     struct quick_decode *qd = (struct quick_decode*) fam->impl;
     free(qd->entries);
+    free(qd->chunk_ids);
+    free(qd->chunk_dir);
     free(qd);
     fam->impl = NULL;
 }
@@ -198,7 +264,15 @@ static void quick_decode_init(apriltag_family_t *family, int maxhamming)
     assert(family->impl == NULL);
     assert(family->ncodes < 65536);
 
+    if (maxhamming > 3) {
+        debug_print("\"maxhamming\" beyond 3 not supported\n");
+        // set errno to Error INvalid VALue
+        errno = EINVAL;
+        return;
+    }
+
     struct quick_decode *qd = calloc(1, sizeof(struct quick_decode));
+    qd->nbits = family->nbits;
     int capacity = family->ncodes;
 
     int nbits = family->nbits;
@@ -264,13 +338,6 @@ static void quick_decode_init(apriltag_family_t *family, int maxhamming)
                     for (int m = 0; m < k; m++)
                         quick_decode_add(qd, code ^ (APRILTAG_U64_ONE << j) ^ (APRILTAG_U64_ONE << k) ^ (APRILTAG_U64_ONE << m), i, 3);
         }
-
-        if (maxhamming > 3) {
-            debug_print("\"maxhamming\" beyond 3 not supported\n");
-            // set errno to Error INvalid VALue
-            errno = EINVAL;
-            return;
-        }
     }
 
     family->impl = qd;
@@ -300,6 +367,134 @@ static void quick_decode_init(apriltag_family_t *family, int maxhamming)
     #endif
 }
 
+static inline int popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+struct chunk_key
+{
+    uint32_t key;
+    uint16_t id;
+};
+
+static int chunk_key_compare(const void *_a, const void *_b)
+{
+    const struct chunk_key *a = _a, *b = _b;
+
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    return a->id - b->id;
+}
+
+static void quick_decode_init_compact(apriltag_family_t *family, int maxhamming)
+{
+    assert(family->impl == NULL);
+    assert(family->ncodes < 65536);
+
+    if (maxhamming > 3) {
+        debug_print("\"maxhamming\" beyond 3 not supported\n");
+        errno = EINVAL;
+        return;
+    }
+
+    struct quick_decode *qd = calloc(1, sizeof(struct quick_decode));
+    qd->maxhamming = maxhamming;
+
+    // at least two fields, so that each fits in 32 bits.
+    qd->nchunks = imax(maxhamming + 1, 2);
+
+    // about one code per directory bucket.
+    int dir_bits = 1;
+    while ((APRILTAG_U64_ONE << dir_bits) < family->ncodes)
+        dir_bits++;
+    dir_bits = imin(dir_bits, family->nbits / qd->nchunks);
+    qd->dir_size = 1 << dir_bits;
+
+    qd->chunk_ids = malloc(sizeof(uint16_t) * qd->nchunks * family->ncodes);
+    qd->chunk_dir = malloc(sizeof(uint16_t) * qd->nchunks * (qd->dir_size + 1));
+    struct chunk_key *keys = malloc(sizeof(struct chunk_key) * family->ncodes);
+    if (qd->chunk_ids == NULL || qd->chunk_dir == NULL || keys == NULL) {
+        debug_print("Failed to allocate hamming decode index\n");
+        free(keys);
+        free(qd->chunk_ids);
+        free(qd->chunk_dir);
+        free(qd);
+        return;
+    }
+
+    errno = 0;
+
+    int shift = 0;
+    for (int c = 0; c < qd->nchunks; c++) {
+        int width = (family->nbits - shift) / (qd->nchunks - c);
+        qd->chunk_shift[c] = shift;
+        qd->chunk_mask[c] = (APRILTAG_U64_ONE << width) - 1;
+        qd->dir_shift[c] = width - dir_bits;
+        shift += width;
+
+        for (uint32_t i = 0; i < family->ncodes; i++) {
+            keys[i].key = (family->codes[i] >> qd->chunk_shift[c]) & qd->chunk_mask[c];
+            keys[i].id = i;
+        }
+        qsort(keys, family->ncodes, sizeof(struct chunk_key), chunk_key_compare);
+
+        uint16_t *dir = &qd->chunk_dir[c*(qd->dir_size + 1)];
+        int bucket = 0;
+        for (uint32_t i = 0; i < family->ncodes; i++) {
+            qd->chunk_ids[c*family->ncodes + i] = keys[i].id;
+            for (; bucket <= (int) (keys[i].key >> qd->dir_shift[c]); bucket++)
+                dir[bucket] = i;
+        }
+        for (; bucket <= qd->dir_size; bucket++)
+            dir[bucket] = family->ncodes;
+    }
+
+    free(keys);
+    family->impl = qd;
+}
+
+// Best match of rcode (not rotated) in the compact index, or -1.
+static int quick_decode_lookup_compact(const apriltag_family_t *tf, const struct quick_decode *qd,
+                                       uint64_t rcode, int *hamming)
+{
+    int best = -1;
+    *hamming = qd->maxhamming + 1;
+
+    for (int c = 0; c < qd->nchunks; c++) {
+        const uint16_t *ids = &qd->chunk_ids[c*tf->ncodes];
+        const uint16_t *dir = &qd->chunk_dir[c*(qd->dir_size + 1)];
+        int shift = qd->chunk_shift[c];
+        uint32_t mask = qd->chunk_mask[c];
+        uint32_t key = (rcode >> shift) & mask;
+        uint32_t bucket = key >> qd->dir_shift[c];
+
+        for (int i = dir[bucket]; i < dir[bucket + 1]; i++) {
+            uint64_t code = tf->codes[ids[i]];
+            if (((code >> shift) & mask) != key)
+                continue;
+
+            int h = popcount64(code ^ rcode);
+            if (h < *hamming) {
+                *hamming = h;
+                best = ids[i];
+            }
+        }
+
+        if (*hamming == 0)
+            break;
+    }
+
+    return best;
+}
+
 // returns an entry with hamming set to 255 if no decode was found.
 static void quick_decode_codeword(apriltag_family_t *tf, uint64_t rcode,
                                   struct quick_decode_entry *entry)
@@ -307,20 +502,49 @@ static void quick_decode_codeword(apriltag_family_t *tf, uint64_t rcode,
     struct quick_decode *qd = (struct quick_decode*) tf->impl;
 
     // qd might be null if detector_add_family_bits() failed
-    for (int ridx = 0; qd != NULL && ridx < 4; ridx++) {
+    for (int ridx = 0; qd != NULL && qd->entries == NULL && ridx < 4; ridx++) {
+        int hamming;
+        int id = quick_decode_lookup_compact(tf, qd, rcode, &hamming);
+        if (id >= 0) {
+            entry->rcode = rcode;
+            entry->id = id;
+            entry->hamming = hamming;
+            entry->rotation = ridx;
+            return;
+        }
+
+        rcode = rotate90(rcode, tf->nbits);
+    }
 
-        for (int bucket = rcode % qd->nentries;
+    if (qd != NULL && qd->entries != NULL) {
+        uint64_t rots[4];
+        int rotation, period;
+        uint64_t canonical = canonical_rotation(rcode, tf->nbits, rots, &rotation, &period);
+
+        // rotating the query by ridx gives the stored code when
+        // rotation - ridx equals the stored code's rotation, modulo the
+        // period. Several stored codes can share a canonical form; like
+        // probing each rotation in turn, the smallest ridx wins.
+        int best = -1, best_ridx = 4;
+        for (int bucket = canonical % qd->nentries;
              qd->entries[bucket].rcode != UINT64_MAX;
              bucket = (bucket + 1) % qd->nentries) {
 
-            if (qd->entries[bucket].rcode == rcode) {
-                *entry = qd->entries[bucket];
-                entry->rotation = ridx;
-                return;
+            if (qd->entries[bucket].rcode == canonical) {
+                int ridx = (rotation - qd->entries[bucket].rotation + period) % period;
+                if (ridx < best_ridx) {
+                    best = bucket;
+                    best_ridx = ridx;
+                }
             }
         }
 
-        rcode = rotate90(rcode, tf->nbits);
+        if (best >= 0) {
+            *entry = qd->entries[best];
+            entry->rcode = rots[best_ridx];
+            entry->rotation = best_ridx;
+            return;
+        }
     }
 
     entry->rcode = 0;
@@ -347,8 +571,44 @@ void apriltag_detector_add_family_bits(apriltag_detector_t *td, apriltag_family_
 {
     zarray_add(td->tag_families, &fam);
 
-    if (!fam->impl)
-        quick_decode_init(fam, bits_corrected);
+    if (!fam->impl) {
+        if (td->compact_decode_index)
+            quick_decode_init_compact(fam, bits_corrected);
+        else
+            quick_decode_init(fam, bits_corrected);
+
+        // impl stays NULL if the index could not be built; the family
+        // then decodes nothing.
+        if (fam->impl)
+            ((struct quick_decode*) fam->impl)->decode_float = quad_decode_float_for(fam);
+    }
+}
+
+int apriltag_family_decode(apriltag_family_t *fam, uint64_t code, int *hamming, int *rotation)
+{
+    struct quick_decode_entry entry;
+    quick_decode_codeword(fam, code, &entry);
+
+    if (entry.hamming == 255)
+        return -1;
+
+    *hamming = entry.hamming;
+    *rotation = entry.rotation;
+    return entry.id;
+}
+
+size_t apriltag_family_decode_index_bytes(const apriltag_family_t *fam)
+{
+    const struct quick_decode *qd = (const struct quick_decode*) fam->impl;
+    if (qd == NULL)
+        return 0;
+
+    size_t bytes = sizeof(struct quick_decode);
+    if (qd->entries)
+        bytes += (size_t) qd->nentries * sizeof(struct quick_decode_entry);
+    if (qd->chunk_ids)
+        bytes += (size_t) qd->nchunks * (fam->ncodes + qd->dir_size + 1) * sizeof(uint16_t);
+    return bytes;
 }
 
 void apriltag_detector_clear_families(apriltag_detector_t *td)
@@ -376,6 +636,8 @@ apriltag_detector_t *apriltag_detector_create()
     td->qtp.cos_critical_rad = cos(10 * M_PI / 180);
     td->qtp.deglitch = false;
     td->qtp.min_white_black_diff = 5;
+    td->qtp.rle_components = true;
+    td->qtp.packed_threshold = true;
 
     td->tag_families = zarray_create(sizeof(apriltag_family_t*));
 
@@ -383,8 +645,14 @@ apriltag_detector_t *apriltag_detector_create()
 
     td->tp = timeprofile_create();
 
+    td->arena = frame_arena_create();
+
     td->refine_edges = true;
+    td->fused_decimate = true;
     td->decode_sharpening = 0.25;
+    td->decode_float = APRILTAG_DECODE_FLOAT;
+    td->specialized_decode = true;
+    td->compact_decode_index = APRILTAG_COMPACT_DECODE_INDEX;
 
 
     td->debug = false;
@@ -403,6 +671,8 @@ void apriltag_detector_destroy(apriltag_detector_t *td)
     apriltag_detector_clear_families(td);
 
     zarray_destroy(td->tag_families);
+    frame_arena_destroy(td->arena);
+    thresh_history_destroy(td->thresh_history);
     free(td);
 }
 
@@ -412,10 +682,25 @@ struct quad_decode_task
     zarray_t *quads;
     apriltag_detector_t *td;
 
+    // per family: the index of the first family with the same sampling
+    // layout, whose rcode and margin it reuses.
+    const int *sample_src;
+
     image_u8_t *im;
     zarray_t *detections;
 
     image_u8_t *im_samples;
+
+    // private scratch for quad_decode(), carved from td->arena.
+    frame_arena_t scratch;
+
+    // decodes run, and rejected by each stage; summed into td.
+    uint32_t ndecodes;
+    uint32_t nrejected_contrast, nrejected_bits, nrejected_margin;
+
+    // utime_now() after which the remaining quads are skipped, or 0.
+    int64_t deadline;
+    uint32_t nskipped;
 };
 
 struct evaluate_quad_ret
@@ -428,103 +713,36 @@ struct evaluate_quad_ret
     struct quick_decode_entry e;
 };
 
-static matd_t* homography_compute2(double c[4][4]) {
-    double A[] =  {
-            c[0][0], c[0][1], 1,       0,       0, 0, -c[0][0]*c[0][2], -c[0][1]*c[0][2], c[0][2],
-                  0,       0, 0, c[0][0], c[0][1], 1, -c[0][0]*c[0][3], -c[0][1]*c[0][3], c[0][3],
-            c[1][0], c[1][1], 1,       0,       0, 0, -c[1][0]*c[1][2], -c[1][1]*c[1][2], c[1][2],
-                  0,       0, 0, c[1][0], c[1][1], 1, -c[1][0]*c[1][3], -c[1][1]*c[1][3], c[1][3],
-            c[2][0], c[2][1], 1,       0,       0, 0, -c[2][0]*c[2][2], -c[2][1]*c[2][2], c[2][2],
-                  0,       0, 0, c[2][0], c[2][1], 1, -c[2][0]*c[2][3], -c[2][1]*c[2][3], c[2][3],
-            c[3][0], c[3][1], 1,       0,       0, 0, -c[3][0]*c[3][2], -c[3][1]*c[3][2], c[3][2],
-                  0,       0, 0, c[3][0], c[3][1], 1, -c[3][0]*c[3][3], -c[3][1]*c[3][3], c[3][3],
-    };
-
-    double epsilon = 1e-10;
-
-    // Eliminate.
-    for (int col = 0; col < 8; col++) {
-        // Find best row to swap with.
-        double max_val = 0;
-        int max_val_idx = -1;
-        for (int row = col; row < 8; row++) {
-            double val = fabs(A[row*9 + col]);
-            if (val > max_val) {
-                max_val = val;
-                max_val_idx = row;
-            }
-        }
-
-        if (max_val_idx < 0) {
-            return NULL;
-        }
-
-        if (max_val < epsilon) {
-            debug_print("WRN: Matrix is singular.\n");
-            return NULL;
-        }
-
-        // Swap to get best row.
-        if (max_val_idx != col) {
-            for (int i = col; i < 9; i++) {
-                double tmp = A[col*9 + i];
-                A[col*9 + i] = A[max_val_idx*9 + i];
-                A[max_val_idx*9 + i] = tmp;
-            }
-        }
-
-        // Do eliminate.
-        for (int i = col + 1; i < 8; i++) {
-            double f = A[i*9 + col]/A[col*9 + col];
-            A[i*9 + col] = 0;
-            for (int j = col + 1; j < 9; j++) {
-                A[i*9 + j] -= f*A[col*9 + j];
-            }
-        }
-    }
-
-    // Back solve.
-    for (int col = 7; col >=0; col--) {
-        double sum = 0;
-        for (int i = col + 1; i < 8; i++) {
-            sum += A[col*9 + i]*A[i*9 + 8];
-        }
-        A[col*9 + 8] = (A[col*9 + 8] - sum)/A[col*9 + col];
-    }
-    return matd_create_data(3, 3, (double[]) { A[8], A[17], A[26], A[35], A[44], A[53], A[62], A[71], 1 });
-}
-
-// returns non-zero if an error occurs (i.e., H has no inverse)
-static int quad_update_homographies(struct quad *quad)
+// The homographies of a quad, in storage of the caller; quad->H and
+// quad->Hinv point into it.
+struct quad_homographies
 {
-    //zarray_t *correspondences = zarray_create(sizeof(float[4]));
-
-    double corr_arr[4][4];
+    double H[9], Hinv[9];
+    matd_t Hm, Hinvm;
+};
 
+// returns non-zero if an error occurs (i.e., H has no inverse).
+static int quad_update_homographies(struct quad *quad, struct quad_homographies *qh)
+{
+    double p[4][2];
     for (int i = 0; i < 4; i++) {
-        corr_arr[i][0] = (i==0 || i==3) ? -1 : 1;
-        corr_arr[i][1] = (i==0 || i==1) ? -1 : 1;
-        corr_arr[i][2] = quad->p[i][0];
-        corr_arr[i][3] = quad->p[i][1];
+        p[i][0] = quad->p[i][0];
+        p[i][1] = quad->p[i][1];
     }
 
-    if (quad->H)
-        matd_destroy(quad->H);
-    if (quad->Hinv)
-        matd_destroy(quad->Hinv);
+    quad->H = NULL;
+    quad->Hinv = NULL;
 
-    // XXX Tunable
-    quad->H = homography_compute2(corr_arr);
-    if (quad->H != NULL) {
-        quad->Hinv = matd_inverse(quad->H);
-        if (quad->Hinv != NULL) {
-	    // Success!
-            return 0;
-        }
-        matd_destroy(quad->H);
-        quad->H = NULL;
-    }
-    return -1;
+    if (mat33_square_homography(p, qh->H) != 0)
+        return -1;
+    if (mat33_inv(qh->H, qh->Hinv) != 0)
+        return -1;
+
+    qh->Hm = (matd_t) { 3, 3, qh->H };
+    qh->Hinvm = (matd_t) { 3, 3, qh->Hinv };
+    quad->H = &qh->Hm;
+    quad->Hinv = &qh->Hinvm;
+    return 0;
 }
 
 static double value_for_pixel(image_u8_t *im, double px, double py) {
@@ -543,8 +761,8 @@ static double value_for_pixel(image_u8_t *im, double px, double py) {
             im->buf[y2*im->stride + x2]*x*y;
 }
 
-static void sharpen(apriltag_detector_t* td, double* values, int size) {
-    double *sharpened = malloc(sizeof(double)*size*size);
+static void sharpen(apriltag_detector_t* td, frame_arena_t *scratch, double* values, int size) {
+    double *sharpened = frame_arena_alloc(scratch, sizeof(double)*size*size);
     double kernel[9] = {
         0, -1, 0,
         -1, 4, -1,
@@ -571,23 +789,19 @@ static void sharpen(apriltag_detector_t* td, double* values, int size) {
             values[y*size + x] = values[y*size + x] + td->decode_sharpening*sharpened[y*size + x];
         }
     }
-
-    free(sharpened);
 }
 
-// returns the decision margin. Return < 0 if the detection should be rejected.
-static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, image_u8_t *im, struct quad *quad, struct quick_decode_entry *entry, image_u8_t *im_samples)
-{
-    // decode the tag binary contents by sampling the pixel
-    // closest to the center of each bit cell.
+// We will compute a threshold by sampling known white/black cells around this tag.
+// This sampling is achieved by considering a set of samples along lines.
+//
+// coordinates are given in bit coordinates. ([0, fam->border_width]).
+//
+// { initial x, initial y, delta x, delta y, WHITE=1 }
+#define DECODE_NPATTERNS 8
 
-    // We will compute a threshold by sampling known white/black cells around this tag.
-    // This sampling is achieved by considering a set of samples along lines.
-    //
-    // coordinates are given in bit coordinates. ([0, fam->border_width]).
-    //
-    // { initial x, initial y, delta x, delta y, WHITE=1 }
-    float patterns[] = {
+static inline void decode_border_patterns(int width_at_border, float patterns[DECODE_NPATTERNS*5])
+{
+    const float p[DECODE_NPATTERNS*5] = {
         // left white column
         -0.5, 0.5,
         0, 1,
@@ -599,12 +813,12 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
         0,
 
         // right white column
-        family->width_at_border + 0.5, .5,
+        width_at_border + 0.5, .5,
         0, 1,
         1,
 
         // right black column
-        family->width_at_border - 0.5, .5,
+        width_at_border - 0.5, .5,
         0, 1,
         0,
 
@@ -619,27 +833,73 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
         0,
 
         // bottom white row
-        0.5, family->width_at_border + 0.5,
+        0.5, width_at_border + 0.5,
         1, 0,
         1,
 
         // bottom black row
-        0.5, family->width_at_border - 0.5,
+        0.5, width_at_border - 0.5,
         1, 0,
         0
 
         // XXX double-counts the corners.
     };
 
+    memcpy(patterns, p, sizeof(p));
+}
+
+// Early rejects of the decoders, for quads that cannot reach
+// td->min_decision_margin. Decoders return these negative values instead
+// of a margin.
+#define DECODE_REJECT_POLARITY -1 // border darker inside than outside (or reverse)
+#define DECODE_REJECT_CONTRAST -2 // left border columns without the contrast of a tag
+#define DECODE_REJECT_BITS     -3 // bits too close to the threshold
+
+// A tag's bits sit about half the border contrast from the threshold,
+// and sharpening adds at most half again, so a quad whose left white and
+// black border columns differ by less than this fraction of the minimum
+// margin will not reach it. Heuristic: the only stage that can drop a
+// quad whose full decode would have made the margin.
+#define DECODE_MIN_CONTRAST_FRACTION 0.5
+
+// Upper bound of the decision margin given sum |v| of the unsharpened
+// bit values. Sharpening adds k*(4v - neighbours) to each value, so the
+// bits' sum |v| grows by at most |1+4k| + 4|k|, and the margin, the
+// smaller of the white and black averages, is at most the average of
+// all nbits+2 terms.
+static inline float decode_margin_bound(float sum_abs, float sharpening, int nbits)
+{
+    return sum_abs * (fabsf(1 + 4*sharpening) + 4*fabsf(sharpening)) / (nbits + 2);
+}
+
+// Samples the payload of 'quad' for family's layout into *rcode.
+// returns the decision margin. Return < 0 if the detection should be rejected.
+static float quad_decode(apriltag_detector_t* td, frame_arena_t *scratch, apriltag_family_t *family, image_u8_t *im, struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples)
+{
+    // decode the tag binary contents by sampling the pixel
+    // closest to the center of each bit cell.
+    float patterns[DECODE_NPATTERNS*5];
+    decode_border_patterns(family->width_at_border, patterns);
+
     struct graymodel whitemodel, blackmodel;
     graymodel_init(&whitemodel);
     graymodel_init(&blackmodel);
 
-    for (long unsigned int pattern_idx = 0; pattern_idx < sizeof(patterns)/(5*sizeof(float)); pattern_idx ++) {
+    float min_margin = td->min_decision_margin;
+
+    for (int pattern_idx = 0; pattern_idx < DECODE_NPATTERNS; pattern_idx ++) {
         float *pattern = &patterns[pattern_idx * 5];
 
         int is_white = pattern[4];
 
+        // the left white and black columns (the first two patterns)
+        // are enough to drop most quads that are not tags.
+        if (pattern_idx == 2 && min_margin > 0 && whitemodel.A[2][2] > 0 && blackmodel.A[2][2] > 0) {
+            double contrast = whitemodel.B[2] / whitemodel.A[2][2] - blackmodel.B[2] / blackmodel.A[2][2];
+            if ((family->reversed_border ? -contrast : contrast) < min_margin * DECODE_MIN_CONTRAST_FRACTION)
+                return DECODE_REJECT_CONTRAST;
+        }
+
         for (int i = 0; i < family->width_at_border; i++) {
             double tagx01 = (pattern[0] + i*pattern[2]) / (family->width_at_border);
             double tagy01 = (pattern[1] + i*pattern[3]) / (family->width_at_border);
@@ -681,7 +941,7 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
 
     // XXX Tunable
     if ((graymodel_interpolate(&whitemodel, 0, 0) - graymodel_interpolate(&blackmodel, 0, 0) < 0) != family->reversed_border) {
-        return -1;
+        return DECODE_REJECT_POLARITY;
     }
 
     // compute the average decision margin (how far was each bit from
@@ -693,7 +953,9 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
     float black_score = 0, white_score = 0;
     float black_score_count = 1, white_score_count = 1;
 
-    double *values = calloc(family->total_width*family->total_width, sizeof(double));
+    frame_arena_mark_t mark = frame_arena_mark(scratch);
+    double *values = frame_arena_calloc(scratch, family->total_width*family->total_width, sizeof(double));
+    double sum_abs = 0;
 
     int min_coord = (family->width_at_border - family->total_width)/2;
     for (uint32_t i = 0; i < family->nbits; i++) {
@@ -718,6 +980,7 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
 
         double thresh = (graymodel_interpolate(&blackmodel, tagx, tagy) + graymodel_interpolate(&whitemodel, tagx, tagy)) / 2.0;
         values[family->total_width*(bity - min_coord) + bitx - min_coord] = v - thresh;
+        sum_abs += fabs(v - thresh);
 
         if (im_samples) {
             int ix = px;
@@ -726,7 +989,12 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
         }
     }
 
-    sharpen(td, values, family->total_width);
+    if (min_margin > 0 && decode_margin_bound(sum_abs, td->decode_sharpening, family->nbits) < min_margin) {
+        frame_arena_release(scratch, mark);
+        return DECODE_REJECT_BITS;
+    }
+
+    sharpen(td, scratch, values, family->total_width);
 
     uint64_t rcode = 0;
     for (uint32_t i = 0; i < family->nbits; i++) {
@@ -745,112 +1013,466 @@ static float quad_decode(apriltag_detector_t* td, apriltag_family_t *family, ima
         }
     }
 
-    quick_decode_codeword(family, rcode, entry);
-    free(values);
+    *rcode_out = rcode;
+    frame_arena_release(scratch, mark);
     return fmin(white_score / white_score_count, black_score / black_score_count);
 }
 
-static void refine_edges(apriltag_detector_t *td, image_u8_t *im_orig, struct quad *quad)
+////////////////////////////////////////////////////////////////
+// Single-precision decode (td->decode_float). Same algorithm as
+// quad_decode(), for cores whose FPU only does float: the homography
+// and gray models are float, bilinear sampling uses Q16 weights and the
+// bit values live on the stack.
+
+// Largest family->total_width decoded in single precision; wider
+// families fall back to quad_decode().
+#define DECODE_FLOAT_MAX_WIDTH 16
+
+// DECODE_FOR(i, n, stmt) runs stmt for i in [0, n), fully unrolled
+// when n is a compile-time constant (the per-layout decoders) and as a
+// plain loop otherwise, which keeps the generic decoder small.
+#if defined(__GNUC__)
+#define DECODE_INLINE static inline __attribute__((always_inline))
+#define DECODE_FOR(i, n, stmt)                                          \
+    do {                                                                \
+        if (__builtin_constant_p(n)) {                                  \
+            _Pragma("GCC unroll 64")                                    \
+            for (int i = 0; i < (n); i++) { stmt; }                     \
+        } else {                                                        \
+            for (int i = 0; i < (n); i++) { stmt; }                     \
+        }                                                               \
+    } while (0)
+#else
+#define DECODE_INLINE static inline
+#define DECODE_FOR(i, n, stmt) for (int i = 0; i < (n); i++) { stmt; }
+#endif
+
+struct graymodelf
 {
-    double lines[4][4]; // for each line, [Ex Ey nx ny]
+    float A[3][3];
+    float B[3];
+    float C[3];
+};
 
-    for (int edge = 0; edge < 4; edge++) {
-        int a = edge, b = (edge + 1) & 3; // indices of the end points.
+static inline void graymodelf_add(struct graymodelf *gm, float x, float y, float gray)
+{
+    gm->A[0][0] += x*x;
+    gm->A[0][1] += x*y;
+    gm->A[0][2] += x;
+    gm->A[1][1] += y*y;
+    gm->A[1][2] += y;
+    gm->A[2][2] += 1;
 
-        // compute the normal to the current line estimate
-        double nx = quad->p[b][1] - quad->p[a][1];
-        double ny = -quad->p[b][0] + quad->p[a][0];
-        double mag = sqrt(nx*nx + ny*ny);
-        nx /= mag;
-        ny /= mag;
+    gm->B[0] += x * gray;
+    gm->B[1] += y * gray;
+    gm->B[2] += gray;
+}
 
-        if (quad->reversed_border) {
-            nx = -nx;
-            ny = -ny;
-        }
+static inline float graymodelf_interpolate(const struct graymodelf *gm, float x, float y)
+{
+    return gm->C[0]*x + gm->C[1]*y + gm->C[2];
+}
 
-        // we will now fit a NEW line by sampling points near
-        // our original line that have large gradients. On really big tags,
-        // we're willing to sample more to get an even better estimate.
-        int nsamples = imax(16, mag / 8); // XXX tunable
+static inline void homography_project_f(const float H[9], float x, float y, float *ox, float *oy)
+{
+    float xx = H[0]*x + H[1]*y + H[2];
+    float yy = H[3]*x + H[4]*y + H[5];
+    float zz = H[6]*x + H[7]*y + H[8];
 
-        // stats for fitting a line...
-        double Mx = 0, My = 0, Mxx = 0, Mxy = 0, Myy = 0, N = 0;
+    *ox = xx / zz;
+    *oy = yy / zz;
+}
 
-        for (int s = 0; s < nsamples; s++) {
-            // compute a point along the line... Note, we're avoiding
-            // sampling *right* at the corners, since those points are
-            // the least reliable.
-            double alpha = (1.0 + s) / (nsamples + 1);
-            double x0 = alpha*quad->p[a][0] + (1-alpha)*quad->p[b][0];
-            double y0 = alpha*quad->p[a][1] + (1-alpha)*quad->p[b][1];
+// value_for_pixel() with Q16 weights. Returns the value in Q8 (gray
+// level * 256), or -1 outside the image.
+static int value_for_pixel_q16(const image_u8_t *im, float px, float py)
+{
+    float fx = px - 0.5f, fy = py - 0.5f;
+    float flx = floorf(fx), fly = floorf(fy);
+    int x1 = flx, y1 = fly;
+    int x2 = x1 + (fx > flx), y2 = y1 + (fy > fly);
 
-            // search along the normal to this line, looking at the
-            // gradients along the way. We're looking for a strong
-            // response.
-            double Mn = 0;
-            double Mcount = 0;
+    if (x1 < 0 || x2 >= im->width || y1 < 0 || y2 >= im->height)
+        return -1;
 
-            // XXX tunable: how far to search?  We want to search far
-            // enough that we find the best edge, but not so far that
-            // we hit other edges that aren't part of the tag. We
-            // shouldn't ever have to search more than quad_decimate,
-            // since otherwise we would (ideally) have started our
-            // search on another pixel in the first place. Likewise,
-            // for very small tags, we don't want the range to be too
-            // big.
+    uint32_t wx = (fx - flx) * 65536.0f;
+    uint32_t wy = (fy - fly) * 65536.0f;
 
-            int range = td->quad_decimate + 1;
+    const uint8_t *r1 = &im->buf[y1*im->stride], *r2 = &im->buf[y2*im->stride];
 
-            // To reduce the overhead of bilinear interpolation, we can
-            // reduce the number of steps per unit.
-            int steps_per_unit = 4;
-            double step_length = 1.0 / steps_per_unit;
-            int max_steps = 2 * steps_per_unit * range + 1;
-            double delta = 0.5;
+    // rows in Q8 (< 2^16), so the vertical blend fits in 32 bits.
+    uint32_t top = (r1[x1]*(65536 - wx) + r1[x2]*wx) >> 8;
+    uint32_t bot = (r2[x1]*(65536 - wx) + r2[x2]*wx) >> 8;
 
-            // XXX tunable step size.
-            for (int step = 0; step < max_steps; ++step) {
-                double n = -range + step_length * step;
-                // Because of the guaranteed winding order of the
-                // points in the quad, we will start inside the white
-                // portion of the quad and work our way outward.
-                //
-                // sample to points (x1,y1) and (x2,y2) XXX tunable:
-                // how far +/- to look? Small values compute the
-                // gradient more precisely, but are more sensitive to
-                // noise.
-                double grange = 1;
+    return (top*(65536 - wy) + bot*wy) >> 16;
+}
 
-                double x1 = x0 + (n + grange)*nx - delta;
-                double y1 = y0 + (n + grange)*ny - delta;
-                double x1i_d, y1i_d, a1, b1;
-                a1 = modf(x1, &x1i_d);
-                b1 = modf(y1, &y1i_d);
-                int x1i = x1i_d, y1i = y1i_d;
+static void sharpen_f(float sharpening, float *values, int size)
+{
+    float sharpened[DECODE_FLOAT_MAX_WIDTH*DECODE_FLOAT_MAX_WIDTH];
 
-                if (x1i < 0 || x1i + 1 >= im_orig->width || y1i < 0 || y1i + 1 >= im_orig->height)
-                    continue;
+    // the kernel is 4 at the center and -1 at the 4-neighbours.
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float acc = 4*values[y*size + x];
+            if (y > 0)
+                acc -= values[(y-1)*size + x];
+            if (y < size - 1)
+                acc -= values[(y+1)*size + x];
+            if (x > 0)
+                acc -= values[y*size + x - 1];
+            if (x < size - 1)
+                acc -= values[y*size + x + 1];
+            sharpened[y*size + x] = acc;
+        }
+    }
 
-                double x2 = x0 + (n - grange)*nx - delta;
-                double y2 = y0 + (n - grange)*ny - delta;
-                double x2i_d, y2i_d, a2, b2;
-                a2 = modf(x2, &x2i_d);
-                b2 = modf(y2, &y2i_d);
-                int x2i = x2i_d, y2i = y2i_d;
+    for (int i = 0; i < size*size; i++)
+        values[i] += sharpening*sharpened[i];
+}
 
-                if (x2i < 0 || x2i + 1 >= im_orig->width || y2i < 0 || y2i + 1 >= im_orig->height)
-                    continue;
+// One sample of a border pattern of quad_decode_float(), added to the
+// white or black gray model.
+DECODE_INLINE void decode_border_sample_f(const float H[9], image_u8_t *im, image_u8_t *im_samples,
+                                          const float *pattern, int i, float inv_width,
+                                          struct graymodelf *whitemodel, struct graymodelf *blackmodel)
+{
+    int is_white = pattern[4];
 
-                // interpolate
-                double g1 = (1 - a1) * (1 - b1) * im_orig->buf[y1i*im_orig->stride + x1i] +
-                                  a1 * (1 - b1) * im_orig->buf[y1i*im_orig->stride + x1i + 1] +
-                            (1 - a1) *    b1    * im_orig->buf[(y1i + 1)*im_orig->stride + x1i] +
-                                  a1 *    b1    * im_orig->buf[(y1i + 1)*im_orig->stride + x1i + 1];
-                double g2 = (1 - a2) * (1 - b2) * im_orig->buf[y2i*im_orig->stride + x2i] +
-                                  a2 * (1 - b2) * im_orig->buf[y2i*im_orig->stride + x2i + 1] +
-                            (1 - a2) *    b2    * im_orig->buf[(y2i + 1)*im_orig->stride + x2i] +
-                                  a2 *    b2    * im_orig->buf[(y2i + 1)*im_orig->stride + x2i + 1];
+    float tagx = 2*((pattern[0] + i*pattern[2]) * inv_width - 0.5f);
+    float tagy = 2*((pattern[1] + i*pattern[3]) * inv_width - 0.5f);
+
+    float px, py;
+    homography_project_f(H, tagx, tagy, &px, &py);
+
+    // don't round
+    int ix = px;
+    int iy = py;
+    if (ix < 0 || iy < 0 || ix >= im->width || iy >= im->height)
+        return;
+
+    int v = im->buf[iy*im->stride + ix];
+
+    if (im_samples) {
+        im_samples->buf[iy*im_samples->stride + ix] = (1-is_white)*255;
+    }
+
+    graymodelf_add(is_white ? whitemodel : blackmodel, tagx, tagy, v);
+}
+
+// Stores the value of bit (bitx, bity) less the threshold at that point
+// in *value; leaves it alone outside the image.
+DECODE_INLINE void decode_bit_sample_f(const float H[9], image_u8_t *im, image_u8_t *im_samples,
+                                       int bitx, int bity, float inv_width,
+                                       const struct graymodelf *whitemodel, const struct graymodelf *blackmodel,
+                                       float *value)
+{
+    float tagx = 2*((bitx + 0.5f) * inv_width - 0.5f);
+    float tagy = 2*((bity + 0.5f) * inv_width - 0.5f);
+
+    float px, py;
+    homography_project_f(H, tagx, tagy, &px, &py);
+
+    int q8 = value_for_pixel_q16(im, px, py);
+    if (q8 < 0)
+        return;
+
+    float v = q8 * (1.0f / 256);
+    float thresh = (graymodelf_interpolate(blackmodel, tagx, tagy) + graymodelf_interpolate(whitemodel, tagx, tagy)) * 0.5f;
+    *value = v - thresh;
+
+    if (im_samples) {
+        int ix = px;
+        int iy = py;
+        im_samples->buf[iy*im_samples->stride + ix] = (v < thresh) * 255;
+    }
+}
+
+// The body of quad_decode_float() for a layout passed by value. Inlined
+// into the generic decoder with the fields of the family, and into the
+// per-layout decoders below with constants, where the sampling loops
+// are unrolled and the tag coordinates folded.
+DECODE_INLINE float quad_decode_float_layout(apriltag_detector_t* td, image_u8_t *im, struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples,
+                                             int nbits, int width_at_border, int total_width, bool reversed_border,
+                                             const uint32_t *bit_x, const uint32_t *bit_y)
+{
+    float patterns[DECODE_NPATTERNS*5];
+    decode_border_patterns(width_at_border, patterns);
+
+    float H[9];
+    for (int i = 0; i < 9; i++)
+        H[i] = quad->H->data[i];
+
+    struct graymodelf whitemodel, blackmodel;
+    memset(&whitemodel, 0, sizeof(whitemodel));
+    memset(&blackmodel, 0, sizeof(blackmodel));
+
+    float inv_width = 1.0f / width_at_border;
+    float min_margin = td->min_decision_margin;
+
+    for (int pattern_idx = 0; pattern_idx < DECODE_NPATTERNS; pattern_idx ++) {
+        // see quad_decode().
+        if (pattern_idx == 2 && min_margin > 0 && whitemodel.A[2][2] > 0 && blackmodel.A[2][2] > 0) {
+            float contrast = whitemodel.B[2] / whitemodel.A[2][2] - blackmodel.B[2] / blackmodel.A[2][2];
+            if ((reversed_border ? -contrast : contrast) < min_margin * (float) DECODE_MIN_CONTRAST_FRACTION)
+                return DECODE_REJECT_CONTRAST;
+        }
+
+        DECODE_FOR(i, width_at_border,
+                   decode_border_sample_f(H, im, im_samples, &patterns[pattern_idx * 5], i, inv_width,
+                                          &whitemodel, &blackmodel));
+    }
+
+    mat33f_sym_solve((float*) whitemodel.A, whitemodel.B, whitemodel.C);
+    if (width_at_border > 1) {
+        mat33f_sym_solve((float*) blackmodel.A, blackmodel.B, blackmodel.C);
+    } else {
+        blackmodel.C[0] = 0;
+        blackmodel.C[1] = 0;
+        blackmodel.C[2] = blackmodel.B[2]/4;
+    }
+
+    if ((graymodelf_interpolate(&whitemodel, 0, 0) - graymodelf_interpolate(&blackmodel, 0, 0) < 0) != reversed_border) {
+        return DECODE_REJECT_POLARITY;
+    }
+
+    float black_score = 0, white_score = 0;
+    float black_score_count = 1, white_score_count = 1;
+
+    int tw = total_width;
+    float values[DECODE_FLOAT_MAX_WIDTH*DECODE_FLOAT_MAX_WIDTH];
+    memset(values, 0, tw*tw*sizeof(float));
+
+    int min_coord = (width_at_border - total_width)/2;
+    DECODE_FOR(i, nbits,
+               decode_bit_sample_f(H, im, im_samples, (int) bit_x[i], (int) bit_y[i], inv_width,
+                                   &whitemodel, &blackmodel,
+                                   &values[tw*((int) bit_y[i] - min_coord) + (int) bit_x[i] - min_coord]));
+
+    if (min_margin > 0) {
+        float sum_abs = 0;
+        for (int i = 0; i < tw*tw; i++)
+            sum_abs += fabsf(values[i]);
+        if (decode_margin_bound(sum_abs, td->decode_sharpening, nbits) < min_margin)
+            return DECODE_REJECT_BITS;
+    }
+
+    sharpen_f(td->decode_sharpening, values, tw);
+
+    uint64_t rcode = 0;
+    DECODE_FOR(i, nbits, {
+        rcode = (rcode << 1);
+        float v = values[((int) bit_y[i] - min_coord)*tw + (int) bit_x[i] - min_coord];
+
+        if (v > 0) {
+            white_score += v;
+            white_score_count++;
+            rcode |= 1;
+        } else {
+            black_score -= v;
+            black_score_count++;
+        }
+    });
+
+    *rcode_out = rcode;
+    return fminf(white_score / white_score_count, black_score / black_score_count);
+}
+
+static float quad_decode_float(apriltag_detector_t* td, apriltag_family_t *family, image_u8_t *im, struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples)
+{
+    return quad_decode_float_layout(td, im, quad, rcode_out, im_samples,
+                                    family->nbits, family->width_at_border, family->total_width, family->reversed_border,
+                                    family->bit_x, family->bit_y);
+}
+
+#if APRILTAG_SPECIALIZED_DECODE
+// Bit layouts of the families built for the device, from their tag*.c
+// files. tag36h10 shares the layout of tag36h11; other families with one
+// of these layouts get its decoder too.
+static const uint32_t tag36h11_bit_x[] = {
+    1, 2, 3, 4, 5, 2, 3, 4, 3, 6, 6, 6, 6, 6, 5, 5, 5, 4, 6, 5, 4, 3, 2, 5, 4,
+    3, 4, 1, 1, 1, 1, 1, 2, 2, 2, 3
+};
+static const uint32_t tag36h11_bit_y[] = {
+    1, 1, 1, 1, 1, 2, 2, 2, 3, 1, 2, 3, 4, 5, 2, 3, 4, 3, 6, 6, 6, 6, 6, 5, 5,
+    5, 4, 6, 5, 4, 3, 2, 5, 4, 3, 4
+};
+
+static const uint32_t tagStandard41h12_bit_x[] = {
+    -2, -1, 0, 1, 2, 3, 4, 5, 1, 2, 6, 6, 6, 6, 6, 6, 6, 6, 3, 3, 6, 5, 4, 3, 2,
+    1, 0, -1, 3, 2, -2, -2, -2, -2, -2, -2, -2, -2, 1, 1, 2
+};
+static const uint32_t tagStandard41h12_bit_y[] = {
+    -2, -2, -2, -2, -2, -2, -2, -2, 1, 1, -2, -1, 0, 1, 2, 3, 4, 5, 1, 2, 6, 6,
+    6, 6, 6, 6, 6, 6, 3, 3, 6, 5, 4, 3, 2, 1, 0, -1, 3, 2, 2
+};
+
+static const uint32_t tagCircle49h12_bit_x[] = {
+    1, 2, 3, -1, 0, 1, 2, 3, 4, 5, 1, 2, 7, 7, 7, 6, 6, 6, 6, 6, 6, 6, 3, 3, 3,
+    2, 1, 5, 4, 3, 2, 1, 0, -1, 3, 2, -3, -3, -3, -2, -2, -2, -2, -2, -2, -2, 1,
+    1, 2
+};
+static const uint32_t tagCircle49h12_bit_y[] = {
+    -3, -3, -3, -2, -2, -2, -2, -2, -2, -2, 1, 1, 1, 2, 3, -1, 0, 1, 2, 3, 4, 5,
+    1, 2, 7, 7, 7, 6, 6, 6, 6, 6, 6, 6, 3, 3, 3, 2, 1, 5, 4, 3, 2, 1, 0, -1, 3,
+    2, 2
+};
+
+static const uint32_t tagCustom48h12_bit_x[] = {
+    -2, -1, 0, 1, 2, 3, 4, 5, 6, 1, 2, 3, 7, 7, 7, 7, 7, 7, 7, 7, 7, 4, 4, 4, 7,
+    6, 5, 4, 3, 2, 1, 0, -1, 4, 3, 2, -2, -2, -2, -2, -2, -2, -2, -2, -2, 1, 1,
+    1
+};
+static const uint32_t tagCustom48h12_bit_y[] = {
+    -2, -2, -2, -2, -2, -2, -2, -2, -2, 1, 1, 1, -2, -1, 0, 1, 2, 3, 4, 5, 6, 1,
+    2, 3, 7, 7, 7, 7, 7, 7, 7, 7, 7, 4, 4, 4, 7, 6, 5, 4, 3, 2, 1, 0, -1, 4, 3,
+    2
+};
+
+#define DECODE_FLOAT_LAYOUT(name, nbits, width_at_border, total_width, reversed_border) \
+    static float quad_decode_float_##name(apriltag_detector_t* td, apriltag_family_t *family, image_u8_t *im, struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples) \
+    { \
+        (void) family; \
+        return quad_decode_float_layout(td, im, quad, rcode_out, im_samples, \
+                                        nbits, width_at_border, total_width, reversed_border, \
+                                        name##_bit_x, name##_bit_y); \
+    }
+
+DECODE_FLOAT_LAYOUT(tag36h11, 36, 8, 10, false)
+DECODE_FLOAT_LAYOUT(tagStandard41h12, 41, 5, 9, true)
+DECODE_FLOAT_LAYOUT(tagCircle49h12, 49, 5, 11, true)
+DECODE_FLOAT_LAYOUT(tagCustom48h12, 48, 6, 10, true)
+
+static const struct decode_layout
+{
+    int nbits;
+    int width_at_border;
+    int total_width;
+    bool reversed_border;
+    const uint32_t *bit_x;
+    const uint32_t *bit_y;
+    quad_decode_float_fn decode;
+} decode_layouts[] = {
+    { 36, 8, 10, false, tag36h11_bit_x, tag36h11_bit_y, quad_decode_float_tag36h11 },
+    { 41, 5, 9, true, tagStandard41h12_bit_x, tagStandard41h12_bit_y, quad_decode_float_tagStandard41h12 },
+    { 49, 5, 11, true, tagCircle49h12_bit_x, tagCircle49h12_bit_y, quad_decode_float_tagCircle49h12 },
+    { 48, 6, 10, true, tagCustom48h12_bit_x, tagCustom48h12_bit_y, quad_decode_float_tagCustom48h12 },
+};
+#endif
+
+// The single-precision decoder for family: the one specialized for its
+// layout if there is one, quad_decode_float() otherwise.
+static quad_decode_float_fn quad_decode_float_for(const apriltag_family_t *family)
+{
+#if APRILTAG_SPECIALIZED_DECODE
+    for (size_t i = 0; i < sizeof(decode_layouts) / sizeof(decode_layouts[0]); i++) {
+        const struct decode_layout *l = &decode_layouts[i];
+        if (l->nbits == (int) family->nbits &&
+            l->width_at_border == family->width_at_border &&
+            l->total_width == family->total_width &&
+            l->reversed_border == family->reversed_border &&
+            !memcmp(l->bit_x, family->bit_x, l->nbits * sizeof(uint32_t)) &&
+            !memcmp(l->bit_y, family->bit_y, l->nbits * sizeof(uint32_t)))
+            return l->decode;
+    }
+#endif
+    return quad_decode_float;
+}
+
+// Re-fits the four edges of quad to the strongest gradients within
+// 'range' pixels of them. Returns false when an edge had fewer than two
+// points to fit; the corners next to it are then not reliable.
+static bool refine_edges(image_u8_t *im_orig, struct quad *quad, int range)
+{
+    double lines[4][4]; // for each line, [Ex Ey nx ny]
+    bool ok = true;
+
+    for (int edge = 0; edge < 4; edge++) {
+        int a = edge, b = (edge + 1) & 3; // indices of the end points.
+
+        // compute the normal to the current line estimate
+        double nx = quad->p[b][1] - quad->p[a][1];
+        double ny = -quad->p[b][0] + quad->p[a][0];
+        double mag = sqrt(nx*nx + ny*ny);
+        nx /= mag;
+        ny /= mag;
+
+        if (quad->reversed_border) {
+            nx = -nx;
+            ny = -ny;
+        }
+
+        // we will now fit a NEW line by sampling points near
+        // our original line that have large gradients. On really big tags,
+        // we're willing to sample more to get an even better estimate.
+        int nsamples = imax(16, mag / 8); // XXX tunable
+
+        // stats for fitting a line...
+        double Mx = 0, My = 0, Mxx = 0, Mxy = 0, Myy = 0, N = 0;
+
+        for (int s = 0; s < nsamples; s++) {
+            // compute a point along the line... Note, we're avoiding
+            // sampling *right* at the corners, since those points are
+            // the least reliable.
+            double alpha = (1.0 + s) / (nsamples + 1);
+            double x0 = alpha*quad->p[a][0] + (1-alpha)*quad->p[b][0];
+            double y0 = alpha*quad->p[a][1] + (1-alpha)*quad->p[b][1];
+
+            // search along the normal to this line, looking at the
+            // gradients along the way. We're looking for a strong
+            // response.
+            double Mn = 0;
+            double Mcount = 0;
+
+            // To reduce the overhead of bilinear interpolation, we can
+            // reduce the number of steps per unit.
+            int steps_per_unit = 4;
+            double step_length = 1.0 / steps_per_unit;
+            int max_steps = 2 * steps_per_unit * range + 1;
+            double delta = 0.5;
+
+            // XXX tunable step size.
+            for (int step = 0; step < max_steps; ++step) {
+                double n = -range + step_length * step;
+                // Because of the guaranteed winding order of the
+                // points in the quad, we will start inside the white
+                // portion of the quad and work our way outward.
+                //
+                // sample to points (x1,y1) and (x2,y2) XXX tunable:
+                // how far +/- to look? Small values compute the
+                // gradient more precisely, but are more sensitive to
+                // noise.
+                double grange = 1;
+
+                double x1 = x0 + (n + grange)*nx - delta;
+                double y1 = y0 + (n + grange)*ny - delta;
+                double x1i_d, y1i_d, a1, b1;
+                a1 = modf(x1, &x1i_d);
+                b1 = modf(y1, &y1i_d);
+                int x1i = x1i_d, y1i = y1i_d;
+
+                if (x1i < 0 || x1i + 1 >= im_orig->width || y1i < 0 || y1i + 1 >= im_orig->height)
+                    continue;
+
+                double x2 = x0 + (n - grange)*nx - delta;
+                double y2 = y0 + (n - grange)*ny - delta;
+                double x2i_d, y2i_d, a2, b2;
+                a2 = modf(x2, &x2i_d);
+                b2 = modf(y2, &y2i_d);
+                int x2i = x2i_d, y2i = y2i_d;
+
+                if (x2i < 0 || x2i + 1 >= im_orig->width || y2i < 0 || y2i + 1 >= im_orig->height)
+                    continue;
+
+                // interpolate
+                double g1 = (1 - a1) * (1 - b1) * im_orig->buf[y1i*im_orig->stride + x1i] +
+                                  a1 * (1 - b1) * im_orig->buf[y1i*im_orig->stride + x1i + 1] +
+                            (1 - a1) *    b1    * im_orig->buf[(y1i + 1)*im_orig->stride + x1i] +
+                                  a1 *    b1    * im_orig->buf[(y1i + 1)*im_orig->stride + x1i + 1];
+                double g2 = (1 - a2) * (1 - b2) * im_orig->buf[y2i*im_orig->stride + x2i] +
+                                  a2 * (1 - b2) * im_orig->buf[y2i*im_orig->stride + x2i + 1] +
+                            (1 - a2) *    b2    * im_orig->buf[(y2i + 1)*im_orig->stride + x2i] +
+                                  a2 *    b2    * im_orig->buf[(y2i + 1)*im_orig->stride + x2i + 1];
                 if (g1 < g2) // reject points whose gradient is "backwards". They can only hurt us.
                     continue;
 
@@ -880,6 +1502,9 @@ static void refine_edges(apriltag_detector_t *td, image_u8_t *im_orig, struct qu
             N++;
         }
 
+        if (N < 2)
+            ok = false;
+
         // fit a line
         double Ex = Mx / N, Ey = My / N;
         double Cxx = Mxx / N - Ex*Ex;
@@ -923,6 +1548,105 @@ static void refine_edges(apriltag_detector_t *td, image_u8_t *im_orig, struct qu
 //            debug_print("bad det: %15f %15f %15f %15f %15f\n", A00, A11, A10, A01, det);
         }
     }
+
+    return ok;
+}
+
+// true when quad_decode() samples the same bits, in the same order, for
+// both families.
+static bool family_same_sampling(const apriltag_family_t *a, const apriltag_family_t *b)
+{
+    return a->width_at_border == b->width_at_border &&
+        a->total_width == b->total_width &&
+        a->reversed_border == b->reversed_border &&
+        a->nbits == b->nbits &&
+        !memcmp(a->bit_x, b->bit_x, a->nbits * sizeof(uint32_t)) &&
+        !memcmp(a->bit_y, b->bit_y, a->nbits * sizeof(uint32_t));
+}
+
+// quad_decode() or the single-precision decoder td selects for family.
+static float quad_decode_family(apriltag_detector_t *td, frame_arena_t *scratch, apriltag_family_t *family,
+                                image_u8_t *im, struct quad *quad, uint64_t *rcode_out, image_u8_t *im_samples)
+{
+    if (td->decode_float && family->total_width <= DECODE_FLOAT_MAX_WIDTH) {
+        const struct quick_decode *qd = (const struct quick_decode*) family->impl;
+        quad_decode_float_fn decode = td->specialized_decode && qd ? qd->decode_float : quad_decode_float;
+        return decode(td, family, im, quad, rcode_out, im_samples);
+    }
+
+    return quad_decode(td, scratch, family, im, quad, rcode_out, im_samples);
+}
+
+// A detection and its H are one allocation: the matd_t and its data
+// follow the detection.
+struct detection_storage
+{
+    apriltag_detection_t det;
+    matd_t H;
+    double H_data[9];
+};
+
+// A zeroed detection whose H points at the matrix in its own allocation.
+static apriltag_detection_t *detection_alloc(void)
+{
+    struct detection_storage *storage = calloc(1, sizeof(struct detection_storage));
+    if (storage == NULL)
+        return NULL;
+
+    storage->H = (matd_t) { 3, 3, storage->H_data };
+    storage->det.H = &storage->H;
+    return &storage->det;
+}
+
+// The detection of a decoded quad: its homography rotated to the tag's
+// orientation, and the center and corners it maps to.
+static apriltag_detection_t *detection_create(apriltag_family_t *family, const struct quad *quad,
+                                              const struct quick_decode_entry *entry, float decision_margin)
+{
+    apriltag_detection_t *det = detection_alloc();
+
+    det->family = family;
+    det->id = entry->id;
+    det->hamming = entry->hamming;
+    det->decision_margin = decision_margin;
+
+    double theta = entry->rotation * M_PI / 2.0;
+    double c = cos(theta), s = sin(theta);
+
+    // Fix the rotation of our homography to properly orient the tag
+    double R[9] = {
+        c, -s, 0,
+        s,  c, 0,
+        0,  0, 1 };
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double acc = 0;
+            for (int k = 0; k < 3; k++)
+                acc += MATD_EL(quad->H, i, k) * R[k*3 + j];
+            MATD_EL(det->H, i, j) = acc;
+        }
+    }
+
+    homography_project(det->H, 0, 0, &det->c[0], &det->c[1]);
+
+    // [-1, -1], [1, -1], [1, 1], [-1, 1], Desired points
+    // [-1, 1], [1, 1], [1, -1], [-1, -1], FLIP Y
+    // adjust the points in det->p so that they correspond to
+    // counter-clockwise around the quad, starting at -1,-1.
+    for (int i = 0; i < 4; i++) {
+        int tcx = (i == 1 || i == 2) ? 1 : -1;
+        int tcy = (i < 2) ? 1 : -1;
+
+        double p[2];
+
+        homography_project(det->H, tcx, tcy, &p[0], &p[1]);
+
+        det->p[i][0] = p[0];
+        det->p[i][1] = p[1];
+    }
+
+    return det;
 }
 
 static void quad_decode_task(void *_u)
@@ -932,93 +1656,105 @@ static void quad_decode_task(void *_u)
     image_u8_t *im = task->im;
 
     for (int quadidx = task->i0; quadidx < task->i1; quadidx++) {
-        struct quad *quad_original;
-        zarray_get_volatile(task->quads, quadidx, &quad_original);
+        if (task->deadline && utime_now() > task->deadline) {
+            task->nskipped += task->i1 - quadidx;
+            break;
+        }
+
+        struct quad *quad;
+        zarray_get_volatile(task->quads, quadidx, &quad);
 
         // refine edges is not dependent upon the tag family, thus
         // apply this optimization BEFORE the other work.
         //if (td->quad_decimate > 1 && td->refine_edges) {
         if (td->refine_edges) {
-            refine_edges(td, im, quad_original);
+            // XXX tunable: how far to search?  We want to search far
+            // enough that we find the best edge, but not so far that
+            // we hit other edges that aren't part of the tag. We
+            // shouldn't ever have to search more than quad_decimate,
+            // since otherwise we would (ideally) have started our
+            // search on another pixel in the first place. Likewise,
+            // for very small tags, we don't want the range to be too
+            // big.
+            refine_edges(im, quad, td->quad_decimate + 1);
         }
 
         // make sure the homographies are computed...
-        if (quad_update_homographies(quad_original) != 0)
+        struct quad_homographies qh;
+        if (quad_update_homographies(quad, &qh) != 0)
             continue;
 
-        for (int famidx = 0; famidx < zarray_size(td->tag_families); famidx++) {
+        // the per-family results only live until the next quad.
+        frame_arena_mark_t mark = frame_arena_mark(&task->scratch);
+
+        int nfamilies = zarray_size(td->tag_families);
+        float *margins = frame_arena_alloc(&task->scratch, nfamilies * sizeof(float));
+        uint64_t *rcodes = frame_arena_alloc(&task->scratch, nfamilies * sizeof(uint64_t));
+
+        for (int famidx = 0; famidx < nfamilies; famidx++) {
             apriltag_family_t *family;
             zarray_get(td->tag_families, famidx, &family);
 
-            if (family->reversed_border != quad_original->reversed_border) {
+            if (family->reversed_border != quad->reversed_border) {
                 continue;
             }
 
-            // since the geometry of tag families can vary, start any
-            // optimization process over with the original quad.
-            struct quad *quad = quad_copy(quad_original);
-
-            struct quick_decode_entry entry;
-
-            float decision_margin = quad_decode(td, family, im, quad, &entry, task->im_samples);
-
-            if (decision_margin >= 0 && entry.hamming < 255) {
-                apriltag_detection_t *det = calloc(1, sizeof(apriltag_detection_t));
-
-                det->family = family;
-                det->id = entry.id;
-                det->hamming = entry.hamming;
-                det->decision_margin = decision_margin;
-
-                double theta = entry.rotation * M_PI / 2.0;
-                double c = cos(theta), s = sin(theta);
-
-                // Fix the rotation of our homography to properly orient the tag
-                matd_t *R = matd_create(3,3);
-                MATD_EL(R, 0, 0) = c;
-                MATD_EL(R, 0, 1) = -s;
-                MATD_EL(R, 1, 0) = s;
-                MATD_EL(R, 1, 1) = c;
-                MATD_EL(R, 2, 2) = 1;
-
-                det->H = matd_op("M*M", quad->H, R);
-
-                matd_destroy(R);
-
-                homography_project(det->H, 0, 0, &det->c[0], &det->c[1]);
-
-                // [-1, -1], [1, -1], [1, 1], [-1, 1], Desired points
-                // [-1, 1], [1, 1], [1, -1], [-1, -1], FLIP Y
-                // adjust the points in det->p so that they correspond to
-                // counter-clockwise around the quad, starting at -1,-1.
-                for (int i = 0; i < 4; i++) {
-                    int tcx = (i == 1 || i == 2) ? 1 : -1;
-                    int tcy = (i < 2) ? 1 : -1;
+            // quad_decode() does not modify the quad, so every family
+            // starts from the same (original) geometry. Families laid
+            // out like an earlier one sample the same bits; only the
+            // codeword lookup differs.
+            int src = task->sample_src[famidx];
+            if (src == famidx) {
+                margins[famidx] = quad_decode_family(td, &task->scratch, family, im, quad, &rcodes[famidx], task->im_samples);
+
+                task->ndecodes++;
+                if (margins[famidx] == DECODE_REJECT_CONTRAST)
+                    task->nrejected_contrast++;
+                else if (margins[famidx] == DECODE_REJECT_BITS)
+                    task->nrejected_bits++;
+                else if (margins[famidx] >= 0 && margins[famidx] < td->min_decision_margin)
+                    task->nrejected_margin++;
+            }
 
-                    double p[2];
+            // below the minimum, skip the codeword lookup.
+            float decision_margin = margins[src];
+            if (decision_margin < 0 || decision_margin < td->min_decision_margin)
+                continue;
 
-                    homography_project(det->H, tcx, tcy, &p[0], &p[1]);
+            struct quick_decode_entry entry;
+            quick_decode_codeword(family, rcodes[src], &entry);
 
-                    det->p[i][0] = p[0];
-                    det->p[i][1] = p[1];
-                }
+            if (entry.hamming < 255) {
+                apriltag_detection_t *det = detection_create(family, quad, &entry, decision_margin);
 
                 pthread_mutex_lock(&td->mutex);
                 zarray_add(task->detections, &det);
                 pthread_mutex_unlock(&td->mutex);
             }
-
-            quad_destroy(quad);
         }
+
+        frame_arena_release(&task->scratch, mark);
+        quad->H = NULL;
+        quad->Hinv = NULL;
     }
 }
 
-void apriltag_detection_destroy(apriltag_detection_t *det)
+apriltag_detection_t *apriltag_detection_copy(const apriltag_detection_t *det)
 {
-    if (det == NULL)
-        return;
+    apriltag_detection_t *copy = detection_alloc();
+    if (copy == NULL)
+        return NULL;
+
+    matd_t *H = copy->H;
+    *copy = *det;
+    copy->H = H;
+    memcpy(H->data, det->H->data, 9 * sizeof(double));
+    return copy;
+}
 
-    matd_destroy(det->H);
+void apriltag_detection_destroy(apriltag_detection_t *det)
+{
+    // H lives in the same allocation.
     free(det);
 }
 
@@ -1036,32 +1772,74 @@ static int prefer_smaller(int pref, double q0, double q1)
     return 0;
 }
 
-zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
+// (Re)creates the worker pool for td->nthreads. Returns false if that
+// failed.
+static bool detector_prepare_workerpool(apriltag_detector_t *td)
 {
-    if (zarray_size(td->tag_families) == 0) {
-        zarray_t *s = zarray_create(sizeof(apriltag_detection_t*));
-        debug_print("No tag families enabled\n");
-        return s;
-    }
-
     if (td->wp == NULL || td->nthreads != workerpool_get_nthreads(td->wp)) {
         workerpool_destroy(td->wp);
         td->wp = workerpool_create(td->nthreads);
-        if (td->wp == NULL) {
-            // creating workerpool failed - return empty zarray
-            return zarray_create(sizeof(apriltag_detection_t*));
-        }
+        if (td->wp == NULL)
+            return false;
     }
+    return true;
+}
 
-    timeprofile_clear(td->tp);
-    timeprofile_stamp(td->tp, "init");
+static zarray_t *detections_from_quads(apriltag_detector_t *td, image_u8_t *im_orig,
+                                       zarray_t *quads, float quad_scale,
+                                       uint32_t heap_calls0, int64_t deadline);
 
-    ///////////////////////////////////////////////////////////
-    // Step 1. Detect quads according to requested image decimation
-    // and blurring parameters.
+static void decode_quads(apriltag_detector_t *td, image_u8_t *im_orig, zarray_t *quads,
+                         zarray_t *detections, int64_t deadline);
+static zarray_t *detections_finish(apriltag_detector_t *td, image_u8_t *im_orig, zarray_t *quads,
+                                   zarray_t *detections, uint32_t heap_calls0);
+
+// Clears the statistics decode_quads() adds to.
+static void decode_stats_clear(apriltag_detector_t *td)
+{
+    td->nquads_skipped = 0;
+    td->ndecodes = 0;
+    td->ndecodes_rejected_contrast = 0;
+    td->ndecodes_rejected_bits = 0;
+    td->ndecodes_rejected_margin = 0;
+}
+
+// From the coordinates of the quad image to those of the input image.
+static float quad_scale(const apriltag_detector_t *td)
+{
+    return td->quad_decimate > 1 ? td->quad_decimate : 1;
+}
+
+// The utime_now() at which a frame started now runs out of
+// td->deadline_us, or 0 without a budget.
+static int64_t detector_deadline(const apriltag_detector_t *td)
+{
+    return td->deadline_us ? utime_now() + td->deadline_us : 0;
+}
+
+// Step 1 of apriltag_detector_detect(): finds the quads in im_orig, in
+// the coordinates of the (decimated) image they were found in. With
+// 'temporal' the threshold reuses the tiles of td->thresh_history.
+static zarray_t *detector_find_quads(apriltag_detector_t *td, image_u8_t *im_orig, bool temporal)
+{
     image_u8_t *quad_im = im_orig;
-    if (td->quad_decimate > 1) {
-        quad_im = image_u8_decimate(im_orig, td->quad_decimate);
+
+    // tile extrema of quad_im when the decimation produced them.
+    uint8_t *im_max = NULL, *im_min = NULL;
+
+    // the fused path needs the decimated image to stay as it is.
+    bool fused = td->fused_decimate && td->quad_sigma == 0 &&
+        (td->quad_decimate == 1.5 || (td->quad_decimate >= 2 && td->quad_decimate == (int) td->quad_decimate));
+
+    if (td->quad_decimate > 1 && fused) {
+        quad_im = decimate_minmax(td, im_orig, &im_max, &im_min);
+
+        timeprofile_stamp(td->tp, "decimate");
+    } else if (td->quad_decimate > 1) {
+        int dw, dh;
+        image_u8_decimate_size(im_orig, td->quad_decimate, &dw, &dh);
+        quad_im = frame_arena_image_u8_create(td->arena, dw, dh, DEFAULT_ALIGNMENT_U8);
+        image_u8_decimate_into(im_orig, td->quad_decimate, quad_im);
 
         timeprofile_stamp(td->tp, "decimate");
     }
@@ -1089,7 +1867,9 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
                 image_u8_gaussian_blur_parallel(td->wp, quad_im, sigma, ksz);
             } else {
                 // SHARPEN the image by subtracting the low frequency components.
-                image_u8_t *orig = image_u8_copy(quad_im);
+                image_u8_t *orig = frame_arena_image_u8_create(td->arena, quad_im->width, quad_im->height, DEFAULT_ALIGNMENT_U8);
+                for (int y = 0; y < quad_im->height; y++)
+                    memcpy(&orig->buf[y*orig->stride], &quad_im->buf[y*quad_im->stride], quad_im->width);
                 image_u8_gaussian_blur_parallel(td->wp, quad_im, sigma, ksz);
 
                 for (int y = 0; y < orig->height; y++) {
@@ -1106,7 +1886,6 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
                         quad_im->buf[y*quad_im->stride + x] = (uint8_t) v;
                     }
                 }
-                image_u8_destroy(orig);
             }
         }
     }
@@ -1116,89 +1895,367 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
     if (td->debug)
         image_u8_write_pnm(quad_im, "debug_preprocess.pnm");
 
-    zarray_t *quads = apriltag_quad_thresh(td, quad_im);
+    return apriltag_quad_thresh_minmax(td, quad_im, im_max, im_min, temporal);
+}
 
-    // adjust centers of pixels so that they correspond to the
-    // original full-resolution image.
-    if (td->quad_decimate > 1) {
-        for (int i = 0; i < zarray_size(quads); i++) {
-            struct quad *q;
-            zarray_get_volatile(quads, i, &q);
+// Merges overlapping boxes (int[4]: x0, y0, x1, y1) until none overlap.
+static void boxes_merge(zarray_t *boxes)
+{
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < zarray_size(boxes); i++) {
+            int *a;
+            zarray_get_volatile(boxes, i, &a);
+
+            for (int j = zarray_size(boxes) - 1; j > i; j--) {
+                int *b;
+                zarray_get_volatile(boxes, j, &b);
+
+                if (a[0] > b[2] || b[0] > a[2] || a[1] > b[3] || b[1] > a[3])
+                    continue;
 
-            for (int j = 0; j < 4; j++) {
-                q->p[j][0] *= td->quad_decimate;
-                q->p[j][1] *= td->quad_decimate;
+                a[0] = imin(a[0], b[0]);
+                a[1] = imin(a[1], b[1]);
+                a[2] = imax(a[2], b[2]);
+                a[3] = imax(a[3], b[3]);
+                zarray_remove_index(boxes, j, true);
+                merged = true;
             }
         }
     }
+}
 
-    if (quad_im != im_orig)
-        image_u8_destroy(quad_im);
+// apriltag_detector_detect() with td->pyramid: decodes the quads of the
+// decimated image, then searches the full-resolution image around its
+// clusters too small to be found there, away from the tags it found, and
+// decodes those quads too. The detections of both are reconciled
+// together.
+static zarray_t *detect_pyramid(apriltag_detector_t *td, image_u8_t *im_orig,
+                                uint32_t heap_calls0, int64_t deadline)
+{
+    float decimate = td->quad_decimate;
+
+    td->pyramid_candidates = frame_arena_zarray_create(td->arena, sizeof(int[4]), 16);
+    zarray_t *quads = detector_find_quads(td, im_orig, td->temporal_tiles);
+    zarray_t *boxes = td->pyramid_candidates;
+    td->pyramid_candidates = NULL;
+
+    for (int i = 0; i < zarray_size(quads); i++) {
+        struct quad *q;
+        zarray_get_volatile(quads, i, &q);
+        for (int j = 0; j < 4; j++) {
+            q->p[j][0] *= decimate;
+            q->p[j][1] *= decimate;
+        }
+    }
 
     zarray_t *detections = zarray_create(sizeof(apriltag_detection_t*));
+    decode_stats_clear(td);
+    decode_quads(td, im_orig, quads, detections, deadline);
+
+    // to full-resolution pixels, padded by a decimated pixel and two
+    // threshold tiles so that the search sees the whole tag and the
+    // background the threshold compares it with, with the origin aligned
+    // to the 4x4 threshold tiles. Boxes touching a tag found already are
+    // dropped.
+    for (int i = zarray_size(boxes) - 1; i >= 0; i--) {
+        int *b;
+        zarray_get_volatile(boxes, i, &b);
+
+        int pad = (imax(b[2] - b[0], b[3] - b[1]) / 4 + 1) * decimate + 8;
+        b[0] = imax(0, (int) (b[0] * decimate) - pad) & ~3;
+        b[1] = imax(0, (int) (b[1] * decimate) - pad) & ~3;
+        b[2] = imin(im_orig->width, (int) ceilf(b[2] * decimate) + pad);
+        b[3] = imin(im_orig->height, (int) ceilf(b[3] * decimate) + pad);
+
+        for (int j = 0; j < zarray_size(detections); j++) {
+            apriltag_detection_t *det;
+            zarray_get(detections, j, &det);
 
-    td->nquads = zarray_size(quads);
+            bool outside = true;
+            for (int k = 0; k < 4; k++)
+                outside &= det->p[k][0] < b[0] || det->p[k][0] > b[2] ||
+                    det->p[k][1] < b[1] || det->p[k][1] > b[3];
+            if (!outside || (det->c[0] >= b[0] && det->c[0] <= b[2] &&
+                             det->c[1] >= b[1] && det->c[1] <= b[3])) {
+                zarray_remove_index(boxes, i, true);
+                break;
+            }
+        }
+    }
+    boxes_merge(boxes);
 
-    timeprofile_stamp(td->tp, "quads");
+    timeprofile_stamp(td->tp, "pyramid regions");
 
-    if (td->debug) {
-        image_u8_t *im_quads = image_u8_copy(im_orig);
-        image_u8_darken(im_quads);
-        image_u8_darken(im_quads);
+    td->quad_decimate = 1;
+    td->npyramid_pixels = 0;
 
-        srandom(0);
+    zarray_t *fine = frame_arena_zarray_create(td->arena, sizeof(struct quad), 0);
+    for (int i = 0; i < zarray_size(boxes); i++) {
+        int *b;
+        zarray_get_volatile(boxes, i, &b);
 
-        for (int i = 0; i < zarray_size(quads); i++) {
-            struct quad *quad;
-            zarray_get_volatile(quads, i, &quad);
+        // threshold() needs two tiles each way.
+        int w = b[2] - b[0], h = b[3] - b[1];
+        if (w < 8 || h < 8)
+            continue;
 
-            const int bias = 100;
-            int color = bias + (random() % (255-bias));
+        // a view into im_orig, or a copy the blur can modify.
+        image_u8_t view = { .width = w, .height = h, .stride = im_orig->stride,
+                            .buf = &im_orig->buf[b[1]*im_orig->stride + b[0]] };
+        image_u8_t *fine_im = &view;
+        if (td->quad_sigma != 0) {
+            fine_im = frame_arena_image_u8_create(td->arena, w, h, DEFAULT_ALIGNMENT_U8);
+            for (int y = 0; y < h; y++)
+                memcpy(&fine_im->buf[y*fine_im->stride], &view.buf[y*view.stride], w);
+        }
 
-            image_u8_draw_line(im_quads, quad->p[0][0], quad->p[0][1], quad->p[1][0], quad->p[1][1], color, 1);
-            image_u8_draw_line(im_quads, quad->p[1][0], quad->p[1][1], quad->p[2][0], quad->p[2][1], color, 1);
-            image_u8_draw_line(im_quads, quad->p[2][0], quad->p[2][1], quad->p[3][0], quad->p[3][1], color, 1);
-            image_u8_draw_line(im_quads, quad->p[3][0], quad->p[3][1], quad->p[0][0], quad->p[0][1], color, 1);
+        zarray_t *box_quads = detector_find_quads(td, fine_im, false);
+        td->npyramid_pixels += w * h;
+
+        for (int j = 0; j < zarray_size(box_quads); j++) {
+            struct quad *q;
+            zarray_get_volatile(box_quads, j, &q);
+            for (int k = 0; k < 4; k++) {
+                q->p[k][0] += b[0];
+                q->p[k][1] += b[1];
+            }
+            frame_arena_zarray_add(td->arena, fine, q);
         }
+    }
 
-        image_u8_write_pnm(im_quads, "debug_quads_raw.pnm");
-        image_u8_destroy(im_quads);
+    decode_quads(td, im_orig, fine, detections, deadline);
+    td->quad_decimate = decimate;
+
+    for (int i = 0; i < zarray_size(fine); i++) {
+        struct quad *q;
+        zarray_get_volatile(fine, i, &q);
+        frame_arena_zarray_add(td->arena, quads, q);
     }
+    td->nquads = zarray_size(quads);
 
-    ////////////////////////////////////////////////////////////////
-    // Step 2. Decode tags from each quad.
-    if (1) {
-        image_u8_t *im_samples = td->debug ? image_u8_copy(im_orig) : NULL;
+    return detections_finish(td, im_orig, quads, detections, heap_calls0);
+}
 
-        int chunksize = 1 + zarray_size(quads) / (APRILTAG_TASKS_PER_THREAD_TARGET * td->nthreads);
+zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
+{
+    int64_t deadline = detector_deadline(td);
 
-        struct quad_decode_task *tasks = malloc(sizeof(struct quad_decode_task)*(zarray_size(quads) / chunksize + 1));
+    if (zarray_size(td->tag_families) == 0) {
+        zarray_t *s = zarray_create(sizeof(apriltag_detection_t*));
+        debug_print("No tag families enabled\n");
+        return s;
+    }
+
+    if (!detector_prepare_workerpool(td)) {
+        // creating workerpool failed - return empty zarray
+        return zarray_create(sizeof(apriltag_detection_t*));
+    }
+
+    timeprofile_clear(td->tp);
+    timeprofile_stamp(td->tp, "init");
+
+    // every scratch buffer of this frame comes from td->arena, which is
+    // reset before returning.
+    uint32_t heap_calls0 = td->arena->nheap_calls;
+
+    ///////////////////////////////////////////////////////////
+    // Step 1. Detect quads according to requested image decimation
+    // and blurring parameters.
+    if (td->pyramid && td->quad_decimate > 1)
+        return detect_pyramid(td, im_orig, heap_calls0, deadline);
+
+    zarray_t *quads = detector_find_quads(td, im_orig, td->temporal_tiles);
+
+    return detections_from_quads(td, im_orig, quads, quad_scale(td), heap_calls0, deadline);
+}
 
-        int ntasks = 0;
-        for (int i = 0; i < zarray_size(quads); i+= chunksize) {
-            tasks[ntasks].i0 = i;
-            tasks[ntasks].i1 = imin(zarray_size(quads), i + chunksize);
-            tasks[ntasks].quads = quads;
-            tasks[ntasks].td = td;
-            tasks[ntasks].im = im_orig;
-            tasks[ntasks].detections = detections;
+// Gray level of im at (x, y), clamped to the image.
+static inline int pixel_clamped(const image_u8_t *im, float x, float y)
+{
+    int ix = iclamp((int) x, 0, im->width - 1);
+    int iy = iclamp((int) y, 0, im->height - 1);
+    return im->buf[iy*im->stride + ix];
+}
+
+// A cheap guess at how likely a quad is to decode, for ordering the
+// decodes under a deadline: its size, times the mean gray difference
+// across its edges (sampled at a third and two thirds of each edge, a
+// sixteenth of the side inside and outside), up to four times higher
+// close to the last detection.
+static float quad_rank_score(const apriltag_detector_t *td, const image_u8_t *im, const struct quad *quad)
+{
+    float area = 0, cx = 0, cy = 0;
+    for (int i = 0; i < 4; i++) {
+        int j = (i + 1) & 3;
+        area += quad->p[i][0]*quad->p[j][1] - quad->p[j][0]*quad->p[i][1];
+        cx += quad->p[i][0] / 4;
+        cy += quad->p[i][1] / 4;
+    }
 
-            tasks[ntasks].im_samples = im_samples;
+    float side = sqrtf(fabsf(area) / 2);
+    if (side < 1)
+        return 0;
 
-            workerpool_add_task(td->wp, quad_decode_task, &tasks[ntasks]);
-            ntasks++;
+    float contrast = 0;
+    for (int i = 0; i < 4; i++) {
+        int j = (i + 1) & 3;
+        for (int k = 1; k <= 2; k++) {
+            float mx = quad->p[i][0] + (quad->p[j][0] - quad->p[i][0]) * k / 3;
+            float my = quad->p[i][1] + (quad->p[j][1] - quad->p[i][1]) * k / 3;
+
+            // towards the center, a sixteenth of the side (one pixel at least).
+            float dx = cx - mx, dy = cy - my;
+            float scale = fmaxf(1, side / 16) / fmaxf(1e-3f, sqrtf(dx*dx + dy*dy));
+            dx *= scale;
+            dy *= scale;
+
+            contrast += abs(pixel_clamped(im, mx + dx, my + dy) - pixel_clamped(im, mx - dx, my - dy));
         }
+    }
 
-        workerpool_run(td->wp);
+    float score = side * contrast / 8;
 
-        free(tasks);
+    if (td->has_last_center) {
+        float dx = cx - td->last_center[0], dy = cy - td->last_center[1];
+        score *= 1 + 3 * side / (side + sqrtf(dx*dx + dy*dy));
+    }
+
+    return score;
+}
+
+struct quad_rank
+{
+    float score;
+    int idx;
+};
+
+static int quad_rank_compare(const void *_a, const void *_b)
+{
+    const struct quad_rank *a = _a, *b = _b;
 
-        if (im_samples != NULL) {
-            image_u8_write_pnm(im_samples, "debug_samples.pnm");
-            image_u8_destroy(im_samples);
+    if (a->score != b->score)
+        return a->score > b->score ? -1 : 1;
+    return a->idx - b->idx;
+}
+
+// Sorts quads best first by quad_rank_score().
+static void quads_rank(apriltag_detector_t *td, const image_u8_t *im, zarray_t *quads)
+{
+    int nquads = zarray_size(quads);
+    if (nquads < 2)
+        return;
+
+    struct quad_rank *ranks = frame_arena_alloc(td->arena, nquads * sizeof(struct quad_rank));
+    struct quad *sorted = frame_arena_alloc(td->arena, nquads * sizeof(struct quad));
+
+    for (int i = 0; i < nquads; i++) {
+        struct quad *quad;
+        zarray_get_volatile(quads, i, &quad);
+        ranks[i].score = quad_rank_score(td, im, quad);
+        ranks[i].idx = i;
+    }
+
+    qsort(ranks, nquads, sizeof(struct quad_rank), quad_rank_compare);
+
+    for (int i = 0; i < nquads; i++)
+        zarray_get(quads, ranks[i].idx, &sorted[i]);
+    for (int i = 0; i < nquads; i++)
+        zarray_set(quads, i, &sorted[i], NULL);
+}
+
+// Step 2 of apriltag_detector_detect(): decodes quads, in im_orig
+// coordinates, adding the tags found to detections and the counts to
+// td's statistics.
+static void decode_quads(apriltag_detector_t *td, image_u8_t *im_orig, zarray_t *quads,
+                         zarray_t *detections, int64_t deadline)
+{
+    if (deadline)
+        quads_rank(td, im_orig, quads);
+
+    image_u8_t *im_samples = td->debug ? image_u8_copy(im_orig) : NULL;
+
+    int chunksize = 1 + zarray_size(quads) / (APRILTAG_TASKS_PER_THREAD_TARGET * td->nthreads);
+
+    struct quad_decode_task *tasks = frame_arena_alloc(td->arena, sizeof(struct quad_decode_task)*(zarray_size(quads) / chunksize + 1));
+
+    // per-quad scratch: the homographies, plus the bit values and
+    // their sharpened copy for the widest family.
+    int maxwidth = 0;
+    for (int i = 0; i < zarray_size(td->tag_families); i++) {
+        apriltag_family_t *family;
+        zarray_get(td->tag_families, i, &family);
+        maxwidth = imax(maxwidth, family->total_width);
+    }
+    size_t scratchsz = 2 * (sizeof(matd_t) + 9 * sizeof(double)) +
+        2 * sizeof(double) * maxwidth * maxwidth + 8 * FRAME_ARENA_ALIGN;
+
+    int nfamilies = zarray_size(td->tag_families);
+    int *sample_src = frame_arena_alloc(td->arena, nfamilies * sizeof(int));
+    for (int i = 0; i < nfamilies; i++) {
+        apriltag_family_t *family;
+        zarray_get(td->tag_families, i, &family);
+
+        sample_src[i] = i;
+        for (int j = 0; j < i; j++) {
+            apriltag_family_t *other;
+            zarray_get(td->tag_families, j, &other);
+            if (family_same_sampling(family, other)) {
+                sample_src[i] = j;
+                break;
+            }
         }
     }
+    scratchsz += nfamilies * (sizeof(float) + sizeof(uint64_t)) + 2 * FRAME_ARENA_ALIGN;
+
+    int ntasks = 0;
+    for (int i = 0; i < zarray_size(quads); i+= chunksize) {
+        tasks[ntasks].sample_src = sample_src;
+        tasks[ntasks].i0 = i;
+        tasks[ntasks].i1 = imin(zarray_size(quads), i + chunksize);
+        tasks[ntasks].quads = quads;
+        tasks[ntasks].td = td;
+        tasks[ntasks].im = im_orig;
+        tasks[ntasks].detections = detections;
+
+        tasks[ntasks].im_samples = im_samples;
+        tasks[ntasks].ndecodes = 0;
+        tasks[ntasks].nrejected_contrast = 0;
+        tasks[ntasks].nrejected_bits = 0;
+        tasks[ntasks].nrejected_margin = 0;
+        tasks[ntasks].deadline = deadline;
+        tasks[ntasks].nskipped = 0;
+        frame_arena_init_slab(&tasks[ntasks].scratch, td->arena, scratchsz);
+
+        workerpool_add_task(td->wp, quad_decode_task, &tasks[ntasks]);
+        ntasks++;
+    }
 
+    workerpool_run(td->wp);
+
+    for (int i = 0; i < ntasks; i++) {
+        td->ndecodes += tasks[i].ndecodes;
+        td->ndecodes_rejected_contrast += tasks[i].nrejected_contrast;
+        td->ndecodes_rejected_bits += tasks[i].nrejected_bits;
+        td->ndecodes_rejected_margin += tasks[i].nrejected_margin;
+        td->nquads_skipped += tasks[i].nskipped;
+    }
+
+    for (int i = 0; i < ntasks; i++)
+        frame_arena_fini_slab(&tasks[i].scratch, td->arena);
+
+    if (im_samples != NULL) {
+        image_u8_write_pnm(im_samples, "debug_samples.pnm");
+        image_u8_destroy(im_samples);
+    }
+}
+
+// Step 3 of apriltag_detector_detect(): reconciles the detections of
+// quads and resets the frame arena.
+static zarray_t *detections_finish(apriltag_detector_t *td, image_u8_t *im_orig, zarray_t *quads,
+                                   zarray_t *detections, uint32_t heap_calls0)
+{
     if (td->debug) {
         image_u8_t *im_quads = image_u8_copy(im_orig);
         image_u8_darken(im_quads);
@@ -1230,8 +2287,10 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
     // Step 3. Reconcile detections--- don't report the same tag more
     // than once. (Allow non-overlapping duplicate detections.)
     if (1) {
-        zarray_t *poly0 = g2d_polygon_create_zeros(4);
-        zarray_t *poly1 = g2d_polygon_create_zeros(4);
+        zarray_t *poly0 = frame_arena_zarray_create(td->arena, sizeof(double[2]), 4);
+        zarray_t *poly1 = frame_arena_zarray_create(td->arena, sizeof(double[2]), 4);
+        poly0->size = 4;
+        poly1->size = 4;
 
         for (int i0 = 0; i0 < zarray_size(detections); i0++) {
 
@@ -1292,9 +2351,6 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
 
           retry0: ;
         }
-
-        zarray_destroy(poly0);
-        zarray_destroy(poly1);
     }
 
     timeprofile_stamp(td->tp, "reconcile");
@@ -1426,21 +2482,297 @@ zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig)
 
     timeprofile_stamp(td->tp, "debug output");
 
-    for (int i = 0; i < zarray_size(quads); i++) {
-        struct quad *quad;
-        zarray_get_volatile(quads, i, &quad);
-        matd_destroy(quad->H);
-        matd_destroy(quad->Hinv);
-    }
-
-    zarray_destroy(quads);
+    // releases quads and every other scratch buffer of this frame.
+    if (td->arena->high_water > td->scratch_bytes)
+        td->scratch_bytes = td->arena->high_water;
+    frame_arena_reset(td->arena);
+    td->nscratch_heap_calls = td->arena->nheap_calls - heap_calls0;
 
     zarray_sort(detections, detection_compare_function);
+
+    float best_margin = -1;
+    for (int i = 0; i < zarray_size(detections); i++) {
+        apriltag_detection_t *det;
+        zarray_get(detections, i, &det);
+
+        if (det->decision_margin > best_margin) {
+            best_margin = det->decision_margin;
+            td->has_last_center = true;
+            td->last_center[0] = det->c[0];
+            td->last_center[1] = det->c[1];
+        }
+    }
+
     timeprofile_stamp(td->tp, "cleanup");
 
     return detections;
 }
 
+// Steps 2 and 3 of apriltag_detector_detect(): decodes the quads found in
+// im_orig (in quad image coordinates, quad_scale times smaller),
+// reconciles the detections and resets the frame arena.
+static zarray_t *detections_from_quads(apriltag_detector_t *td, image_u8_t *im_orig,
+                                       zarray_t *quads, float quad_scale,
+                                       uint32_t heap_calls0, int64_t deadline)
+{
+    // adjust centers of pixels so that they correspond to the
+    // original full-resolution image.
+    if (quad_scale != 1) {
+        for (int i = 0; i < zarray_size(quads); i++) {
+            struct quad *q;
+            zarray_get_volatile(quads, i, &q);
+
+            for (int j = 0; j < 4; j++) {
+                q->p[j][0] *= quad_scale;
+                q->p[j][1] *= quad_scale;
+            }
+        }
+    }
+
+    zarray_t *detections = zarray_create(sizeof(apriltag_detection_t*));
+
+    td->nquads = zarray_size(quads);
+    decode_stats_clear(td);
+
+    timeprofile_stamp(td->tp, "quads");
+
+    if (td->debug) {
+        image_u8_t *im_quads = image_u8_copy(im_orig);
+        image_u8_darken(im_quads);
+        image_u8_darken(im_quads);
+
+        srandom(0);
+
+        for (int i = 0; i < zarray_size(quads); i++) {
+            struct quad *quad;
+            zarray_get_volatile(quads, i, &quad);
+
+            const int bias = 100;
+            int color = bias + (random() % (255-bias));
+
+            image_u8_draw_line(im_quads, quad->p[0][0], quad->p[0][1], quad->p[1][0], quad->p[1][1], color, 1);
+            image_u8_draw_line(im_quads, quad->p[1][0], quad->p[1][1], quad->p[2][0], quad->p[2][1], color, 1);
+            image_u8_draw_line(im_quads, quad->p[2][0], quad->p[2][1], quad->p[3][0], quad->p[3][1], color, 1);
+            image_u8_draw_line(im_quads, quad->p[3][0], quad->p[3][1], quad->p[0][0], quad->p[0][1], color, 1);
+        }
+
+        image_u8_write_pnm(im_quads, "debug_quads_raw.pnm");
+        image_u8_destroy(im_quads);
+    }
+
+    decode_quads(td, im_orig, quads, detections, deadline);
+
+    return detections_finish(td, im_orig, quads, detections, heap_calls0);
+}
+
+struct apriltag_stream
+{
+    apriltag_detector_t *td;
+    image_u8_t *im;
+    int nrows;
+    uint32_t heap_calls0;
+    int64_t deadline;
+
+    // NULL when td's settings are not supported by the streaming
+    // front-end: the rows are only collected and apriltag_stream_finish()
+    // runs apriltag_detector_detect().
+    quad_thresh_stream_t *qs;
+};
+
+apriltag_stream_t *apriltag_stream_begin(apriltag_detector_t *td, image_u8_t *im)
+{
+    apriltag_stream_t *st = frame_arena_calloc(td->arena, 1, sizeof(apriltag_stream_t));
+    st->td = td;
+    st->im = im;
+    st->deadline = detector_deadline(td);
+
+    if (zarray_size(td->tag_families) == 0 || !quad_thresh_stream_supported(td) ||
+        !detector_prepare_workerpool(td))
+        return st;
+
+    timeprofile_clear(td->tp);
+    timeprofile_stamp(td->tp, "init");
+
+    st->heap_calls0 = td->arena->nheap_calls;
+    st->qs = quad_thresh_stream_begin(td, im);
+
+    return st;
+}
+
+void apriltag_stream_push_rows(apriltag_stream_t *st, const uint8_t *rows, int stride, int nrows)
+{
+    image_u8_t *im = st->im;
+    nrows = imin(nrows, im->height - st->nrows);
+    if (nrows <= 0)
+        return;
+
+    uint8_t *dst = &im->buf[st->nrows*im->stride];
+    if (rows != dst) {
+        for (int y = 0; y < nrows; y++)
+            memcpy(&dst[y*im->stride], &rows[y*stride], im->width);
+    }
+
+    st->nrows += nrows;
+
+    if (st->qs)
+        quad_thresh_stream_rows(st->qs, st->nrows);
+}
+
+zarray_t *apriltag_stream_finish(apriltag_stream_t *st)
+{
+    apriltag_detector_t *td = st->td;
+
+    if (st->qs == NULL)
+        return apriltag_detector_detect(td, st->im);
+
+    timeprofile_stamp(td->tp, "rows");
+
+    image_u8_t *quad_im;
+    zarray_t *quads = quad_thresh_stream_finish(st->qs, &quad_im);
+
+    return detections_from_quads(td, st->im, quads, quad_scale(td), st->heap_calls0, st->deadline);
+}
+
+apriltag_detection_t *apriltag_detector_track(apriltag_detector_t *td, image_u8_t *im,
+                                              const apriltag_detection_t *prev, int band, double reuse_px)
+{
+    apriltag_family_t *family = prev->family;
+    if (family->impl == NULL)
+        return NULL;
+
+    uint32_t heap_calls0 = td->arena->nheap_calls;
+
+    // the quad whose homography is prev->H: the same winding as the
+    // quads of the full search, with the decoded rotation undone.
+    struct quad quad;
+    memset(&quad, 0, sizeof(quad));
+    quad.reversed_border = family->reversed_border;
+
+    double prevp[4][2];
+    for (int i = 0; i < 4; i++) {
+        homography_project(prev->H, (i == 0 || i == 3) ? -1 : 1, (i == 0 || i == 1) ? -1 : 1,
+                           &prevp[i][0], &prevp[i][1]);
+        quad.p[i][0] = prevp[i][0];
+        quad.p[i][1] = prevp[i][1];
+    }
+
+    // find the edges within the band, then fit them again closely
+    // around where they were found; the narrow passes are what make the
+    // result independent of how far the tag moved.
+    static const int ranges[] = { 2, 2, 1, 1 };
+    bool found = refine_edges(im, &quad, band);
+    for (int i = 0; found && i < 4; i++)
+        found = refine_edges(im, &quad, ranges[i]);
+
+    double moved = 0;
+    for (int i = 0; found && i < 4; i++) {
+        if (!isfinite(quad.p[i][0]) || !isfinite(quad.p[i][1])) {
+            found = false;
+            break;
+        }
+        double dx = quad.p[i][0] - prevp[i][0], dy = quad.p[i][1] - prevp[i][1];
+        moved = fmax(moved, sqrt(dx*dx + dy*dy));
+    }
+
+    apriltag_detection_t *det = NULL;
+
+    struct quad_homographies qh;
+    if (found && moved <= band + 1 && quad_update_homographies(&quad, &qh) == 0) {
+        struct quick_decode_entry entry = { .rcode = 0, .id = prev->id, .hamming = prev->hamming, .rotation = 0 };
+        float decision_margin = prev->decision_margin;
+
+        // the tag barely moved: its bits are where they were.
+        if (moved > reuse_px) {
+            uint64_t rcode;
+            decision_margin = quad_decode_family(td, td->arena, family, im, &quad, &rcode, NULL);
+            if (decision_margin >= 0 && decision_margin >= td->min_decision_margin)
+                quick_decode_codeword(family, rcode, &entry);
+            else
+                entry.hamming = 255;
+        }
+
+        if (entry.hamming < 255 && entry.id == prev->id) {
+            det = detection_create(family, &quad, &entry, decision_margin);
+            td->has_last_center = true;
+            td->last_center[0] = det->c[0];
+            td->last_center[1] = det->c[1];
+        }
+    }
+
+    if (td->arena->high_water > td->scratch_bytes)
+        td->scratch_bytes = td->arena->high_water;
+    frame_arena_reset(td->arena);
+    td->nscratch_heap_calls = td->arena->nheap_calls - heap_calls0;
+
+    return det;
+}
+
+zarray_t *apriltag_detector_detect_roi(apriltag_detector_t *td, image_u8_t *im_orig,
+                                       int x0, int y0, int w, int h)
+{
+    // threshold() uses 4x4 tiles of the decimated image. Snap the
+    // origin to a multiple of the tile footprint in the input image so
+    // that decimation samples and tiles line up with a full-frame
+    // search.
+    int align = 4;
+    if (td->quad_decimate == 1.5)
+        align = 12;
+    else if (td->quad_decimate > 1)
+        align = 4 * (int) td->quad_decimate;
+
+    int x1 = x0 + w, y1 = y0 + h;
+
+    x0 = imax(0, x0);
+    y0 = imax(0, y0);
+    x0 -= x0 % align;
+    y0 -= y0 % align;
+    x1 = imin(im_orig->width, x1);
+    y1 = imin(im_orig->height, y1);
+
+    if (x0 == 0 && y0 == 0 && x1 == im_orig->width && y1 == im_orig->height)
+        return apriltag_detector_detect(td, im_orig);
+
+    // too small to hold anything (and to be thresholded).
+    if (x1 - x0 < 2 * align || y1 - y0 < 2 * align) {
+        td->nquads = 0;
+        return zarray_create(sizeof(apriltag_detection_t*));
+    }
+
+    // a view into im_orig; no pixels are copied.
+    image_u8_t roi = { .width = x1 - x0,
+                       .height = y1 - y0,
+                       .stride = im_orig->stride,
+                       .buf = &im_orig->buf[y0*im_orig->stride + x0] };
+
+    // the last center, in the view's coordinates while detecting.
+    td->last_center[0] -= x0;
+    td->last_center[1] -= y0;
+
+    zarray_t *detections = apriltag_detector_detect(td, &roi);
+
+    td->last_center[0] += x0;
+    td->last_center[1] += y0;
+
+    for (int i = 0; i < zarray_size(detections); i++) {
+        apriltag_detection_t *det;
+        zarray_get(detections, i, &det);
+
+        // H' = [1 0 x0; 0 1 y0; 0 0 1] * H
+        for (int j = 0; j < 3; j++) {
+            MATD_EL(det->H, 0, j) += x0 * MATD_EL(det->H, 2, j);
+            MATD_EL(det->H, 1, j) += y0 * MATD_EL(det->H, 2, j);
+        }
+
+        det->c[0] += x0;
+        det->c[1] += y0;
+        for (int j = 0; j < 4; j++) {
+            det->p[j][0] += x0;
+            det->p[j][1] += y0;
+        }
+    }
+
+    return detections;
+}
 
 // Call this method on each of the tags returned by apriltag_detector_detect
 void apriltag_detections_destroy(zarray_t *detections)
@@ -39,6 +39,7 @@ extern "C" {
 #include "common/workerpool.h"
 #include "common/timeprofile.h"
 #include "common/pthreads_cross.h"
+#include "common/frame_arena.h"
 
 #define APRILTAG_TASKS_PER_THREAD_TARGET 10
 
@@ -118,6 +119,25 @@ struct apriltag_quad_thresh_params
     // should the thresholded image be deglitched? Only useful for
     // very noisy images
     int deglitch;
+
+    // Label the connected components of the thresholded image by runs
+    // of equal pixels instead of one union-find node per pixel. The
+    // components are the same; memory is O(runs) instead of O(pixels).
+    bool rle_components;
+
+    // Keep the thresholded image as two bitplanes (black, white) instead
+    // of one byte per pixel, and find run and cluster boundaries a 64-bit
+    // word at a time. Same detections with a quarter of the memory. Needs
+    // rle_components; ignored with deglitch or debug.
+    bool packed_threshold;
+
+    // Expected length of the longest tag edge in the input image, in
+    // pixels, e.g. from the last measured distance; 0 for no bound.
+    // Clusters too small or too large to outline such a quad are dropped
+    // before fitting, and fitted quads outside the range before
+    // decoding.
+    float min_tag_px;
+    float max_tag_px;
 };
 
 // Represents a detector object. Upon creating a detector, all fields
@@ -153,6 +173,12 @@ struct apriltag_detector
     // quad_decimate = 1.
     bool refine_edges;
 
+    // When true and quad_sigma is 0, decimation by 1.5 or an integer
+    // factor also computes the tile min/max of the threshold step, so
+    // the input image is read once and the decimated one is not read
+    // back. The detections are identical either way. Default true.
+    bool fused_decimate;
+
     // How much sharpening should be done to decoded images? This
     // can help decode small tags but may or may not help in odd
     // lighting conditions or low light conditions.
@@ -160,6 +186,72 @@ struct apriltag_detector
     // The default value is 0.25.
     double decode_sharpening;
 
+    // Decode the tag payload in single precision: float homography and
+    // gray models, Q16 bilinear sampling and stack buffers. For cores
+    // whose FPU has no double support (the ESP32); decision margins
+    // agree with the double path to a fraction of a gray level. Defaults
+    // to the APRILTAG_DECODE_FLOAT build flag (off unless defined to 1).
+    bool decode_float;
+
+    // With decode_float, decode families laid out like tag36h11/36h10,
+    // tagStandard41h12, tagCircle49h12 or tagCustom48h12 with a decoder
+    // compiled for that layout (unrolled, constant bit coordinates).
+    // Same results as the generic decoder. Default true; building with
+    // APRILTAG_SPECIALIZED_DECODE=0 leaves the specialized decoders out.
+    bool specialized_decode;
+
+    // Index the codes of families added from now on by bit fields of
+    // the valid codes instead of hashing every code within
+    // bits_corrected errors. Same decodes; memory is
+    // max(bits_corrected+1, 2) * (ncodes + dir_size + 1) * 2 bytes, where
+    // dir_size is about ncodes rounded up to a power of two (see
+    // apriltag_family_decode_index_bytes), instead of up to hundreds of
+    // MB, which makes 1-2 bit correction affordable on small targets.
+    // Lookups are a few binary searches per rotation instead of one
+    // hash probe. Defaults to the APRILTAG_COMPACT_DECODE_INDEX build
+    // flag (off unless defined to 1).
+    bool compact_decode_index;
+
+    // Quads whose decision margin is below this are not reported, and
+    // the decoder gives up on them early: after the first two border
+    // columns if their contrast is under half of it, after sampling the
+    // bits if their distance to the threshold bounds the margin below
+    // it, and before the codeword lookup otherwise. Only the border
+    // contrast stage is a heuristic. Default 0: every quad with the
+    // right border polarity is looked up, as before.
+    float min_decision_margin;
+
+    // With quad_decimate > 1, also look for tags too small for it:
+    // search the decimated image first, then the full-resolution image
+    // only around the clusters of the decimated search too small for it
+    // to fit reliably. The quads of both levels are decoded together and
+    // their duplicates reconciled. Not used by apriltag_stream_begin().
+    // Default false.
+    bool pyramid;
+
+    // Keep the threshold image between frames and, on the next frame,
+    // reuse it for every 4x4 tile whose pixels and blurred extrema (which
+    // also cover the 8 neighbouring tiles) are all within
+    // temporal_tile_tolerance gray levels of the ones it was last
+    // thresholded with; only the other tiles are thresholded again.
+    // Likewise a cluster with the same points as one of the last frame,
+    // lying on reused tiles only, gets that cluster's quad fit (or
+    // rejection) without fitting. The connected components are still
+    // labeled over the whole image. With a tolerance of 0 the results
+    // are those of a full search. Only the search of the whole
+    // (decimated) image by apriltag_detector_detect() reuses tiles.
+    // Default false.
+    bool temporal_tiles;
+    uint8_t temporal_tile_tolerance;
+
+    // Time budget for decoding a frame, in microseconds from the start of
+    // apriltag_detector_detect() (apriltag_stream_begin() for a stream);
+    // 0 for none. With a budget the quads are decoded best first, ranked
+    // by size, border contrast and distance to the last detection, and
+    // the ones still waiting when it runs out are skipped
+    // (nquads_skipped). The quad search itself always runs to the end.
+    uint32_t deadline_us;
+
     // When true, write a variety of debugging images to the
     // current working directory at various stages through the
     // detection process. (Somewhat slow).
@@ -175,6 +267,36 @@ struct apriltag_detector
     uint32_t nsegments;
     uint32_t nquads;
 
+    // Payload decodes run by the last detection (one per quad and
+    // sampling layout of the families, with the right border polarity)
+    // and how many of them each min_decision_margin stage dropped.
+    uint32_t ndecodes;
+    uint32_t ndecodes_rejected_contrast;
+    uint32_t ndecodes_rejected_bits;
+    uint32_t ndecodes_rejected_margin;
+
+    // Quads of the last detection left undecoded by deadline_us.
+    uint32_t nquads_skipped;
+
+    // Pixels searched at full resolution by the last pyramid detection.
+    uint32_t npyramid_pixels;
+
+    // Full 4x4 tiles of the last image thresholded with temporal_tiles,
+    // and how many of them were reused from an earlier frame; likewise
+    // for the quad fits of its clusters.
+    uint32_t nthresh_tiles;
+    uint32_t nthresh_tiles_reused;
+    uint32_t nquad_fits;
+    uint32_t nquad_fits_reused;
+
+    // Heap calls (malloc + free) made for per-frame scratch memory by
+    // the last apriltag_detector_detect(). Zero in steady state; the
+    // returned detections are not counted.
+    uint32_t nscratch_heap_calls;
+
+    // Peak scratch memory used by any frame so far, in bytes.
+    size_t scratch_bytes;
+
     ///////////////////////////////////////////////////////////////
     // Internal variables below
 
@@ -188,6 +310,24 @@ struct apriltag_detector
 
     // Used for thread safety.
     pthread_mutex_t mutex;
+
+    // Scratch memory for the frame being processed. Everything in it is
+    // released at the end of apriltag_detector_detect().
+    frame_arena_t *arena;
+
+    // While the decimated level of a pyramid detection is searched, the
+    // bounding boxes (int[4]: x0, y0, x1, y1 in the decimated image) of
+    // clusters small enough to be a tag it cannot find. NULL otherwise.
+    zarray_t *pyramid_candidates;
+
+    // Threshold image of the last temporal_tiles frame and what each of
+    // its tiles was computed from. Kept across frames.
+    struct thresh_history *thresh_history;
+
+    // Center of the strongest tag of the last frame that had one; ranks
+    // the quads under deadline_us.
+    bool has_last_center;
+    float last_center[2];
 };
 
 // Represents the detection of a tag. These are returned to the user
@@ -218,8 +358,9 @@ struct apriltag_detection
 
     // The 3x3 homography matrix describing the projection from an
     // "ideal" tag (with corners at (-1,1), (1,1), (1,-1), and (-1,
-    // -1)) to pixels in the image. This matrix will be freed by
-    // apriltag_detection_destroy.
+    // -1)) to pixels in the image. It lives in the detection's own
+    // allocation and is freed with it by apriltag_detection_destroy, so
+    // never matd_destroy() or replace it; change its entries instead.
     matd_t *H;
 
     // The center of the detection in image pixel coordinates.
@@ -255,13 +396,71 @@ void apriltag_detector_clear_families(apriltag_detector_t *td);
 // apriltag_family_t used to initialize it.)
 void apriltag_detector_destroy(apriltag_detector_t *td);
 
+// Look up a sampled code (bits in family->bit_x/bit_y order) in the
+// index built by apriltag_detector_add_family_bits(). Returns the tag id
+// and sets the corrected bits and the number of 90 degree rotations,
+// or returns -1 when no code is within the family's bits_corrected.
+int apriltag_family_decode(apriltag_family_t *fam, uint64_t code, int *hamming, int *rotation);
+
+// Memory held by the decode index of a family that has been added to a
+// detector, in bytes.
+size_t apriltag_family_decode_index_bytes(const apriltag_family_t *fam);
+
 // Detect tags from an image and return an array of
 // apriltag_detection_t*. You can use apriltag_detections_destroy to
 // free the array and the detections it contains, or call
 // _detection_destroy and zarray_destroy yourself.
 zarray_t *apriltag_detector_detect(apriltag_detector_t *td, image_u8_t *im_orig);
 
-// Call this method on each of the tags returned by apriltag_detector_detect
+// Detect tags inside the rectangle [x0, x0+w) x [y0, y0+h) of im_orig
+// only. The rectangle is clipped to the image, and its origin is moved
+// down/left so that it falls on the detector's decimation/threshold tile
+// grid (this keeps results consistent with a full-frame search). Returned
+// detections (corners, center and H) are in full-image coordinates.
+// Tags that are not entirely inside the rectangle are generally missed.
+zarray_t *apriltag_detector_detect_roi(apriltag_detector_t *td, image_u8_t *im_orig,
+                                       int x0, int y0, int w, int h);
+
+// Follow a tag found in an earlier frame without searching the image:
+// re-fits the edges of 'prev' (a detection by td, or a copy of one) to
+// the strongest gradients within 'band' pixels of them and decodes that
+// quad alone. When no corner moved more than reuse_px pixels, the
+// decode is skipped and prev's id, hamming and decision margin are
+// carried over. Returns the updated detection, to be freed with
+// apriltag_detection_destroy(), or NULL when the edges are not found,
+// moved further than the band, or the quad no longer decodes to prev's
+// id with at least td->min_decision_margin; the caller should then
+// search the frame again.
+apriltag_detection_t *apriltag_detector_track(apriltag_detector_t *td, image_u8_t *im,
+                                              const apriltag_detection_t *prev, int band, double reuse_px);
+
+// Detect tags in an image that arrives a band of rows at a time, e.g. as
+// a camera reads out the sensor. Each pushed band is decimated,
+// thresholded and labeled as soon as the rows it depends on are in;
+// apriltag_stream_finish() then fits and decodes quads and returns the
+// same detections apriltag_detector_detect(td, im) would. 'im' receives
+// the rows and must stay valid until finish. Settings the streaming
+// front-end does not handle (quad_sigma != 0, deglitch, decimation
+// other than 1.5 or an integer) fall back to apriltag_detector_detect()
+// at finish. td must not be used for anything else in between.
+typedef struct apriltag_stream apriltag_stream_t;
+apriltag_stream_t *apriltag_stream_begin(apriltag_detector_t *td, image_u8_t *im);
+
+// Appends the next nrows rows. They are copied into the stream's image
+// unless 'rows' already points at the next row of it (the producer
+// writes in place).
+void apriltag_stream_push_rows(apriltag_stream_t *st, const uint8_t *rows, int stride, int nrows);
+
+// Processes any rows not yet seen (all of im when fewer than its height
+// were pushed) and returns the detections. The stream is freed.
+zarray_t *apriltag_stream_finish(apriltag_stream_t *st);
+
+// A copy of a detection, with its own H. Detections are copied with this
+// rather than by assignment, which would share H with the original.
+apriltag_detection_t *apriltag_detection_copy(const apriltag_detection_t *det);
+
+// Call this method on each of the tags returned by apriltag_detector_detect,
+// apriltag_detector_track or apriltag_detection_copy, and on nothing else.
 void apriltag_detection_destroy(apriltag_detection_t *det);
 
 // destroys the array AND the detections within it.
@@ -99,3 +99,103 @@ static inline void mat33_sym_solve(const double *A,
     R[1] = M[4]*tmp[1] + M[7]*tmp[2];
     R[2] = M[8]*tmp[2];
 }
+
+// Single-precision mat33_sym_solve(), for cores whose FPU has no double
+// support. Only the upper triangle of A is read.
+static inline void mat33f_sym_solve(const float *A,
+                                    const float *B,
+                                    float *R)
+{
+    // cholesky factor L (lower triangular, row-major)
+    float L0 = sqrtf(A[0]);
+    float L3 = A[1] / L0;
+    float L6 = A[2] / L0;
+    float L4 = sqrtf(A[4] - L3*L3);
+    float L7 = (A[5] - L3*L6) / L4;
+    float L8 = sqrtf(A[8] - L6*L6 - L7*L7);
+
+    // M = inv(L)
+    float M0 = 1 / L0;
+    float M3 = -L3*M0 / L4;
+    float M4 = 1 / L4;
+    float M6 = (-L6*M0 - L7*M3) / L8;
+    float M7 = -L7*M4 / L8;
+    float M8 = 1 / L8;
+
+    float t0 = M0*B[0];
+    float t1 = M3*B[0] + M4*B[1];
+    float t2 = M6*B[0] + M7*B[1] + M8*B[2];
+
+    R[0] = M0*t0 + M3*t1 + M6*t2;
+    R[1] = M4*t1 + M7*t2;
+    R[2] = M8*t2;
+}
+
+// Inverts the (row-major) 3x3 matrix A into R using the adjugate.
+// Returns non-zero if A is singular.
+static inline int mat33_inv(const double *A,
+                            double *R)
+{
+    double c0 = A[4]*A[8] - A[5]*A[7];
+    double c1 = A[5]*A[6] - A[3]*A[8];
+    double c2 = A[3]*A[7] - A[4]*A[6];
+
+    double det = A[0]*c0 + A[1]*c1 + A[2]*c2;
+    if (det == 0)
+        return -1;
+
+    double invdet = 1.0 / det;
+
+    R[0] = c0 * invdet;
+    R[1] = (A[2]*A[7] - A[1]*A[8]) * invdet;
+    R[2] = (A[1]*A[5] - A[2]*A[4]) * invdet;
+    R[3] = c1 * invdet;
+    R[4] = (A[0]*A[8] - A[2]*A[6]) * invdet;
+    R[5] = (A[2]*A[3] - A[0]*A[5]) * invdet;
+    R[6] = c2 * invdet;
+    R[7] = (A[1]*A[6] - A[0]*A[7]) * invdet;
+    R[8] = (A[0]*A[4] - A[1]*A[3]) * invdet;
+    return 0;
+}
+
+// Computes the (row-major) homography H that maps the corners (-1,-1),
+// (1,-1), (1,1), (-1,1) of the ideal tag onto p[0..3], scaled so that
+// H[8] = 1. The square-to-quad map has a closed form (Heckbert,
+// "Fundamentals of Texture Mapping and Image Warping", 1989), which
+// spares solving the general 8x8 system. Returns non-zero if the quad is
+// degenerate.
+static inline int mat33_square_homography(double p[4][2],
+                                          double *H)
+{
+    double dx1 = p[1][0] - p[2][0], dx2 = p[3][0] - p[2][0];
+    double dx3 = p[0][0] - p[1][0] + p[2][0] - p[3][0];
+    double dy1 = p[1][1] - p[2][1], dy2 = p[3][1] - p[2][1];
+    double dy3 = p[0][1] - p[1][1] + p[2][1] - p[3][1];
+
+    double den = dx1*dy2 - dx2*dy1;
+    if (fabs(den) < 1e-10)
+        return -1;
+
+    // the map from the unit square, (0,0) to p[0] and (1,0) to p[1]...
+    double g = (dx3*dy2 - dx2*dy3) / den;
+    double h = (dx1*dy3 - dx3*dy1) / den;
+    double a = p[1][0] - p[0][0] + g*p[1][0], b = p[3][0] - p[0][0] + h*p[3][0];
+    double d = p[1][1] - p[0][1] + g*p[1][1], e = p[3][1] - p[0][1] + h*p[3][1];
+
+    // ...after (x, y) -> ((x+1)/2, (y+1)/2).
+    double w = 0.5*(g + h) + 1;
+    if (fabs(w) < 1e-10)
+        return -1;
+
+    double s = 0.5 / w;
+    H[0] = a*s;
+    H[1] = b*s;
+    H[2] = (0.5*(a + b) + p[0][0]) / w;
+    H[3] = d*s;
+    H[4] = e*s;
+    H[5] = (0.5*(d + e) + p[0][1]) / w;
+    H[6] = g*s;
+    H[7] = h*s;
+    H[8] = 1;
+    return 0;
+}
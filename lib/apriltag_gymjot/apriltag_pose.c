@@ -1,5 +1,6 @@
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "common/debug_print.h"
 #include "apriltag_pose.h"
@@ -28,112 +29,271 @@ double matd_to_double(matd_t *a)
     return d;
 }
 
+/**
+ * Fixed-size arithmetic on 3x1 and row-major 3x3 arrays for
+ * orthogonal_iteration() and fix_pose_ambiguities(). Each sums in the
+ * order matd_multiply() does, so results match the matd_op() forms.
+ */
+static inline void vecn_add(const double* a, const double* b, int n, double* r)
+{
+    for (int i = 0; i < n; i++)
+        r[i] = a[i] + b[i];
+}
+
+static inline void vecn_subtract(const double* a, const double* b, int n, double* r)
+{
+    for (int i = 0; i < n; i++)
+        r[i] = a[i] - b[i];
+}
+
+static inline void vecn_scale(double s, const double* a, int n, double* r)
+{
+    for (int i = 0; i < n; i++)
+        r[i] = a[i]*s;
+}
+
+static inline double vec3_dot(const double a[3], const double b[3])
+{
+    double acc = 0;
+    for (int i = 0; i < 3; i++)
+        acc += a[i]*b[i];
+    return acc;
+}
+
+static inline double vec3_mag(const double a[3])
+{
+    return sqrt(vec3_dot(a, a));
+}
+
+static inline void vec3_cross(const double a[3], const double b[3], double r[3])
+{
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+// r = a b'
+static inline void vec3_outer(const double a[3], const double b[3], double r[9])
+{
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            r[3*i + j] = a[i]*b[j];
+}
+
+// r = A b
+static inline void mat33_mul_vec(const double A[9], const double b[3], double r[3])
+{
+    for (int i = 0; i < 3; i++) {
+        double acc = 0;
+        for (int k = 0; k < 3; k++)
+            acc += A[3*i + k]*b[k];
+        r[i] = acc;
+    }
+}
+
+// r = A' b
+static inline void mat33_mul_at_vec(const double A[9], const double b[3], double r[3])
+{
+    for (int i = 0; i < 3; i++) {
+        double acc = 0;
+        for (int k = 0; k < 3; k++)
+            acc += A[3*k + i]*b[k];
+        r[i] = acc;
+    }
+}
+
+// R = A B
+static inline void mat33_mul(const double A[9], const double B[9], double R[9])
+{
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double acc = 0;
+            for (int k = 0; k < 3; k++)
+                acc += A[3*i + k]*B[3*k + j];
+            R[3*i + j] = acc;
+        }
+    }
+}
+
+// R = A' B
+static inline void mat33_mul_at(const double A[9], const double B[9], double R[9])
+{
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double acc = 0;
+            for (int k = 0; k < 3; k++)
+                acc += A[3*k + i]*B[3*k + j];
+            R[3*i + j] = acc;
+        }
+    }
+}
+
+// R = A B'
+static inline void mat33_mul_bt(const double A[9], const double B[9], double R[9])
+{
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double acc = 0;
+            for (int k = 0; k < 3; k++)
+                acc += A[3*i + k]*B[3*j + k];
+            R[3*i + j] = acc;
+        }
+    }
+}
+
+/**
+ * Projection operator F = v v' / (v' v) of an image point, as calculate_F(),
+ * into a 3x3 row-major array.
+ */
+static void calculate_F3(const double v[3], double F[9])
+{
+    double inv_inner = 1.0/vec3_dot(v, v);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            F[3*i + j] = (v[i]*v[j])*inv_inner;
+        }
+    }
+}
+
+/**
+ * Inverse of a 3x3 row-major array, as matd_inverse().
+ */
+static void inverse33(const double A[9], double A_inv[9])
+{
+    matd_t a = { 3, 3, (double*) A };
+    matd_t* inv = matd_inverse(&a);
+    memcpy(A_inv, inv->data, 9*sizeof(double));
+    matd_destroy(inv);
+}
+
+/**
+ * Per point terms of orthogonal_iteration(), fixed-size and on the stack
+ * (up to 4 points) so the iteration does not allocate.
+ */
+struct oi_point {
+    double p[3];     // object point
+    double p_res[3]; // p - mean(p)
+    double F[9];     // projection operator of the image point
+    double FmI[9];   // F - I
+};
+
 /**
  * @param v Image points on the image plane.
  * @param p Object points in object space.
- * @outparam t Optimal translation.
+ * @outparam t Optimal translation, written into the 3x1 *t.
  * @param R In/Outparam. Should be set to initial guess at R. Will be modified to be the optimal translation.
  * @param n_points Number of points.
  * @param n_steps Number of iterations.
  *
  * @return Object-space error after iteration.
  *
- * Implementation of Orthogonal Iteration from Lu, 2000.
+ * Implementation of Orthogonal Iteration from Lu, 2000. The expressions
+ * are those the matd_op() strings in the comments evaluate, in the same
+ * order, on 3x1 and 3x3 stack arrays.
  */
 double orthogonal_iteration(matd_t** v, matd_t** p, matd_t** t, matd_t** R, int n_points, int n_steps) {
-    matd_t* p_mean = matd_create(3, 1);
+    struct oi_point pts_stack[4];
+    struct oi_point* pts = n_points <= 4 ? pts_stack : malloc(sizeof(struct oi_point)*n_points);
+
+    double p_mean[3] = { 0, 0, 0 };
     for (int i = 0; i < n_points; i++) {
-        matd_add_inplace(p_mean, p[i]);
+        memcpy(pts[i].p, p[i]->data, sizeof(pts[i].p));
+        vecn_add(p_mean, pts[i].p, 3, p_mean);
     }
-    matd_scale_inplace(p_mean, 1.0/n_points);
+    vecn_scale(1.0/n_points, p_mean, 3, p_mean);
 
-    matd_t** p_res = malloc(sizeof(matd_t *)*n_points);
     for (int i = 0; i < n_points; i++) {
-        p_res[i] = matd_op("M-M", p[i], p_mean);
+        // "M-M"
+        vecn_subtract(pts[i].p, p_mean, 3, pts[i].p_res);
     }
 
     // Compute M1_inv.
-    matd_t** F = malloc(sizeof(matd_t *)*n_points);
-    matd_t *avg_F = matd_create(3, 3);
+    static const double I3[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    double avg_F[9] = { 0 };
     for (int i = 0; i < n_points; i++) {
-        F[i] = calculate_F(v[i]);
-        matd_add_inplace(avg_F, F[i]);
+        calculate_F3(v[i]->data, pts[i].F);
+        vecn_subtract(pts[i].F, I3, 9, pts[i].FmI);
+        vecn_add(avg_F, pts[i].F, 9, avg_F);
     }
-    matd_scale_inplace(avg_F, 1.0/n_points);
-    matd_t *I3 = matd_identity(3);
-    matd_t *M1 = matd_subtract(I3, avg_F);
-    matd_t *M1_inv = matd_inverse(M1);
-    matd_destroy(avg_F);
-    matd_destroy(M1);
+    vecn_scale(1.0/n_points, avg_F, 9, avg_F);
+    double M1[9], M1_inv[9];
+    vecn_subtract(I3, avg_F, 9, M1);
+    inverse33(M1, M1_inv);
+
+    double* Rd = (*R)->data;
+    double* td = (*t)->data;
+    double tmp33[9], tmp3[3];
 
     double prev_error = HUGE_VAL;
     // Iterate.
     for (int i = 0; i < n_steps; i++) {
         // Calculate translation.
-        matd_t *M2 = matd_create(3, 1);
+        double M2[3] = { 0, 0, 0 };
         for (int j = 0; j < n_points; j++) {
-            matd_t* M2_update = matd_op("(M - M)*M*M", F[j], I3, *R, p[j]);
-            matd_add_inplace(M2, M2_update);
-            matd_destroy(M2_update);
+            // "(M - M)*M*M": F - I, R, p. matd_op() applies an explicit
+            // '*' to the whole term on its right: (F - I)(R p).
+            double Rp[3];
+            mat33_mul_vec(Rd, pts[j].p, Rp);
+            mat33_mul_vec(pts[j].FmI, Rp, tmp3);
+            vecn_add(M2, tmp3, 3, M2);
         }
-        matd_scale_inplace(M2, 1.0/n_points);
-        matd_destroy(*t);
-        *t = matd_multiply(M1_inv, M2);
-        matd_destroy(M2);
+        vecn_scale(1.0/n_points, M2, 3, M2);
+        mat33_mul_vec(M1_inv, M2, td);
 
         // Calculate rotation.
-        matd_t** q = malloc(sizeof(matd_t *)*n_points);
-        matd_t* q_mean = matd_create(3, 1);
+        double q[4][3];
+        double (*qs)[3] = n_points <= 4 ? q : malloc(sizeof(double[3])*n_points);
+        double q_mean[3] = { 0, 0, 0 };
         for (int j = 0; j < n_points; j++) {
-            q[j] = matd_op("M*(M*M+M)", F[j], *R, p[j], *t);
-            matd_add_inplace(q_mean, q[j]);
+            // "M*(M*M+M)": F, R, p, t
+            mat33_mul_vec(Rd, pts[j].p, tmp3);
+            vecn_add(tmp3, td, 3, tmp3);
+            mat33_mul_vec(pts[j].F, tmp3, qs[j]);
+            vecn_add(q_mean, qs[j], 3, q_mean);
         }
-        matd_scale_inplace(q_mean, 1.0/n_points);
+        vecn_scale(1.0/n_points, q_mean, 3, q_mean);
 
-        matd_t* M3 = matd_create(3, 3);
+        double M3[9] = { 0 };
         for (int j = 0; j < n_points; j++) {
-            matd_t *M3_update = matd_op("(M-M)*M'", q[j], q_mean, p_res[j]);
-            matd_add_inplace(M3, M3_update);
-            matd_destroy(M3_update);
+            // "(M-M)*M'": q, q_mean, p_res
+            vecn_subtract(qs[j], q_mean, 3, tmp3);
+            vec3_outer(tmp3, pts[j].p_res, tmp33);
+            vecn_add(M3, tmp33, 9, M3);
+        }
+        if (qs != q) {
+            free(qs);
         }
-        matd_svd_t M3_svd = matd_svd(M3);
-        matd_destroy(M3);
-        matd_destroy(*R);
-        *R = matd_op("M*M'", M3_svd.U, M3_svd.V);
+
+        matd_t M3_m = { 3, 3, M3 };
+        matd_svd_t M3_svd = matd_svd(&M3_m);
+        // "M*M'": U, V
+        mat33_mul_bt(M3_svd.U->data, M3_svd.V->data, Rd);
         double R_det = matd_det(*R);
         if (R_det < 0) {
-            matd_put(*R, 0, 2, - matd_get(*R, 0, 2));
-            matd_put(*R, 1, 2, - matd_get(*R, 1, 2));
-            matd_put(*R, 2, 2, - matd_get(*R, 2, 2));
+            Rd[2] = -Rd[2];
+            Rd[5] = -Rd[5];
+            Rd[8] = -Rd[8];
         }
         matd_destroy(M3_svd.U);
         matd_destroy(M3_svd.S);
         matd_destroy(M3_svd.V);
-        matd_destroy(q_mean);
-        for (int j = 0; j < n_points; j++) {
-            matd_destroy(q[j]);
-        }
 
         double error = 0;
         for (int j = 0; j < 4; j++) {
-            matd_t* err_vec = matd_op("(M-M)(MM+M)", I3, F[j], *R, p[j], *t);
-            error += matd_to_double(matd_op("M'M", err_vec, err_vec));
-            matd_destroy(err_vec);
+            // "(M-M)(MM+M)": I - F, R, p, t; then "M'M". I - F is -(F - I),
+            // which rounds the same.
+            double err_vec[3];
+            mat33_mul_vec(Rd, pts[j].p, tmp3);
+            vecn_add(tmp3, td, 3, tmp3);
+            mat33_mul_vec(pts[j].FmI, tmp3, err_vec);
+            error += vec3_dot(err_vec, err_vec);
         }
         prev_error = error;
-
-        free(q);
     }
 
-    matd_destroy(I3);
-    matd_destroy(M1_inv);
-    for (int i = 0; i < n_points; i++) {
-        matd_destroy(p_res[i]);
-        matd_destroy(F[i]);
+    if (pts != pts_stack) {
+        free(pts);
     }
-    free(p_res);
-    free(F);
-    matd_destroy(p_mean);
     return prev_error;
 }
 
@@ -255,102 +415,126 @@ void solve_poly_approx(double* p, int degree, double* roots, int* n_roots) {
 
 /**
  * Given a local minima of the pose error tries to find the other minima.
+ * As orthogonal_iteration(), on stack arrays, evaluating the matd_op()
+ * strings in the comments in the same order.
  */
 matd_t* fix_pose_ambiguities(matd_t** v, matd_t** p, matd_t* t, matd_t* R, int n_points) {
-    matd_t* I3 = matd_identity(3);
-
-    // 1. Find R_t
-    matd_t* R_t_3 = matd_vec_normalize(t);
+    static const double I3[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    double tmp33[9], tmp33b[9], tmp3[3];
 
-    matd_t* e_x = matd_create(3, 1);
-    MATD_EL(e_x, 0, 0) = 1;
-    matd_t* R_t_1_tmp = matd_op("M-(M'*M)*M", e_x, e_x, R_t_3, R_t_3);
-    matd_t* R_t_1 = matd_vec_normalize(R_t_1_tmp);
-    matd_destroy(e_x);
-    matd_destroy(R_t_1_tmp);
+    // 1. Find R_t: its rows are R_t_1, R_t_2 and R_t_3.
+    double R_t[9];
+    double* R_t_1 = &R_t[0];
+    double* R_t_2 = &R_t[3];
+    double* R_t_3 = &R_t[6];
+    // matd_vec_normalize() divides by the magnitude.
+    double mag = vec3_mag(t->data);
+    for (int i = 0; i < 3; i++) {
+        R_t_3[i] = t->data[i]/mag;
+    }
 
-    matd_t* R_t_2 = matd_crossproduct(R_t_3, R_t_1);
+    // "M-(M'*M)*M": e_x, e_x, R_t_3, R_t_3
+    static const double e_x[3] = { 1, 0, 0 };
+    double R_t_1_tmp[3];
+    vecn_scale(vec3_dot(e_x, R_t_3), R_t_3, 3, tmp3);
+    vecn_subtract(e_x, tmp3, 3, R_t_1_tmp);
+    mag = vec3_mag(R_t_1_tmp);
+    for (int i = 0; i < 3; i++) {
+        R_t_1[i] = R_t_1_tmp[i]/mag;
+    }
 
-    matd_t* R_t = matd_create_data(3, 3, (double[]) {
-            MATD_EL(R_t_1, 0, 0), MATD_EL(R_t_1, 0, 1), MATD_EL(R_t_1, 0, 2),
-            MATD_EL(R_t_2, 0, 0), MATD_EL(R_t_2, 0, 1), MATD_EL(R_t_2, 0, 2),
-            MATD_EL(R_t_3, 0, 0), MATD_EL(R_t_3, 0, 1), MATD_EL(R_t_3, 0, 2)});
-    matd_destroy(R_t_1);
-    matd_destroy(R_t_2);
-    matd_destroy(R_t_3);
+    vec3_cross(R_t_3, R_t_1, R_t_2);
 
     // 2. Find R_z
-    matd_t* R_1_prime = matd_multiply(R_t, R);
-    double r31 = MATD_EL(R_1_prime, 2, 0);
-    double r32 = MATD_EL(R_1_prime, 2, 1);
+    double R_1_prime[9];
+    mat33_mul(R_t, R->data, R_1_prime);
+    double r31 = R_1_prime[6];
+    double r32 = R_1_prime[7];
     double hypotenuse = sqrt(r31*r31 + r32*r32);
     if (hypotenuse < 1e-100) {
         r31 = 1;
         r32 = 0;
         hypotenuse = 1;
     }
-    matd_t* R_z = matd_create_data(3, 3, (double[]) {
+    double R_z[9] = {
             r31/hypotenuse, -r32/hypotenuse, 0,
             r32/hypotenuse, r31/hypotenuse, 0,
-            0, 0, 1});
+            0, 0, 1};
 
     // 3. Calculate parameters of Eos
-    matd_t* R_trans = matd_multiply(R_1_prime, R_z);
-    double sin_gamma = -MATD_EL(R_trans, 0, 1);
-    double cos_gamma = MATD_EL(R_trans, 1, 1);
-    matd_t* R_gamma = matd_create_data(3, 3, (double[]) {
+    double R_trans[9];
+    mat33_mul(R_1_prime, R_z, R_trans);
+    double sin_gamma = -R_trans[1];
+    double cos_gamma = R_trans[4];
+    double R_gamma[9] = {
             cos_gamma, -sin_gamma, 0,
             sin_gamma, cos_gamma, 0,
-            0, 0, 1});
+            0, 0, 1};
 
-    double sin_beta = -MATD_EL(R_trans, 2, 0);
-    double cos_beta = MATD_EL(R_trans, 2, 2);
+    double sin_beta = -R_trans[6];
+    double cos_beta = R_trans[8];
     double t_initial = atan2(sin_beta, cos_beta);
-    matd_destroy(R_trans);
 
-    matd_t** v_trans = malloc(sizeof(matd_t *)*n_points);
-    matd_t** p_trans = malloc(sizeof(matd_t *)*n_points);
-    matd_t** F_trans = malloc(sizeof(matd_t *)*n_points);
-    matd_t* avg_F_trans = matd_create(3, 3);
+    struct fpa_point {
+        double p_trans[3];
+        double F_trans[9];
+        double FmI[9]; // F_trans - I
+    } pts_stack[4];
+    struct fpa_point* pts = n_points <= 4 ? pts_stack : malloc(sizeof(struct fpa_point)*n_points);
+
+    double avg_F_trans[9] = { 0 };
     for (int i = 0; i < n_points; i++) {
-        p_trans[i] = matd_op("M'*M", R_z, p[i]);
-        v_trans[i] = matd_op("M*M", R_t, v[i]);
-        F_trans[i] = calculate_F(v_trans[i]);
-        matd_add_inplace(avg_F_trans, F_trans[i]);
+        double v_trans[3];
+        // "M'*M": R_z, p; "M*M": R_t, v
+        mat33_mul_at_vec(R_z, p[i]->data, pts[i].p_trans);
+        mat33_mul_vec(R_t, v[i]->data, v_trans);
+        calculate_F3(v_trans, pts[i].F_trans);
+        vecn_subtract(pts[i].F_trans, I3, 9, pts[i].FmI);
+        vecn_add(avg_F_trans, pts[i].F_trans, 9, avg_F_trans);
     }
-    matd_scale_inplace(avg_F_trans, 1.0/n_points);
+    vecn_scale(1.0/n_points, avg_F_trans, 9, avg_F_trans);
 
-    matd_t* G = matd_op("(M-M)^-1", I3, avg_F_trans);
-    matd_scale_inplace(G, 1.0/n_points);
+    // "(M-M)^-1": I3, avg_F_trans
+    double G[9];
+    vecn_subtract(I3, avg_F_trans, 9, tmp33);
+    inverse33(tmp33, G);
+    vecn_scale(1.0/n_points, G, 9, G);
 
-    matd_t* M1 = matd_create_data(3, 3, (double[]) {
+    static const double M1[9] = {
             0, 0, 2,
             0, 0, 0,
-            -2, 0, 0});
-    matd_t* M2 = matd_create_data(3, 3, (double[]) {
+            -2, 0, 0};
+    static const double M2[9] = {
             -1, 0, 0,
             0, 1, 0,
-            0, 0, -1});
+            0, 0, -1};
 
-    matd_t* b0 = matd_create(3, 1);
-    matd_t* b1 = matd_create(3, 1);
-    matd_t* b2 = matd_create(3, 1);
+    // (F - I) R_gamma, (F - I) R_gamma M1 and (F - I) R_gamma M2 of each
+    // point, the left-hand products of "(M-M)MM" and "(M-M)MMM".
+    double b0[3] = { 0, 0, 0 };
+    double b1[3] = { 0, 0, 0 };
+    double b2[3] = { 0, 0, 0 };
     for (int i = 0; i < n_points; i++) {
-        matd_t* op_tmp1 = matd_op("(M-M)MM", F_trans[i], I3, R_gamma, p_trans[i]);
-        matd_t* op_tmp2 = matd_op("(M-M)MMM", F_trans[i], I3, R_gamma, M1, p_trans[i]);
-        matd_t* op_tmp3 = matd_op("(M-M)MMM", F_trans[i], I3, R_gamma, M2, p_trans[i]);
+        mat33_mul(pts[i].FmI, R_gamma, tmp33);
+        mat33_mul_vec(tmp33, pts[i].p_trans, tmp3);
+        vecn_add(b0, tmp3, 3, b0);
 
-        matd_add_inplace(b0, op_tmp1);
-        matd_add_inplace(b1, op_tmp2);
-        matd_add_inplace(b2, op_tmp3);
+        mat33_mul(tmp33, M1, tmp33b);
+        mat33_mul_vec(tmp33b, pts[i].p_trans, tmp3);
+        vecn_add(b1, tmp3, 3, b1);
 
-        matd_destroy(op_tmp1);
-        matd_destroy(op_tmp2);
-        matd_destroy(op_tmp3);
+        mat33_mul(tmp33, M2, tmp33b);
+        mat33_mul_vec(tmp33b, pts[i].p_trans, tmp3);
+        vecn_add(b2, tmp3, 3, b2);
     }
-    matd_t* b0_ = matd_multiply(G, b0);
-    matd_t* b1_ = matd_multiply(G, b1);
-    matd_t* b2_ = matd_multiply(G, b2);
+    double b0_[3], b1_[3], b2_[3];
+    mat33_mul_vec(G, b0, b0_);
+    mat33_mul_vec(G, b1, b1_);
+    mat33_mul_vec(G, b2, b2_);
+
+    double R_gamma_M1[9], R_gamma_M2[9];
+    mat33_mul(R_gamma, M1, R_gamma_M1);
+    mat33_mul(R_gamma, M2, R_gamma_M2);
 
     double a0 = 0;
     double a1 = 0;
@@ -358,39 +542,32 @@ matd_t* fix_pose_ambiguities(matd_t** v, matd_t** p, matd_t* t, matd_t* R, int n
     double a3 = 0;
     double a4 = 0;
     for (int i = 0; i < n_points; i++) {
-        matd_t* c0 = matd_op("(M-M)(MM+M)", I3, F_trans[i], R_gamma, p_trans[i], b0_);
-        matd_t* c1 = matd_op("(M-M)(MMM+M)", I3, F_trans[i], R_gamma, M1, p_trans[i], b1_);
-        matd_t* c2 = matd_op("(M-M)(MMM+M)", I3, F_trans[i], R_gamma, M2, p_trans[i], b2_);
-
-        a0 += matd_to_double(matd_op("M'M", c0, c0));
-        a1 += matd_to_double(matd_op("2M'M", c0, c1));
-        a2 += matd_to_double(matd_op("M'M+2M'M", c1, c1, c0, c2));
-        a3 += matd_to_double(matd_op("2M'M", c1, c2));
-        a4 += matd_to_double(matd_op("M'M", c2, c2));
+        // "(M-M)(MM+M)" and "(M-M)(MMM+M)" with I - F = -(F - I); the
+        // signs cancel in the products below.
+        double c0[3], c1[3], c2[3];
+        mat33_mul_vec(R_gamma, pts[i].p_trans, tmp3);
+        vecn_add(tmp3, b0_, 3, tmp3);
+        mat33_mul_vec(pts[i].FmI, tmp3, c0);
 
-        matd_destroy(c0);
-        matd_destroy(c1);
-        matd_destroy(c2);
-    }
+        mat33_mul_vec(R_gamma_M1, pts[i].p_trans, tmp3);
+        vecn_add(tmp3, b1_, 3, tmp3);
+        mat33_mul_vec(pts[i].FmI, tmp3, c1);
 
-    matd_destroy(b0);
-    matd_destroy(b1);
-    matd_destroy(b2);
-    matd_destroy(b0_);
-    matd_destroy(b1_);
-    matd_destroy(b2_);
+        mat33_mul_vec(R_gamma_M2, pts[i].p_trans, tmp3);
+        vecn_add(tmp3, b2_, 3, tmp3);
+        mat33_mul_vec(pts[i].FmI, tmp3, c2);
 
-    for (int i = 0; i < n_points; i++) {
-        matd_destroy(p_trans[i]);
-        matd_destroy(v_trans[i]);
-        matd_destroy(F_trans[i]);
+        // "M'M", "2M'M", "M'M+2M'M", "2M'M", "M'M"
+        a0 += vec3_dot(c0, c0);
+        a1 += 2*vec3_dot(c0, c1);
+        a2 += vec3_dot(c1, c1) + 2*vec3_dot(c0, c2);
+        a3 += 2*vec3_dot(c1, c2);
+        a4 += vec3_dot(c2, c2);
     }
-    free(p_trans);
-    free(v_trans);
-    free(F_trans);
-    matd_destroy(avg_F_trans);
-    matd_destroy(G);
 
+    if (pts != pts_stack) {
+        free(pts);
+    }
 
     // 4. Solve for minima of Eos.
     double p0 = a1;
@@ -427,25 +604,19 @@ matd_t* fix_pose_ambiguities(matd_t** v, matd_t** p, matd_t* t, matd_t* R, int n
     matd_t* ret = NULL;
     if (n_minima == 1) {
         double t_cur = minima[0];
-        matd_t* R_beta = matd_copy(M2);
-        matd_scale_inplace(R_beta, t_cur);
-        matd_add_inplace(R_beta, M1);
-        matd_scale_inplace(R_beta, t_cur);
-        matd_add_inplace(R_beta, I3);
-        matd_scale_inplace(R_beta, 1/(1 + t_cur*t_cur));
-        ret = matd_op("M'MMM'", R_t, R_gamma, R_beta, R_z);
-        matd_destroy(R_beta);
+        double R_beta[9];
+        for (int i = 0; i < 9; i++) {
+            R_beta[i] = ((M2[i]*t_cur + M1[i])*t_cur + I3[i])*(1/(1 + t_cur*t_cur));
+        }
+        // "M'MMM'": R_t, R_gamma, R_beta, R_z
+        ret = matd_create(3, 3);
+        mat33_mul_at(R_t, R_gamma, tmp33);
+        mat33_mul(tmp33, R_beta, tmp33b);
+        mat33_mul_bt(tmp33b, R_z, ret->data);
     } else if (n_minima > 1)  {
         // This can happen if our prior pose estimate was not very good.
         debug_print("Error, more than one new minimum found.\n");
     }
-    matd_destroy(I3);
-    matd_destroy(M1);
-    matd_destroy(M2);
-    matd_destroy(R_t);
-    matd_destroy(R_gamma);
-    matd_destroy(R_z);
-    matd_destroy(R_1_prime);
     return ret;
 }
 
@@ -545,3 +716,369 @@ double estimate_tag_pose(apriltag_detection_info_t* info, apriltag_pose_t* pose)
         return err2;
     }
 }
+
+/**
+ * Rotation Rv that takes the z axis onto the direction of a (the
+ * transpose of the rotation of a onto the z axis).
+ */
+static void rotate_z_axis_to(const double a[3], double Rv[9])
+{
+    double n = vec3_mag(a);
+    double ax = a[0]/n, ay = a[1]/n, az = a[2]/n;
+
+    if (fabs(1 + az) < 1e-12) {
+        double flip[9] = { 1, 0, 0, 0, 1, 0, 0, 0, -1 };
+        memcpy(Rv, flip, sizeof(flip));
+        return;
+    }
+
+    double d = 1/(1 + az);
+    double Ra[9] = {
+            1 - ax*ax*d, -ax*ay*d, -ax,
+            -ax*ay*d, 1 - ay*ay*d, -ay,
+            ax, ay, 1 - (ax*ax + ay*ay)*d};
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            Rv[3*i + j] = Ra[3*j + i];
+}
+
+/**
+ * Least-squares translation of a pose with rotation R: for each object
+ * point P with image (u, v), u (r3 P + tz) = r1 P + tx and
+ * v (r3 P + tz) = r2 P + ty. Returns false if the system is singular.
+ */
+static bool pose_fast_translation(const double R[9], double P[4][3], double uv[4][2], double t[3])
+{
+    double n = 4, su = 0, sv = 0, suv2 = 0;
+    double b[3] = { 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        double u = uv[i][0], v = uv[i][1];
+        double RP[3];
+        mat33_mul_vec(R, P[i], RP);
+        double b1 = u*RP[2] - RP[0];
+        double b2 = v*RP[2] - RP[1];
+
+        su += u;
+        sv += v;
+        suv2 += u*u + v*v;
+        b[0] += b1;
+        b[1] += b2;
+        b[2] += -u*b1 - v*b2;
+    }
+
+    // A'A t = A'b, A'A = [n 0 -su; 0 n -sv; -su -sv suv2], by cofactors.
+    double det = n*(n*suv2 - sv*sv) - su*su*n;
+    if (fabs(det) < 1e-12)
+        return false;
+
+    double inv[9] = {
+            n*suv2 - sv*sv, su*sv, n*su,
+            su*sv, n*suv2 - su*su, n*sv,
+            n*su, n*sv, n*n};
+    for (int i = 0; i < 3; i++)
+        t[i] = (inv[3*i]*b[0] + inv[3*i + 1]*b[1] + inv[3*i + 2]*b[2])/det;
+    return true;
+}
+
+/**
+ * RMS distance, in pixels, between the projections of the object points
+ * and the detected corners.
+ */
+static double pose_reprojection_error(const apriltag_detection_info_t* info,
+                                      const double R[9], const double t[3], double P[4][3])
+{
+    double sum = 0;
+    for (int i = 0; i < 4; i++) {
+        double c[3];
+        mat33_mul_vec(R, P[i], c);
+        vecn_add(c, t, 3, c);
+
+        double du = info->fx*c[0]/c[2] + info->cx - info->det->p[i][0];
+        double dv = info->fy*c[1]/c[2] + info->cy - info->det->p[i][1];
+        sum += du*du + dv*dv;
+    }
+    return sqrt(sum/4);
+}
+
+/**
+ * Homography H of the tag plane, in the coordinates of the object points
+ * P, onto the normalized image points uv.
+ */
+static bool tag_homography(const apriltag_detection_info_t* info, double P[4][3], double uv[4][2], double H[9])
+{
+    double s = info->tagsize/2.0;
+
+    // the object points of estimate_tag_pose_orthogonal_iteration() and
+    // the normalized image points.
+    double P0[4][3] = { { -s, s, 0 }, { s, s, 0 }, { s, -s, 0 }, { -s, -s, 0 } };
+    memcpy(P, P0, sizeof(P0));
+    for (int i = 0; i < 4; i++) {
+        uv[i][0] = (info->det->p[i][0] - info->cx)/info->fx;
+        uv[i][1] = (info->det->p[i][1] - info->cy)/info->fy;
+    }
+
+    // Homography of the unit square (0,0), (1,0), (1,1), (0,1) onto the
+    // image points, in closed form (Heckbert, "Fundamentals of Texture
+    // Mapping and Image Warping", 1989)...
+    double dx1 = uv[1][0] - uv[2][0], dx2 = uv[3][0] - uv[2][0];
+    double dx3 = uv[0][0] - uv[1][0] + uv[2][0] - uv[3][0];
+    double dy1 = uv[1][1] - uv[2][1], dy2 = uv[3][1] - uv[2][1];
+    double dy3 = uv[0][1] - uv[1][1] + uv[2][1] - uv[3][1];
+    double den = dx1*dy2 - dx2*dy1;
+    if (fabs(den) < 1e-15)
+        return false;
+
+    double g = (dx3*dy2 - dx2*dy3)/den;
+    double h = (dx1*dy3 - dx3*dy1)/den;
+    double S[9] = {
+            uv[1][0] - uv[0][0] + g*uv[1][0], uv[3][0] - uv[0][0] + h*uv[3][0], uv[0][0],
+            uv[1][1] - uv[0][1] + g*uv[1][1], uv[3][1] - uv[0][1] + h*uv[3][1], uv[0][1],
+            g, h, 1};
+
+    // ...after the tag plane onto the unit square: P[0] to (0,0), P[1] to
+    // (1,0), P[2] to (1,1).
+    double A[9] = {
+            1/(2*s), 0, 0.5,
+            0, -1/(2*s), 0.5,
+            0, 0, 1};
+    mat33_mul(S, A, H);
+    return true;
+}
+
+/**
+ * The first-order (affine) projection of the tag plane at the tag's
+ * center: the rotation Rv of the z axis onto the center's view ray, and
+ * there the 2x2 Jacobian A of the projection and its largest singular
+ * value gamma, the inverse of the center's depth.
+ */
+static bool tag_center_affine(const apriltag_detection_info_t* info, double P[4][3], double uv[4][2],
+                              double Rv[9], double A[4], double* gamma)
+{
+    double H[9];
+    if (!tag_homography(info, P, uv, H))
+        return false;
+
+    // The image (p, q) of the tag's center and the Jacobian J of the
+    // homography there.
+    double p = H[2]/H[8], q = H[5]/H[8];
+    double j00 = (H[0] - H[6]*p)/H[8], j01 = (H[1] - H[7]*p)/H[8];
+    double j10 = (H[3] - H[6]*q)/H[8], j11 = (H[4] - H[7]*q)/H[8];
+
+    // Rotate the view ray of the center onto the z axis; there the two
+    // rotations follow from the largest singular value of the 2x2
+    // B^-1 J (IPPE, section 4).
+    rotate_z_axis_to((double[]) { p, q, 1 }, Rv);
+
+    double b00 = Rv[0] - p*Rv[6], b01 = Rv[1] - p*Rv[7];
+    double b10 = Rv[3] - q*Rv[6], b11 = Rv[4] - q*Rv[7];
+    double bdet = b00*b11 - b01*b10;
+    if (fabs(bdet) < 1e-15)
+        return false;
+
+    A[0] = (b11*j00 - b01*j10)/bdet;
+    A[1] = (b11*j01 - b01*j11)/bdet;
+    A[2] = (-b10*j00 + b00*j10)/bdet;
+    A[3] = (-b10*j01 + b00*j11)/bdet;
+
+    double ata00 = A[0]*A[0] + A[1]*A[1];
+    double ata01 = A[0]*A[2] + A[1]*A[3];
+    double ata11 = A[2]*A[2] + A[3]*A[3];
+    *gamma = sqrt(0.5*(ata00 + ata11 + sqrt((ata00 - ata11)*(ata00 - ata11) + 4*ata01*ata01)));
+    return *gamma > 1e-15;
+}
+
+/**
+ * Estimate the two poses of a square tag with IPPE.
+ */
+int estimate_tag_pose_fast(const apriltag_detection_info_t* info, apriltag_pose_fast_t poses[2]) {
+    double P[4][3];
+    double uv[4][2];
+    double Rv[9], A[4], gamma;
+    if (!tag_center_affine(info, P, uv, Rv, A, &gamma))
+        return 0;
+
+    double a00 = A[0], a01 = A[1], a10 = A[2], a11 = A[3];
+    double r00 = a00/gamma, r01 = a01/gamma, r10 = a10/gamma, r11 = a11/gamma;
+    double c0 = sqrt(fmax(0, 1 - r00*r00 - r10*r10));
+    double c1 = sqrt(fmax(0, 1 - r01*r01 - r11*r11));
+    if (-r00*r01 - r10*r11 < 0)
+        c1 = -c1;
+
+    for (int k = 0; k < 2; k++) {
+        // the two solutions differ in the sign of the third row of the
+        // first two columns.
+        double sign = k == 0 ? 1 : -1;
+        double col0[3] = { r00, r10, sign*c0 };
+        double col1[3] = { r01, r11, sign*c1 };
+        double col2[3];
+        vec3_cross(col0, col1, col2);
+
+        double Rt[9] = {
+                col0[0], col1[0], col2[0],
+                col0[1], col1[1], col2[1],
+                col0[2], col1[2], col2[2]};
+        mat33_mul(Rv, Rt, poses[k].R);
+
+        if (!pose_fast_translation(poses[k].R, P, uv, poses[k].t))
+            return 0;
+        poses[k].err = pose_reprojection_error(info, poses[k].R, poses[k].t, P);
+    }
+
+    if (poses[1].err < poses[0].err) {
+        apriltag_pose_fast_t tmp = poses[0];
+        poses[0] = poses[1];
+        poses[1] = tmp;
+    }
+    return 2;
+}
+
+void apriltag_pose_track_init(apriltag_pose_track_t* track) {
+    memset(track, 0, sizeof(*track));
+    track->id = -1;
+    track->n_iters = 10;
+    track->max_err_jump = 0.5;
+}
+
+void apriltag_pose_track_clear(apriltag_pose_track_t* track) {
+    if (track->R) {
+        matd_destroy(track->R);
+        matd_destroy(track->t);
+    }
+    track->R = NULL;
+    track->t = NULL;
+    track->id = -1;
+}
+
+/**
+ * Estimate tag pose from the track's last pose.
+ */
+double estimate_tag_pose_track(apriltag_detection_info_t* info, apriltag_pose_track_t* track) {
+    double s = info->tagsize/2.0;
+    double P[4][3] = { { -s, s, 0 }, { s, s, 0 }, { s, -s, 0 }, { -s, -s, 0 } };
+
+    if (track->R && track->id == info->det->id) {
+        // the points of estimate_tag_pose_orthogonal_iteration(), in stack
+        // matrices.
+        double v_data[4][3];
+        matd_t v_m[4], p_m[4];
+        matd_t* v[4];
+        matd_t* p[4];
+        for (int i = 0; i < 4; i++) {
+            v_data[i][0] = (info->det->p[i][0] - info->cx)/info->fx;
+            v_data[i][1] = (info->det->p[i][1] - info->cy)/info->fy;
+            v_data[i][2] = 1;
+            v_m[i] = (matd_t) { 3, 1, v_data[i] };
+            p_m[i] = (matd_t) { 3, 1, P[i] };
+            v[i] = &v_m[i];
+            p[i] = &p_m[i];
+        }
+
+        double err = orthogonal_iteration(v, p, &track->t, &track->R, 4, track->n_iters);
+        double reproj_err = pose_reprojection_error(info, track->R->data, track->t->data, P);
+        if (reproj_err <= track->full_err + track->max_err_jump) {
+            track->reproj_err = reproj_err;
+            track->nwarm++;
+            return err;
+        }
+    }
+
+    apriltag_pose_t pose;
+    double err = estimate_tag_pose(info, &pose);
+
+    if (track->R == NULL) {
+        track->R = matd_create(3, 3);
+        track->t = matd_create(3, 1);
+    }
+    memcpy(track->R->data, pose.R->data, 9*sizeof(double));
+    memcpy(track->t->data, pose.t->data, 3*sizeof(double));
+    matd_destroy(pose.R);
+    matd_destroy(pose.t);
+
+    track->id = info->det->id;
+    track->reproj_err = pose_reprojection_error(info, track->R->data, track->t->data, P);
+    track->full_err = track->reproj_err;
+    track->nfull++;
+    return err;
+}
+
+/**
+ * Estimate the distance of a tag from its first-order projection.
+ */
+double estimate_tag_distance(const apriltag_detection_info_t* info) {
+    double P[4][3];
+    double uv[4][2];
+    double Rv[9], A[4], gamma;
+    if (!tag_center_affine(info, P, uv, Rv, A, &gamma))
+        return 0;
+
+    // 1/gamma is the depth of the center; Rv[8] the z of its unit ray.
+    return 1/(gamma*Rv[8]);
+}
+
+void apriltag_distance_calib_init(apriltag_distance_calib_t* calib, double min_dist, double max_dist) {
+    memset(calib, 0, sizeof(*calib));
+    calib->min_dist = min_dist;
+    calib->max_dist = max_dist;
+}
+
+// position of a distance on the bins, from 0 (max_dist) to
+// APRILTAG_DISTANCE_CALIB_BINS (min_dist).
+static double distance_calib_position(const apriltag_distance_calib_t* calib, double dist) {
+    double lo = 1/calib->max_dist, hi = 1/calib->min_dist;
+    double x = (1/dist - lo)/(hi - lo)*APRILTAG_DISTANCE_CALIB_BINS;
+    return fmin(fmax(x, 0), APRILTAG_DISTANCE_CALIB_BINS);
+}
+
+void apriltag_distance_calib_add(apriltag_distance_calib_t* calib, double dist, double full_dist) {
+    if (!(dist > 0) || !(full_dist > 0))
+        return;
+
+    double err = fabs(apriltag_distance_calib_apply(calib, dist) - full_dist)/full_dist;
+    calib->nchecked++;
+    calib->err_sum += err;
+    calib->err_max = fmax(calib->err_max, err);
+
+    double x = distance_calib_position(calib, dist);
+    int b = (int) x;
+    if (b == APRILTAG_DISTANCE_CALIB_BINS)
+        b--;
+    if (calib->count[b] == 64) {
+        calib->ratio_sum[b] /= 2;
+        calib->pos_sum[b] /= 2;
+        calib->count[b] /= 2;
+    }
+    calib->ratio_sum[b] += full_dist/dist;
+    calib->pos_sum[b] += x;
+    calib->count[b]++;
+}
+
+double apriltag_distance_calib_apply(const apriltag_distance_calib_t* calib, double dist) {
+    if (!(dist > 0))
+        return dist;
+
+    // the nearest bins with samples on either side.
+    double x = distance_calib_position(calib, dist);
+    int lo = -1, hi = -1;
+    for (int b = 0; b < APRILTAG_DISTANCE_CALIB_BINS; b++) {
+        if (calib->count[b] == 0)
+            continue;
+        if (calib->pos_sum[b]/calib->count[b] <= x)
+            lo = b;
+        else if (hi < 0)
+            hi = b;
+    }
+
+    double ratio;
+    if (lo < 0 && hi < 0)
+        ratio = 1;
+    else if (lo < 0)
+        ratio = calib->ratio_sum[hi]/calib->count[hi];
+    else if (hi < 0)
+        ratio = calib->ratio_sum[lo]/calib->count[lo];
+    else {
+        double xlo = calib->pos_sum[lo]/calib->count[lo], xhi = calib->pos_sum[hi]/calib->count[hi];
+        double a = (x - xlo)/(xhi - xlo);
+        ratio = (1 - a)*calib->ratio_sum[lo]/calib->count[lo] + a*calib->ratio_sum[hi]/calib->count[hi];
+    }
+    return ratio*dist;
+}
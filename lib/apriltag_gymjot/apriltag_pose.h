@@ -27,6 +27,16 @@ typedef struct {
     matd_t* t; // Translation matrix 3x1 of doubles.
 } apriltag_pose_t;
 
+/**
+ * A pose of estimate_tag_pose_fast(), in fixed-size arrays, with the
+ * same frames as apriltag_pose_t.
+ */
+typedef struct {
+    double R[9]; // Rotation, 3x3 row-major.
+    double t[3]; // Translation.
+    double err;  // RMS reprojection error of the four corners, in pixels.
+} apriltag_pose_fast_t;
+
 /**
  * Estimate pose of the tag using the homography method described in [1].
  * @outparam pose
@@ -74,6 +84,123 @@ void estimate_tag_pose_orthogonal_iteration(
  */
 double estimate_tag_pose(apriltag_detection_info_t* info, apriltag_pose_t* pose);
 
+/**
+ * The pose of one tag over frames, for estimate_tag_pose_track().
+ */
+typedef struct {
+    int id;            // Tag id of the last pose, -1 if there is none.
+    matd_t* R;         // The last pose (3x3, 3x1), NULL before the first.
+    matd_t* t;
+    double reproj_err; // Its RMS reprojection error, in pixels.
+    double full_err;   // That of the last pose estimate_tag_pose() found.
+
+    // Orthogonal iterations from the last pose, and how much larger than
+    // full_err the reprojection error (in pixels) may get before both
+    // poses are searched again with estimate_tag_pose().
+    int n_iters;
+    double max_err_jump;
+
+    // How many calls refined the last pose, and how many searched again.
+    int nwarm, nfull;
+} apriltag_pose_track_t;
+
+/**
+ * Initialize a track with no pose, 10 iterations and a 0.5 px error jump.
+ */
+void apriltag_pose_track_init(apriltag_pose_track_t* track);
+
+/**
+ * Release the pose of a track and forget it.
+ */
+void apriltag_pose_track_clear(apriltag_pose_track_t* track);
+
+/**
+ * Estimate tag pose, starting from the track's last pose of the same tag.
+ * The pose changes little from frame to frame, so a few orthogonal
+ * iterations from it (track->n_iters) replace the homography pose, the
+ * 50 iterations and the search for the second pose of estimate_tag_pose().
+ * That full search still runs for a new tag id, and when the refined
+ * pose's reprojection error jumps (e.g. the pose flipped to the other
+ * minimum).
+ *
+ * The pose is left in track->R and track->t, which the track owns; only
+ * the first call for a track allocates.
+ *
+ * @return Object-space error of the pose.
+ */
+double estimate_tag_pose_track(apriltag_detection_info_t* info, apriltag_pose_track_t* track);
+
+/**
+ * Estimate the two poses of a square tag in closed form with IPPE [4]:
+ * the homography of the corners gives, at the tag's center, the two
+ * rotations that agree with its first-order (affine) projection, and each
+ * rotation the least-squares translation. Cheaper than estimate_tag_pose()
+ * and allocation-free, but without its iterative refinement.
+ *
+ * [4]: T. Collins and A. Bartoli, "Infinitesimal Plane-Based Pose
+ *      Estimation," International Journal of Computer Vision, vol. 109,
+ *      no. 3, pp. 252-286, Sep. 2014. doi: 10.1007/s11263-014-0725-5
+ *
+ * @outparam poses The two poses, the one with the smaller reprojection
+ *           error first.
+ * @return 2, or 0 if the corners are degenerate (poses are then unset).
+ */
+int estimate_tag_pose_fast(const apriltag_detection_info_t* info, apriltag_pose_fast_t poses[2]);
+
+/**
+ * Estimate only the distance of the tag's center from the camera, from
+ * the apparent size of the tag there: the scale of the first-order
+ * projection at the center that estimate_tag_pose_fast() starts from,
+ * which is the same for both poses. Exact for exact corners, but without
+ * building and comparing the two poses.
+ *
+ * @return Distance in the units of info->tagsize, or 0 if the corners are
+ *         degenerate.
+ */
+double estimate_tag_distance(const apriltag_detection_info_t* info);
+
+#define APRILTAG_DISTANCE_CALIB_BINS 16
+
+/**
+ * Correction of estimate_tag_distance() towards the distances of a full
+ * pose solver, by distance: each bin holds the mean ratio of full to
+ * estimated distance of the samples added to it, and their mean position.
+ * Bins are evenly spaced in 1/distance, i.e. in apparent tag size, from
+ * max_dist to min_dist.
+ * Plain data, so it can be saved once it is built.
+ */
+typedef struct {
+    double min_dist, max_dist;
+    double ratio_sum[APRILTAG_DISTANCE_CALIB_BINS];
+    double pos_sum[APRILTAG_DISTANCE_CALIB_BINS];
+    int count[APRILTAG_DISTANCE_CALIB_BINS];
+
+    // Relative error of the corrected distances against the full ones of
+    // the samples, measured as each sample is added.
+    int nchecked;
+    double err_sum, err_max;
+} apriltag_distance_calib_t;
+
+/**
+ * Initialize an empty table for distances from min_dist to max_dist;
+ * corrects nothing until samples are added.
+ */
+void apriltag_distance_calib_init(apriltag_distance_calib_t* calib, double min_dist, double max_dist);
+
+/**
+ * Add a sample: estimate_tag_distance() of a detection, and the distance
+ * of a full pose (e.g. estimate_tag_pose()) of the same detection. Once a
+ * bin has 64 samples, older ones weigh less, so the table follows slow
+ * changes.
+ */
+void apriltag_distance_calib_add(apriltag_distance_calib_t* calib, double dist, double full_dist);
+
+/**
+ * Correct a distance from estimate_tag_distance() with the table,
+ * interpolating between the mean positions of the bins that have samples.
+ */
+double apriltag_distance_calib_apply(const apriltag_distance_calib_t* calib, double dist);
+
 #ifdef __cplusplus
 }
 #endif
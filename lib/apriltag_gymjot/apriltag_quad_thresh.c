@@ -30,6 +30,7 @@ either expressed or implied, of the Regents of The University of Michigan.
 // fractional bit.
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -43,6 +44,8 @@ either expressed or implied, of the Regents of The University of Michigan.
 #include "common/zmaxheap.h"
 #include "common/postscript_utils.h"
 #include "common/math_util.h"
+#include "common/frame_arena.h"
+#include "common/thresh_kernels.h"
 
 #ifdef _WIN32
 static inline long int random(void)
@@ -55,14 +58,6 @@ static inline uint32_t u64hash_2(uint64_t x) {
     return (2654435761 * x) >> 32;
 }
 
-struct uint64_zarray_entry
-{
-    uint64_t id;
-    zarray_t *cluster;
-
-    struct uint64_zarray_entry *next;
-};
-
 struct pt
 {
     // Note: these represent 2*actual value.
@@ -72,6 +67,55 @@ struct pt
     float slope;
 };
 
+// A run of equal pixels [x0, x1) within one row of the threshold image.
+struct component_run
+{
+    uint16_t x0, x1;
+};
+
+// Connected components of the threshold image. In pixel mode 'uf' has
+// one node per pixel. In run mode (qtp.rle_components) uf is NULL and
+// the nodes are runs: the runs of row y are [row_start[y],
+// row_start[y+1]), run_label holds the representative run of each run
+// and set_size the pixel count of each set, indexed by representative.
+// Both modes partition the pixels identically.
+typedef struct components components_t;
+struct components
+{
+    int w, h;
+
+    unionfind_t *uf;
+
+    uint32_t *row_start;
+    struct component_run *runs;
+    uint32_t *run_label;
+    uint32_t *set_size;
+};
+
+// Representative of pixel (x, y). *hint is a run index in row y (start
+// with row_start[y]); lookups that move along the row are O(1).
+static inline uint32_t components_rep(components_t *cc, int x, int y, uint32_t *hint)
+{
+    if (cc->uf)
+        return unionfind_get_representative(cc->uf, y*cc->w + x);
+
+    uint32_t r = *hint;
+    while (x >= cc->runs[r].x1)
+        r++;
+    while (x < cc->runs[r].x0)
+        r--;
+    *hint = r;
+
+    return cc->run_label[r];
+}
+
+static inline uint32_t components_set_size(components_t *cc, uint32_t rep)
+{
+    if (cc->uf)
+        return unionfind_get_set_size(cc->uf, rep);
+    return cc->set_size[rep];
+}
+
 struct unionfind_task
 {
     int y0, y1;
@@ -92,9 +136,82 @@ struct quad_task
     int tag_width;
     bool normal_border;
     bool reversed_border;
+
+    // qtp.min_tag_px and max_tag_px in quad image pixels; 0 for no bound.
+    float min_tag_side, max_tag_side;
+
+    // with td->temporal_tiles: the history whose fits are reused, the
+    // summed-area table of its changed tiles, and the fits of this task's
+    // clusters (room for one per cluster) for the next frame. hist is
+    // NULL otherwise.
+    struct thresh_history *hist;
+    const uint32_t *changed_sum;
+    struct fit_entry *fits;
+    int nfits;
+    uint32_t nfits_reused;
+
+    // private scratch for fit_quad(), carved from td->arena.
+    frame_arena_t scratch;
 };
 
 
+// The threshold image packed into two bitplanes: bit x%64 of word x/64
+// of row y is set in 'black' (resp. 'white') for a pixel of value 0
+// (resp. 255). Neither is set for the low-contrast 127. A quarter of the
+// bytes of the threshold image, and boundaries are found a word at a
+// time.
+struct thresh_bits
+{
+    int w, h;
+    int words; // per row
+    uint64_t *black;
+    uint64_t *white;
+};
+
+static inline uint8_t thresh_bits_get(const struct thresh_bits *tb, int x, int y)
+{
+    int i = y*tb->words + (x >> 6);
+    uint64_t bit = 1ULL << (x & 63);
+    return (tb->black[i] & bit) ? 0 : (tb->white[i] & bit) ? 255 : 127;
+}
+
+// bits of word i of a row for columns [lo, hi].
+static inline uint64_t thresh_bits_columns(int i, int lo, int hi)
+{
+    int a = imax(lo, i*64) - i*64;
+    int b = imin(hi, i*64 + 63) - i*64;
+    if (a > b)
+        return 0;
+    return (~0ULL >> (63 - b)) & (~0ULL << a);
+}
+
+static inline int popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+// index of the lowest set bit; v must not be 0.
+static inline int ctz64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
 struct cluster_task
 {
     int y0;
@@ -102,9 +219,11 @@ struct cluster_task
     int w;
     int s;
     int nclustermap;
-    unionfind_t* uf;
+    components_t* cc;
     image_u8_t* im;
+    const struct thresh_bits *bits; // used instead of im if not NULL
     zarray_t* clusters;
+    frame_arena_t* fa;
 };
 
 struct minmax_task {
@@ -115,6 +234,16 @@ struct minmax_task {
     uint8_t *im_min;
 };
 
+struct decimate_minmax_task {
+    int ty0, ty1;
+
+    image_u8_t *im;
+    float factor;
+    image_u8_t *decim;
+    uint8_t *im_max;
+    uint8_t *im_min;
+};
+
 struct blur_task {
     int ty;
 
@@ -126,13 +255,70 @@ struct blur_task {
 };
 
 struct threshold_task {
-    int ty;
+    int ty0, ty1; // tile rows [ty0, ty1)
 
     apriltag_detector_t *td;
     image_u8_t *im;
     image_u8_t *threshim;
     uint8_t *im_max;
     uint8_t *im_min;
+
+    // for a packed threshold: the output, with threshim NULL, and 4 rows
+    // of the input's stride to threshold one tile row into.
+    struct thresh_bits *bits;
+    uint8_t *scratch;
+
+    // with td->temporal_tiles: the history to reuse and update, and how
+    // many tiles of this row it supplied. hist is NULL otherwise.
+    struct thresh_history *hist;
+    uint32_t nreused;
+};
+
+// The fit_quad() result for a cluster, identified by a hash of its
+// points.
+struct fit_entry
+{
+    uint64_t hash;
+    uint32_t npoints; // 0 for an empty slot
+    bool ok;
+    bool reversed_border;
+    float p[4][2];
+};
+
+// The fit_quad() settings a history's fits were computed with.
+struct fit_params
+{
+    int max_nmaxima;
+    float cos_critical_rad;
+    float max_line_fit_mse;
+    int tag_width;
+    bool normal_border, reversed_border;
+};
+
+// What threshold() last produced for td->temporal_tiles, packed (stride
+// w): the threshold image and, per full tile, the pixels and blurred
+// extrema it was computed from. A tile keeps its entry while it is
+// reused, so slow drift cannot add up past the tolerance. Then the
+// fit_quad() result of every cluster of that frame, in an open
+// addressing table.
+struct thresh_history
+{
+    int w, h;
+    int min_white_black_diff;
+    bool valid;
+
+    size_t capacity;
+    uint8_t *im;
+    uint8_t *threshim;
+    uint8_t *im_max;
+    uint8_t *im_min;
+
+    // per full tile, 1 if the last frame thresholded it again.
+    uint8_t *changed;
+
+    struct fit_params fit_params;
+    struct fit_entry *fits;
+    uint32_t fits_capacity; // a power of two; 0 for no table
 };
 
 struct remove_vertex
@@ -166,6 +352,48 @@ struct cluster_hash
     zarray_t* data;
 };
 
+// Clusters found by one do_gradient_clusters() task. An open-addressed
+// table maps each cluster id to its index in 'entries'. Points go into a
+// pool of chunks in scan order, each tagged with that index, and are
+// grouped per cluster by cluster_table_finish().
+#define CLUSTER_POOL_CHUNK 2048
+
+struct cluster_entry
+{
+    uint64_t id;
+    uint32_t npts;
+};
+
+struct cluster_slot
+{
+    uint64_t id;
+    uint32_t idx1; // index into entries + 1; 0 marks an empty slot
+};
+
+struct cluster_pool_chunk
+{
+    struct cluster_pool_chunk *next;
+    int n;
+    uint32_t idx[CLUSTER_POOL_CHUNK];
+    struct pt p[CLUSTER_POOL_CHUNK];
+};
+
+struct cluster_table
+{
+    frame_arena_t *fa;
+
+    struct cluster_slot *slots;
+    int logcap;
+
+    zarray_t *entries; // struct cluster_entry, in the arena
+
+    struct cluster_pool_chunk *head, *tail;
+
+    // consecutive points usually belong to the same cluster.
+    uint64_t last_id;
+    uint32_t last_idx;
+};
+
 
 // lfps contains *cumulative* moments for N points, with
 // index j reflecting points [0,j] (inclusive).
@@ -320,7 +548,7 @@ int err_compare_descending(const void *_a, const void *_b)
   rather than pairs of clusters.) Critically, this helps keep nearby
   edges from becoming connected.
 */
-int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_fit_pt *lfps, int indices[4])
+int quad_segment_maxima(apriltag_detector_t *td, frame_arena_t *scratch, zarray_t *cluster, struct line_fit_pt *lfps, int indices[4])
 {
     int sz = zarray_size(cluster);
 
@@ -341,7 +569,9 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
     if (ksz < 2)
         return 0;
 
-    double *errs = malloc(sizeof(double)*sz);
+    frame_arena_mark_t mark = frame_arena_mark(scratch);
+
+    double *errs = frame_arena_alloc(scratch, sizeof(double)*sz);
 
     for (int i = 0; i < sz; i++) {
         fit_line(lfps, sz, (i + sz - ksz) % sz, (i + ksz) % sz, NULL, &errs[i], NULL);
@@ -349,7 +579,8 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
 
     // apply a low-pass filter to errs
     if (1) {
-        double *y = malloc(sizeof(double)*sz);
+        frame_arena_mark_t ymark = frame_arena_mark(scratch);
+        double *y = frame_arena_alloc(scratch, sizeof(double)*sz);
 
         // how much filter to apply?
 
@@ -371,7 +602,7 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
 
         // For default values of cutoff = 0.05, sigma = 3,
         // we have fsz = 17.
-        float *f = malloc(sizeof(float)*fsz);
+        float *f = frame_arena_alloc(scratch, sizeof(float)*fsz);
 
         for (int i = 0; i < fsz; i++) {
             int j = i - fsz / 2;
@@ -388,12 +619,11 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
         }
 
         memcpy(errs, y, sizeof(double)*sz);
-        free(y);
-        free(f);
+        frame_arena_release(scratch, ymark);
     }
 
-    int *maxima = malloc(sizeof(int)*sz);
-    double *maxima_errs = malloc(sizeof(double)*sz);
+    int *maxima = frame_arena_alloc(scratch, sizeof(int)*sz);
+    double *maxima_errs = frame_arena_alloc(scratch, sizeof(double)*sz);
     int nmaxima = 0;
 
     for (int i = 0; i < sz; i++) {
@@ -403,12 +633,10 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
             nmaxima++;
         }
     }
-    free(errs);
 
     // if we didn't get at least 4 maxima, we can't fit a quad.
     if (nmaxima < 4){
-        free(maxima);
-        free(maxima_errs);
+        frame_arena_release(scratch, mark);
         return 0;
     }
 
@@ -416,7 +644,7 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
     int max_nmaxima = td->qtp.max_nmaxima;
 
     if (nmaxima > max_nmaxima) {
-        double *maxima_errs_copy = malloc(sizeof(double)*nmaxima);
+        double *maxima_errs_copy = frame_arena_alloc(scratch, sizeof(double)*nmaxima);
         memcpy(maxima_errs_copy, maxima_errs, sizeof(double)*nmaxima);
 
         // throw out all but the best handful of maxima. Sorts descending.
@@ -430,9 +658,7 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
             maxima[out++] = maxima[in];
         }
         nmaxima = out;
-        free(maxima_errs_copy);
     }
-    free(maxima_errs);
 
     int best_indices[4];
     double best_error = HUGE_VALF;
@@ -490,7 +716,7 @@ int quad_segment_maxima(apriltag_detector_t *td, zarray_t *cluster, struct line_
         }
     }
 
-    free(maxima);
+    frame_arena_release(scratch, mark);
 
     if (best_error == HUGE_VALF)
         return 0;
@@ -618,8 +844,9 @@ int quad_segment_agg(zarray_t *cluster, struct line_fit_pt *lfps, int indices[4]
  * Compute statistics that allow line fit queries to be
  * efficiently computed for any contiguous range of indices.
  */
-struct line_fit_pt* compute_lfps(int sz, zarray_t* cluster, image_u8_t* im) {
-    struct line_fit_pt *lfps = calloc(sz, sizeof(struct line_fit_pt));
+struct line_fit_pt* compute_lfps(frame_arena_t *scratch, int sz, zarray_t* cluster, image_u8_t* im) {
+    struct line_fit_pt *lfps = frame_arena_alloc(scratch, sz * sizeof(struct line_fit_pt));
+    memset(&lfps[0], 0, sizeof(struct line_fit_pt));
 
     for (int i = 0; i < sz; i++) {
         struct pt *p;
@@ -660,7 +887,9 @@ struct line_fit_pt* compute_lfps(int sz, zarray_t* cluster, image_u8_t* im) {
     return lfps;
 }
 
-static inline void ptsort(struct pt *pts, int sz)
+// 'scratch' must be able to hold 2*sz points (merge buffers along the
+// recursion path); each level releases its buffer before returning.
+static inline void ptsort(frame_arena_t *scratch, struct pt *pts, int sz)
 {
 #define MAYBE_SWAP(arr,apos,bpos)                                   \
     if (pt_compare_angle(&(arr[apos]), &(arr[bpos])) > 0) {                        \
@@ -715,7 +944,8 @@ static inline void ptsort(struct pt *pts, int sz)
 
     // a merge sort with temp storage.
 
-    struct pt *tmp = malloc(sizeof(struct pt) * sz);
+    frame_arena_mark_t mark = frame_arena_mark(scratch);
+    struct pt *tmp = frame_arena_alloc(scratch, sizeof(struct pt) * sz);
 
     memcpy(tmp, pts, sizeof(struct pt) * sz);
 
@@ -725,8 +955,8 @@ static inline void ptsort(struct pt *pts, int sz)
     struct pt *as = &tmp[0];
     struct pt *bs = &tmp[asz];
 
-    ptsort(as, asz);
-    ptsort(bs, bsz);
+    ptsort(scratch, as, asz);
+    ptsort(scratch, bs, bsz);
 
     #define MERGE(apos,bpos)                        \
     if (pt_compare_angle(&(as[apos]), &(bs[bpos])) < 0)        \
@@ -749,7 +979,7 @@ static inline void ptsort(struct pt *pts, int sz)
     if (bpos < bsz)
         memcpy(&pts[outpos], &bs[bpos], (bsz-bpos)*sizeof(struct pt));
 
-    free(tmp);
+    frame_arena_release(scratch, mark);
 
 #undef MERGE
 }
@@ -757,6 +987,7 @@ static inline void ptsort(struct pt *pts, int sz)
 // return 1 if the quad looks okay, 0 if it should be discarded
 int fit_quad(
         apriltag_detector_t *td,
+        frame_arena_t *scratch,
         image_u8_t *im,
         zarray_t *cluster,
         struct quad *quad,
@@ -850,14 +1081,15 @@ int fit_quad(
     // we now sort the points according to theta. This is a prepatory
     // step for segmenting them into four lines.
     if (1) {
-        ptsort((struct pt*) cluster->data, zarray_size(cluster));
+        ptsort(scratch, (struct pt*) cluster->data, zarray_size(cluster));
     }
 
-    struct line_fit_pt *lfps = compute_lfps(sz, cluster, im);
+    frame_arena_mark_t mark = frame_arena_mark(scratch);
+    struct line_fit_pt *lfps = compute_lfps(scratch, sz, cluster, im);
 
     int indices[4];
     if (1) {
-        if (!quad_segment_maxima(td, cluster, lfps, indices))
+        if (!quad_segment_maxima(td, scratch, cluster, lfps, indices))
             goto finish;
     } else {
         if (!quad_segment_agg(cluster, lfps, indices))
@@ -974,7 +1206,7 @@ int fit_quad(
 
   finish:
 
-    free(lfps);
+    frame_arena_release(scratch, mark);
 
     return res;
 }
@@ -1046,6 +1278,188 @@ static void do_unionfind_task2(void *p)
     }
 }
 
+// A cluster holds 2.5 to 17 points per pixel of the longest edge of the
+// quad fitted to it (over the test images); these bounds leave a margin.
+#define CLUSTER_MIN_POINTS_PER_SIDE 2
+#define CLUSTER_MAX_POINTS_PER_SIDE 24
+
+// Clusters whose bounding box is at most this many pixels of the
+// decimated image are candidates for the full-resolution level of a
+// pyramid search: below it tags are found unreliably. Boxes that are
+// smaller, or longer than wide by more than the ratio, are not tags.
+#define PYRAMID_CANDIDATE_MIN_SIDE 3
+#define PYRAMID_CANDIDATE_MAX_SIDE 12
+#define PYRAMID_CANDIDATE_MAX_ASPECT 2
+
+static void pyramid_candidate_add(apriltag_detector_t *td, zarray_t *cluster)
+{
+    struct pt *p;
+    zarray_get_volatile(cluster, 0, &p);
+    int xmin = p->x, xmax = p->x, ymin = p->y, ymax = p->y;
+    for (int i = 1; i < zarray_size(cluster); i++) {
+        zarray_get_volatile(cluster, i, &p);
+        xmin = imin(xmin, p->x);
+        xmax = imax(xmax, p->x);
+        ymin = imin(ymin, p->y);
+        ymax = imax(ymax, p->y);
+    }
+
+    // struct pt holds twice the coordinates.
+    int box[4] = { xmin / 2, ymin / 2, (xmax + 1) / 2, (ymax + 1) / 2 };
+    int bw = box[2] - box[0], bh = box[3] - box[1];
+    if (imin(bw, bh) < PYRAMID_CANDIDATE_MIN_SIDE || imax(bw, bh) > PYRAMID_CANDIDATE_MAX_SIDE ||
+        imax(bw, bh) > PYRAMID_CANDIDATE_MAX_ASPECT * imin(bw, bh))
+        return;
+
+    pthread_mutex_lock(&td->mutex);
+    frame_arena_zarray_add(td->arena, td->pyramid_candidates, box);
+    pthread_mutex_unlock(&td->mutex);
+}
+
+static bool quad_side_in_range(const struct quad *quad, float min_side, float max_side)
+{
+    float side2 = 0;
+    for (int i = 0; i < 4; i++) {
+        int j = (i + 1) & 3;
+        side2 = fmaxf(side2, fsq(quad->p[j][0] - quad->p[i][0]) + fsq(quad->p[j][1] - quad->p[i][1]));
+    }
+
+    return side2 >= fsq(min_side) && (max_side == 0 || side2 <= fsq(max_side));
+}
+
+// Hash of a cluster's points, in their order, and their bounding box
+// (x0, y0, x1, y1) in struct pt coordinates.
+static uint64_t cluster_signature(zarray_t *cluster, int box[4])
+{
+    uint64_t hash = 14695981039346656037ULL;
+    box[0] = box[1] = INT32_MAX;
+    box[2] = box[3] = 0;
+
+    for (int i = 0; i < zarray_size(cluster); i++) {
+        struct pt *p;
+        zarray_get_volatile(cluster, i, &p);
+
+        uint64_t v = (uint64_t) p->x | (uint64_t) p->y << 16 |
+            (uint64_t) (uint16_t) p->gx << 32 | (uint64_t) (uint16_t) p->gy << 48;
+        hash = (hash ^ v) * 1099511628211ULL;
+
+        box[0] = imin(box[0], p->x);
+        box[1] = imin(box[1], p->y);
+        box[2] = imax(box[2], p->x);
+        box[3] = imax(box[3], p->y);
+    }
+
+    return hash;
+}
+
+// Whether the pixels fit_quad() reads for a cluster with bounding box
+// 'box' (the points, and their neighbours for the gradient weights) are
+// all in full tiles that the threshold reused.
+static bool cluster_box_unchanged(const struct thresh_history *hist, const uint32_t *changed_sum,
+                                  const int box[4])
+{
+    const int tilesz = 4;
+    int tw = hist->w / tilesz, th = hist->h / tilesz;
+
+    int x0 = imax(0, (box[0] + 1) / 2 - 1), y0 = imax(0, (box[1] + 1) / 2 - 1);
+    int x1 = (box[2] + 1) / 2 + 1, y1 = (box[3] + 1) / 2 + 1;
+    if (x1 >= tw*tilesz || y1 >= th*tilesz)
+        return false;
+
+    int tx0 = x0 / tilesz, ty0 = y0 / tilesz;
+    int tx1 = x1 / tilesz + 1, ty1 = y1 / tilesz + 1;
+
+    return changed_sum[ty1*(tw+1) + tx1] - changed_sum[ty0*(tw+1) + tx1] -
+        changed_sum[ty1*(tw+1) + tx0] + changed_sum[ty0*(tw+1) + tx0] == 0;
+}
+
+static struct fit_entry *fit_lookup(const struct thresh_history *hist, uint64_t hash, uint32_t npoints)
+{
+    if (hist->fits_capacity == 0)
+        return NULL;
+
+    uint32_t mask = hist->fits_capacity - 1;
+    for (uint32_t i = (uint32_t) (hash >> 32) & mask; ; i = (i + 1) & mask) {
+        struct fit_entry *e = &hist->fits[i];
+        if (e->npoints == 0)
+            return NULL;
+        if (e->hash == hash && e->npoints == npoints)
+            return e;
+    }
+}
+
+// fit_quad() through td->thresh_history: a cluster with the same points
+// as one of the last frame, over tiles the threshold reused, gets that
+// cluster's result without fitting. Every result is recorded for the
+// next frame.
+static int fit_quad_temporal(struct quad_task *task, zarray_t *cluster, struct quad *quad)
+{
+    int box[4];
+    uint64_t hash = cluster_signature(cluster, box);
+    uint32_t npoints = zarray_size(cluster);
+
+    struct fit_entry *prev = NULL;
+    if (cluster_box_unchanged(task->hist, task->changed_sum, box))
+        prev = fit_lookup(task->hist, hash, npoints);
+
+    int res;
+    if (prev) {
+        res = prev->ok;
+        memcpy(quad->p, prev->p, sizeof(quad->p));
+        quad->reversed_border = prev->reversed_border;
+        task->nfits_reused++;
+    } else {
+        res = fit_quad(task->td, &task->scratch, task->im, cluster, quad, task->tag_width,
+                       task->normal_border, task->reversed_border);
+    }
+
+    struct fit_entry *e = &task->fits[task->nfits++];
+    e->hash = hash;
+    e->npoints = npoints;
+    e->ok = res;
+    e->reversed_border = quad->reversed_border;
+    memcpy(e->p, quad->p, sizeof(e->p));
+
+    return res;
+}
+
+// Replaces the fits of hist by those of this frame's tasks.
+static bool fits_store(struct thresh_history *hist, const struct quad_task *tasks, int ntasks)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < ntasks; i++)
+        n += tasks[i].nfits;
+
+    uint32_t capacity = 64;
+    while (capacity < 2 * n)
+        capacity *= 2;
+
+    // grown only, like the rest of the history.
+    if (capacity > hist->fits_capacity) {
+        free(hist->fits);
+        hist->fits = malloc(capacity * sizeof(struct fit_entry));
+        if (hist->fits == NULL) {
+            hist->fits_capacity = 0;
+            return false;
+        }
+        hist->fits_capacity = capacity;
+    }
+    memset(hist->fits, 0, hist->fits_capacity * sizeof(struct fit_entry));
+
+    uint32_t mask = hist->fits_capacity - 1;
+    for (int i = 0; i < ntasks; i++) {
+        for (int j = 0; j < tasks[i].nfits; j++) {
+            const struct fit_entry *e = &tasks[i].fits[j];
+            uint32_t k = (uint32_t) (e->hash >> 32) & mask;
+            while (hist->fits[k].npoints != 0)
+                k = (k + 1) & mask;
+            hist->fits[k] = *e;
+        }
+    }
+
+    return true;
+}
+
 static void do_quad_task(void *p)
 {
     struct quad_task *task = (struct quad_task*) p;
@@ -1073,12 +1487,27 @@ static void do_quad_task(void *p)
             continue;
         }
 
+        if (td->pyramid_candidates)
+            pyramid_candidate_add(td, *cluster);
+
+        // too small or too large for the expected tag size.
+        if (zarray_size(*cluster) < CLUSTER_MIN_POINTS_PER_SIDE * task->min_tag_side ||
+            (task->max_tag_side > 0 && zarray_size(*cluster) > CLUSTER_MAX_POINTS_PER_SIDE * task->max_tag_side)) {
+            continue;
+        }
+
         struct quad quad;
         memset(&quad, 0, sizeof(struct quad));
 
-        if (fit_quad(td, task->im, *cluster, &quad, task->tag_width, task->normal_border, task->reversed_border)) {
+        int res;
+        if (task->hist)
+            res = fit_quad_temporal(task, *cluster, &quad);
+        else
+            res = fit_quad(td, &task->scratch, task->im, *cluster, &quad, task->tag_width, task->normal_border, task->reversed_border);
+
+        if (res && quad_side_in_range(&quad, task->min_tag_side, task->max_tag_side)) {
             pthread_mutex_lock(&td->mutex);
-            zarray_add(quads, &quad);
+            frame_arena_zarray_add(td->arena, quads, &quad);
             pthread_mutex_unlock(&td->mutex);
         }
     }
@@ -1093,24 +1522,16 @@ void do_minmax_task(void *p)
     int tw = task->im->width / tilesz;
     image_u8_t *im = task->im;
 
-    for (int tx = 0; tx < tw; tx++) {
-        uint8_t max = 0, min = 255;
-
-        for (int dy = 0; dy < tilesz; dy++) {
-
-            for (int dx = 0; dx < tilesz; dx++) {
+    thresh_tile_minmax_row(&im->buf[ty*tilesz*s], s, tw,
+                           &task->im_max[ty*tw], &task->im_min[ty*tw]);
+}
 
-                uint8_t v = im->buf[(ty*tilesz+dy)*s + tx*tilesz + dx];
-                if (v < min)
-                    min = v;
-                if (v > max)
-                    max = v;
-            }
-        }
+void do_decimate_minmax_task(void *p)
+{
+    struct decimate_minmax_task* task = (struct decimate_minmax_task*) p;
 
-        task->im_max[ty*tw+tx] = max;
-        task->im_min[ty*tw+tx] = min;
-    }
+    thresh_decimate_minmax(task->im, task->factor, task->decim, task->ty0, task->ty1,
+                           task->im_max, task->im_min);
 }
 
 void do_blur_task(void *p)
@@ -1123,91 +1544,345 @@ void do_blur_task(void *p)
     uint8_t *im_max = task->im_max;
     uint8_t *im_min = task->im_min;
 
-    for (int tx = 0; tx < tw; tx++) {
-        uint8_t max = 0, min = 255;
+    // rows outside the image are skipped.
+    const uint8_t *max_up = ty > 0 ? &im_max[(ty-1)*tw] : NULL;
+    const uint8_t *min_up = ty > 0 ? &im_min[(ty-1)*tw] : NULL;
+    const uint8_t *max_down = ty + 1 < th ? &im_max[(ty+1)*tw] : NULL;
+    const uint8_t *min_down = ty + 1 < th ? &im_min[(ty+1)*tw] : NULL;
 
-        for (int dy = -1; dy <= 1; dy++) {
-            if (ty+dy < 0 || ty+dy >= th)
-                continue;
-            for (int dx = -1; dx <= 1; dx++) {
-                if (tx+dx < 0 || tx+dx >= tw)
-                    continue;
+    thresh_tile_blur_row(max_up, &im_max[ty*tw], max_down,
+                         min_up, &im_min[ty*tw], min_down,
+                         tw, &task->im_max_tmp[ty*tw], &task->im_min_tmp[ty*tw]);
+}
 
-                uint8_t m = im_max[(ty+dy)*tw+tx+dx];
-                if (m > max)
-                    max = m;
-                m = im_min[(ty+dy)*tw+tx+dx];
-                if (m < min)
-                    min = m;
-            }
+// whether tile (tx, ty) of im and its blurred extrema are within 'tol' of
+// the ones its history entry was computed from.
+static bool tile_unchanged(const struct thresh_history *hist, const image_u8_t *im,
+                           const uint8_t *im_max, const uint8_t *im_min, int tx, int ty, int tol)
+{
+    const int tilesz = 4;
+    int tw = hist->w / tilesz;
+    int t = ty*tw + tx;
+
+    if (abs(im_max[t] - hist->im_max[t]) > tol || abs(im_min[t] - hist->im_min[t]) > tol)
+        return false;
+
+    const uint8_t *a = &im->buf[ty*tilesz*im->stride + tx*tilesz];
+    const uint8_t *b = &hist->im[ty*tilesz*hist->w + tx*tilesz];
+    if (tol == 0) {
+        for (int dy = 0; dy < tilesz; dy++) {
+            if (memcmp(&a[dy*im->stride], &b[dy*hist->w], tilesz) != 0)
+                return false;
         }
+        return true;
+    }
 
-        task->im_max_tmp[ty*tw + tx] = max;
-        task->im_min_tmp[ty*tw + tx] = min;
+    for (int dy = 0; dy < tilesz; dy++) {
+        for (int dx = 0; dx < tilesz; dx++) {
+            if (abs(a[dy*im->stride + dx] - b[dy*hist->w + dx]) > tol)
+                return false;
+        }
     }
+
+    return true;
 }
 
-void do_threshold_task(void *p)
+// Copies a tile, 4 rows of 4 pixels, between images of different strides.
+static inline void tile_copy(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride)
+{
+    for (int dy = 0; dy < 4; dy++)
+        memcpy(&dst[dy*dst_stride], &src[dy*src_stride], 4);
+}
+
+// Thresholds tiles [tx0, tx1) of tile row ty into 'threshim', the first
+// output row of the tile row, and records them and their inputs in the
+// history.
+static void threshold_tiles_record(struct threshold_task *task, int ty, uint8_t *threshim, int tx0, int tx1)
+{
+    const int tilesz = 4;
+    int tw = task->im->width / tilesz;
+    int s = task->im->stride;
+    struct thresh_history *hist = task->hist;
+    const uint8_t *im = &task->im->buf[ty*tilesz*s];
+
+    thresh_tile_threshold_row(&im[tx0*tilesz], &threshim[tx0*tilesz], s,
+                              &task->im_max[ty*tw + tx0], &task->im_min[ty*tw + tx0], tx1 - tx0,
+                              task->td->qtp.min_white_black_diff);
+
+    for (int tx = tx0; tx < tx1; tx++) {
+        tile_copy(&hist->im[ty*tilesz*hist->w + tx*tilesz], hist->w, &im[tx*tilesz], s);
+        tile_copy(&hist->threshim[ty*tilesz*hist->w + tx*tilesz], hist->w, &threshim[tx*tilesz], s);
+        hist->im_max[ty*tw + tx] = task->im_max[ty*tw + tx];
+        hist->im_min[ty*tw + tx] = task->im_min[ty*tw + tx];
+        hist->changed[ty*tw + tx] = 1;
+    }
+}
+
+// Thresholds tile row ty into 'threshim', the first of its 4 output rows
+// (with the stride of the input).
+static void threshold_tile_row(struct threshold_task *task, int ty, uint8_t *threshim)
 {
     const int tilesz = 4;
-    struct threshold_task* task = (struct threshold_task*) p;
-    int ty = task->ty;
     int tw = task->im->width / tilesz;
     int s = task->im->stride;
-    uint8_t *im_max = task->im_max;
-    uint8_t *im_min = task->im_min;
     image_u8_t *im = task->im;
-    image_u8_t *threshim = task->threshim;
-    int min_white_black_diff = task->td->qtp.min_white_black_diff;
+    struct thresh_history *hist = task->hist;
+
+    if (hist == NULL) {
+        // tiles are binarized against the midpoint of their (blurred)
+        // extrema; low-contrast tiles are marked 127. See thresh_kernels.h.
+        thresh_tile_threshold_row(&im->buf[ty*tilesz*s], threshim, s,
+                                  &task->im_max[ty*tw], &task->im_min[ty*tw], tw,
+                                  task->td->qtp.min_white_black_diff);
+        return;
+    }
 
+    // unchanged tiles are copied from the history; runs of changed ones
+    // go through the row kernel together.
+    int tol = task->td->temporal_tile_tolerance;
+    int tx0 = 0;
     for (int tx = 0; tx < tw; tx++) {
-        int min = im_min[ty*tw + tx];
-        int max = im_max[ty*tw + tx];
+        if (!hist->valid || !tile_unchanged(hist, im, task->im_max, task->im_min, tx, ty, tol))
+            continue;
 
-        // low contrast region? (no edges)
-        if (max - min < min_white_black_diff) {
-            for (int dy = 0; dy < tilesz; dy++) {
-                int y = ty*tilesz + dy;
+        if (tx0 < tx)
+            threshold_tiles_record(task, ty, threshim, tx0, tx);
+        tile_copy(&threshim[tx*tilesz], s, &hist->threshim[ty*tilesz*hist->w + tx*tilesz], hist->w);
+        hist->changed[ty*tw + tx] = 0;
+        task->nreused++;
+        tx0 = tx + 1;
+    }
 
-                for (int dx = 0; dx < tilesz; dx++) {
-                    int x = tx*tilesz + dx;
+    if (tx0 < tw)
+        threshold_tiles_record(task, ty, threshim, tx0, tw);
+}
 
-                    threshim->buf[y*s+x] = 127;
-                }
+// One bit per byte of 8 threshold pixels, pixel k in bit k: its high bit
+// for white (only 255 has it), or its inverted low bit for black (only 0
+// lacks it). A multiply gathers the 8 bits.
+static inline void thresh_bits_pack8(const uint8_t *px, uint64_t *black, uint64_t *white)
+{
+    uint64_t q = 0;
+    for (int k = 0; k < 8; k++)
+        q |= (uint64_t) px[k] << (8*k);
+
+    const uint64_t gather = 0x0002040810204081ULL;
+    *white = ((q & 0x8080808080808080ULL) * gather) >> 56;
+    *black = (((~q & 0x0101010101010101ULL) << 7) * gather) >> 56;
+}
+
+// Packs rows [y, y + n) of a threshold image, given from row y on, into
+// tb. Only columns [0, w) are read; the bits of the others are cleared.
+static void thresh_bits_pack(struct thresh_bits *tb, const uint8_t *rows, int stride, int y, int n, int w)
+{
+    for (int dy = 0; dy < n; dy++) {
+        const uint8_t *row = &rows[dy*stride];
+        uint64_t *black = &tb->black[(y + dy)*tb->words];
+        uint64_t *white = &tb->white[(y + dy)*tb->words];
+
+        for (int i = 0; i < tb->words; i++) {
+            int x0 = i*64, nx = imax(0, imin(64, w - x0));
+            uint64_t b = 0, wh = 0;
+            int k = 0;
+            for (; k + 8 <= nx; k += 8) {
+                uint64_t b8, w8;
+                thresh_bits_pack8(&row[x0 + k], &b8, &w8);
+                b |= b8 << k;
+                wh |= w8 << k;
             }
-            continue;
+            for (; k < nx; k++) {
+                b |= (uint64_t) (row[x0 + k] == 0) << k;
+                wh |= (uint64_t) (row[x0 + k] == 255) << k;
+            }
+            black[i] = b;
+            white[i] = wh;
         }
+    }
+}
 
-        // otherwise, actually threshold this tile.
-
-        // argument for biasing towards dark; specular highlights
-        // can be substantially brighter than white tag parts
-        uint8_t thresh = min + (max - min) / 2;
+void do_threshold_task(void *p)
+{
+    const int tilesz = 4;
+    struct threshold_task* task = (struct threshold_task*) p;
+    int tw = task->im->width / tilesz;
+    int s = task->im->stride;
 
-        for (int dy = 0; dy < tilesz; dy++) {
-            int y = ty*tilesz + dy;
+    for (int ty = task->ty0; ty < task->ty1; ty++) {
+        if (task->bits == NULL) {
+            threshold_tile_row(task, ty, &task->threshim->buf[ty*tilesz*s]);
+        } else {
+            threshold_tile_row(task, ty, task->scratch);
+            thresh_bits_pack(task->bits, task->scratch, s, ty*tilesz, tilesz, tw*tilesz);
+        }
+    }
+}
 
-            for (int dx = 0; dx < tilesz; dx++) {
-                int x = tx*tilesz + dx;
+// td->thresh_history for a w x h image, invalidated if it was recorded
+// for another size or contrast setting. NULL if out of memory.
+static struct thresh_history *thresh_history_get(apriltag_detector_t *td, int w, int h)
+{
+    const int tilesz = 4;
+    struct thresh_history *hist = td->thresh_history;
+    if (hist == NULL) {
+        hist = calloc(1, sizeof(struct thresh_history));
+        if (hist == NULL)
+            return NULL;
+        td->thresh_history = hist;
+    }
 
-                uint8_t v = im->buf[y*s+x];
-                if (v > thresh)
-                    threshim->buf[y*s+x] = 255;
-                else
-                    threshim->buf[y*s+x] = 0;
-            }
+    if (hist->w != w || hist->h != h || hist->min_white_black_diff != td->qtp.min_white_black_diff)
+        hist->valid = false;
+
+    // grown only, so that a detector alternating between sizes does not
+    // reallocate every frame.
+    size_t ntiles = (size_t) (w / tilesz) * (h / tilesz);
+    size_t need = 2 * (size_t) w * h + 3 * ntiles;
+    if (need > hist->capacity) {
+        free(hist->im);
+        hist->im = malloc(need);
+        if (hist->im == NULL) {
+            hist->capacity = 0;
+            hist->valid = false;
+            return NULL;
         }
+        hist->capacity = need;
+        hist->valid = false;
     }
+
+    hist->threshim = hist->im + (size_t) w * h;
+    hist->im_max = hist->threshim + (size_t) w * h;
+    hist->im_min = hist->im_max + ntiles;
+    hist->changed = hist->im_min + ntiles;
+    hist->w = w;
+    hist->h = h;
+    hist->min_white_black_diff = td->qtp.min_white_black_diff;
+
+    return hist;
+}
+
+void thresh_history_destroy(struct thresh_history *hist)
+{
+    if (hist == NULL)
+        return;
+
+    free(hist->im);
+    free(hist->fits);
+    free(hist);
 }
  
-image_u8_t *threshold(apriltag_detector_t *td, image_u8_t *im)
+// Thresholds the pixels of rows [y0, y1) that are not in a full tile
+// (the right-most columns, and whole rows below the last tile row)
+// against the blurred extrema of the nearest full tile, into threshim or,
+// if it is NULL, the cleared bits of tb.
+static void threshold_partial_tiles(image_u8_t *im, image_u8_t *threshim, struct thresh_bits *tb,
+                                    const uint8_t *im_max, const uint8_t *im_min, int y0, int y1)
+{
+    const int tilesz = 4;
+    int w = im->width, s = im->stride;
+    int tw = im->width / tilesz;
+    int th = im->height / tilesz;
+
+    for (int y = y0; y < y1; y++) {
+
+        // what is the first x coordinate we need to process in this row?
+
+        int x0;
+
+        if (y >= th*tilesz) {
+            x0 = 0; // we're at the bottom; do the whole row.
+        } else {
+            x0 = tw*tilesz; // we only need to do the right most part.
+        }
+
+        // compute tile coordinates and clamp.
+        int ty = y / tilesz;
+        if (ty >= th)
+            ty = th - 1;
+
+        for (int x = x0; x < w; x++) {
+            int tx = x / tilesz;
+            if (tx >= tw)
+                tx = tw - 1;
+
+            int max = im_max[ty*tw + tx];
+            int min = im_min[ty*tw + tx];
+            int thresh = min + (max - min) / 2;
+
+            uint8_t v = im->buf[y*s+x];
+            if (threshim)
+                threshim->buf[y*s+x] = v > thresh ? 255 : 0;
+            else if (v > thresh)
+                tb->white[y*tb->words + (x >> 6)] |= 1ULL << (x & 63);
+            else
+                tb->black[y*tb->words + (x >> 6)] |= 1ULL << (x & 63);
+        }
+    }
+}
+
+// Decimate 'im' by td->quad_decimate into an arena image and compute the
+// 4x4 tile extrema of the result in the same pass. Pass the extrema to
+// apriltag_quad_thresh_minmax() so that threshold() skips its first step.
+image_u8_t *decimate_minmax(apriltag_detector_t *td, image_u8_t *im,
+                            uint8_t **im_max, uint8_t **im_min)
+{
+    int dw, dh;
+    image_u8_decimate_size(im, td->quad_decimate, &dw, &dh);
+    image_u8_t *decim = frame_arena_image_u8_create(td->arena, dw, dh, DEFAULT_ALIGNMENT_U8);
+
+    int tw = dw / THRESH_TILESZ;
+    int th = dh / THRESH_TILESZ;
+
+    *im_max = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
+    *im_min = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
+
+    // one task per tile row; the last one also does the partial rows.
+    int ntasks = th > 0 ? th : 1;
+    struct decimate_minmax_task *tasks = frame_arena_alloc(td->arena, sizeof(struct decimate_minmax_task)*ntasks);
+    for (int i = 0; i < ntasks; i++) {
+        tasks[i].ty0 = i;
+        tasks[i].ty1 = i < th ? i + 1 : i;
+        tasks[i].im = im;
+        tasks[i].factor = td->quad_decimate;
+        tasks[i].decim = decim;
+        tasks[i].im_max = *im_max;
+        tasks[i].im_min = *im_min;
+
+        workerpool_add_task(td->wp, do_decimate_minmax_task, &tasks[i]);
+    }
+    workerpool_run(td->wp);
+
+    return decim;
+}
+
+static struct thresh_bits *thresh_bits_create(frame_arena_t *fa, int w, int h)
+{
+    struct thresh_bits *tb = frame_arena_alloc(fa, sizeof(struct thresh_bits));
+    tb->w = w;
+    tb->h = h;
+    tb->words = (w + 63) / 64;
+    tb->black = frame_arena_calloc(fa, (size_t) tb->words * h, sizeof(uint64_t));
+    tb->white = frame_arena_calloc(fa, (size_t) tb->words * h, sizeof(uint64_t));
+    return tb;
+}
+
+// im_max/im_min are the tile extrema of 'im' when the caller already has
+// them (see decimate_minmax()), or NULL. With 'temporal' the tiles that
+// td->thresh_history still describes are reused (td->temporal_tiles).
+// If 'bits' is not NULL the result is packed into it instead, NULL is
+// returned, and td->qtp.deglitch is ignored.
+image_u8_t *threshold(apriltag_detector_t *td, image_u8_t *im,
+                      uint8_t *im_max, uint8_t *im_min, bool temporal,
+                      struct thresh_bits *bits)
 {
     int w = im->width, h = im->height, s = im->stride;
     assert(w < 32768);
     assert(h < 32768);
 
-    image_u8_t *threshim = image_u8_create_alignment(w, h, s);
-    assert(threshim->stride == s);
+    image_u8_t *threshim = NULL;
+    if (bits == NULL) {
+        threshim = frame_arena_image_u8_create(td->arena, w, h, s);
+        assert(threshim->stride == s);
+    }
 
     // The idea is to find the maximum and minimum values in a
     // window around each pixel. If it's a contrast-free region
@@ -1239,30 +1914,31 @@ image_u8_t *threshold(apriltag_detector_t *td, image_u8_t *im)
     int tw = w / tilesz;
     int th = h / tilesz;
 
-    uint8_t *im_max = calloc(tw*th, sizeof(uint8_t));
-    uint8_t *im_min = calloc(tw*th, sizeof(uint8_t));
-
-    struct minmax_task *minmax_tasks = malloc(sizeof(struct minmax_task)*th);
     // first, collect min/max statistics for each tile
-    for (int ty = 0; ty < th; ty++) {
-        minmax_tasks[ty].im = im;
-        minmax_tasks[ty].im_max = im_max;
-        minmax_tasks[ty].im_min = im_min;
-        minmax_tasks[ty].ty = ty;
+    if (im_max == NULL) {
+        im_max = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
+        im_min = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
+
+        struct minmax_task *minmax_tasks = frame_arena_alloc(td->arena, sizeof(struct minmax_task)*th);
+        for (int ty = 0; ty < th; ty++) {
+            minmax_tasks[ty].im = im;
+            minmax_tasks[ty].im_max = im_max;
+            minmax_tasks[ty].im_min = im_min;
+            minmax_tasks[ty].ty = ty;
 
-        workerpool_add_task(td->wp, do_minmax_task, &minmax_tasks[ty]);
+            workerpool_add_task(td->wp, do_minmax_task, &minmax_tasks[ty]);
+        }
+        workerpool_run(td->wp);
     }
-    workerpool_run(td->wp);
-    free(minmax_tasks);
 
     // second, apply 3x3 max/min convolution to "blur" these values
     // over larger areas. This reduces artifacts due to abrupt changes
     // in the threshold value.
     if (1) {
-        uint8_t *im_max_tmp = calloc(tw*th, sizeof(uint8_t));
-        uint8_t *im_min_tmp = calloc(tw*th, sizeof(uint8_t));
+        uint8_t *im_max_tmp = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
+        uint8_t *im_min_tmp = frame_arena_alloc(td->arena, tw*th*sizeof(uint8_t));
 
-        struct blur_task *blur_tasks = malloc(sizeof(struct blur_task)*th);
+        struct blur_task *blur_tasks = frame_arena_alloc(td->arena, sizeof(struct blur_task)*th);
         for (int ty = 0; ty < th; ty++) {
             blur_tasks[ty].im = im;
             blur_tasks[ty].im_max = im_max;
@@ -1274,71 +1950,52 @@ image_u8_t *threshold(apriltag_detector_t *td, image_u8_t *im)
             workerpool_add_task(td->wp, do_blur_task, &blur_tasks[ty]);
         }
         workerpool_run(td->wp);
-        free(blur_tasks);
-        free(im_max);
-        free(im_min);
         im_max = im_max_tmp;
         im_min = im_min_tmp;
     }
 
-    struct threshold_task *threshold_tasks = malloc(sizeof(struct threshold_task)*th);
-    for (int ty = 0; ty < th; ty++) {
-        threshold_tasks[ty].im = im;
-        threshold_tasks[ty].threshim = threshim;
-        threshold_tasks[ty].im_max = im_max;
-        threshold_tasks[ty].im_min = im_min;
-        threshold_tasks[ty].ty = ty;
-        threshold_tasks[ty].td = td;
+    struct thresh_history *hist = temporal ? thresh_history_get(td, w, h) : NULL;
+
+    // one tile row per task, or for a packed result one chunk of tile
+    // rows per thread, each thresholded through 4 rows of scratch.
+    int ntasks = bits ? imin(th, td->nthreads) : th;
+    int chunksize = ntasks ? (th + ntasks - 1) / ntasks : 0;
 
-        workerpool_add_task(td->wp, do_threshold_task, &threshold_tasks[ty]);
+    struct threshold_task *threshold_tasks = frame_arena_alloc(td->arena, sizeof(struct threshold_task)*ntasks);
+    for (int i = 0; i < ntasks; i++) {
+        threshold_tasks[i].im = im;
+        threshold_tasks[i].threshim = threshim;
+        threshold_tasks[i].im_max = im_max;
+        threshold_tasks[i].im_min = im_min;
+        threshold_tasks[i].ty0 = i * chunksize;
+        threshold_tasks[i].ty1 = imin(th, (i + 1) * chunksize);
+        threshold_tasks[i].td = td;
+        threshold_tasks[i].hist = hist;
+        threshold_tasks[i].nreused = 0;
+        threshold_tasks[i].bits = bits;
+        threshold_tasks[i].scratch = bits ? frame_arena_alloc(td->arena, (size_t) tilesz*s) : NULL;
+
+        workerpool_add_task(td->wp, do_threshold_task, &threshold_tasks[i]);
     }
     workerpool_run(td->wp);
-    free(threshold_tasks);
-
-    // we skipped over the non-full-sized tiles above. Fix those now.
-    if (1) {
-        for (int y = 0; y < h; y++) {
-
-            // what is the first x coordinate we need to process in this row?
-
-            int x0;
 
-            if (y >= th*tilesz) {
-                x0 = 0; // we're at the bottom; do the whole row.
-            } else {
-                x0 = tw*tilesz; // we only need to do the right most part.
-            }
-
-            // compute tile coordinates and clamp.
-            int ty = y / tilesz;
-            if (ty >= th)
-                ty = th - 1;
-
-            for (int x = x0; x < w; x++) {
-                int tx = x / tilesz;
-                if (tx >= tw)
-                    tx = tw - 1;
-
-                int max = im_max[ty*tw + tx];
-                int min = im_min[ty*tw + tx];
-                int thresh = min + (max - min) / 2;
-
-                uint8_t v = im->buf[y*s+x];
-                if (v > thresh)
-                    threshim->buf[y*s+x] = 255;
-                else
-                    threshim->buf[y*s+x] = 0;
-            }
-        }
+    if (temporal) {
+        td->nthresh_tiles = tw*th;
+        td->nthresh_tiles_reused = 0;
+        for (int i = 0; i < ntasks; i++)
+            td->nthresh_tiles_reused += threshold_tasks[i].nreused;
+        if (hist)
+            hist->valid = true;
     }
 
-    free(im_min);
-    free(im_max);
+    // we skipped over the non-full-sized tiles above. Fix those now.
+    threshold_partial_tiles(im, threshim, bits, im_max, im_min, 0, h);
 
     // this is a dilate/erode deglitching scheme that does not improve
     // anything as far as I can tell.
-    if (td->qtp.deglitch) {
-        image_u8_t *tmp = image_u8_create(w, h);
+    if (td->qtp.deglitch && threshim) {
+        image_u8_t *tmp = frame_arena_image_u8_create(td->arena, w, h, s);
+        memset(tmp->buf, 0, (size_t) h*s);
 
         for (int y = 1; y + 1 < h; y++) {
             for (int x = 1; x + 1 < w; x++) {
@@ -1367,8 +2024,6 @@ image_u8_t *threshold(apriltag_detector_t *td, image_u8_t *im)
                 threshim->buf[y*s+x] = min;
             }
         }
-
-        image_u8_destroy(tmp);
     }
 
     timeprofile_stamp(td->tp, "threshold");
@@ -1495,8 +2150,9 @@ image_u8_t *threshold_bayer(apriltag_detector_t *td, image_u8_t *im)
     return threshim;
 }
 
-unionfind_t* connected_components(apriltag_detector_t *td, image_u8_t* threshim, int w, int h, int ts) {
-    unionfind_t *uf = unionfind_create(w * h);
+static unionfind_t* connected_components_pixels(apriltag_detector_t *td, image_u8_t* threshim, int w, int h, int ts) {
+    unionfind_t *uf = frame_arena_alloc(td->arena, sizeof(unionfind_t));
+    unionfind_init(uf, w * h, frame_arena_alloc(td->arena, (size_t) (w*h + 1) * 2 * sizeof(uint32_t)));
 
     if (td->nthreads <= 1) {
         do_unionfind_first_line(uf, threshim, w, ts);
@@ -1508,7 +2164,7 @@ unionfind_t* connected_components(apriltag_detector_t *td, image_u8_t* threshim,
 
         int sz = h;
         int chunksize = 1 + sz / (APRILTAG_TASKS_PER_THREAD_TARGET * td->nthreads);
-        struct unionfind_task *tasks = malloc(sizeof(struct unionfind_task)*(sz / chunksize + 1));
+        struct unionfind_task *tasks = frame_arena_alloc(td->arena, sizeof(struct unionfind_task)*(sz / chunksize + 1));
 
         int ntasks = 0;
 
@@ -1536,34 +2192,416 @@ unionfind_t* connected_components(apriltag_detector_t *td, image_u8_t* threshim,
         for (int i = 1; i < ntasks; i++) {
             do_unionfind_line2(uf, threshim, w, ts, tasks[i].y0 - 1);
         }
-
-        free(tasks);
     }
     return uf;
 }
 
-zarray_t* do_gradient_clusters(image_u8_t* threshim, int ts, int y0, int y1, int w, int nclustermap, unionfind_t* uf, zarray_t* clusters) {
-    struct uint64_zarray_entry **clustermap = calloc(nclustermap, sizeof(struct uint64_zarray_entry*));
+// Rows are split into runs of equal pixels. Column w-1 is always a run
+// of its own: the pixel path never connects it horizontally or
+// vertically (see do_unionfind_line2()).
+static int count_runs(const uint8_t *row, int w)
+{
+    // branch-free so that the compiler can vectorize it.
+    int n = 1 + (w >= 2);
+    for (int x = 1; x < w - 1; x++)
+        n += row[x] != row[x-1];
+    return n;
+}
+
+static void find_runs(const uint8_t *row, int w, struct component_run *runs)
+{
+    int n = 0;
+    runs[0].x0 = 0;
+
+    // branch-free: the start of a possible next run is always written
+    // and kept only if the pixel differs from its left neighbour.
+    for (int x = 1; x < w - 1; x++) {
+        runs[n+1].x0 = x;
+        n += row[x] != row[x-1];
+    }
+
+    if (w >= 2) {
+        n++;
+        runs[n].x0 = w - 1;
+    }
+
+    for (int i = 0; i < n; i++)
+        runs[i].x1 = runs[i+1].x0;
+    runs[n].x1 = w;
+}
+
+// Bit x of word i of the result is set where pixel x of row y differs
+// from pixel x-1, for x in [1, w-2]: the run starts of find_runs().
+static inline uint64_t thresh_bits_transitions(const struct thresh_bits *tb, int y, int i)
+{
+    const uint64_t *black = &tb->black[y*tb->words];
+    const uint64_t *white = &tb->white[y*tb->words];
+
+    uint64_t b = black[i] ^ ((black[i] << 1) | (i ? black[i-1] >> 63 : 0));
+    uint64_t wh = white[i] ^ ((white[i] << 1) | (i ? white[i-1] >> 63 : 0));
+    return (b | wh) & thresh_bits_columns(i, 1, tb->w - 2);
+}
+
+// count_runs() and find_runs() of a packed row, a word at a time.
+static int count_runs_packed(const struct thresh_bits *tb, int y)
+{
+    int n = 1 + (tb->w >= 2);
+    for (int i = 0; i < tb->words; i++)
+        n += popcount64(thresh_bits_transitions(tb, y, i));
+    return n;
+}
+
+static void find_runs_packed(const struct thresh_bits *tb, int y, struct component_run *runs)
+{
+    int n = 0;
+    runs[0].x0 = 0;
+
+    for (int i = 0; i < tb->words; i++) {
+        for (uint64_t t = thresh_bits_transitions(tb, y, i); t; t &= t - 1)
+            runs[++n].x0 = i*64 + ctz64(t);
+    }
+
+    if (tb->w >= 2) {
+        n++;
+        runs[n].x0 = tb->w - 1;
+    }
+
+    for (int i = 0; i < n; i++)
+        runs[i].x1 = runs[i+1].x0;
+    runs[n].x1 = tb->w;
+}
+
+// pixel x of a threshold image row, given either as bytes or as row y of
+// tb.
+static inline uint8_t thresh_row_get(const uint8_t *row, const struct thresh_bits *tb, int y, int x)
+{
+    return tb ? thresh_bits_get(tb, x, y) : row[x];
+}
+
+// Connects the runs of row y to those of row y-1 exactly as
+// do_unionfind_line2() connects the pixels: 4-connectivity for black,
+// 8-connectivity for white, only for pixels in columns [1, w-2]. The rows
+// are 'prev' and 'cur', or rows y-1 and y of tb if it is not NULL.
+static void connect_run_rows(unionfind_t *uf, const uint8_t *prev, const uint8_t *cur,
+                             const struct thresh_bits *tb, int y, int w,
+                             const struct component_run *runs, uint32_t a_begin, uint32_t b_begin, uint32_t b_end)
+{
+    // the last run of each row is the column w-1 singleton.
+    uint32_t a_end = b_begin - 1;
+    uint32_t a = a_begin;
+
+    for (uint32_t b = b_begin; b < b_end - 1; b++) {
+        uint8_t v = thresh_row_get(cur, tb, y, runs[b].x0);
+        if (v == 127)
+            continue;
+
+        // columns of this run that look at the previous row.
+        int lo = imax(1, runs[b].x0);
+        int hi = imin(w - 2, runs[b].x1 - 1);
+        if (lo > hi)
+            continue;
+
+        int reach = v == 255 ? 1 : 0;
+
+        while (a < a_end && runs[a].x1 - 1 + reach < lo)
+            a++;
+
+        for (uint32_t j = a; j < a_end && runs[j].x0 - reach <= hi; j++) {
+            if (thresh_row_get(prev, tb, y - 1, runs[j].x0) == v)
+                unionfind_connect(uf, b, j);
+        }
+    }
+
+    // (w-2, y) and (w-1, y-1) are joined only when both are white and
+    // (w-2, y-1) is not.
+    if (w >= 3 && thresh_row_get(cur, tb, y, w-2) == 255 &&
+        thresh_row_get(prev, tb, y - 1, w-1) == 255 && thresh_row_get(prev, tb, y - 1, w-2) != 255)
+        unionfind_connect(uf, b_end - 2, a_end);
+}
+
+// Labels each run with its set's representative and sums the set
+// sizes, so that lookups during clustering are read-only.
+static void components_flatten(frame_arena_t *fa, components_t *cc, unionfind_t *uf, uint32_t nruns)
+{
+    cc->run_label = frame_arena_alloc(fa, nruns * sizeof(uint32_t));
+    cc->set_size = frame_arena_calloc(fa, nruns, sizeof(uint32_t));
+    for (uint32_t r = 0; r < nruns; r++) {
+        uint32_t rep = unionfind_get_representative(uf, r);
+        cc->run_label[r] = rep;
+        cc->set_size[rep] += cc->runs[r].x1 - cc->runs[r].x0;
+    }
+}
+
+// threshim is NULL if tb holds the threshold image.
+static components_t* connected_components_runs(apriltag_detector_t *td, image_u8_t* threshim,
+                                               const struct thresh_bits *tb, int w, int h, int ts) {
+    components_t *cc = frame_arena_calloc(td->arena, 1, sizeof(components_t));
+    cc->w = w;
+    cc->h = h;
+
+    cc->row_start = frame_arena_alloc(td->arena, (h + 1) * sizeof(uint32_t));
+    cc->row_start[0] = 0;
+    for (int y = 0; y < h; y++)
+        cc->row_start[y+1] = cc->row_start[y] +
+            (tb ? count_runs_packed(tb, y) : count_runs(&threshim->buf[y*ts], w));
+
+    uint32_t nruns = cc->row_start[h];
+    cc->runs = frame_arena_alloc(td->arena, nruns * sizeof(struct component_run));
+    for (int y = 0; y < h; y++) {
+        if (tb)
+            find_runs_packed(tb, y, &cc->runs[cc->row_start[y]]);
+        else
+            find_runs(&threshim->buf[y*ts], w, &cc->runs[cc->row_start[y]]);
+    }
+
+    unionfind_t uf;
+    unionfind_init(&uf, nruns, frame_arena_alloc(td->arena, (size_t) (nruns + 1) * 2 * sizeof(uint32_t)));
+
+    for (int y = 1; y < h; y++)
+        connect_run_rows(&uf, tb ? NULL : &threshim->buf[(y-1)*ts], tb ? NULL : &threshim->buf[y*ts],
+                         tb, y, w, cc->runs, cc->row_start[y-1], cc->row_start[y], cc->row_start[y+1]);
+
+    components_flatten(td->arena, cc, &uf, nruns);
+
+    return cc;
+}
+
+// A packed threshold image (threshim NULL) needs td->qtp.rle_components.
+components_t* connected_components(apriltag_detector_t *td, image_u8_t* threshim,
+                                   const struct thresh_bits *tb, int w, int h, int ts) {
+    if (td->qtp.rle_components)
+        return connected_components_runs(td, threshim, tb, w, h, ts);
+
+    assert(tb == NULL);
+
+    components_t *cc = frame_arena_calloc(td->arena, 1, sizeof(components_t));
+    cc->w = w;
+    cc->h = h;
+    cc->uf = connected_components_pixels(td, threshim, w, h, ts);
+    return cc;
+}
+
+static inline uint32_t cluster_slot_of(uint64_t id, int logcap)
+{
+    return (id * 0x9E3779B97F4A7C15ull) >> (64 - logcap);
+}
+
+static void cluster_table_init(struct cluster_table *ct, frame_arena_t *fa)
+{
+    ct->fa = fa;
+    ct->logcap = 10;
+    ct->slots = frame_arena_calloc(fa, (size_t) 1 << ct->logcap, sizeof(struct cluster_slot));
+    ct->entries = frame_arena_zarray_create(fa, sizeof(struct cluster_entry), 256);
+    ct->head = ct->tail = NULL;
+    ct->last_id = 0;
+    ct->last_idx = UINT32_MAX;
+}
+
+// doubles the table; slots are rebuilt from 'entries'.
+static void cluster_table_grow(struct cluster_table *ct)
+{
+    ct->logcap++;
+    uint32_t mask = (1u << ct->logcap) - 1;
+    ct->slots = frame_arena_calloc(ct->fa, (size_t) 1 << ct->logcap, sizeof(struct cluster_slot));
+
+    struct cluster_entry *entries = (struct cluster_entry*) ct->entries->data;
+    for (int i = 0; i < zarray_size(ct->entries); i++) {
+        uint32_t slot = cluster_slot_of(entries[i].id, ct->logcap);
+        while (ct->slots[slot].idx1)
+            slot = (slot + 1) & mask;
+        ct->slots[slot].id = entries[i].id;
+        ct->slots[slot].idx1 = i + 1;
+    }
+}
+
+static uint32_t cluster_table_lookup(struct cluster_table *ct, uint64_t id)
+{
+    uint32_t mask = (1u << ct->logcap) - 1;
+    uint32_t slot = cluster_slot_of(id, ct->logcap);
+
+    while (ct->slots[slot].idx1) {
+        if (ct->slots[slot].id == id)
+            return ct->slots[slot].idx1 - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    // new cluster. Keep the load factor at or below 1/2.
+    uint32_t idx = zarray_size(ct->entries);
+    struct cluster_entry entry = { .id = id, .npts = 0 };
+    frame_arena_zarray_add(ct->fa, ct->entries, &entry);
+
+    if (2*(idx + 1) > mask + 1) {
+        cluster_table_grow(ct);
+    } else {
+        ct->slots[slot].id = id;
+        ct->slots[slot].idx1 = idx + 1;
+    }
+
+    return idx;
+}
+
+static inline void cluster_table_add(struct cluster_table *ct, uint64_t id, const struct pt *p)
+{
+    if (id != ct->last_id || ct->last_idx == UINT32_MAX) {
+        ct->last_id = id;
+        ct->last_idx = cluster_table_lookup(ct, id);
+    }
+
+    struct cluster_pool_chunk *chunk = ct->tail;
+    if (chunk == NULL || chunk->n == CLUSTER_POOL_CHUNK) {
+        chunk = frame_arena_alloc(ct->fa, sizeof(struct cluster_pool_chunk));
+        chunk->next = NULL;
+        chunk->n = 0;
+        if (ct->tail)
+            ct->tail->next = chunk;
+        else
+            ct->head = chunk;
+        ct->tail = chunk;
+    }
+
+    chunk->idx[chunk->n] = ct->last_idx;
+    chunk->p[chunk->n] = *p;
+    chunk->n++;
+
+    ((struct cluster_entry*) ct->entries->data)[ct->last_idx].npts++;
+}
+
+// Groups the pooled points by cluster (keeping scan order within each
+// cluster) and appends the clusters to 'clusters' sorted by (hash, id),
+// the order merge_clusters() expects.
+static void cluster_table_finish(struct cluster_table *ct, int nclustermap, zarray_t *clusters)
+{
+    frame_arena_t *fa = ct->fa;
+    int n = zarray_size(ct->entries);
+    if (n == 0)
+        return;
+
+    struct cluster_entry *entries = (struct cluster_entry*) ct->entries->data;
+
+    uint32_t *offset = frame_arena_alloc(fa, n * sizeof(uint32_t));
+    uint32_t npts = 0;
+    for (int i = 0; i < n; i++) {
+        offset[i] = npts;
+        npts += entries[i].npts;
+    }
+
+    struct pt *pts = frame_arena_alloc(fa, npts * sizeof(struct pt));
+    for (struct cluster_pool_chunk *chunk = ct->head; chunk; chunk = chunk->next) {
+        for (int i = 0; i < chunk->n; i++)
+            pts[offset[chunk->idx[i]]++] = chunk->p[i];
+    }
 
-    int mem_chunk_size = 2048;
-    struct uint64_zarray_entry** mem_pools = malloc(sizeof(struct uint64_zarray_entry *)*(1 + 2 * nclustermap / mem_chunk_size)); // SmodeTech: avoid memory corruption when nclustermap < mem_chunk_size
-    int mem_pool_idx = 0;
-    int mem_pool_loc = 0;
-    mem_pools[mem_pool_idx] = calloc(mem_chunk_size, sizeof(struct uint64_zarray_entry));
+    // offset[i] now is the end of cluster i. The per-cluster zarrays are
+    // views into 'pts' with alloc == size, so merge_clusters() copies
+    // them before appending, like any other arena zarray.
+    zarray_t *views = frame_arena_alloc(fa, n * sizeof(zarray_t));
+    struct cluster_hash *hashes = frame_arena_alloc(fa, n * sizeof(struct cluster_hash));
+    for (int i = 0; i < n; i++) {
+        views[i].el_sz = sizeof(struct pt);
+        views[i].size = entries[i].npts;
+        views[i].alloc = entries[i].npts;
+        views[i].data = (char*) &pts[offset[i] - entries[i].npts];
+
+        hashes[i].hash = u64hash_2(entries[i].id) % nclustermap;
+        hashes[i].id = entries[i].id;
+        hashes[i].data = &views[i];
+    }
+
+    // one counting-sort pass on the hash...
+    uint32_t *start = frame_arena_calloc(fa, nclustermap + 1, sizeof(uint32_t));
+    for (int i = 0; i < n; i++)
+        start[hashes[i].hash + 1]++;
+    for (int b = 0; b < nclustermap; b++)
+        start[b + 1] += start[b];
+
+    struct cluster_hash **sorted = frame_arena_alloc(fa, n * sizeof(struct cluster_hash*));
+    for (int i = 0; i < n; i++)
+        sorted[start[hashes[i].hash]++] = &hashes[i];
+
+    // ...then order the (rare) equal hashes by id.
+    for (int i = 1; i < n; i++) {
+        struct cluster_hash *h = sorted[i];
+        int j = i;
+        while (j > 0 && sorted[j-1]->hash == h->hash && sorted[j-1]->id > h->id) {
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = h;
+    }
+
+    frame_arena_zarray_ensure_capacity(fa, clusters, zarray_size(clusters) + n);
+    for (int i = 0; i < n; i++)
+        frame_arena_zarray_add(fa, clusters, &sorted[i]);
+}
+
+// Bit x of word i of the result is set where pixel x of row y, for x in
+// [1, w-2], is black or white and one of (x+1, y), (x-1, y+1), (x, y+1)
+// and (x+1, y+1) has the other color: the pixels that can add a point
+// in do_gradient_clusters(). Row y+1 must exist.
+static inline uint64_t thresh_bits_edges(const struct thresh_bits *tb, int y, int i)
+{
+    const uint64_t *b0 = &tb->black[y*tb->words], *b1 = b0 + tb->words;
+    const uint64_t *w0 = &tb->white[y*tb->words], *w1 = w0 + tb->words;
+    bool last = i + 1 == tb->words;
+
+    // right: pixel x+1; left: pixel x-1.
+#define RIGHT(P) ((P[i] >> 1) | (last ? 0 : P[i+1] << 63))
+#define LEFT(P) ((P[i] << 1) | (i ? P[i-1] >> 63 : 0))
+    uint64_t white_near = RIGHT(w0) | w1[i] | LEFT(w1) | RIGHT(w1);
+    uint64_t black_near = RIGHT(b0) | b1[i] | LEFT(b1) | RIGHT(b1);
+#undef RIGHT
+#undef LEFT
+
+    return ((b0[i] & white_near) | (w0[i] & black_near)) & thresh_bits_columns(i, 1, tb->w - 2);
+}
+
+// threshim is NULL if tb holds the threshold image. Then only the pixels
+// of thresh_bits_edges() are visited, with the same result.
+zarray_t* do_gradient_clusters(frame_arena_t* fa, image_u8_t* threshim, const struct thresh_bits *tb, int ts, int y0, int y1, int w, int nclustermap, components_t* cc, zarray_t* clusters) {
+    struct cluster_table ct;
+    cluster_table_init(&ct, fa);
+
+#define THRESH_AT(x, y) (tb ? thresh_bits_get(tb, x, y) : threshim->buf[(y)*ts + (x)])
 
     for (int y = y0; y < y1; y++) {
         bool connected_last = false;
+
+        // run lookup hints for rows y and y+1 (run mode only).
+        uint32_t hints[2] = { 0, 0 };
+        if (cc->uf == NULL) {
+            hints[0] = cc->row_start[y];
+            hints[1] = cc->row_start[y+1];
+        }
+
+        // packed only: the edge pixels not visited yet of word 'word'.
+        uint64_t edges = 0;
+        int word = -1;
+
         for (int x = 1; x < w-1; x++) {
 
-            uint8_t v0 = threshim->buf[y*ts + x];
+            if (tb) {
+                while (edges == 0 && ++word < tb->words)
+                    edges = thresh_bits_edges(tb, y, word);
+                if (edges == 0)
+                    break;
+
+                // a skipped pixel would not have connected to (x+1, y+1).
+                int next = word*64 + ctz64(edges);
+                edges &= edges - 1;
+                if (next != x)
+                    connected_last = false;
+                x = next;
+            }
+
+            uint8_t v0 = THRESH_AT(x, y);
             if (v0 == 127) {
                 connected_last = false;
                 continue;
             }
 
             // XXX don't query this until we know we need it?
-            uint64_t rep0 = unionfind_get_representative(uf, y*w + x);
-            if (unionfind_get_set_size(uf, rep0) < 25) {
+            uint64_t rep0 = components_rep(cc, x, y, &hints[0]);
+            if (components_set_size(cc, rep0) < 25) {
                 connected_last = false;
                 continue;
             }
@@ -1591,41 +2629,19 @@ zarray_t* do_gradient_clusters(image_u8_t* threshim, int ts, int y0, int y1, int
             bool connected;
 #define DO_CONN(dx, dy)                                                 \
             if (1) {                                                    \
-                uint8_t v1 = threshim->buf[(y + dy)*ts + x + dx];       \
+                uint8_t v1 = THRESH_AT(x + dx, y + dy);                 \
                                                                         \
                 if (v0 + v1 == 255) {                                   \
-                    uint64_t rep1 = unionfind_get_representative(uf, (y + dy)*w + x + dx); \
-                    if (unionfind_get_set_size(uf, rep1) > 24) {        \
+                    uint64_t rep1 = components_rep(cc, x + dx, y + dy, &hints[dy]); \
+                    if (components_set_size(cc, rep1) > 24) {           \
                         uint64_t clusterid;                                 \
                         if (rep0 < rep1)                                    \
                             clusterid = (rep1 << 32) + rep0;                \
                         else                                                \
                             clusterid = (rep0 << 32) + rep1;                \
                                                                             \
-                        /* XXX lousy hash function */                       \
-                        uint32_t clustermap_bucket = u64hash_2(clusterid) % nclustermap; \
-                        struct uint64_zarray_entry *entry = clustermap[clustermap_bucket]; \
-                        while (entry && entry->id != clusterid) {           \
-                            entry = entry->next;                            \
-                        }                                                   \
-                                                                            \
-                        if (!entry) {                                       \
-                            if (mem_pool_loc == mem_chunk_size) {           \
-                                mem_pool_loc = 0;                           \
-                                mem_pool_idx++;                             \
-                                mem_pools[mem_pool_idx] = calloc(mem_chunk_size, sizeof(struct uint64_zarray_entry)); \
-                            }                                               \
-                            entry = mem_pools[mem_pool_idx] + mem_pool_loc; \
-                            mem_pool_loc++;                                 \
-                                                                            \
-                            entry->id = clusterid;                          \
-                            entry->cluster = zarray_create(sizeof(struct pt)); \
-                            entry->next = clustermap[clustermap_bucket];    \
-                            clustermap[clustermap_bucket] = entry;          \
-                        }                                                   \
-                                                                            \
                         struct pt p = { .x = 2*x + dx, .y = 2*y + dy, .gx = dx*((int) v1-v0), .gy = dy*((int) v1-v0)}; \
-                        zarray_add(entry->cluster, &p);                     \
+                        cluster_table_add(&ct, clusterid, &p);              \
                         connected = true;                                   \
                     }                                                   \
                 }                                                       \
@@ -1649,39 +2665,9 @@ zarray_t* do_gradient_clusters(image_u8_t* threshim, int ts, int y0, int y1, int
         }
     }
 #undef DO_CONN
+#undef THRESH_AT
 
-    for (int i = 0; i < nclustermap; i++) {
-        int start = zarray_size(clusters);
-        for (struct uint64_zarray_entry *entry = clustermap[i]; entry; entry = entry->next) {
-            struct cluster_hash* cluster_hash = malloc(sizeof(struct cluster_hash));
-            cluster_hash->hash = u64hash_2(entry->id) % nclustermap;
-            cluster_hash->id = entry->id;
-            cluster_hash->data = entry->cluster;
-            zarray_add(clusters, &cluster_hash);
-        }
-        int end = zarray_size(clusters);
-
-        // Do a quick bubblesort on the secondary key.
-        int n = end - start;
-        for (int j = 0; j < n - 1; j++) {
-            for (int k = 0; k < n - j - 1; k++) {
-                struct cluster_hash** hash1;
-                struct cluster_hash** hash2;
-                zarray_get_volatile(clusters, start + k, &hash1);
-                zarray_get_volatile(clusters, start + k + 1, &hash2);
-                if ((*hash1)->id > (*hash2)->id) {
-                    struct cluster_hash tmp = **hash2;
-                    **hash2 = **hash1;
-                    **hash1 = tmp;
-                }
-            }
-        }
-    }
-    for (int i = 0; i <= mem_pool_idx; i++) {
-        free(mem_pools[i]);
-    }
-    free(mem_pools);
-    free(clustermap);
+    cluster_table_finish(&ct, nclustermap, clusters);
 
     return clusters;
 }
@@ -1690,12 +2676,11 @@ static void do_cluster_task(void *p)
 {
     struct cluster_task *task = (struct cluster_task*) p;
 
-    do_gradient_clusters(task->im, task->s, task->y0, task->y1, task->w, task->nclustermap, task->uf, task->clusters);
+    do_gradient_clusters(task->fa, task->im, task->bits, task->s, task->y0, task->y1, task->w, task->nclustermap, task->cc, task->clusters);
 }
 
-zarray_t* merge_clusters(zarray_t* c1, zarray_t* c2) {
-    zarray_t* ret = zarray_create(sizeof(struct cluster_hash*));
-    zarray_ensure_capacity(ret, zarray_size(c1) + zarray_size(c2));
+zarray_t* merge_clusters(frame_arena_t* fa, zarray_t* c1, zarray_t* c2) {
+    zarray_t* ret = frame_arena_zarray_create(fa, sizeof(struct cluster_hash*), zarray_size(c1) + zarray_size(c2));
 
     int i1 = 0;
     int i2 = 0;
@@ -1709,37 +2694,34 @@ zarray_t* merge_clusters(zarray_t* c1, zarray_t* c2) {
         zarray_get_volatile(c2, i2, &h2);
 
         if ((*h1)->hash == (*h2)->hash && (*h1)->id == (*h2)->id) {
-            zarray_add_range((*h1)->data, (*h2)->data, 0, zarray_size((*h2)->data));
-            zarray_add(ret, h1);
+            frame_arena_zarray_add_range(fa, (*h1)->data, (*h2)->data, 0, zarray_size((*h2)->data));
+            frame_arena_zarray_add(fa, ret, h1);
             i1++;
             i2++;
-            zarray_destroy((*h2)->data);
-            free(*h2);
         } else if ((*h2)->hash < (*h1)->hash || ((*h2)->hash == (*h1)->hash && (*h2)->id < (*h1)->id)) {
-            zarray_add(ret, h2);
+            frame_arena_zarray_add(fa, ret, h2);
             i2++;
         } else {
-            zarray_add(ret, h1);
+            frame_arena_zarray_add(fa, ret, h1);
             i1++;
         }
     }
 
-    zarray_add_range(ret, c1, i1, l1);
-    zarray_add_range(ret, c2, i2, l2);
-
-    zarray_destroy(c1);
-    zarray_destroy(c2);
+    frame_arena_zarray_add_range(fa, ret, c1, i1, l1);
+    frame_arena_zarray_add_range(fa, ret, c2, i2, l2);
 
     return ret;
 }
 
-zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, int w, int h, int ts, unionfind_t* uf) {
+// threshim is NULL if tb holds the threshold image.
+zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, const struct thresh_bits *tb,
+                            int w, int h, int ts, components_t* cc) {
     zarray_t* clusters;
     int nclustermap = 0.2*w*h;
 
     int sz = h - 1;
     int chunksize = 1 + sz / (APRILTAG_TASKS_PER_THREAD_TARGET * td->nthreads);
-    struct cluster_task *tasks = malloc(sizeof(struct cluster_task)*(sz / chunksize + 1));
+    struct cluster_task *tasks = frame_arena_alloc(td->arena, sizeof(struct cluster_task)*(sz / chunksize + 1));
 
     int ntasks = 0;
 
@@ -1750,10 +2732,12 @@ zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, int w
         tasks[ntasks].y1 = imin(sz, i + chunksize);
         tasks[ntasks].w = w;
         tasks[ntasks].s = ts;
-        tasks[ntasks].uf = uf;
+        tasks[ntasks].cc = cc;
         tasks[ntasks].im = threshim;
+        tasks[ntasks].bits = tb;
         tasks[ntasks].nclustermap = nclustermap/(sz / chunksize + 1);
-        tasks[ntasks].clusters = zarray_create(sizeof(struct cluster_hash*));
+        tasks[ntasks].clusters = frame_arena_zarray_create(td->arena, sizeof(struct cluster_hash*), 0);
+        tasks[ntasks].fa = td->arena;
 
         workerpool_add_task(td->wp, do_cluster_task, &tasks[ntasks]);
         ntasks++;
@@ -1761,7 +2745,7 @@ zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, int w
 
     workerpool_run(td->wp);
 
-    zarray_t** clusters_list = malloc(sizeof(zarray_t *)*ntasks);
+    zarray_t** clusters_list = frame_arena_alloc(td->arena, sizeof(zarray_t *)*ntasks);
     for (int i = 0; i < ntasks; i++) {
         clusters_list[i] = tasks[i].clusters;
     }
@@ -1770,7 +2754,7 @@ zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, int w
     while (length > 1) {
         int write = 0;
         for (int i = 0; i < length - 1; i += 2) {
-            clusters_list[write] = merge_clusters(clusters_list[i], clusters_list[i + 1]);
+            clusters_list[write] = merge_clusters(td->arena, clusters_list[i], clusters_list[i + 1]);
             write++;
         }
 
@@ -1781,22 +2765,20 @@ zarray_t* gradient_clusters(apriltag_detector_t *td, image_u8_t* threshim, int w
         length = (length >> 1) + length % 2;
     }
 
-    clusters = zarray_create(sizeof(zarray_t*));
-    zarray_ensure_capacity(clusters, zarray_size(clusters_list[0]));
+    clusters = frame_arena_zarray_create(td->arena, sizeof(zarray_t*), zarray_size(clusters_list[0]));
     for (int i = 0; i < zarray_size(clusters_list[0]); i++) {
         struct cluster_hash** hash;
         zarray_get_volatile(clusters_list[0], i, &hash);
-        zarray_add(clusters, &(*hash)->data);
-        free(*hash);
+        frame_arena_zarray_add(td->arena, clusters, &(*hash)->data);
     }
-    zarray_destroy(clusters_list[0]);
-    free(clusters_list);
-    free(tasks);
     return clusters;
 }
 
-zarray_t* fit_quads(apriltag_detector_t *td, int w, int h, zarray_t* clusters, image_u8_t* im) {
-    zarray_t *quads = zarray_create(sizeof(struct quad));
+// With 'hist' (td->temporal_tiles) the fits of clusters that did not
+// change are reused from it, and it gets this frame's fits.
+zarray_t* fit_quads(apriltag_detector_t *td, int w, int h, zarray_t* clusters, image_u8_t* im,
+                    struct thresh_history *hist) {
+    zarray_t *quads = frame_arena_zarray_create(td->arena, sizeof(struct quad), 0);
 
     bool normal_border = false;
     bool reversed_border = false;
@@ -1816,9 +2798,42 @@ zarray_t* fit_quads(apriltag_detector_t *td, int w, int h, zarray_t* clusters, i
         min_tag_width = 3;
     }
 
+    float px_scale = td->quad_decimate > 1 ? td->quad_decimate : 1;
+    float min_tag_side = fmaxf(0, td->qtp.min_tag_px) / px_scale;
+    float max_tag_side = fmaxf(0, td->qtp.max_tag_px) / px_scale;
+
+    // zeroed so that the padding compares equal too.
+    struct fit_params params;
+    memset(&params, 0, sizeof(params));
+    params.max_nmaxima = td->qtp.max_nmaxima;
+    params.cos_critical_rad = td->qtp.cos_critical_rad;
+    params.max_line_fit_mse = td->qtp.max_line_fit_mse;
+    params.tag_width = min_tag_width;
+    params.normal_border = normal_border;
+    params.reversed_border = reversed_border;
+
+    // summed-area table of the changed tiles, and nothing to reuse if
+    // the fits were made with other settings.
+    uint32_t *changed_sum = NULL;
+    if (hist) {
+        if (memcmp(&params, &hist->fit_params, sizeof(params)) != 0)
+            hist->fits_capacity = 0;
+        hist->fit_params = params;
+
+        int tw = hist->w / 4, th = hist->h / 4;
+        changed_sum = frame_arena_calloc(td->arena, (size_t) (tw + 1) * (th + 1), sizeof(uint32_t));
+        for (int ty = 0; ty < th; ty++) {
+            uint32_t row = 0;
+            for (int tx = 0; tx < tw; tx++) {
+                row += hist->changed[ty*tw + tx];
+                changed_sum[(ty+1)*(tw+1) + tx + 1] = changed_sum[ty*(tw+1) + tx + 1] + row;
+            }
+        }
+    }
+
     int sz = zarray_size(clusters);
     int chunksize = 1 + sz / (APRILTAG_TASKS_PER_THREAD_TARGET * td->nthreads);
-    struct quad_task *tasks = malloc(sizeof(struct quad_task)*(sz / chunksize + 1));
+    struct quad_task *tasks = frame_arena_alloc(td->arena, sizeof(struct quad_task)*(sz / chunksize + 1));
 
     int ntasks = 0;
     for (int i = 0; i < sz; i += chunksize) {
@@ -1833,6 +2848,30 @@ zarray_t* fit_quads(apriltag_detector_t *td, int w, int h, zarray_t* clusters, i
         tasks[ntasks].tag_width = min_tag_width;
         tasks[ntasks].normal_border = normal_border;
         tasks[ntasks].reversed_border = reversed_border;
+        tasks[ntasks].min_tag_side = min_tag_side;
+        tasks[ntasks].max_tag_side = max_tag_side;
+        tasks[ntasks].hist = hist;
+        tasks[ntasks].changed_sum = changed_sum;
+        tasks[ntasks].fits = hist ? frame_arena_alloc(td->arena, sizeof(struct fit_entry) *
+                                                      (tasks[ntasks].cidx1 - tasks[ntasks].cidx0)) : NULL;
+        tasks[ntasks].nfits = 0;
+        tasks[ntasks].nfits_reused = 0;
+
+        // size the task's scratch for the largest cluster it will fit:
+        // ptsort needs 2*n points, quad_segment_maxima at most 4
+        // doubles/ints per point on top of the line fit moments.
+        int maxsz = 0;
+        for (int cidx = tasks[ntasks].cidx0; cidx < tasks[ntasks].cidx1; cidx++) {
+            zarray_t *cluster;
+            zarray_get(clusters, cidx, &cluster);
+            int csz = zarray_size(cluster);
+            if (csz > maxsz && csz >= td->qtp.min_cluster_pixels && csz <= 2*(2*w+2*h))
+                maxsz = csz;
+        }
+        size_t scratchsz = (size_t) maxsz * (2*sizeof(struct pt) + sizeof(struct line_fit_pt) +
+                                             4*sizeof(double)) +
+            64 * FRAME_ARENA_ALIGN;
+        frame_arena_init_slab(&tasks[ntasks].scratch, td->arena, scratchsz);
 
         workerpool_add_task(td->wp, do_quad_task, &tasks[ntasks]);
         ntasks++;
@@ -1840,20 +2879,41 @@ zarray_t* fit_quads(apriltag_detector_t *td, int w, int h, zarray_t* clusters, i
 
     workerpool_run(td->wp);
 
-    free(tasks);
+    for (int i = 0; i < ntasks; i++)
+        frame_arena_fini_slab(&tasks[i].scratch, td->arena);
+
+    if (hist) {
+        td->nquad_fits = 0;
+        td->nquad_fits_reused = 0;
+        for (int i = 0; i < ntasks; i++) {
+            td->nquad_fits += tasks[i].nfits;
+            td->nquad_fits_reused += tasks[i].nfits_reused;
+        }
+        fits_store(hist, tasks, ntasks);
+    }
 
     return quads;
 }
 
-zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
+static zarray_t *quads_from_components(apriltag_detector_t *td, image_u8_t *im,
+                                       image_u8_t *threshim, const struct thresh_bits *tb,
+                                       components_t *cc, struct thresh_history *hist);
+
+zarray_t *apriltag_quad_thresh_minmax(apriltag_detector_t *td, image_u8_t *im,
+                                      uint8_t *im_max, uint8_t *im_min, bool temporal)
 {
     ////////////////////////////////////////////////////////
     // step 1. threshold the image, creating the edge image.
 
     int w = im->width, h = im->height;
 
-    image_u8_t *threshim = threshold(td, im);
-    int ts = threshim->stride;
+    // the debug images and the pixel union-find need the bytes.
+    struct thresh_bits *tb = NULL;
+    if (td->qtp.packed_threshold && td->qtp.rle_components && !td->qtp.deglitch && !td->debug)
+        tb = thresh_bits_create(td->arena, w, h);
+
+    image_u8_t *threshim = threshold(td, im, im_max, im_min, temporal, tb);
+    int ts = threshim ? threshim->stride : 0;
 
     if (td->debug)
         image_u8_write_pnm(threshim, "debug_threshold.pnm");
@@ -1861,7 +2921,23 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
 
     ////////////////////////////////////////////////////////
     // step 2. find connected components.
-    unionfind_t* uf = connected_components(td, threshim, w, h, ts);
+    components_t* cc = connected_components(td, threshim, tb, w, h, ts);
+
+    // the history is up to date only if threshold() could record this frame.
+    struct thresh_history *hist = temporal && td->thresh_history && td->thresh_history->valid ?
+        td->thresh_history : NULL;
+
+    return quads_from_components(td, im, threshim, tb, cc, hist);
+}
+
+// Steps 2 (debug output and timing) and 3 of apriltag_quad_thresh_minmax(),
+// from the labeled threshold image.
+static zarray_t *quads_from_components(apriltag_detector_t *td, image_u8_t *im,
+                                       image_u8_t *threshim, const struct thresh_bits *tb,
+                                       components_t *cc, struct thresh_history *hist)
+{
+    int w = im->width, h = im->height;
+    int ts = threshim ? threshim->stride : 0;
 
     // make segmentation image.
     if (td->debug) {
@@ -1870,10 +2946,11 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
         uint32_t *colors = (uint32_t*) calloc(w*h, sizeof(*colors));
 
         for (int y = 0; y < h; y++) {
+            uint32_t hint = cc->uf ? 0 : cc->row_start[y];
             for (int x = 0; x < w; x++) {
-                uint32_t v = unionfind_get_representative(uf, y*w+x);
+                uint32_t v = components_rep(cc, x, y, &hint);
 
-                if ((int)unionfind_get_set_size(uf, v) < td->qtp.min_cluster_pixels)
+                if ((int)components_set_size(cc, v) < td->qtp.min_cluster_pixels)
                     continue;
 
                 uint32_t color = colors[v];
@@ -1904,7 +2981,7 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
 
     timeprofile_stamp(td->tp, "unionfind");
 
-    zarray_t* clusters = gradient_clusters(td, threshim, w, h, ts, uf);
+    zarray_t* clusters = gradient_clusters(td, threshim, tb, w, h, ts, cc);
 
     if (td->debug) {
         image_u8x3_t *d = image_u8x3_create(w, h);
@@ -1939,13 +3016,12 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
     }
 
 
-    image_u8_destroy(threshim);
     timeprofile_stamp(td->tp, "make clusters");
 
     ////////////////////////////////////////////////////////
     // step 3. process each connected component.
 
-    zarray_t* quads = fit_quads(td, w, h, clusters, im);
+    zarray_t* quads = fit_quads(td, w, h, clusters, im, hist);
 
     if (td->debug) {
         FILE *f = fopen("debug_lines.ps", "w");
@@ -1989,14 +3065,241 @@ zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
 
     timeprofile_stamp(td->tp, "fit quads to clusters");
 
-    unionfind_destroy(uf);
+    // threshim, uf and the clusters live in td->arena and are released
+    // when the detector resets it at the end of the frame.
+    return quads;
+}
+
+zarray_t *apriltag_quad_thresh(apriltag_detector_t *td, image_u8_t *im)
+{
+    return apriltag_quad_thresh_minmax(td, im, NULL, NULL, false);
+}
+
+////////////////////////////////////////////////////////////////
+// Streaming front-end (see apriltag_stream_begin()). Tile rows are
+// decimated, thresholded and labeled as soon as the input rows they
+// depend on have arrived; the threshold image and the run union-find
+// are the same as those of apriltag_quad_thresh_minmax(), so the quads
+// are too.
+
+typedef struct quad_thresh_stream quad_thresh_stream_t;
+struct quad_thresh_stream
+{
+    apriltag_detector_t *td;
+    image_u8_t *im;        // input; rows [0, nrows) are valid
+    int nrows;
+
+    image_u8_t *quad_im;   // decimated input, or 'im'
+    image_u8_t *threshim;
+    int tw, th;
+    uint8_t *im_max, *im_min;
+    uint8_t *im_max_tmp, *im_min_tmp;
+
+    // tile rows done by each stage, and threshold rows labeled.
+    int nminmax, nblur, nthresh;
+    int nlabeled;
+
+    // run components, grown as rows are labeled.
+    components_t *cc;
+    uint32_t runs_cap;
+    unionfind_t uf;
+};
+
+// true when the stream front-end computes exactly what
+// apriltag_quad_thresh_minmax() would for td's settings.
+bool quad_thresh_stream_supported(apriltag_detector_t *td)
+{
+    float f = td->quad_decimate;
+    return td->quad_sigma == 0 && !td->qtp.deglitch &&
+        (f <= 1 || f == 1.5 || (f >= 2 && f == (int) f));
+}
 
-    for (int i = 0; i < zarray_size(clusters); i++) {
-        zarray_t *cluster;
-        zarray_get(clusters, i, &cluster);
-        zarray_destroy(cluster);
+quad_thresh_stream_t *quad_thresh_stream_begin(apriltag_detector_t *td, image_u8_t *im)
+{
+    quad_thresh_stream_t *qs = frame_arena_calloc(td->arena, 1, sizeof(quad_thresh_stream_t));
+    qs->td = td;
+    qs->im = im;
+
+    qs->quad_im = im;
+    if (td->quad_decimate > 1) {
+        int dw, dh;
+        image_u8_decimate_size(im, td->quad_decimate, &dw, &dh);
+        qs->quad_im = frame_arena_image_u8_create(td->arena, dw, dh, DEFAULT_ALIGNMENT_U8);
     }
-    zarray_destroy(clusters);
 
-    return quads;
+    int w = qs->quad_im->width, h = qs->quad_im->height;
+    assert(w < 32768);
+    assert(h < 32768);
+
+    qs->threshim = frame_arena_image_u8_create(td->arena, w, h, qs->quad_im->stride);
+    qs->tw = w / THRESH_TILESZ;
+    qs->th = h / THRESH_TILESZ;
+
+    size_t ntiles = (size_t) qs->tw * qs->th;
+    qs->im_max = frame_arena_alloc(td->arena, ntiles);
+    qs->im_min = frame_arena_alloc(td->arena, ntiles);
+    qs->im_max_tmp = frame_arena_alloc(td->arena, ntiles);
+    qs->im_min_tmp = frame_arena_alloc(td->arena, ntiles);
+
+    if (td->qtp.rle_components) {
+        components_t *cc = frame_arena_calloc(td->arena, 1, sizeof(components_t));
+        cc->w = w;
+        cc->h = h;
+        cc->row_start = frame_arena_alloc(td->arena, (h + 1) * sizeof(uint32_t));
+        cc->row_start[0] = 0;
+
+        // about one run per 8 pixels; grown when exceeded.
+        qs->runs_cap = (uint32_t) w*h/8 + 2*h + 2;
+        cc->runs = frame_arena_alloc(td->arena, qs->runs_cap * sizeof(struct component_run));
+        unionfind_init(&qs->uf, qs->runs_cap,
+                       frame_arena_alloc(td->arena, (size_t) (qs->runs_cap + 1) * 2 * sizeof(uint32_t)));
+        qs->cc = cc;
+    }
+
+    return qs;
+}
+
+// Number of input rows that tile row ty of the quad image depends on.
+static int stream_rows_needed(quad_thresh_stream_t *qs, int ty)
+{
+    float f = qs->td->quad_decimate;
+    int last = (ty + 1) * THRESH_TILESZ - 1; // last row of the tile row
+
+    if (f <= 1)
+        return last + 1;
+    if (f == 1.5)
+        return last / 2 * 3 + 3;
+    return last * (int) f + 1;
+}
+
+static void stream_grow_runs(quad_thresh_stream_t *qs, uint32_t nruns)
+{
+    frame_arena_t *fa = qs->td->arena;
+    uint32_t cap = qs->runs_cap;
+    while (cap < nruns)
+        cap *= 2;
+
+    struct component_run *runs = frame_arena_alloc(fa, cap * sizeof(struct component_run));
+    memcpy(runs, qs->cc->runs, qs->runs_cap * sizeof(struct component_run));
+    qs->cc->runs = runs;
+
+    // parent/size arrays keep their contents; new nodes are unset.
+    uint32_t *storage = frame_arena_alloc(fa, (size_t) (cap + 1) * 2 * sizeof(uint32_t));
+    memcpy(storage, qs->uf.parent, (qs->runs_cap + 1) * sizeof(uint32_t));
+    memset(storage + qs->runs_cap + 1, 0xff, (cap - qs->runs_cap) * sizeof(uint32_t));
+    memcpy(storage + cap + 1, qs->uf.size, (qs->runs_cap + 1) * sizeof(uint32_t));
+    memset(storage + cap + 1 + qs->runs_cap + 1, 0, (cap - qs->runs_cap) * sizeof(uint32_t));
+    qs->uf.maxid = cap;
+    qs->uf.parent = storage;
+    qs->uf.size = storage + cap + 1;
+
+    qs->runs_cap = cap;
+}
+
+// Labels threshold rows [nlabeled, y1), like connected_components_runs().
+static void stream_label_rows(quad_thresh_stream_t *qs, int y1)
+{
+    components_t *cc = qs->cc;
+    image_u8_t *threshim = qs->threshim;
+    int w = cc->w, ts = threshim->stride;
+
+    for (int y = qs->nlabeled; y < y1; y++) {
+        const uint8_t *row = &threshim->buf[y*ts];
+        cc->row_start[y+1] = cc->row_start[y] + count_runs(row, w);
+        if (cc->row_start[y+1] > qs->runs_cap)
+            stream_grow_runs(qs, cc->row_start[y+1]);
+
+        find_runs(row, w, &cc->runs[cc->row_start[y]]);
+
+        if (y > 0)
+            connect_run_rows(&qs->uf, &threshim->buf[(y-1)*ts], row, NULL, y, w,
+                             cc->runs, cc->row_start[y-1], cc->row_start[y], cc->row_start[y+1]);
+    }
+
+    qs->nlabeled = y1;
+}
+
+void quad_thresh_stream_rows(quad_thresh_stream_t *qs, int nrows)
+{
+    apriltag_detector_t *td = qs->td;
+    image_u8_t *qim = qs->quad_im;
+    int tw = qs->tw, th = qs->th, s = qim->stride;
+    bool complete = nrows >= qs->im->height;
+
+    qs->nrows = nrows;
+
+    // tile extrema; the last tile row also decimates the partial rows
+    // below it, so it waits for the whole frame.
+    while (qs->nminmax < th) {
+        int ty = qs->nminmax;
+        if (ty == th - 1 ? !complete : stream_rows_needed(qs, ty) > nrows)
+            break;
+
+        if (td->quad_decimate > 1)
+            thresh_decimate_minmax(qs->im, td->quad_decimate, qim, ty, ty + 1, qs->im_max, qs->im_min);
+        else
+            thresh_tile_minmax_row(&qim->buf[ty*THRESH_TILESZ*s], s, tw,
+                                   &qs->im_max[ty*tw], &qs->im_min[ty*tw]);
+        qs->nminmax++;
+    }
+
+    // 3x3 blur of the extrema, as in threshold().
+    while (qs->nblur < th && (qs->nblur + 1 < qs->nminmax || qs->nminmax == th)) {
+        int ty = qs->nblur;
+        const uint8_t *max_up = ty > 0 ? &qs->im_max[(ty-1)*tw] : NULL;
+        const uint8_t *min_up = ty > 0 ? &qs->im_min[(ty-1)*tw] : NULL;
+        const uint8_t *max_down = ty + 1 < th ? &qs->im_max[(ty+1)*tw] : NULL;
+        const uint8_t *min_down = ty + 1 < th ? &qs->im_min[(ty+1)*tw] : NULL;
+
+        thresh_tile_blur_row(max_up, &qs->im_max[ty*tw], max_down,
+                             min_up, &qs->im_min[ty*tw], min_down,
+                             tw, &qs->im_max_tmp[ty*tw], &qs->im_min_tmp[ty*tw]);
+        qs->nblur++;
+    }
+
+    // threshold each blurred tile row, with the partial tiles at its
+    // right; the last one also does the rows below the tile grid.
+    while (qs->nthresh < qs->nblur) {
+        int ty = qs->nthresh;
+        thresh_tile_threshold_row(&qim->buf[ty*THRESH_TILESZ*s],
+                                  &qs->threshim->buf[ty*THRESH_TILESZ*s], s,
+                                  &qs->im_max_tmp[ty*tw], &qs->im_min_tmp[ty*tw], tw,
+                                  td->qtp.min_white_black_diff);
+
+        int y1 = ty + 1 == th ? qim->height : (ty + 1) * THRESH_TILESZ;
+        threshold_partial_tiles(qim, qs->threshim, NULL, qs->im_max_tmp, qs->im_min_tmp,
+                                ty * THRESH_TILESZ, y1);
+        qs->nthresh++;
+    }
+
+    // the run labels of a row depend on the row above only.
+    if (qs->cc) {
+        int y1 = qs->nthresh == th ? qim->height : qs->nthresh * THRESH_TILESZ;
+        stream_label_rows(qs, y1);
+    }
+}
+
+zarray_t *quad_thresh_stream_finish(quad_thresh_stream_t *qs, image_u8_t **quad_im)
+{
+    apriltag_detector_t *td = qs->td;
+
+    if (qs->nrows < qs->im->height)
+        quad_thresh_stream_rows(qs, qs->im->height);
+
+    timeprofile_stamp(td->tp, "threshold");
+
+    image_u8_t *threshim = qs->threshim;
+    int w = threshim->width, h = threshim->height;
+
+    if (td->debug)
+        image_u8_write_pnm(threshim, "debug_threshold.pnm");
+
+    components_t *cc = qs->cc;
+    if (cc)
+        components_flatten(td->arena, cc, &qs->uf, cc->row_start[h]);
+    else
+        cc = connected_components(td, threshim, NULL, w, h, threshim->stride);
+
+    *quad_im = qs->quad_im;
+    return quads_from_components(td, qs->quad_im, threshim, NULL, cc, NULL);
 }
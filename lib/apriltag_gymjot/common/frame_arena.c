@@ -0,0 +1,373 @@
+/* gymjot: per-frame scratch allocator for the AprilTag detector.
+   See frame_arena.h. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "frame_arena.h"
+
+#if defined(ESP_PLATFORM) && defined(APRILTAG_ARENA_USE_PSRAM) && (APRILTAG_ARENA_USE_PSRAM)
+#include "esp_heap_caps.h"
+#define ARENA_MALLOC(sz) heap_caps_malloc((sz), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define ARENA_MALLOC(sz) malloc(sz)
+#endif
+
+#define ALIGN_UP(v, a) (((v) + ((a) - 1)) & ~((uintptr_t) (a) - 1))
+
+#define BLOCK_HDR_SIZE ALIGN_UP(sizeof(struct frame_arena_block), FRAME_ARENA_ALIGN)
+
+// Smallest block we bother asking the heap for.
+#define MIN_BLOCK_SIZE 4096
+
+static inline uint8_t *block_data(struct frame_arena_block *b)
+{
+    return ((uint8_t*) b) + BLOCK_HDR_SIZE;
+}
+
+static struct frame_arena_block *block_create(frame_arena_t *fa, size_t size)
+{
+    // over-allocate so that the data area can be aligned regardless of
+    // the alignment guarantees of the platform malloc.
+    uint8_t *mem = ARENA_MALLOC(BLOCK_HDR_SIZE + size + FRAME_ARENA_ALIGN);
+    if (mem == NULL)
+        return NULL;
+
+    fa->nheap_calls++;
+
+    struct frame_arena_block *b = (struct frame_arena_block*) mem;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    b->owned = true;
+    return b;
+}
+
+static void free_blocks(frame_arena_t *fa)
+{
+    struct frame_arena_block *b = fa->head;
+    while (b) {
+        struct frame_arena_block *next = b->next;
+        if (b->owned) {
+            free(b);
+            fa->nheap_calls++;
+        }
+        b = next;
+    }
+    fa->head = NULL;
+    fa->cur = NULL;
+}
+
+frame_arena_t *frame_arena_create(void)
+{
+    frame_arena_t *fa = calloc(1, sizeof(frame_arena_t));
+    if (fa == NULL)
+        return NULL;
+
+    fa->locked = true;
+    pthread_mutex_init(&fa->mutex, NULL);
+    return fa;
+}
+
+void frame_arena_destroy(frame_arena_t *fa)
+{
+    if (fa == NULL)
+        return;
+
+    free_blocks(fa);
+    pthread_mutex_destroy(&fa->mutex);
+    free(fa);
+}
+
+size_t frame_arena_capacity(const frame_arena_t *fa)
+{
+    size_t total = 0;
+    for (struct frame_arena_block *b = fa->head; b; b = b->next)
+        total += b->size;
+    return total;
+}
+
+// Size of a single block that holds 'high_water' bytes, with some
+// headroom for alignment padding so that the next frame of the same size
+// fits without heap calls.
+static size_t block_size_for(const frame_arena_t *fa, size_t high_water)
+{
+    size_t want = high_water + high_water / 8 + 1024;
+    return want < fa->reserved ? fa->reserved : want;
+}
+
+void frame_arena_reserve(frame_arena_t *fa, size_t bytes)
+{
+    assert(fa->in_use == 0);
+
+    if (bytes > fa->reserved)
+        fa->reserved = bytes;
+
+    if (fa->head && fa->head->next == NULL && fa->head->size >= bytes)
+        return;
+
+    free_blocks(fa);
+    fa->head = block_create(fa, bytes < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : bytes);
+    fa->cur = fa->head;
+}
+
+void frame_arena_reset(frame_arena_t *fa)
+{
+    fa->in_use = 0;
+    if (fa->high_water > fa->recent_high_water)
+        fa->recent_high_water = fa->high_water;
+    fa->high_water = 0;
+
+    if (fa->head == NULL || !fa->head->owned)
+        return;
+
+    if (fa->head->next != NULL) {
+        // The last frame(s) spilled into overflow blocks. Fold everything
+        // into one block.
+        free_blocks(fa);
+        fa->head = block_create(fa, block_size_for(fa, fa->recent_high_water));
+    } else if (FRAME_ARENA_DECAY_FRAMES > 0 && ++fa->nresets >= FRAME_ARENA_DECAY_FRAMES) {
+        // Shrink only when clearly oversized, so that frames jittering
+        // around the working set do not reallocate every check.
+        size_t want = block_size_for(fa, fa->recent_high_water);
+        if (fa->head->size / 2 > want) {
+            free_blocks(fa);
+            fa->head = block_create(fa, want);
+        }
+        fa->nresets = 0;
+        fa->recent_high_water = 0;
+    }
+
+    if (fa->head)
+        fa->head->used = 0;
+    fa->cur = fa->head;
+}
+
+static void *alloc_locked(frame_arena_t *fa, size_t bytes)
+{
+    if (bytes == 0)
+        bytes = 1;
+
+    struct frame_arena_block *b = fa->cur;
+
+    while (1) {
+        if (b != NULL) {
+            uintptr_t base = (uintptr_t) block_data(b);
+            uintptr_t start = ALIGN_UP(base + b->used, FRAME_ARENA_ALIGN);
+            uintptr_t end = start + bytes;
+
+            if (end <= base + b->size) {
+                fa->in_use += end - (base + b->used);
+                if (fa->in_use > fa->high_water)
+                    fa->high_water = fa->in_use;
+
+                b->used = end - base;
+                fa->cur = b;
+                return (void*) start;
+            }
+
+            // blocks after the current one are spares left over by
+            // frame_arena_release(); they are empty by definition.
+            if (b->next != NULL) {
+                b = b->next;
+                b->used = 0;
+                continue;
+            }
+        }
+
+        // out of space: grow geometrically.
+        size_t capacity = frame_arena_capacity(fa);
+        size_t size = bytes + FRAME_ARENA_ALIGN;
+        if (size < capacity)
+            size = capacity;
+        if (size < MIN_BLOCK_SIZE)
+            size = MIN_BLOCK_SIZE;
+
+        struct frame_arena_block *nb = block_create(fa, size);
+        if (nb == NULL)
+            return NULL;
+
+        if (b == NULL) {
+            fa->head = nb;
+        } else {
+            b->next = nb;
+        }
+        b = nb;
+    }
+}
+
+void *frame_arena_alloc(frame_arena_t *fa, size_t bytes)
+{
+    if (!fa->locked)
+        return alloc_locked(fa, bytes);
+
+    pthread_mutex_lock(&fa->mutex);
+    void *p = alloc_locked(fa, bytes);
+    pthread_mutex_unlock(&fa->mutex);
+    return p;
+}
+
+void *frame_arena_calloc(frame_arena_t *fa, size_t n, size_t el_sz)
+{
+    void *p = frame_arena_alloc(fa, n * el_sz);
+    if (p != NULL)
+        memset(p, 0, n * el_sz);
+    return p;
+}
+
+frame_arena_mark_t frame_arena_mark(frame_arena_t *fa)
+{
+    frame_arena_mark_t mark = {
+        .block = fa->cur,
+        .used = fa->cur ? fa->cur->used : 0,
+        .in_use = fa->in_use
+    };
+    return mark;
+}
+
+void frame_arena_release(frame_arena_t *fa, frame_arena_mark_t mark)
+{
+    if (mark.block == NULL) {
+        fa->cur = fa->head;
+        if (fa->cur)
+            fa->cur->used = 0;
+    } else {
+        fa->cur = mark.block;
+        fa->cur->used = mark.used;
+    }
+    fa->in_use = mark.in_use;
+}
+
+void frame_arena_init_slab(frame_arena_t *child, frame_arena_t *parent, size_t bytes)
+{
+    memset(child, 0, sizeof(frame_arena_t));
+    child->locked = false;
+
+    uint8_t *mem = frame_arena_alloc(parent, BLOCK_HDR_SIZE + bytes);
+    if (mem == NULL)
+        return;
+
+    struct frame_arena_block *b = (struct frame_arena_block*) mem;
+    b->next = NULL;
+    b->size = bytes;
+    b->used = 0;
+    b->owned = false;
+
+    child->head = b;
+    child->cur = b;
+}
+
+void frame_arena_fini_slab(frame_arena_t *child, frame_arena_t *parent)
+{
+    free_blocks(child);
+
+    if (parent->locked)
+        pthread_mutex_lock(&parent->mutex);
+    parent->nheap_calls += child->nheap_calls;
+    if (parent->locked)
+        pthread_mutex_unlock(&parent->mutex);
+}
+
+zarray_t *frame_arena_zarray_create(frame_arena_t *fa, size_t el_sz, int capacity)
+{
+    assert(el_sz > 0);
+
+    zarray_t *za = frame_arena_alloc(fa, sizeof(zarray_t));
+    if (za == NULL)
+        return NULL;
+
+    za->el_sz = el_sz;
+    za->size = 0;
+    za->alloc = 0;
+    za->data = NULL;
+
+    frame_arena_zarray_ensure_capacity(fa, za, capacity);
+    return za;
+}
+
+void frame_arena_zarray_ensure_capacity(frame_arena_t *fa, zarray_t *za, int capacity)
+{
+    if (capacity <= za->alloc)
+        return;
+
+    int alloc = za->alloc * 2;
+    if (alloc < 8)
+        alloc = 8;
+    if (alloc < capacity)
+        alloc = capacity;
+
+    char *data = frame_arena_alloc(fa, alloc * za->el_sz);
+    if (data == NULL)
+        return;
+
+    if (za->size > 0)
+        memcpy(data, za->data, za->size * za->el_sz);
+
+    za->data = data;
+    za->alloc = alloc;
+}
+
+void frame_arena_zarray_add_slow(frame_arena_t *fa, zarray_t *za, const void *p)
+{
+    if (za->size + 1 > za->alloc) {
+        frame_arena_zarray_ensure_capacity(fa, za, za->size + 1);
+        if (za->size + 1 > za->alloc)
+            return; // out of memory; drop the element.
+    }
+
+    memcpy(&za->data[za->size*za->el_sz], p, za->el_sz);
+    za->size++;
+}
+
+void frame_arena_zarray_add_range(frame_arena_t *fa, zarray_t *dest, const zarray_t *source,
+                                  int start, int end)
+{
+    assert(dest->el_sz == source->el_sz);
+    assert(start >= 0);
+    assert(end <= source->size);
+
+    if (start >= end)
+        return;
+
+    int count = end - start;
+    frame_arena_zarray_ensure_capacity(fa, dest, dest->size + count);
+    if (dest->size + count > dest->alloc)
+        return;
+
+    memcpy(&dest->data[dest->size*dest->el_sz], &source->data[source->el_sz*start],
+           dest->el_sz*count);
+    dest->size += count;
+}
+
+image_u8_t *frame_arena_image_u8_create(frame_arena_t *fa, int width, int height, int alignment)
+{
+    int stride = width;
+    if ((stride % alignment) != 0)
+        stride += alignment - (stride % alignment);
+
+    image_u8_t *im = frame_arena_alloc(fa, sizeof(image_u8_t));
+    uint8_t *buf = frame_arena_alloc(fa, (size_t) height*stride);
+    if (im == NULL || buf == NULL)
+        return NULL;
+
+    // const initializer
+    image_u8_t tmp = { .width = width, .height = height, .stride = stride, .buf = buf };
+    memcpy(im, &tmp, sizeof(image_u8_t));
+    return im;
+}
+
+matd_t *frame_arena_matd_create(frame_arena_t *fa, int rows, int cols)
+{
+    assert(rows > 0 && cols > 0);
+
+    matd_t *m = frame_arena_alloc(fa, sizeof(matd_t));
+    double *data = frame_arena_alloc(fa, sizeof(double) * rows * cols);
+    if (m == NULL || data == NULL)
+        return NULL;
+
+    m->nrows = rows;
+    m->ncols = cols;
+    m->data = data;
+    return m;
+}
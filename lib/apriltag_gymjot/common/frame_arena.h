@@ -0,0 +1,159 @@
+/* gymjot: per-frame scratch allocator for the AprilTag detector.
+
+A frame arena is a bump allocator that hands out memory which is only
+valid until the next frame_arena_reset(). The detector allocates every
+intermediate buffer of a frame (decimated image, threshold image,
+union-find, clusters, quads, decode scratch) from one arena and resets it
+once the frame is done, so in steady state a detection performs no heap
+calls for its scratch data.
+
+When a frame needs more memory than the arena holds, an overflow block is
+taken from the heap. On the next reset the chain is folded back into a
+single block large enough for the whole frame, so the arena converges to
+the working set of the configured resolution after the first frame(s).
+Every FRAME_ARENA_DECAY_FRAMES resets, a block more than twice the size
+the busiest of those frames needed is replaced by one sized for that
+frame, so a single busy frame does not pin its memory for good.
+
+Every malloc/free performed by the arena is counted in nheap_calls; this
+is the number the detector reports to prove the steady state.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "zarray.h"
+#include "image_types.h"
+#include "matd.h"
+#include "pthreads_cross.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Alignment of every pointer returned by the arena.
+#define FRAME_ARENA_ALIGN 16
+
+// Frames after which an oversized block shrinks to the recent working
+// set. 0 keeps the largest block ever needed.
+#ifndef FRAME_ARENA_DECAY_FRAMES
+#define FRAME_ARENA_DECAY_FRAMES 64
+#endif
+
+struct frame_arena_block
+{
+    struct frame_arena_block *next;
+
+    size_t size; // usable bytes following the header
+    size_t used;
+
+    // false when the block lives inside memory owned by someone else
+    // (see frame_arena_init_slab)
+    bool owned;
+};
+
+typedef struct frame_arena frame_arena_t;
+struct frame_arena
+{
+    struct frame_arena_block *head;
+    struct frame_arena_block *cur; // block currently being filled
+
+    // Largest number of bytes that were in use at once since the last
+    // reset, and since the last decay check.
+    size_t high_water;
+    size_t recent_high_water;
+    size_t in_use;
+
+    // Resets since the last decay check, and the size that
+    // frame_arena_reserve() asked for, which the arena never shrinks below.
+    uint32_t nresets;
+    size_t reserved;
+
+    // Number of heap calls (malloc + free) made by this arena since
+    // creation. Monotonic.
+    uint32_t nheap_calls;
+
+    // When set, frame_arena_alloc() takes 'mutex' so worker tasks may
+    // allocate from a shared arena. mark/release/reset are NOT
+    // thread-safe. Slab arenas are single-threaded and never lock.
+    bool locked;
+    pthread_mutex_t mutex;
+};
+
+typedef struct frame_arena_mark frame_arena_mark_t;
+struct frame_arena_mark
+{
+    struct frame_arena_block *block;
+    size_t used;
+    size_t in_use;
+};
+
+// Create an empty arena. No memory is reserved until the first
+// allocation or frame_arena_reserve().
+frame_arena_t *frame_arena_create(void);
+void frame_arena_destroy(frame_arena_t *fa);
+
+// Make sure that at least 'bytes' can be allocated after the next reset
+// without touching the heap. Only legal while the arena is empty.
+void frame_arena_reserve(frame_arena_t *fa, size_t bytes);
+
+// Invalidate every allocation. If overflow blocks were needed since the
+// last reset, they are merged into one block sized for the high-water mark
+// of the recent frames; an oversized block shrinks to it as well (see
+// FRAME_ARENA_DECAY_FRAMES).
+void frame_arena_reset(frame_arena_t *fa);
+
+void *frame_arena_alloc(frame_arena_t *fa, size_t bytes);
+void *frame_arena_calloc(frame_arena_t *fa, size_t n, size_t el_sz);
+
+// Stack-like scoped allocation: everything allocated after
+// frame_arena_mark() is released by frame_arena_release(). Intended for
+// single-threaded use of an arena (e.g. a slab owned by a worker task).
+frame_arena_mark_t frame_arena_mark(frame_arena_t *fa);
+void frame_arena_release(frame_arena_t *fa, frame_arena_mark_t mark);
+
+// Initialize 'child' as an arena over 'bytes' carved from 'parent'. The
+// child may be used by exactly one thread. If it runs out it falls back to
+// the heap; frame_arena_fini_slab() frees those blocks and adds the
+// child's heap calls to the parent's counter.
+void frame_arena_init_slab(frame_arena_t *child, frame_arena_t *parent, size_t bytes);
+void frame_arena_fini_slab(frame_arena_t *child, frame_arena_t *parent);
+
+// Total usable bytes currently held by the arena.
+size_t frame_arena_capacity(const frame_arena_t *fa);
+
+// zarrays whose header and storage live inside the arena. They grow by
+// copying into a larger arena buffer (the old one is reclaimed on reset)
+// and must never be passed to zarray_destroy(), zarray_add() or any other
+// function that may realloc/free their storage.
+zarray_t *frame_arena_zarray_create(frame_arena_t *fa, size_t el_sz, int capacity);
+void frame_arena_zarray_ensure_capacity(frame_arena_t *fa, zarray_t *za, int capacity);
+void frame_arena_zarray_add_slow(frame_arena_t *fa, zarray_t *za, const void *p);
+void frame_arena_zarray_add_range(frame_arena_t *fa, zarray_t *dest, const zarray_t *source,
+                                  int start, int end);
+
+static inline void frame_arena_zarray_add(frame_arena_t *fa, zarray_t *za, const void *p)
+{
+    if (za->size < za->alloc) {
+        memcpy(&za->data[za->size*za->el_sz], p, za->el_sz);
+        za->size++;
+        return;
+    }
+    frame_arena_zarray_add_slow(fa, za, p);
+}
+
+// An image whose header and pixels live in the arena (contents are
+// undefined). Never pass it to image_u8_destroy().
+image_u8_t *frame_arena_image_u8_create(frame_arena_t *fa, int width, int height, int alignment);
+
+// A matrix whose header and data live in the arena (contents are
+// undefined). Never pass it to matd_destroy().
+matd_t *frame_arena_matd_create(frame_arena_t *fa, int rows, int cols);
+
+#ifdef __cplusplus
+}
+#endif
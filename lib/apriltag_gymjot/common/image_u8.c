@@ -35,10 +35,6 @@ either expressed or implied, of the Regents of The University of Michigan.
 #include "common/pnm.h"
 #include "common/math_util.h"
 
-// least common multiple of 64 (sandy bridge cache line) and 24 (stride
-// needed for RGB in 8-wide vector processing)
-#define DEFAULT_ALIGNMENT_U8 96
-
 image_u8_t *image_u8_create_stride(unsigned int width, unsigned int height, unsigned int stride)
 {
     uint8_t *buf = calloc(height*stride, sizeof(uint8_t));
@@ -436,14 +432,25 @@ image_u8_t *image_u8_rotate(const image_u8_t *in, double rad, uint8_t pad)
     return out;
 }
 
-image_u8_t *image_u8_decimate(image_u8_t *im, float ffactor)
+void image_u8_decimate_size(const image_u8_t *im, float ffactor, int *width, int *height)
+{
+    if (ffactor == 1.5) {
+        *width = im->width / 3 * 2;
+        *height = im->height / 3 * 2;
+        return;
+    }
+
+    int factor = (int) ffactor;
+    *width = 1 + (im->width - 1)/factor;
+    *height = 1 + (im->height - 1)/factor;
+}
+
+void image_u8_decimate_into(const image_u8_t *im, float ffactor, image_u8_t *decim)
 {
     int width = im->width, height = im->height;
 
     if (ffactor == 1.5) {
-        int swidth = width / 3 * 2, sheight = height / 3 * 2;
-
-        image_u8_t *decim = image_u8_create(swidth, sheight);
+        int swidth = decim->width, sheight = decim->height;
 
         int y = 0, sy = 0;
         while (sy < sheight) {
@@ -483,14 +490,11 @@ image_u8_t *image_u8_decimate(image_u8_t *im, float ffactor)
             sy += 2;
         }
 
-        return decim;
+        return;
     }
 
     int factor = (int) ffactor;
 
-    int swidth = 1 + (width - 1)/factor;
-    int sheight = 1 + (height - 1)/factor;
-    image_u8_t *decim = image_u8_create(swidth, sheight);
     int sy = 0;
     for (int y = 0; y < height; y += factor) {
         int sx = 0;
@@ -500,6 +504,15 @@ image_u8_t *image_u8_decimate(image_u8_t *im, float ffactor)
         }
         sy++;
     }
+}
+
+image_u8_t *image_u8_decimate(image_u8_t *im, float ffactor)
+{
+    int swidth, sheight;
+    image_u8_decimate_size(im, ffactor, &swidth, &sheight);
+
+    image_u8_t *decim = image_u8_create(swidth, sheight);
+    image_u8_decimate_into(im, ffactor, decim);
     return decim;
 }
 
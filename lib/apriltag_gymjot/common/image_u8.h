@@ -34,6 +34,10 @@ either expressed or implied, of the Regents of The University of Michigan.
 extern "C" {
 #endif
 
+// least common multiple of 64 (sandy bridge cache line) and 24 (stride
+// needed for RGB in 8-wide vector processing)
+#define DEFAULT_ALIGNMENT_U8 96
+
 typedef struct image_u8_lut image_u8_lut_t;
 struct image_u8_lut
 {
@@ -73,6 +77,11 @@ void image_u8_gaussian_blur(image_u8_t *im, double sigma, int k);
 // 1.5, 2, 3, 4, ... supported
 image_u8_t *image_u8_decimate(image_u8_t *im, float factor);
 
+// Size of the image produced by image_u8_decimate(), and a variant that
+// writes into a caller-provided image of exactly that size.
+void image_u8_decimate_size(const image_u8_t *im, float factor, int *width, int *height);
+void image_u8_decimate_into(const image_u8_t *im, float factor, image_u8_t *decim);
+
 void image_u8_destroy(image_u8_t *im);
 
 // Write a pnm. Returns 0 on success
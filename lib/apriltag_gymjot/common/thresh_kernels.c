@@ -0,0 +1,744 @@
+/* gymjot: row kernels of the adaptive threshold. See thresh_kernels.h. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "thresh_kernels.h"
+
+#if !defined(APRILTAG_THRESH_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THRESH_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define THRESH_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define THRESH_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+////////////////////////////////////////////////////////////////
+// scalar reference
+
+static void minmax_row_scalar(const uint8_t *im, int stride, int tw,
+                              uint8_t *im_max, uint8_t *im_min)
+{
+    for (int tx = 0; tx < tw; tx++) {
+        uint8_t max = 0, min = 255;
+
+        for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+            for (int dx = 0; dx < THRESH_TILESZ; dx++) {
+                uint8_t v = im[dy*stride + tx*THRESH_TILESZ + dx];
+                if (v < min)
+                    min = v;
+                if (v > max)
+                    max = v;
+            }
+        }
+
+        im_max[tx] = max;
+        im_min[tx] = min;
+    }
+}
+
+// 3x3 filter at tile tx only; used by the vector versions for the first
+// and last tile of the row.
+static inline void blur_tile_scalar(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                                    const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                                    int tw, int tx, uint8_t *out_max, uint8_t *out_min)
+{
+    const uint8_t *maxs[3] = { max_up, max, max_down };
+    const uint8_t *mins[3] = { min_up, min, min_down };
+    uint8_t mx = 0, mn = 255;
+
+    for (int dy = 0; dy < 3; dy++) {
+        if (maxs[dy] == NULL)
+            continue;
+        for (int dx = -1; dx <= 1; dx++) {
+            if (tx+dx < 0 || tx+dx >= tw)
+                continue;
+
+            uint8_t m = maxs[dy][tx+dx];
+            if (m > mx)
+                mx = m;
+            m = mins[dy][tx+dx];
+            if (m < mn)
+                mn = m;
+        }
+    }
+
+    out_max[tx] = mx;
+    out_min[tx] = mn;
+}
+
+static void blur_row_scalar(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                            const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                            int tw, uint8_t *out_max, uint8_t *out_min)
+{
+    for (int tx = 0; tx < tw; tx++)
+        blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, tx, out_max, out_min);
+}
+
+static inline void threshold_tile_scalar(const uint8_t *im, uint8_t *threshim, int stride,
+                                         int max, int min, int min_white_black_diff)
+{
+    // low contrast region? (no edges)
+    if (max - min < min_white_black_diff) {
+        for (int dy = 0; dy < THRESH_TILESZ; dy++)
+            memset(&threshim[dy*stride], 127, THRESH_TILESZ);
+        return;
+    }
+
+    // argument for biasing towards dark; specular highlights
+    // can be substantially brighter than white tag parts
+    uint8_t thresh = min + (max - min) / 2;
+
+    for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+        for (int dx = 0; dx < THRESH_TILESZ; dx++) {
+            uint8_t v = im[dy*stride + dx];
+            threshim[dy*stride + dx] = v > thresh ? 255 : 0;
+        }
+    }
+}
+
+static void threshold_row_scalar(const uint8_t *im, uint8_t *threshim, int stride,
+                                 const uint8_t *im_max, const uint8_t *im_min, int tw,
+                                 int min_white_black_diff)
+{
+    for (int tx = 0; tx < tw; tx++)
+        threshold_tile_scalar(&im[tx*THRESH_TILESZ], &threshim[tx*THRESH_TILESZ], stride,
+                              im_max[tx], im_min[tx], min_white_black_diff);
+}
+
+////////////////////////////////////////////////////////////////
+// SWAR: four bytes per 32-bit word
+
+#define SWAR_H 0x80808080u
+
+static inline uint32_t swar_load(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void swar_store(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+// 0xff in every byte where a >= b (unsigned), 0x00 elsewhere.
+static inline uint32_t swar_ge(uint32_t a, uint32_t b)
+{
+    // high bit of each byte of x: low 7 bits of a >= low 7 bits of b.
+    // Setting/clearing the high bits keeps borrows inside their byte.
+    uint32_t x = (a | SWAR_H) - (b & ~SWAR_H);
+    uint32_t ge = ((a & ~b) | (~(a ^ b) & x)) & SWAR_H;
+    return (ge >> 7) * 0xff;
+}
+
+static inline uint32_t swar_max(uint32_t a, uint32_t b)
+{
+    return b ^ ((a ^ b) & swar_ge(a, b));
+}
+
+static inline uint32_t swar_min(uint32_t a, uint32_t b)
+{
+    return a ^ ((a ^ b) & swar_ge(a, b));
+}
+
+// *mx = max(a,b), *mn = min(a,b) from a single comparison.
+static inline void swar_minmax(uint32_t a, uint32_t b, uint32_t *mx, uint32_t *mn)
+{
+    uint32_t d = (a ^ b) & swar_ge(a, b);
+    *mx = b ^ d;
+    *mn = a ^ d;
+}
+
+static void minmax_row_swar(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min)
+{
+    for (int tx = 0; tx < tw; tx++) {
+        const uint8_t *p = &im[tx*THRESH_TILESZ];
+        uint32_t mx01, mn01, mx23, mn23;
+
+        swar_minmax(swar_load(p), swar_load(p + stride), &mx01, &mn01);
+        swar_minmax(swar_load(p + 2*stride), swar_load(p + 3*stride), &mx23, &mn23);
+
+        uint32_t mx = swar_max(mx01, mx23);
+        uint32_t mn = swar_min(mn01, mn23);
+
+        // fold the four columns into the low byte. The bytes shifted
+        // in from the top never reach it.
+        mx = swar_max(mx, mx >> 16);
+        mx = swar_max(mx, mx >> 8);
+        mn = swar_min(mn, mn >> 16);
+        mn = swar_min(mn, mn >> 8);
+
+        im_max[tx] = mx & 0xff;
+        im_min[tx] = mn & 0xff;
+    }
+}
+
+static void blur_row_swar(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                          const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                          int tw, uint8_t *out_max, uint8_t *out_min)
+{
+    if (tw < 3) {
+        blur_row_scalar(max_up, max, max_down, min_up, min, min_down, tw, out_max, out_min);
+        return;
+    }
+
+    // a missing row contributes nothing; substituting the center row is
+    // equivalent.
+    if (max_up == NULL) { max_up = max; min_up = min; }
+    if (max_down == NULL) { max_down = max; min_down = min; }
+
+    blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, 0, out_max, out_min);
+
+    int tx = 1;
+    for (; tx + 4 <= tw - 1; tx += 4) {
+        uint32_t mx = 0, mn = 0xffffffffu;
+        for (int dx = -1; dx <= 1; dx++) {
+            mx = swar_max(mx, swar_max(swar_load(&max_up[tx+dx]),
+                                       swar_max(swar_load(&max[tx+dx]), swar_load(&max_down[tx+dx]))));
+            mn = swar_min(mn, swar_min(swar_load(&min_up[tx+dx]),
+                                       swar_min(swar_load(&min[tx+dx]), swar_load(&min_down[tx+dx]))));
+        }
+        swar_store(&out_max[tx], mx);
+        swar_store(&out_min[tx], mn);
+    }
+
+    for (; tx < tw; tx++)
+        blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, tx, out_max, out_min);
+}
+
+static void threshold_row_swar(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff)
+{
+    for (int tx = 0; tx < tw; tx++) {
+        const uint8_t *p = &im[tx*THRESH_TILESZ];
+        uint8_t *q = &threshim[tx*THRESH_TILESZ];
+        int max = im_max[tx], min = im_min[tx];
+
+        if (max - min < min_white_black_diff) {
+            for (int dy = 0; dy < THRESH_TILESZ; dy++)
+                swar_store(&q[dy*stride], 0x7f7f7f7fu);
+            continue;
+        }
+
+        uint32_t thresh = (uint32_t) (min + (max - min) / 2) * 0x01010101u;
+
+        // v > thresh  <=>  !(thresh >= v)
+        for (int dy = 0; dy < THRESH_TILESZ; dy++)
+            swar_store(&q[dy*stride], ~swar_ge(thresh, swar_load(&p[dy*stride])));
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// SSE2
+
+#ifdef THRESH_HAVE_SSE2
+
+// low byte of every 32-bit lane <- max (resp. min) of the lane's 4 bytes.
+static inline __m128i sse2_hmax4(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_epi32(v, 16));
+    v = _mm_max_epu8(v, _mm_srli_epi32(v, 8));
+    return _mm_and_si128(v, _mm_set1_epi32(0xff));
+}
+
+static inline __m128i sse2_hmin4(__m128i v)
+{
+    v = _mm_min_epu8(v, _mm_srli_epi32(v, 16));
+    v = _mm_min_epu8(v, _mm_srli_epi32(v, 8));
+    return _mm_and_si128(v, _mm_set1_epi32(0xff));
+}
+
+static void minmax_row_sse2(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min)
+{
+    int tx = 0;
+
+    // 16 tiles (64 pixels) per iteration.
+    for (; tx + 16 <= tw; tx += 16) {
+        __m128i mx[4], mn[4];
+
+        for (int k = 0; k < 4; k++) {
+            const uint8_t *p = &im[tx*THRESH_TILESZ + 16*k];
+            __m128i r0 = _mm_loadu_si128((const __m128i*) p);
+            __m128i r1 = _mm_loadu_si128((const __m128i*) (p + stride));
+            __m128i r2 = _mm_loadu_si128((const __m128i*) (p + 2*stride));
+            __m128i r3 = _mm_loadu_si128((const __m128i*) (p + 3*stride));
+
+            mx[k] = sse2_hmax4(_mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3)));
+            mn[k] = sse2_hmin4(_mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3)));
+        }
+
+        // lanes hold 0..255, so the signed saturating packs are exact.
+        __m128i vmax = _mm_packus_epi16(_mm_packs_epi32(mx[0], mx[1]), _mm_packs_epi32(mx[2], mx[3]));
+        __m128i vmin = _mm_packus_epi16(_mm_packs_epi32(mn[0], mn[1]), _mm_packs_epi32(mn[2], mn[3]));
+
+        _mm_storeu_si128((__m128i*) &im_max[tx], vmax);
+        _mm_storeu_si128((__m128i*) &im_min[tx], vmin);
+    }
+
+    minmax_row_scalar(&im[tx*THRESH_TILESZ], stride, tw - tx, &im_max[tx], &im_min[tx]);
+}
+
+static void blur_row_sse2(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                          const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                          int tw, uint8_t *out_max, uint8_t *out_min)
+{
+    if (tw < 3) {
+        blur_row_scalar(max_up, max, max_down, min_up, min, min_down, tw, out_max, out_min);
+        return;
+    }
+
+    if (max_up == NULL) { max_up = max; min_up = min; }
+    if (max_down == NULL) { max_down = max; min_down = min; }
+
+    blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, 0, out_max, out_min);
+
+    int tx = 1;
+    for (; tx + 16 <= tw - 1; tx += 16) {
+        __m128i mx = _mm_setzero_si128(), mn = _mm_set1_epi8((char) 0xff);
+        for (int dx = -1; dx <= 1; dx++) {
+            mx = _mm_max_epu8(mx, _mm_loadu_si128((const __m128i*) &max_up[tx+dx]));
+            mx = _mm_max_epu8(mx, _mm_loadu_si128((const __m128i*) &max[tx+dx]));
+            mx = _mm_max_epu8(mx, _mm_loadu_si128((const __m128i*) &max_down[tx+dx]));
+            mn = _mm_min_epu8(mn, _mm_loadu_si128((const __m128i*) &min_up[tx+dx]));
+            mn = _mm_min_epu8(mn, _mm_loadu_si128((const __m128i*) &min[tx+dx]));
+            mn = _mm_min_epu8(mn, _mm_loadu_si128((const __m128i*) &min_down[tx+dx]));
+        }
+        _mm_storeu_si128((__m128i*) &out_max[tx], mx);
+        _mm_storeu_si128((__m128i*) &out_min[tx], mn);
+    }
+
+    for (; tx < tw; tx++)
+        blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, tx, out_max, out_min);
+}
+
+// per-byte mask of (range < diff), for ranges in [0, 255].
+static inline __m128i sse2_low_contrast(__m128i range, int diff)
+{
+    if (diff <= 0)
+        return _mm_setzero_si128();
+    if (diff > 255)
+        return _mm_set1_epi8((char) 0xff);
+
+    // range <= diff-1
+    __m128i d = _mm_set1_epi8((char) (diff - 1));
+    return _mm_cmpeq_epi8(_mm_min_epu8(range, d), range);
+}
+
+static void threshold_row_sse2(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff)
+{
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    const __m128i gray = _mm_set1_epi8(127);
+    int tx = 0;
+
+    // 4 tiles (16 pixels) per iteration.
+    for (; tx + 4 <= tw; tx += 4) {
+        int32_t tmax, tmin;
+        memcpy(&tmax, &im_max[tx], 4);
+        memcpy(&tmin, &im_min[tx], 4);
+
+        // replicate each tile's value over its 4 columns.
+        __m128i mx = _mm_cvtsi32_si128(tmax);
+        __m128i mn = _mm_cvtsi32_si128(tmin);
+        mx = _mm_unpacklo_epi8(mx, mx);
+        mx = _mm_unpacklo_epi16(mx, mx);
+        mn = _mm_unpacklo_epi8(mn, mn);
+        mn = _mm_unpacklo_epi16(mn, mn);
+
+        __m128i range = _mm_subs_epu8(mx, mn);
+        __m128i half = _mm_and_si128(_mm_srli_epi16(range, 1), _mm_set1_epi8(0x7f));
+        __m128i thresh = _mm_xor_si128(_mm_add_epi8(mn, half), bias);
+        __m128i low = sse2_low_contrast(range, min_white_black_diff);
+        __m128i lowval = _mm_and_si128(low, gray);
+
+        for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+            __m128i v = _mm_loadu_si128((const __m128i*) &im[dy*stride + tx*THRESH_TILESZ]);
+            __m128i gt = _mm_cmpgt_epi8(_mm_xor_si128(v, bias), thresh);
+            __m128i out = _mm_or_si128(lowval, _mm_andnot_si128(low, gt));
+            _mm_storeu_si128((__m128i*) &threshim[dy*stride + tx*THRESH_TILESZ], out);
+        }
+    }
+
+    threshold_row_scalar(&im[tx*THRESH_TILESZ], &threshim[tx*THRESH_TILESZ], stride,
+                         &im_max[tx], &im_min[tx], tw - tx, min_white_black_diff);
+}
+
+#endif // THRESH_HAVE_SSE2
+
+////////////////////////////////////////////////////////////////
+// AVX2 (blur uses the SSE2 kernel; it touches 1/16 of the data)
+
+#ifdef THRESH_HAVE_AVX2
+
+static inline __m256i avx2_hmax4(__m256i v)
+{
+    v = _mm256_max_epu8(v, _mm256_srli_epi32(v, 16));
+    v = _mm256_max_epu8(v, _mm256_srli_epi32(v, 8));
+    return _mm256_and_si256(v, _mm256_set1_epi32(0xff));
+}
+
+static inline __m256i avx2_hmin4(__m256i v)
+{
+    v = _mm256_min_epu8(v, _mm256_srli_epi32(v, 16));
+    v = _mm256_min_epu8(v, _mm256_srli_epi32(v, 8));
+    return _mm256_and_si256(v, _mm256_set1_epi32(0xff));
+}
+
+// packs work per 128-bit lane; this restores tile order afterwards.
+static inline __m256i avx2_pack4(const __m256i a[4])
+{
+    __m256i p = _mm256_packus_epi16(_mm256_packs_epi32(a[0], a[1]), _mm256_packs_epi32(a[2], a[3]));
+    return _mm256_permutevar8x32_epi32(p, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+static void minmax_row_avx2(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min)
+{
+    int tx = 0;
+
+    // 32 tiles (128 pixels) per iteration.
+    for (; tx + 32 <= tw; tx += 32) {
+        __m256i mx[4], mn[4];
+
+        for (int k = 0; k < 4; k++) {
+            const uint8_t *p = &im[tx*THRESH_TILESZ + 32*k];
+            __m256i r0 = _mm256_loadu_si256((const __m256i*) p);
+            __m256i r1 = _mm256_loadu_si256((const __m256i*) (p + stride));
+            __m256i r2 = _mm256_loadu_si256((const __m256i*) (p + 2*stride));
+            __m256i r3 = _mm256_loadu_si256((const __m256i*) (p + 3*stride));
+
+            mx[k] = avx2_hmax4(_mm256_max_epu8(_mm256_max_epu8(r0, r1), _mm256_max_epu8(r2, r3)));
+            mn[k] = avx2_hmin4(_mm256_min_epu8(_mm256_min_epu8(r0, r1), _mm256_min_epu8(r2, r3)));
+        }
+
+        _mm256_storeu_si256((__m256i*) &im_max[tx], avx2_pack4(mx));
+        _mm256_storeu_si256((__m256i*) &im_min[tx], avx2_pack4(mn));
+    }
+
+    minmax_row_sse2(&im[tx*THRESH_TILESZ], stride, tw - tx, &im_max[tx], &im_min[tx]);
+}
+
+static void threshold_row_avx2(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff)
+{
+    const __m256i bias = _mm256_set1_epi8((char) 0x80);
+    const __m256i gray = _mm256_set1_epi8(127);
+    int tx = 0;
+
+    __m256i low_all;
+    int low_fixed = 1;
+    if (min_white_black_diff <= 0)
+        low_all = _mm256_setzero_si256();
+    else if (min_white_black_diff > 255)
+        low_all = _mm256_set1_epi8((char) 0xff);
+    else
+        low_fixed = 0, low_all = _mm256_set1_epi8((char) (min_white_black_diff - 1));
+
+    // 8 tiles (32 pixels) per iteration.
+    for (; tx + 8 <= tw; tx += 8) {
+        // replicate each tile's value over its 4 columns.
+        __m256i mx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) &im_max[tx]));
+        __m256i mn = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) &im_min[tx]));
+        mx = _mm256_or_si256(mx, _mm256_slli_epi32(mx, 8));
+        mx = _mm256_or_si256(mx, _mm256_slli_epi32(mx, 16));
+        mn = _mm256_or_si256(mn, _mm256_slli_epi32(mn, 8));
+        mn = _mm256_or_si256(mn, _mm256_slli_epi32(mn, 16));
+
+        __m256i range = _mm256_subs_epu8(mx, mn);
+        __m256i half = _mm256_and_si256(_mm256_srli_epi16(range, 1), _mm256_set1_epi8(0x7f));
+        __m256i thresh = _mm256_xor_si256(_mm256_add_epi8(mn, half), bias);
+        __m256i low = low_fixed ? low_all :
+            _mm256_cmpeq_epi8(_mm256_min_epu8(range, low_all), range);
+        __m256i lowval = _mm256_and_si256(low, gray);
+
+        for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) &im[dy*stride + tx*THRESH_TILESZ]);
+            __m256i gt = _mm256_cmpgt_epi8(_mm256_xor_si256(v, bias), thresh);
+            __m256i out = _mm256_or_si256(lowval, _mm256_andnot_si256(low, gt));
+            _mm256_storeu_si256((__m256i*) &threshim[dy*stride + tx*THRESH_TILESZ], out);
+        }
+    }
+
+    threshold_row_sse2(&im[tx*THRESH_TILESZ], &threshim[tx*THRESH_TILESZ], stride,
+                       &im_max[tx], &im_min[tx], tw - tx, min_white_black_diff);
+}
+
+#endif // THRESH_HAVE_AVX2
+
+////////////////////////////////////////////////////////////////
+// NEON
+
+#ifdef THRESH_HAVE_NEON
+
+static void minmax_row_neon(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min)
+{
+    int tx = 0;
+
+    // 16 tiles (64 pixels) per iteration. vld4 de-interleaves the four
+    // columns of every tile into separate registers.
+    for (; tx + 16 <= tw; tx += 16) {
+        uint8x16_t mx = vdupq_n_u8(0), mn = vdupq_n_u8(255);
+
+        for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+            uint8x16x4_t r = vld4q_u8(&im[dy*stride + tx*THRESH_TILESZ]);
+            mx = vmaxq_u8(mx, vmaxq_u8(vmaxq_u8(r.val[0], r.val[1]), vmaxq_u8(r.val[2], r.val[3])));
+            mn = vminq_u8(mn, vminq_u8(vminq_u8(r.val[0], r.val[1]), vminq_u8(r.val[2], r.val[3])));
+        }
+
+        vst1q_u8(&im_max[tx], mx);
+        vst1q_u8(&im_min[tx], mn);
+    }
+
+    minmax_row_scalar(&im[tx*THRESH_TILESZ], stride, tw - tx, &im_max[tx], &im_min[tx]);
+}
+
+static void blur_row_neon(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                          const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                          int tw, uint8_t *out_max, uint8_t *out_min)
+{
+    if (tw < 3) {
+        blur_row_scalar(max_up, max, max_down, min_up, min, min_down, tw, out_max, out_min);
+        return;
+    }
+
+    if (max_up == NULL) { max_up = max; min_up = min; }
+    if (max_down == NULL) { max_down = max; min_down = min; }
+
+    blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, 0, out_max, out_min);
+
+    int tx = 1;
+    for (; tx + 16 <= tw - 1; tx += 16) {
+        uint8x16_t mx = vdupq_n_u8(0), mn = vdupq_n_u8(255);
+        for (int dx = -1; dx <= 1; dx++) {
+            mx = vmaxq_u8(mx, vmaxq_u8(vld1q_u8(&max_up[tx+dx]),
+                                       vmaxq_u8(vld1q_u8(&max[tx+dx]), vld1q_u8(&max_down[tx+dx]))));
+            mn = vminq_u8(mn, vminq_u8(vld1q_u8(&min_up[tx+dx]),
+                                       vminq_u8(vld1q_u8(&min[tx+dx]), vld1q_u8(&min_down[tx+dx]))));
+        }
+        vst1q_u8(&out_max[tx], mx);
+        vst1q_u8(&out_min[tx], mn);
+    }
+
+    for (; tx < tw; tx++)
+        blur_tile_scalar(max_up, max, max_down, min_up, min, min_down, tw, tx, out_max, out_min);
+}
+
+static inline uint8x16_t neon_spread4(const uint8_t *p)
+{
+    // [a b c d] -> [a a a a b b b b c c c c d d d d]
+    uint8x8_t v = vreinterpret_u8_u32(vld1_lane_u32((const uint32_t*) (const void*) p, vdup_n_u32(0), 0));
+    uint8x8x2_t z = vzip_u8(v, v);    // a a b b c c d d
+    uint8x8x2_t zz = vzip_u8(z.val[0], z.val[0]);
+    return vcombine_u8(zz.val[0], zz.val[1]);
+}
+
+static void threshold_row_neon(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff)
+{
+    const uint8x16_t gray = vdupq_n_u8(127);
+    int tx = 0;
+
+    // 4 tiles (16 pixels) per iteration.
+    for (; tx + 4 <= tw; tx += 4) {
+        uint8x16_t mx = neon_spread4(&im_max[tx]);
+        uint8x16_t mn = neon_spread4(&im_min[tx]);
+
+        uint8x16_t range = vqsubq_u8(mx, mn);
+        uint8x16_t thresh = vaddq_u8(mn, vshrq_n_u8(range, 1));
+
+        uint8x16_t low;
+        if (min_white_black_diff <= 0)
+            low = vdupq_n_u8(0);
+        else if (min_white_black_diff > 255)
+            low = vdupq_n_u8(255);
+        else
+            low = vcltq_u8(range, vdupq_n_u8((uint8_t) min_white_black_diff));
+
+        for (int dy = 0; dy < THRESH_TILESZ; dy++) {
+            uint8x16_t v = vld1q_u8(&im[dy*stride + tx*THRESH_TILESZ]);
+            uint8x16_t gt = vcgtq_u8(v, thresh);
+            vst1q_u8(&threshim[dy*stride + tx*THRESH_TILESZ], vbslq_u8(low, gray, gt));
+        }
+    }
+
+    threshold_row_scalar(&im[tx*THRESH_TILESZ], &threshim[tx*THRESH_TILESZ], stride,
+                         &im_max[tx], &im_min[tx], tw - tx, min_white_black_diff);
+}
+
+#endif // THRESH_HAVE_NEON
+
+////////////////////////////////////////////////////////////////
+
+static const thresh_kernels_t kernels[] = {
+    { "scalar", minmax_row_scalar, blur_row_scalar, threshold_row_scalar },
+    { "swar", minmax_row_swar, blur_row_swar, threshold_row_swar },
+#ifdef THRESH_HAVE_SSE2
+    { "sse2", minmax_row_sse2, blur_row_sse2, threshold_row_sse2 },
+#endif
+#ifdef THRESH_HAVE_AVX2
+    { "avx2", minmax_row_avx2, blur_row_sse2, threshold_row_avx2 },
+#endif
+#ifdef THRESH_HAVE_NEON
+    { "neon", minmax_row_neon, blur_row_neon, threshold_row_neon },
+#endif
+};
+
+#define NKERNELS ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+#if defined(APRILTAG_THRESH_SCALAR)
+#define BEST_minmax minmax_row_scalar
+#define BEST_blur blur_row_scalar
+#define BEST_threshold threshold_row_scalar
+#elif defined(THRESH_HAVE_AVX2)
+#define BEST_minmax minmax_row_avx2
+#define BEST_blur blur_row_sse2
+#define BEST_threshold threshold_row_avx2
+#elif defined(THRESH_HAVE_SSE2)
+#define BEST_minmax minmax_row_sse2
+#define BEST_blur blur_row_sse2
+#define BEST_threshold threshold_row_sse2
+#elif defined(THRESH_HAVE_NEON)
+#define BEST_minmax minmax_row_neon
+#define BEST_blur blur_row_neon
+#define BEST_threshold threshold_row_neon
+#else
+// The SWAR min/max costs about a dozen ALU ops per compare, which loses to
+// the byte loop on cores with native min/max instructions (Xtensa MINU/MAXU).
+#define BEST_minmax minmax_row_scalar
+#define BEST_blur blur_row_swar
+#define BEST_threshold threshold_row_swar
+#endif
+
+const thresh_kernels_t *thresh_kernels_get(int idx)
+{
+    if (idx < 0 || idx >= NKERNELS)
+        return NULL;
+    return &kernels[idx];
+}
+
+const thresh_kernels_t *thresh_kernels_default(void)
+{
+    static const thresh_kernels_t best = {
+#if defined(APRILTAG_THRESH_SCALAR)
+        "scalar",
+#elif defined(THRESH_HAVE_AVX2)
+        "avx2",
+#elif defined(THRESH_HAVE_SSE2)
+        "sse2",
+#elif defined(THRESH_HAVE_NEON)
+        "neon",
+#else
+        "swar",
+#endif
+        BEST_minmax, BEST_blur, BEST_threshold
+    };
+
+    return &best;
+}
+
+void thresh_tile_minmax_row(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min)
+{
+    BEST_minmax(im, stride, tw, im_max, im_min);
+}
+
+void thresh_tile_blur_row(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                          const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                          int tw, uint8_t *out_max, uint8_t *out_min)
+{
+    BEST_blur(max_up, max, max_down, min_up, min, min_down, tw, out_max, out_min);
+}
+
+void thresh_tile_threshold_row(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff)
+{
+    BEST_threshold(im, threshim, stride, im_max, im_min, tw, min_white_black_diff);
+}
+
+////////////////////////////////////////////////////////////////
+// fused decimation
+
+// point sampling; the factor is a constant in each instantiation.
+static inline void decimate_row_int(const uint8_t *src, uint8_t *dst, int dw, const int factor)
+{
+    for (int sx = 0; sx < dw; sx++)
+        dst[sx] = src[sx*factor];
+}
+
+// two output rows from three input rows; see image_u8_decimate_into().
+static void decimate_rows_1_5(const uint8_t *src, int stride, uint8_t *dst, int dstride, int dw)
+{
+    const uint8_t *r0 = src, *r1 = src + stride, *r2 = src + 2*stride;
+    uint8_t *d0 = dst, *d1 = dst + dstride;
+
+    for (int x = 0, sx = 0; sx < dw; x += 3, sx += 2) {
+        // a b c
+        // d e f
+        // g h i
+        int a = r0[x], b = r0[x+1], c = r0[x+2];
+        int d = r1[x], e = r1[x+1], f = r1[x+2];
+        int g = r2[x], h = r2[x+1], i = r2[x+2];
+
+        d0[sx+0] = (4*a+2*b+2*d+e)/9;
+        d0[sx+1] = (4*c+2*b+2*f+e)/9;
+        d1[sx+0] = (4*g+2*d+2*h+e)/9;
+        d1[sx+1] = (4*i+2*f+2*h+e)/9;
+    }
+}
+
+// output rows [sy0, sy1); sy0 and sy1 are even for factor 1.5.
+static void decimate_rows(const image_u8_t *im, float factor, image_u8_t *decim, int sy0, int sy1)
+{
+    int dw = decim->width, ds = decim->stride, s = im->stride;
+
+    if (factor == 1.5) {
+        for (int sy = sy0; sy < sy1; sy += 2)
+            decimate_rows_1_5(&im->buf[(sy/2*3)*s], s, &decim->buf[sy*ds], ds, dw);
+        return;
+    }
+
+    int f = (int) factor;
+    for (int sy = sy0; sy < sy1; sy++) {
+        const uint8_t *src = &im->buf[sy*f*s];
+        uint8_t *dst = &decim->buf[sy*ds];
+
+        switch (f) {
+            case 2: decimate_row_int(src, dst, dw, 2); break;
+            case 3: decimate_row_int(src, dst, dw, 3); break;
+            default: decimate_row_int(src, dst, dw, f); break;
+        }
+    }
+}
+
+void thresh_decimate_minmax(const image_u8_t *im, float factor, image_u8_t *decim,
+                            int ty0, int ty1, uint8_t *im_max, uint8_t *im_min)
+{
+    int tw = decim->width / THRESH_TILESZ;
+    int th = decim->height / THRESH_TILESZ;
+    int ds = decim->stride;
+
+    for (int ty = ty0; ty < ty1; ty++) {
+        decimate_rows(im, factor, decim, ty*THRESH_TILESZ, (ty+1)*THRESH_TILESZ);
+        BEST_minmax(&decim->buf[ty*THRESH_TILESZ*ds], ds, tw, &im_max[ty*tw], &im_min[ty*tw]);
+    }
+
+    if (ty1 == th)
+        decimate_rows(im, factor, decim, th*THRESH_TILESZ, decim->height);
+}
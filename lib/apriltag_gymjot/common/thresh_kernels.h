@@ -0,0 +1,89 @@
+/* gymjot: row kernels of the adaptive threshold in apriltag_quad_thresh.c.
+
+threshold() works on 4x4 tiles: it computes the min/max of every tile,
+dilates/erodes those over the 3x3 neighbouring tiles and then binarizes
+each tile against the midpoint of its extrema. The kernels below do one
+row of tiles at a time.
+
+Several implementations are compiled, all bit-exact with the scalar
+reference:
+
+  scalar   the original byte-at-a-time loops
+  swar     32-bit SIMD-within-a-register, for cores without vector
+           units (e.g. Xtensa). Used for blur and threshold only; the
+           scalar min/max is faster there.
+  sse2     x86 (always available on x86-64)
+  avx2     x86, when the translation unit is built with -mavx2
+  neon     ARMv7/ARMv8 with NEON
+
+The thresh_tile_* entry points use the best one available at build time.
+Define APRILTAG_THRESH_SCALAR to force the scalar path.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "image_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THRESH_TILESZ 4
+
+// Min/max of each of the tw 4x4 tiles whose top-left pixel row starts at im.
+typedef void (*thresh_minmax_row_fn)(const uint8_t *im, int stride, int tw,
+                                     uint8_t *im_max, uint8_t *im_min);
+
+// 3x3 max (resp. min) filter over tile row 'max' (resp. 'min'). The rows
+// above/below are NULL at the top/bottom of the image.
+typedef void (*thresh_blur_row_fn)(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                                   const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                                   int tw, uint8_t *out_max, uint8_t *out_min);
+
+// Binarize tw tiles of 4 pixel rows: 255 above the tile's threshold, 0 at
+// or below it, 127 for tiles whose contrast is below min_white_black_diff.
+// im and threshim share 'stride'.
+typedef void (*thresh_threshold_row_fn)(const uint8_t *im, uint8_t *threshim, int stride,
+                                        const uint8_t *im_max, const uint8_t *im_min, int tw,
+                                        int min_white_black_diff);
+
+typedef struct thresh_kernels thresh_kernels_t;
+struct thresh_kernels
+{
+    const char *name;
+
+    thresh_minmax_row_fn minmax_row;
+    thresh_blur_row_fn blur_row;
+    thresh_threshold_row_fn threshold_row;
+};
+
+// The implementations compiled into this build, index 0 being the scalar
+// reference. Returns NULL past the last one.
+const thresh_kernels_t *thresh_kernels_get(int idx);
+
+// The implementation used by the detector.
+const thresh_kernels_t *thresh_kernels_default(void);
+
+void thresh_tile_minmax_row(const uint8_t *im, int stride, int tw,
+                            uint8_t *im_max, uint8_t *im_min);
+void thresh_tile_blur_row(const uint8_t *max_up, const uint8_t *max, const uint8_t *max_down,
+                          const uint8_t *min_up, const uint8_t *min, const uint8_t *min_down,
+                          int tw, uint8_t *out_max, uint8_t *out_min);
+void thresh_tile_threshold_row(const uint8_t *im, uint8_t *threshim, int stride,
+                               const uint8_t *im_max, const uint8_t *im_min, int tw,
+                               int min_white_black_diff);
+
+// Fused decimation: writes output rows [4*ty0, 4*ty1) of 'decim' (the
+// image_u8_decimate_into() result for 'factor', 1.5 or an integer >= 2)
+// and the extrema of those tile rows into im_max/im_min, reading each
+// input row once. Each band of 4 output rows is passed to the min/max
+// kernel while it is still in cache. When ty1 is the last tile row, the
+// rows below it that do not form a full tile are decimated too.
+void thresh_decimate_minmax(const image_u8_t *im, float factor, image_u8_t *decim,
+                            int ty0, int ty1, uint8_t *im_max, uint8_t *im_min);
+
+#ifdef __cplusplus
+}
+#endif
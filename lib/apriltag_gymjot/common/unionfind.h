@@ -44,14 +44,21 @@ struct unionfind
     uint32_t *size;
 };
 
-static inline unionfind_t *unionfind_create(uint32_t maxid)
+// Initialize a union-find over caller-provided storage, which must hold
+// 2*(maxid+1) uint32_t values (parent and size arrays).
+static inline void unionfind_init(unionfind_t *uf, uint32_t maxid, uint32_t *storage)
 {
-    unionfind_t *uf = (unionfind_t*) calloc(1, sizeof(unionfind_t));
     uf->maxid = maxid;
-    uf->parent = (uint32_t *) malloc((maxid+1) * sizeof(uint32_t) * 2);
+    uf->parent = storage;
     memset(uf->parent, 0xff, (maxid+1) * sizeof(uint32_t));
     uf->size = uf->parent + (maxid+1);
     memset(uf->size, 0, (maxid+1) * sizeof(uint32_t));
+}
+
+static inline unionfind_t *unionfind_create(uint32_t maxid)
+{
+    unionfind_t *uf = (unionfind_t*) calloc(1, sizeof(unionfind_t));
+    unionfind_init(uf, maxid, (uint32_t *) malloc((maxid+1) * sizeof(uint32_t) * 2));
     return uf;
 }
 
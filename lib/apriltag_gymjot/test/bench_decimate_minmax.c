@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <common/image_u8.h>
+#include <common/thresh_kernels.h>
+#include <common/time_util.h>
+
+// Compares the two-pass front end (image_u8_decimate_into() followed by
+// the tile min/max over the decimated image) with the fused
+// thresh_decimate_minmax(). Not a test; run by hand:
+//
+//   bench_decimate_minmax [width height [iterations]]
+//
+// The default 320x240 is the camera resolution used on the device.
+
+int
+main(int argc, char *argv[])
+{
+    int w = 320, h = 240, iters = 2000;
+    if (argc >= 3) {
+        w = atoi(argv[1]);
+        h = atoi(argv[2]);
+    }
+    if (argc >= 4)
+        iters = atoi(argv[3]);
+
+    if (w < 24 || h < 24 || iters < 1) {
+        fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    image_u8_t *im = image_u8_create(w, h);
+    uint32_t state = 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            state = state*1664525u + 1013904223u;
+            im->buf[y*im->stride + x] = state >> 24;
+        }
+    }
+
+    static const float factors[] = { 1.5, 2, 3 };
+
+    printf("%dx%d, %d iterations, %s kernels\n", w, h, iters, thresh_kernels_default()->name);
+    printf("%-8s %14s %14s\n", "decimate", "two-pass us", "fused us");
+
+    for (int i = 0; i < 3; i++) {
+        float factor = factors[i];
+
+        int dw, dh;
+        image_u8_decimate_size(im, factor, &dw, &dh);
+        int tw = dw / THRESH_TILESZ, th = dh / THRESH_TILESZ;
+
+        image_u8_t *decim = image_u8_create(dw, dh);
+        uint8_t *im_max = malloc(tw*th + 1), *im_min = malloc(tw*th + 1);
+
+        int64_t t0 = utime_now();
+        for (int it = 0; it < iters; it++) {
+            image_u8_decimate_into(im, factor, decim);
+            for (int ty = 0; ty < th; ty++)
+                thresh_tile_minmax_row(&decim->buf[ty*THRESH_TILESZ*decim->stride], decim->stride, tw,
+                                       &im_max[ty*tw], &im_min[ty*tw]);
+        }
+
+        int64_t t1 = utime_now();
+        for (int it = 0; it < iters; it++)
+            thresh_decimate_minmax(im, factor, decim, 0, th, im_max, im_min);
+        int64_t t2 = utime_now();
+
+        printf("%-8.1f %14.2f %14.2f\n", factor,
+               (double) (t1 - t0) / iters, (double) (t2 - t1) / iters);
+
+        free(im_max);
+        free(im_min);
+        image_u8_destroy(decim);
+    }
+
+    image_u8_destroy(im);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+#include <common/timeprofile.h>
+
+// Per-frame time of the stages that read the threshold image, and the
+// detector's arena size, with the byte and the packed threshold image
+// (td->qtp.packed_threshold). Not a test; run by hand:
+//
+//   bench_packed_threshold [-d decimate] image.jpg|image.pnm
+
+static image_u8_t *
+load(const char *path)
+{
+    size_t len = strlen(path);
+    if (len > 4 && strcmp(&path[len - 4], ".jpg") == 0) {
+        pjpeg_t *pjpeg = pjpeg_create_from_file(path, 0, NULL);
+        if (pjpeg == NULL)
+            return NULL;
+        image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+        pjpeg_destroy(pjpeg);
+        return im;
+    }
+
+    return image_u8_create_from_pnm(path);
+}
+
+// time of the last detection's stage 'name', in us.
+static int64_t
+stage_us(const timeprofile_t *tp, const char *name)
+{
+    int64_t last = tp->utime;
+    for (int i = 0; i < zarray_size(tp->stamps); i++) {
+        struct timeprofile_entry *stamp;
+        zarray_get_volatile(tp->stamps, i, &stamp);
+        if (strcmp(stamp->name, name) == 0)
+            return stamp->utime - last;
+        last = stamp->utime;
+    }
+    return 0;
+}
+
+static const char *stages[] = { "threshold", "unionfind", "make clusters" };
+#define NSTAGES 3
+
+struct result
+{
+    double frame_ms;
+    double stage_ms[NSTAGES];
+    size_t arena_bytes;
+    int ndetections;
+};
+
+static void
+run(image_u8_t *im, apriltag_family_t *tf, float decimate, bool packed, struct result *r)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = 1;
+    td->compact_decode_index = true;
+    td->qtp.packed_threshold = packed;
+    apriltag_detector_add_family(td, tf);
+
+    // the first frame sizes the arena.
+    zarray_t *dets = apriltag_detector_detect(td, im);
+    r->ndetections = zarray_size(dets);
+    apriltag_detections_destroy(dets);
+    r->arena_bytes = frame_arena_capacity(td->arena);
+
+    r->frame_ms = 1e30;
+    for (int s = 0; s < NSTAGES; s++)
+        r->stage_ms[s] = 1e30;
+
+    for (int rep = 0; rep < 20; rep++) {
+        int64_t t0 = utime_now();
+        apriltag_detections_destroy(apriltag_detector_detect(td, im));
+        r->frame_ms = fmin(r->frame_ms, (utime_now() - t0) / 1000.0);
+        for (int s = 0; s < NSTAGES; s++)
+            r->stage_ms[s] = fmin(r->stage_ms[s], stage_us(td->tp, stages[s]) / 1000.0);
+    }
+
+    apriltag_detector_destroy(td);
+}
+
+int
+main(int argc, char *argv[])
+{
+    float decimate = 2;
+
+    int a = 1;
+    for (; a + 1 < argc && argv[a][0] == '-'; a += 2) {
+        if (strcmp(argv[a], "-d") == 0)
+            decimate = atof(argv[a+1]);
+    }
+
+    if (a >= argc) {
+        fprintf(stderr, "usage: %s [-d decimate] image\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    image_u8_t *im = load(argv[a]);
+    if (im == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[a]);
+        return EXIT_FAILURE;
+    }
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    struct result bytes, packed;
+    run(im, tf, decimate, false, &bytes);
+    run(im, tf, decimate, true, &packed);
+
+    int w = im->width / decimate, h = im->height / decimate;
+    printf("%dx%d, decimate %.1f, %d/%d detections\n", im->width, im->height, decimate,
+           bytes.ndetections, packed.ndetections);
+    printf("threshold image  %8d B  %8d B\n", w*h, 2 * 8 * ((w + 63) / 64) * h);
+    printf("arena            %8zu B  %8zu B\n", bytes.arena_bytes, packed.arena_bytes);
+    for (int s = 0; s < NSTAGES; s++)
+        printf("%-16s %8.3f ms %8.3f ms\n", stages[s], bytes.stage_ms[s], packed.stage_ms[s]);
+    printf("frame            %8.3f ms %8.3f ms\n", bytes.frame_ms, packed.frame_ms);
+
+    image_u8_destroy(im);
+    tag36h11_destroy(tf);
+
+    return EXIT_SUCCESS;
+}
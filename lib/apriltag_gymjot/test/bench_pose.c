@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apriltag.h>
+#include <apriltag_pose.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+
+// Mean time of estimate_tag_pose(), estimate_tag_pose_fast(),
+// estimate_tag_pose_track() and estimate_tag_distance() over the
+// detections of an image; the tracks see every detection once per
+// repeat, as if the image were a still sequence. Not a test; run by hand:
+//
+//   bench_pose [-n repeats] image.jpg|image.pnm
+
+static image_u8_t *
+load(const char *path)
+{
+    size_t len = strlen(path);
+    if (len > 4 && strcmp(&path[len - 4], ".jpg") == 0) {
+        pjpeg_t *pjpeg = pjpeg_create_from_file(path, 0, NULL);
+        if (pjpeg == NULL)
+            return NULL;
+        image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+        pjpeg_destroy(pjpeg);
+        return im;
+    }
+
+    return image_u8_create_from_pnm(path);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int repeats = 200;
+
+    int a = 1;
+    for (; a + 1 < argc && argv[a][0] == '-'; a += 2) {
+        if (strcmp(argv[a], "-n") == 0)
+            repeats = atoi(argv[a+1]);
+    }
+
+    if (a >= argc) {
+        fprintf(stderr, "usage: %s [-n repeats] image\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    image_u8_t *im = load(argv[a]);
+    if (im == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[a]);
+        return EXIT_FAILURE;
+    }
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = 1;
+    apriltag_detector_add_family(td, tf);
+
+    zarray_t *dets = apriltag_detector_detect(td, im);
+    int n = zarray_size(dets);
+    if (n <= 0) {
+        fprintf(stderr, "no detections in %s\n", argv[a]);
+        return EXIT_FAILURE;
+    }
+
+    double err_sum = 0;
+    int64_t t0 = utime_now();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < n; i++) {
+            apriltag_detection_t *det;
+            zarray_get(dets, i, &det);
+
+            apriltag_detection_info_t info = {
+                .det = det, .tagsize = 0.1,
+                .fx = 600, .fy = 600, .cx = im->width / 2.0, .cy = im->height / 2.0
+            };
+            apriltag_pose_t pose;
+            err_sum += estimate_tag_pose(&info, &pose);
+            matd_destroy(pose.R);
+            matd_destroy(pose.t);
+        }
+    }
+    double us = (utime_now() - t0) / (double) (repeats * n);
+
+    double fast_err_sum = 0;
+    t0 = utime_now();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < n; i++) {
+            apriltag_detection_t *det;
+            zarray_get(dets, i, &det);
+
+            apriltag_detection_info_t info = {
+                .det = det, .tagsize = 0.1,
+                .fx = 600, .fy = 600, .cx = im->width / 2.0, .cy = im->height / 2.0
+            };
+            apriltag_pose_fast_t poses[2];
+            if (estimate_tag_pose_fast(&info, poses) == 2)
+                fast_err_sum += poses[0].err;
+        }
+    }
+    double fast_us = (utime_now() - t0) / (double) (repeats * n);
+
+    apriltag_pose_track_t *tracks = calloc(n, sizeof(apriltag_pose_track_t));
+    for (int i = 0; i < n; i++)
+        apriltag_pose_track_init(&tracks[i]);
+
+    double track_err_sum = 0;
+    t0 = utime_now();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < n; i++) {
+            apriltag_detection_t *det;
+            zarray_get(dets, i, &det);
+
+            apriltag_detection_info_t info = {
+                .det = det, .tagsize = 0.1,
+                .fx = 600, .fy = 600, .cx = im->width / 2.0, .cy = im->height / 2.0
+            };
+            track_err_sum += estimate_tag_pose_track(&info, &tracks[i]);
+        }
+    }
+    double track_us = (utime_now() - t0) / (double) (repeats * n);
+
+    int nfull = 0;
+    for (int i = 0; i < n; i++) {
+        nfull += tracks[i].nfull;
+        apriltag_pose_track_clear(&tracks[i]);
+    }
+    free(tracks);
+
+    double dist_sum = 0;
+    t0 = utime_now();
+    for (int r = 0; r < repeats; r++) {
+        for (int i = 0; i < n; i++) {
+            apriltag_detection_t *det;
+            zarray_get(dets, i, &det);
+
+            apriltag_detection_info_t info = {
+                .det = det, .tagsize = 0.1,
+                .fx = 600, .fy = 600, .cx = im->width / 2.0, .cy = im->height / 2.0
+            };
+            dist_sum += estimate_tag_distance(&info);
+        }
+    }
+    double dist_us = (utime_now() - t0) / (double) (repeats * n);
+
+    printf("%d detections\n", n);
+    printf("estimate_tag_pose       %7.2f us (mean object-space error %.3g)\n", us, err_sum / (repeats * n));
+    printf("estimate_tag_pose_fast  %7.2f us (mean reprojection error %.3g px)\n", fast_us,
+           fast_err_sum / (repeats * n));
+    printf("estimate_tag_pose_track %7.2f us (mean object-space error %.3g, %d full searches)\n",
+           track_us, track_err_sum / (repeats * n), nfull);
+    printf("estimate_tag_distance   %7.2f us (mean distance %.3f)\n", dist_us, dist_sum / (repeats * n));
+
+    apriltag_detections_destroy(dets);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/math_util.h>
+#include <common/time_util.h>
+
+// Distance sweep: one tag36h11 tag, from far (small) to near (large), on
+// a cluttered background. For each size, compares detection and time of
+// a fixed decimation of 1, a fixed decimation of D and the pyramid
+// search from decimation D. Not a test; run by hand:
+//
+//   bench_pyramid [decimate [width height [iterations]]]
+
+// gradient plus random gray rectangles; the same for every run.
+static void
+draw_background(image_u8_t *im)
+{
+    for (int y = 0; y < im->height; y++)
+        for (int x = 0; x < im->width; x++)
+            im->buf[y*im->stride + x] = 80 + 100 * x / im->width + 40 * y / im->height;
+
+    srand(1);
+    int nrects = im->width * im->height / 1500;
+    for (int i = 0; i < nrects; i++) {
+        int w = 2 + rand() % 40, h = 2 + rand() % 40;
+        int x0 = rand() % im->width, y0 = rand() % im->height;
+        int v = 30 + rand() % 200;
+        for (int y = y0; y < y0 + h && y < im->height; y++)
+            for (int x = x0; x < x0 + w && x < im->width; x++)
+                im->buf[y*im->stride + x] = v;
+    }
+}
+
+// the tag centered, edge px across the black square, printed on paper
+// with two more cells of white around its own white border.
+static void
+draw_tag(image_u8_t *im, image_u8_t *tag, apriltag_family_t *tf, double edge)
+{
+    double cell = edge / tf->width_at_border;
+    double size = cell * (tag->width + 4);
+    double x0 = (im->width - size) / 2 + 0.3, y0 = (im->height - size) / 2 + 0.2;
+
+    for (int y = imax(0, y0); y < y0 + size && y < im->height; y++) {
+        for (int x = imax(0, x0); x < x0 + size && x < im->width; x++) {
+            int u = (x + 0.5 - x0) / cell - 2, v = (y + 0.5 - y0) / cell - 2;
+            bool white = u < 0 || v < 0 || u >= tag->width || v >= tag->height ||
+                tag->buf[v*tag->stride + u];
+            im->buf[y*im->stride + x] = white ? 230 : 25;
+        }
+    }
+}
+
+static bool
+found(zarray_t *dets, int id)
+{
+    for (int i = 0; i < zarray_size(dets); i++) {
+        apriltag_detection_t *det;
+        zarray_get(dets, i, &det);
+        if (det->id == id)
+            return true;
+    }
+    return false;
+}
+
+static double
+time_detect(apriltag_detector_t *td, image_u8_t *im, int iters, bool *hit)
+{
+    zarray_t *dets = apriltag_detector_detect(td, im);
+    *hit = found(dets, 7);
+    apriltag_detections_destroy(dets);
+
+    double best = 1e30;
+    for (int it = 0; it < iters; it++) {
+        int64_t t0 = utime_now();
+        apriltag_detections_destroy(apriltag_detector_detect(td, im));
+        best = fmin(best, utime_now() - t0);
+    }
+    return best / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+    float decimate = argc >= 2 ? atof(argv[1]) : 3;
+    int width = argc >= 4 ? atoi(argv[2]) : 320;
+    int height = argc >= 4 ? atoi(argv[3]) : 240;
+    int iters = argc >= 5 ? atoi(argv[4]) : 20;
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->nthreads = 1;
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    image_u8_t *tag = apriltag_to_image(tf, 7);
+    image_u8_t *im = image_u8_create(width, height);
+
+    printf("%dx%d, min of %d runs, ms (* = found)\n", width, height, iters);
+    printf("edge px   decimate 1   decimate %.1f   pyramid %.1f  full-res px\n", decimate, decimate);
+
+    static const double edges[] = { 10, 12, 14, 16, 20, 24, 32, 40, 56, 80, 112, 160 };
+    double total[3] = { 0, 0, 0 };
+    int nfound[3] = { 0, 0, 0 };
+    int nedges = 0;
+
+    for (int e = 0; e < (int) (sizeof(edges) / sizeof(edges[0])); e++) {
+        if (edges[e] * (tag->width + 4) / tf->width_at_border > fmin(width, height))
+            break;
+
+        draw_background(im);
+        draw_tag(im, tag, tf, edges[e]);
+        nedges++;
+
+        bool hit[3];
+        double ms[3];
+
+        td->pyramid = false;
+        td->quad_decimate = 1;
+        ms[0] = time_detect(td, im, iters, &hit[0]);
+        td->quad_decimate = decimate;
+        ms[1] = time_detect(td, im, iters, &hit[1]);
+        td->pyramid = true;
+        ms[2] = time_detect(td, im, iters, &hit[2]);
+
+        for (int i = 0; i < 3; i++) {
+            total[i] += ms[i];
+            nfound[i] += hit[i];
+        }
+
+        printf("%7.0f   %9.2f%c   %11.2f%c   %10.2f%c  %5.1f%%\n", edges[e],
+               ms[0], hit[0] ? '*' : ' ', ms[1], hit[1] ? '*' : ' ', ms[2], hit[2] ? '*' : ' ',
+               100.0 * td->npyramid_pixels / (width * height));
+    }
+
+    printf("found     %9d/%d %11d/%d %10d/%d\n", nfound[0], nedges, nfound[1], nedges, nfound[2], nedges);
+    printf("mean ms   %10.2f   %12.2f   %11.2f\n", total[0] / nedges, total[1] / nedges, total[2] / nedges);
+
+    image_u8_destroy(im);
+    image_u8_destroy(tag);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+
+    return EXIT_SUCCESS;
+}
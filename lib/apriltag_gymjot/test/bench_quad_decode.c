@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <tagStandard41h12.h>
+#include <tagCircle49h12.h>
+#include <common/pjpeg.h>
+
+// Times the payload decode of every quad with the double, the generic
+// single-precision and the layout-specialized path. Not a test; run by
+// hand:
+//
+//   bench_quad_decode image.jpg [decimate [iterations [family [min_margin]]]]
+//
+// family is tag36h11 (default), tagStandard41h12 or tagCircle49h12.
+// With min_margin, also reports how many decodes each early-reject stage
+// dropped.
+//
+// Edge refinement is off so that the "decode+refinement" stage is the
+// decode alone. Reports the fastest iteration, which is the least
+// disturbed by the rest of the system.
+
+static double
+decode_us(apriltag_detector_t *td, image_u8_t *im, int iters, int *nquads)
+{
+    double best = -1;
+
+    for (int it = 0; it < iters; it++) {
+        double total = 0;
+        zarray_t *dets = apriltag_detector_detect(td, im);
+        apriltag_detections_destroy(dets);
+
+        for (int i = 1; i < zarray_size(td->tp->stamps); i++) {
+            struct timeprofile_entry *stamp, *prev;
+            zarray_get_volatile(td->tp->stamps, i, &stamp);
+            if (strcmp(stamp->name, "decode+refinement"))
+                continue;
+            zarray_get_volatile(td->tp->stamps, i - 1, &prev);
+            total += stamp->utime - prev->utime;
+        }
+        if (best < 0 || total < best)
+            best = total;
+    }
+
+    *nquads = td->nquads;
+    return best;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s image.jpg [decimate [iterations [family [min_margin]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    float decimate = argc >= 3 ? atof(argv[2]) : 1;
+    int iters = argc >= 4 ? atoi(argv[3]) : 50;
+    const char *famname = argc >= 5 ? argv[4] : "tag36h11";
+    float min_margin = argc >= 6 ? atof(argv[5]) : 0;
+
+    apriltag_family_t *tf;
+    void (*destroy)(apriltag_family_t *);
+    if (!strcmp(famname, "tag36h11")) {
+        tf = tag36h11_create();
+        destroy = tag36h11_destroy;
+    } else if (!strcmp(famname, "tagStandard41h12")) {
+        tf = tagStandard41h12_create();
+        destroy = tagStandard41h12_destroy;
+    } else if (!strcmp(famname, "tagCircle49h12")) {
+        tf = tagCircle49h12_create();
+        destroy = tagCircle49h12_destroy;
+    } else {
+        fprintf(stderr, "unknown family %s\n", famname);
+        return EXIT_FAILURE;
+    }
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(argv[1], 0, NULL);
+    if (pjpeg == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->refine_edges = false;
+    td->compact_decode_index = true;
+    td->min_decision_margin = min_margin;
+    td->nthreads = 1;
+    apriltag_detector_add_family(td, tf);
+
+    printf("%s, %dx%d, decimate %.1f, min margin %.1f, %d iterations\n", famname, im->width, im->height,
+           decimate, min_margin, iters);
+    printf("%-12s %8s %12s %12s\n", "decode", "quads", "min us", "us/quad");
+
+    static const char *names[] = { "double", "float", "float-spec" };
+    for (int f = 0; f < 3; f++) {
+        td->decode_float = f > 0;
+        td->specialized_decode = f > 1;
+        int nquads;
+        double us = decode_us(td, im, iters, &nquads);
+        printf("%-12s %8d %12.1f %12.3f\n", names[f], nquads, us,
+               nquads ? us / nquads : 0);
+    }
+
+    printf("%u decodes, rejected: %u by border contrast, %u by bits, %u by margin\n",
+           td->ndecodes, td->ndecodes_rejected_contrast, td->ndecodes_rejected_bits,
+           td->ndecodes_rejected_margin);
+
+    apriltag_detector_destroy(td);
+    destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <apriltag.h>
+#include <tag16h5.h>
+#include <tag25h9.h>
+#include <tag36h10.h>
+#include <tag36h11.h>
+#include <tagCircle21h7.h>
+#include <tagCircle49h12.h>
+#include <tagCustom48h12.h>
+#include <tagStandard41h12.h>
+#include <tagStandard52h13.h>
+#include <common/time_util.h>
+
+// Memory and lookup time of the hash table and the compact decode index
+// for each family and number of corrected bits. Not a test; run by hand:
+//
+//   bench_quick_decode [max table MB]
+//
+// Hash tables larger than the limit (default 512 MB) are not built; their
+// size is still reported.
+
+#define NQUERIES 100000
+
+static uint32_t rng_state = 12345;
+
+static uint64_t
+rng(void)
+{
+    rng_state = rng_state*1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+// the size quick_decode_init() allocates.
+static double
+hash_table_mb(apriltag_family_t *fam, int bits)
+{
+    double capacity = fam->ncodes, nbits = fam->nbits;
+    if (bits >= 1)
+        capacity += fam->ncodes * nbits;
+    if (bits >= 2)
+        capacity += fam->ncodes * nbits * (nbits - 1);
+    return capacity * 3 * 16 / (1024.0 * 1024.0);
+}
+
+// ns per lookup over a mix of valid codes with a few flipped bits and
+// random codes.
+static double
+lookup_ns(apriltag_family_t *fam, const uint64_t *queries, int *ndecoded)
+{
+    int64_t t0 = utime_now();
+    *ndecoded = 0;
+    for (int q = 0; q < NQUERIES; q++) {
+        int hamming, rotation;
+        *ndecoded += apriltag_family_decode(fam, queries[q], &hamming, &rotation) >= 0;
+    }
+    return (utime_now() - t0) * 1000.0 / NQUERIES;
+}
+
+int
+main(int argc, char *argv[])
+{
+    double max_mb = argc >= 2 ? atof(argv[1]) : 512;
+
+    apriltag_family_t *families[] = {
+        tag16h5_create(), tag25h9_create(), tag36h10_create(), tag36h11_create(),
+        tagCircle21h7_create(), tagCircle49h12_create(), tagCustom48h12_create(),
+        tagStandard41h12_create(), tagStandard52h13_create(),
+    };
+    int nfamilies = sizeof(families) / sizeof(families[0]);
+
+    uint64_t *queries = malloc(sizeof(uint64_t) * NQUERIES);
+
+    printf("%-18s %4s %12s %10s %12s %10s\n", "family", "bits", "hash KB", "hash ns",
+           "compact KB", "compact ns");
+
+    for (int f = 0; f < nfamilies; f++) {
+        apriltag_family_t *fam = families[f];
+
+        for (int bits = 0; bits <= 2; bits++) {
+            for (int q = 0; q < NQUERIES; q++) {
+                uint64_t code = fam->codes[rng() % fam->ncodes];
+                if (q % 4 == 3)
+                    code = (rng() << 40) ^ (rng() << 20) ^ rng();
+                for (int n = rng() % (bits + 2); n > 0; n--)
+                    code ^= 1ULL << (rng() % fam->nbits);
+                queries[q] = code & ((1ULL << fam->nbits) - 1);
+            }
+
+            apriltag_detector_t *td = apriltag_detector_create();
+            int ndecoded;
+
+            printf("%-18s %4d ", fam->name, bits);
+
+            if (hash_table_mb(fam, bits) <= max_mb) {
+                td->compact_decode_index = false;
+                apriltag_detector_add_family_bits(td, fam, bits);
+                double ns = lookup_ns(fam, queries, &ndecoded);
+                printf("%12.0f %10.1f ", apriltag_family_decode_index_bytes(fam) / 1024.0, ns);
+                apriltag_detector_remove_family(td, fam);
+            } else {
+                printf("%12.0f %10s ", hash_table_mb(fam, bits) * 1024, "-");
+            }
+
+            td->compact_decode_index = true;
+            apriltag_detector_add_family_bits(td, fam, bits);
+            double ns = lookup_ns(fam, queries, &ndecoded);
+            printf("%12.1f %10.1f\n", apriltag_family_decode_index_bytes(fam) / 1024.0, ns);
+            apriltag_detector_remove_family(td, fam);
+
+            apriltag_detector_destroy(td);
+        }
+    }
+
+    tag16h5_destroy(families[0]);
+    tag25h9_destroy(families[1]);
+    tag36h10_destroy(families[2]);
+    tag36h11_destroy(families[3]);
+    tagCircle21h7_destroy(families[4]);
+    tagCircle49h12_destroy(families[5]);
+    tagCustom48h12_destroy(families[6]);
+    tagStandard41h12_destroy(families[7]);
+    tagStandard52h13_destroy(families[8]);
+    free(queries);
+
+    return EXIT_SUCCESS;
+}
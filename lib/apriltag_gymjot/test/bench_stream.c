@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+
+// Replays an image as a sensor readout, one band of rows every
+// band*line_us microseconds, and measures the latency from the last row
+// to the detections for apriltag_detector_detect() started on the
+// complete frame and for the streaming API fed band by band. Not a
+// test; run by hand:
+//
+//   bench_stream image.jpg [decimate [line_us [band [iterations]]]]
+//
+// The default line time reads the frame out in 33 ms.
+
+static void
+wait_until(int64_t t)
+{
+    while (utime_now() < t)
+        ;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s image.jpg [decimate [line_us [band [iterations]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(argv[1], 0, NULL);
+    if (pjpeg == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    float decimate = argc >= 3 ? atof(argv[2]) : 3;
+    double line_us = argc >= 4 ? atof(argv[3]) : 33000.0 / im->height;
+    int band = argc >= 5 ? atoi(argv[4]) : 8;
+    int iters = argc >= 6 ? atoi(argv[5]) : 20;
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = 1;
+    apriltag_detector_add_family(td, tf);
+
+    image_u8_t *frame = image_u8_create(im->width, im->height);
+
+    double whole_us = 0, stream_us = 0;
+    int ndets = 0;
+
+    for (int it = 0; it < iters; it++) {
+        // whole frame: detection starts once the last row is in.
+        int64_t t0 = utime_now();
+        int64_t t_last = t0 + (int64_t) (im->height * line_us);
+        wait_until(t_last);
+        zarray_t *dets = apriltag_detector_detect(td, im);
+        whole_us += utime_now() - t_last;
+        apriltag_detections_destroy(dets);
+
+        // streaming: each band is pushed as soon as it has been read out.
+        t0 = utime_now();
+        apriltag_stream_t *st = apriltag_stream_begin(td, frame);
+        for (int y = 0; y < im->height; y += band) {
+            int n = band < im->height - y ? band : im->height - y;
+            wait_until(t0 + (int64_t) ((y + n) * line_us));
+            apriltag_stream_push_rows(st, &im->buf[y*im->stride], im->stride, n);
+        }
+        t_last = t0 + (int64_t) (im->height * line_us);
+        dets = apriltag_stream_finish(st);
+        stream_us += utime_now() - t_last;
+        ndets = zarray_size(dets);
+        apriltag_detections_destroy(dets);
+    }
+
+    printf("%dx%d, decimate %.1f, %.1f us/line, bands of %d rows, %d detections\n",
+           im->width, im->height, decimate, line_us, band, ndets);
+    printf("last row to detections: whole frame %.0f us, streamed %.0f us\n",
+           whole_us / iters, stream_us / iters);
+
+    image_u8_destroy(frame);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return EXIT_SUCCESS;
+}
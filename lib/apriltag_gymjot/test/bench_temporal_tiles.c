@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/math_util.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+#include <common/timeprofile.h>
+
+// Per-frame time of apriltag_detector_detect() with and without
+// td->temporal_tiles over a sequence of frames, and the fraction of tiles
+// and quad fits reused. Not a test; run by hand on a recorded sequence (jpg or pnm
+// frames of one size):
+//
+//   bench_temporal_tiles [-d decimate] [-t tolerance] frame0 frame1 ...
+//
+// or on a single image, from which a sequence of 60 frames is made: the
+// scene still, a gray block (someone walking through) crossing it, and
+// +-noise gray levels of sensor noise on every frame.
+//
+//   bench_temporal_tiles [-d decimate] [-t tolerance] [-n noise] image
+
+static image_u8_t *
+load(const char *path)
+{
+    size_t len = strlen(path);
+    if (len > 4 && strcmp(&path[len - 4], ".jpg") == 0) {
+        pjpeg_t *pjpeg = pjpeg_create_from_file(path, 0, NULL);
+        if (pjpeg == NULL)
+            return NULL;
+        image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+        pjpeg_destroy(pjpeg);
+        return im;
+    }
+
+    return image_u8_create_from_pnm(path);
+}
+
+static image_u8_t *
+synthetic_frame(const image_u8_t *im, int k, int nframes, int noise)
+{
+    image_u8_t *frame = image_u8_copy(im);
+
+    // still for the first third, then crossing.
+    int x0 = (k - nframes / 3) * im->width / (nframes / 2);
+    for (int y = im->height / 4; y < im->height * 3 / 4; y++) {
+        for (int x = imax(0, x0); x < x0 + im->width / 6 && x < im->width; x++)
+            frame->buf[y*frame->stride + x] = 90;
+    }
+
+    if (noise > 0) {
+        for (int y = 0; y < im->height; y++) {
+            for (int x = 0; x < im->width; x++) {
+                int v = frame->buf[y*frame->stride + x] + rand() % (2*noise + 1) - noise;
+                frame->buf[y*frame->stride + x] = v < 0 ? 0 : v > 255 ? 255 : v;
+            }
+        }
+    }
+
+    return frame;
+}
+
+// time of the last detection's stage 'name', in us.
+static int64_t
+stage_us(const timeprofile_t *tp, const char *name)
+{
+    int64_t last = tp->utime;
+    for (int i = 0; i < zarray_size(tp->stamps); i++) {
+        struct timeprofile_entry *stamp;
+        zarray_get_volatile(tp->stamps, i, &stamp);
+        if (strcmp(stamp->name, name) == 0)
+            return stamp->utime - last;
+        last = stamp->utime;
+    }
+    return 0;
+}
+
+// mean ms per frame over the sequence and in threshold(), and the tiles
+// and quad fits reused.
+static double
+run(apriltag_detector_t *td, image_u8_t **frames, int nframes, double *thresh_ms,
+    uint64_t *nreused, uint64_t *ntiles, uint64_t *nfits_reused, uint64_t *nfits)
+{
+    int64_t thresh_us = 0;
+    *nreused = *ntiles = *nfits_reused = *nfits = 0;
+
+    int64_t t0 = utime_now();
+    for (int i = 0; i < nframes; i++) {
+        apriltag_detections_destroy(apriltag_detector_detect(td, frames[i]));
+        thresh_us += stage_us(td->tp, "threshold");
+        *nreused += td->nthresh_tiles_reused;
+        *ntiles += td->nthresh_tiles;
+        *nfits_reused += td->nquad_fits_reused;
+        *nfits += td->nquad_fits;
+    }
+
+    *thresh_ms = thresh_us / 1000.0 / nframes;
+    return (utime_now() - t0) / 1000.0 / nframes;
+}
+
+int
+main(int argc, char *argv[])
+{
+    float decimate = 2;
+    int tolerance = 0, noise = 0;
+
+    int a = 1;
+    for (; a + 1 < argc && argv[a][0] == '-'; a += 2) {
+        if (strcmp(argv[a], "-d") == 0)
+            decimate = atof(argv[a+1]);
+        else if (strcmp(argv[a], "-t") == 0)
+            tolerance = atoi(argv[a+1]);
+        else if (strcmp(argv[a], "-n") == 0)
+            noise = atoi(argv[a+1]);
+    }
+
+    if (a >= argc) {
+        fprintf(stderr, "usage: %s [-d decimate] [-t tolerance] [-n noise] frame0 [frame1 ...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int nframes = argc - a > 1 ? argc - a : 60;
+    image_u8_t **frames = calloc(nframes, sizeof(image_u8_t*));
+
+    if (argc - a > 1) {
+        for (int i = 0; i < nframes; i++) {
+            frames[i] = load(argv[a + i]);
+            if (frames[i] == NULL || frames[i]->width != frames[0]->width ||
+                frames[i]->height != frames[0]->height) {
+                fprintf(stderr, "cannot read %s, or not the size of the first frame\n", argv[a + i]);
+                return EXIT_FAILURE;
+            }
+        }
+    } else {
+        image_u8_t *im = load(argv[a]);
+        if (im == NULL) {
+            fprintf(stderr, "cannot read %s\n", argv[a]);
+            return EXIT_FAILURE;
+        }
+        srand(1);
+        for (int i = 0; i < nframes; i++)
+            frames[i] = synthetic_frame(im, i, nframes, noise);
+        image_u8_destroy(im);
+    }
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = 1;
+    td->compact_decode_index = true;
+    td->temporal_tile_tolerance = tolerance;
+    apriltag_detector_add_family(td, tf);
+
+    // warm up the arena, then alternate so both see the same machine.
+    uint64_t nreused, ntiles, nfits_reused, nfits;
+    double thresh_ms;
+    run(td, frames, nframes, &thresh_ms, &nreused, &ntiles, &nfits_reused, &nfits);
+
+    double full = 1e30, temporal = 1e30, full_thresh = 1e30, temporal_thresh = 1e30;
+    for (int rep = 0; rep < 5; rep++) {
+        td->temporal_tiles = false;
+        double ms = run(td, frames, nframes, &thresh_ms, &nreused, &ntiles, &nfits_reused, &nfits);
+        full = fmin(full, ms);
+        full_thresh = fmin(full_thresh, thresh_ms);
+
+        td->temporal_tiles = true;
+        ms = run(td, frames, nframes, &thresh_ms, &nreused, &ntiles, &nfits_reused, &nfits);
+        temporal = fmin(temporal, ms);
+        temporal_thresh = fmin(temporal_thresh, thresh_ms);
+    }
+
+    printf("%dx%d, %d frames, decimate %.1f, tolerance %d, noise %d\n",
+           frames[0]->width, frames[0]->height, nframes, decimate, tolerance,
+           argc - a > 1 ? -1 : noise);
+    printf("tiles reused   %5.1f%%\n", 100.0 * nreused / ntiles);
+    printf("fits reused    %5.1f%%\n", 100.0 * nfits_reused / nfits);
+    printf("               frame            threshold\n");
+    printf("full           %6.2f ms          %6.3f ms\n", full, full_thresh);
+    printf("temporal       %6.2f ms (%.2fx)  %6.3f ms (%.2fx)\n", temporal, full / temporal,
+           temporal_thresh, full_thresh / temporal_thresh);
+
+    for (int i = 0; i < nframes; i++)
+        image_u8_destroy(frames[i]);
+    free(frames);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <common/thresh_kernels.h>
+#include <common/time_util.h>
+
+// Times each threshold kernel of every compiled implementation on a
+// synthetic image. Not a test; run by hand:
+//
+//   bench_thresh_kernels [width height [iterations]]
+//
+// The default 320x240 is the decimated size used on the device.
+
+int
+main(int argc, char *argv[])
+{
+    int w = 320, h = 240, iters = 2000;
+    if (argc >= 3) {
+        w = atoi(argv[1]);
+        h = atoi(argv[2]);
+    }
+    if (argc >= 4)
+        iters = atoi(argv[3]);
+
+    int tw = w / THRESH_TILESZ, th = h / THRESH_TILESZ;
+    if (tw < 1 || th < 1 || iters < 1) {
+        fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int s = w;
+    uint8_t *im = malloc((size_t) s*h);
+    uint8_t *threshim = malloc((size_t) s*h);
+    uint8_t *im_max = malloc((size_t) tw*th), *im_min = malloc((size_t) tw*th);
+    uint8_t *im_max_tmp = malloc((size_t) tw*th), *im_min_tmp = malloc((size_t) tw*th);
+
+    uint32_t state = 1;
+    for (int i = 0; i < s*h; i++) {
+        state = state*1664525u + 1013904223u;
+        im[i] = state >> 24;
+    }
+
+    printf("%dx%d, %d iterations, default %s\n", w, h, iters, thresh_kernels_default()->name);
+    printf("%-8s %12s %12s %12s\n", "kernels", "minmax us", "blur us", "thresh us");
+
+    for (int idx = 0; thresh_kernels_get(idx) != NULL; idx++) {
+        const thresh_kernels_t *k = thresh_kernels_get(idx);
+
+        int64_t t0 = utime_now();
+        for (int it = 0; it < iters; it++) {
+            for (int ty = 0; ty < th; ty++)
+                k->minmax_row(&im[ty*THRESH_TILESZ*s], s, tw, &im_max[ty*tw], &im_min[ty*tw]);
+        }
+
+        int64_t t1 = utime_now();
+        for (int it = 0; it < iters; it++) {
+            for (int ty = 0; ty < th; ty++) {
+                k->blur_row(ty > 0 ? &im_max[(ty-1)*tw] : NULL, &im_max[ty*tw],
+                            ty + 1 < th ? &im_max[(ty+1)*tw] : NULL,
+                            ty > 0 ? &im_min[(ty-1)*tw] : NULL, &im_min[ty*tw],
+                            ty + 1 < th ? &im_min[(ty+1)*tw] : NULL,
+                            tw, &im_max_tmp[ty*tw], &im_min_tmp[ty*tw]);
+            }
+        }
+
+        int64_t t2 = utime_now();
+        for (int it = 0; it < iters; it++) {
+            for (int ty = 0; ty < th; ty++)
+                k->threshold_row(&im[ty*THRESH_TILESZ*s], &threshim[ty*THRESH_TILESZ*s], s,
+                                 &im_max_tmp[ty*tw], &im_min_tmp[ty*tw], tw, 5);
+        }
+        int64_t t3 = utime_now();
+
+        printf("%-8s %12.2f %12.2f %12.2f\n", k->name,
+               (double) (t1 - t0) / iters, (double) (t2 - t1) / iters, (double) (t3 - t2) / iters);
+    }
+
+    free(im);
+    free(threshim);
+    free(im_max);
+    free(im_min);
+    free(im_max_tmp);
+    free(im_min_tmp);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+
+// Times a full apriltag_detector_detect() against apriltag_detector_track()
+// of one of its detections, with and without the decode. Not a test; run
+// by hand:
+//
+//   bench_track image.jpg [decimate [iterations]]
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s image.jpg [decimate [iterations]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    float decimate = argc >= 3 ? atof(argv[2]) : 3;
+    int iters = argc >= 4 ? atoi(argv[3]) : 200;
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(argv[1], 0, NULL);
+    if (pjpeg == NULL) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = 1;
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    zarray_t *dets = apriltag_detector_detect(td, im);
+    if (zarray_size(dets) == 0) {
+        fprintf(stderr, "no tags in %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // the largest tag, like the locked station tag.
+    apriltag_detection_t *prev = NULL;
+    double best = 0;
+    for (int i = 0; i < zarray_size(dets); i++) {
+        apriltag_detection_t *det;
+        zarray_get(dets, i, &det);
+        double w = det->p[1][0] - det->p[0][0], h = det->p[1][1] - det->p[0][1];
+        if (w*w + h*h > best) {
+            best = w*w + h*h;
+            prev = det;
+        }
+    }
+
+    int64_t t0 = utime_now();
+    for (int it = 0; it < iters; it++)
+        apriltag_detections_destroy(apriltag_detector_detect(td, im));
+
+    int64_t t1 = utime_now();
+    int ntracked = 0;
+    for (int it = 0; it < iters; it++) {
+        apriltag_detection_t *det = apriltag_detector_track(td, im, prev, 4, 0);
+        if (det) {
+            ntracked++;
+            apriltag_detection_destroy(det);
+        }
+    }
+
+    int64_t t2 = utime_now();
+    for (int it = 0; it < iters; it++) {
+        apriltag_detection_t *det = apriltag_detector_track(td, im, prev, 4, 1);
+        if (det)
+            apriltag_detection_destroy(det);
+    }
+    int64_t t3 = utime_now();
+
+    double detect_us = (double) (t1 - t0) / iters;
+    double track_us = (double) (t2 - t1) / iters;
+    double reuse_us = (double) (t3 - t2) / iters;
+
+    printf("%dx%d, decimate %.1f, %d iterations, tag %d (%.0f px side), tracked %d/%d\n",
+           im->width, im->height, decimate, iters, prev->id, sqrt(best), ntracked, iters);
+    printf("detect        %10.1f us\n", detect_us);
+    printf("track         %10.1f us  (%.1f%%)\n", track_us, 100 * track_us / detect_us);
+    printf("track, reuse  %10.1f us  (%.1f%%)\n", reuse_us, 100 * reuse_us / detect_us);
+
+    apriltag_detections_destroy(dets);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/time_util.h>
+
+// Under td->deadline_us the detector decodes the quads best first and
+// skips the rest: a budget that is never reached must give exactly the
+// detections without one, an exhausted one none (every quad skipped), and
+// anything in between a subset of them.
+
+static bool
+detection_in(const apriltag_detection_t *det, zarray_t *detections)
+{
+    for (int i = 0; i < zarray_size(detections); i++) {
+        apriltag_detection_t *other;
+        zarray_get(detections, i, &other);
+
+        if (other->family != det->family || other->id != det->id ||
+            other->hamming != det->hamming || other->decision_margin != det->decision_margin)
+            continue;
+
+        bool same = true;
+        for (int j = 0; j < 4; j++)
+            same &= other->p[j][0] == det->p[j][0] && other->p[j][1] == det->p[j][1];
+        if (same)
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+detections_subset(zarray_t *a, zarray_t *b)
+{
+    for (int i = 0; i < zarray_size(a); i++) {
+        apriltag_detection_t *det;
+        zarray_get(a, i, &det);
+        if (!detection_in(det, b))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, float decimate)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    int64_t t0 = utime_now();
+    zarray_t *all = apriltag_detector_detect(td, im);
+    uint32_t detect_us = utime_now() - t0;
+    bool ok = td->nquads_skipped == 0;
+
+    td->deadline_us = 60 * 1000 * 1000;
+    zarray_t *generous = apriltag_detector_detect(td, im);
+    ok &= td->nquads_skipped == 0;
+    ok &= zarray_size(generous) == zarray_size(all) && detections_subset(generous, all);
+
+    td->deadline_us = 1;
+    zarray_t *none = apriltag_detector_detect(td, im);
+    ok &= td->nquads_skipped == td->nquads && zarray_size(none) == 0;
+
+    td->deadline_us = detect_us * 3 / 4;
+    zarray_t *some = apriltag_detector_detect(td, im);
+    ok &= td->nquads_skipped <= td->nquads && detections_subset(some, all);
+
+    printf("decimate %.1f: %d detections, %d with a %u us budget (%d of %d quads skipped), %s\n",
+           decimate, zarray_size(all), zarray_size(some), td->deadline_us, td->nquads_skipped,
+           td->nquads, ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(all);
+    apriltag_detections_destroy(generous);
+    apriltag_detections_destroy(none);
+    apriltag_detections_destroy(some);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    ok &= check(im, tf, 1);
+    ok &= check(im, tf, 2);
+    ok &= check(im, tf, 3);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
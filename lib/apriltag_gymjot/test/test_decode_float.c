@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <tagStandard41h12.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// The single-precision decode must report the same tags as the double
+// one: same ids, hamming distances and corners, with decision margins
+// within a fraction of a gray level.
+
+#define MARGIN_TOLERANCE 0.05
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, float decimate)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = 1;
+    apriltag_detector_add_family(td, tf);
+
+    td->decode_float = false;
+    zarray_t *ref = apriltag_detector_detect(td, im);
+    td->decode_float = true;
+    zarray_t *dets = apriltag_detector_detect(td, im);
+
+    bool ok = zarray_size(ref) == zarray_size(dets);
+    double max_diff = 0;
+
+    zarray_sort(ref, detection_order);
+    zarray_sort(dets, detection_order);
+
+    for (int i = 0; ok && i < zarray_size(ref); i++) {
+        apriltag_detection_t *a, *b;
+        zarray_get(ref, i, &a);
+        zarray_get(dets, i, &b);
+
+        if (a->id != b->id || a->hamming != b->hamming)
+            ok = false;
+
+        for (int j = 0; j < 4; j++) {
+            if (a->p[j][0] != b->p[j][0] || a->p[j][1] != b->p[j][1])
+                ok = false;
+        }
+
+        max_diff = fmax(max_diff, fabs(a->decision_margin - b->decision_margin));
+    }
+
+    if (max_diff > MARGIN_TOLERANCE)
+        ok = false;
+
+    printf("%s decimate %.1f: %d detections double, %d float, max margin diff %.4f, %s\n",
+           tf->name, decimate, zarray_size(ref), zarray_size(dets), max_diff, ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(ref);
+    apriltag_detections_destroy(dets);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf36 = tag36h11_create();
+    apriltag_family_t *tf41 = tagStandard41h12_create();
+
+    bool ok = true;
+    ok &= check(im, tf36, 1);
+    ok &= check(im, tf36, 2);
+    ok &= check(im, tf41, 1);
+
+    tagStandard41h12_destroy(tf41);
+    tag36h11_destroy(tf36);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/homography.h>
+#include <math.h>
+
+// Every tag found by a full-frame search must be found again, with the
+// same corners, by apriltag_detector_detect_roi() on a padded box around
+// it.
+
+static bool
+same_detection(const apriltag_detection_t *a, const apriltag_detection_t *b)
+{
+    if (a->id != b->id)
+        return false;
+
+    for (int j = 0; j < 4; j++) {
+        for (int c = 0; c < 2; c++) {
+            if (fabs(a->p[j][c] - b->p[j][c]) > 1e-1)
+                return false;
+        }
+    }
+
+    // the homography must have been moved to full-image coordinates too.
+    double px, py;
+    homography_project(b->H, -1, 1, &px, &py);
+    return fabs(px - b->p[0][0]) < 1e-6 && fabs(py - b->p[0][1]) < 1e-6;
+}
+
+static bool
+run_config(image_u8_t *im, apriltag_family_t *tf, float decimate)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->refine_edges = false;
+    apriltag_detector_add_family(td, tf);
+
+    bool ok = true;
+
+    zarray_t *full = apriltag_detector_detect(td, im);
+
+    for (int i = 0; i < zarray_size(full); i++) {
+        apriltag_detection_t *det;
+        zarray_get(full, i, &det);
+
+        double xmin = det->p[0][0], xmax = xmin, ymin = det->p[0][1], ymax = ymin;
+        for (int j = 1; j < 4; j++) {
+            xmin = fmin(xmin, det->p[j][0]);
+            xmax = fmax(xmax, det->p[j][0]);
+            ymin = fmin(ymin, det->p[j][1]);
+            ymax = fmax(ymax, det->p[j][1]);
+        }
+
+        // pad by half the tag size on every side.
+        double pad = 0.5 * fmax(xmax - xmin, ymax - ymin);
+        int x0 = floor(xmin - pad), y0 = floor(ymin - pad);
+        int x1 = ceil(xmax + pad), y1 = ceil(ymax + pad);
+
+        zarray_t *roi = apriltag_detector_detect_roi(td, im, x0, y0, x1 - x0, y1 - y0);
+
+        bool found = false;
+        for (int k = 0; k < zarray_size(roi); k++) {
+            apriltag_detection_t *rdet;
+            zarray_get(roi, k, &rdet);
+            found |= same_detection(det, rdet);
+        }
+
+        printf("decimate %.1f: tag %d in [%d,%d)x[%d,%d): %d detections, %s\n",
+               decimate, det->id, x0, x1, y0, y1, zarray_size(roi), found ? "found" : "MISSED");
+
+        if (!found)
+            ok = false;
+
+        apriltag_detections_destroy(roi);
+    }
+
+    // a box outside the image is empty rather than an error.
+    zarray_t *none = apriltag_detector_detect_roi(td, im, im->width + 10, 0, 50, 50);
+    if (zarray_size(none) != 0)
+        ok = false;
+    apriltag_detections_destroy(none);
+
+    apriltag_detections_destroy(full);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    ok &= run_config(im, tf, 1);
+    ok &= run_config(im, tf, 2);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
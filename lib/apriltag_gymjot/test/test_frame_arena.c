@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/frame_arena.h>
+#include <math.h>
+#include "test_util.h"
+
+// Runs the detector repeatedly on the same image and checks that, once
+// the scratch arena has grown to the working set, frames perform no heap
+// calls for scratch memory and produce identical detections.
+
+static bool
+run_config(image_u8_t *im, apriltag_family_t *tf, float decimate, int nthreads)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->nthreads = nthreads;
+    apriltag_detector_add_family(td, tf);
+
+    bool ok = true;
+
+    zarray_t *first = apriltag_detector_detect(td, im);
+    uint32_t first_calls = td->nscratch_heap_calls;
+
+    for (int iter = 0; iter < 3; iter++) {
+        zarray_t *detections = apriltag_detector_detect(td, im);
+
+        printf("decimate %.1f, %d threads, frame %d: %d detections, %u scratch heap calls (first frame %u), %zu scratch bytes\n",
+               decimate, nthreads, iter + 1, zarray_size(detections),
+               td->nscratch_heap_calls, first_calls, td->scratch_bytes);
+
+        if (td->nscratch_heap_calls != 0) {
+            fprintf(stderr, "Scratch heap calls in steady state: %u\n", td->nscratch_heap_calls);
+            ok = false;
+        }
+
+        if (!detections_equal(first, detections)) {
+            fprintf(stderr, "Detections differ from the first frame.\n");
+            ok = false;
+        }
+
+        apriltag_detections_destroy(detections);
+    }
+
+    apriltag_detections_destroy(first);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+// One busy frame grows the arena; after FRAME_ARENA_DECAY_FRAMES quiet
+// frames it shrinks back, and the quiet frames then make no heap calls.
+static bool
+check_decay(void)
+{
+    const size_t busy = 1 << 20, quiet = 16 << 10;
+    frame_arena_t *fa = frame_arena_create();
+    bool ok = true;
+
+    for (int i = 0; i < 4; i++) {
+        frame_arena_alloc(fa, quiet);
+        frame_arena_reset(fa);
+    }
+    size_t quiet_capacity = frame_arena_capacity(fa);
+
+    frame_arena_alloc(fa, busy);
+    frame_arena_reset(fa);
+    size_t busy_capacity = frame_arena_capacity(fa);
+
+    for (int i = 0; i < 2 * FRAME_ARENA_DECAY_FRAMES; i++) {
+        frame_arena_alloc(fa, quiet);
+        frame_arena_reset(fa);
+    }
+    size_t decayed_capacity = frame_arena_capacity(fa);
+
+    uint32_t calls = fa->nheap_calls;
+    for (int i = 0; i < 2 * FRAME_ARENA_DECAY_FRAMES; i++) {
+        frame_arena_alloc(fa, quiet);
+        frame_arena_reset(fa);
+    }
+
+    printf("arena decay: %zu bytes quiet, %zu after a busy frame, %zu %d frames later\n",
+           quiet_capacity, busy_capacity, decayed_capacity, 2 * FRAME_ARENA_DECAY_FRAMES);
+
+    if (busy_capacity < busy || decayed_capacity >= busy) {
+        fprintf(stderr, "Arena did not shrink after the busy frame.\n");
+        ok = false;
+    }
+    if (fa->nheap_calls != calls) {
+        fprintf(stderr, "Heap calls after the arena shrank: %u\n", fa->nheap_calls - calls);
+        ok = false;
+    }
+
+    frame_arena_destroy(fa);
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = check_decay();
+    ok &= run_config(im, tf, 1, 1);
+    ok &= run_config(im, tf, 2, 1);
+    ok &= run_config(im, tf, 1.5, 4);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include <common/thresh_kernels.h>
+#include "test_util.h"
+
+// The fused decimate + tile min/max pass must produce the same decimated
+// image and extrema as image_u8_decimate_into() followed by the scalar
+// min/max, and the detector must report the same tags with and without it.
+
+// compares the buffers for a w x h crop of 'im'.
+static bool
+check_buffers(image_u8_t *im, int w, int h, float factor)
+{
+    image_u8_t crop = { .width = w, .height = h, .stride = im->stride, .buf = im->buf };
+
+    int dw, dh;
+    image_u8_decimate_size(&crop, factor, &dw, &dh);
+    int tw = dw / THRESH_TILESZ, th = dh / THRESH_TILESZ;
+
+    image_u8_t *ref = image_u8_create(dw, dh);
+    image_u8_t *fused = image_u8_create(dw, dh);
+    uint8_t *max_ref = calloc(tw*th + 1, 1), *min_ref = calloc(tw*th + 1, 1);
+    uint8_t *max_fused = calloc(tw*th + 1, 1), *min_fused = calloc(tw*th + 1, 1);
+
+    image_u8_decimate_into(&crop, factor, ref);
+    const thresh_kernels_t *scalar = thresh_kernels_get(0);
+    for (int ty = 0; ty < th; ty++)
+        scalar->minmax_row(&ref->buf[ty*THRESH_TILESZ*ref->stride], ref->stride, tw,
+                           &max_ref[ty*tw], &min_ref[ty*tw]);
+
+    // in two bands, like the detector's tasks do.
+    thresh_decimate_minmax(&crop, factor, fused, 0, th / 2, max_fused, min_fused);
+    thresh_decimate_minmax(&crop, factor, fused, th / 2, th, max_fused, min_fused);
+
+    bool ok = true;
+    for (int y = 0; y < dh; y++) {
+        if (memcmp(&ref->buf[y*ref->stride], &fused->buf[y*fused->stride], dw))
+            ok = false;
+    }
+    if (memcmp(max_ref, max_fused, tw*th) || memcmp(min_ref, min_fused, tw*th))
+        ok = false;
+
+    if (!ok)
+        printf("decimate %.1f of %dx%d: buffers differ\n", factor, w, h);
+
+    free(max_ref);
+    free(min_ref);
+    free(max_fused);
+    free(min_fused);
+    image_u8_destroy(ref);
+    image_u8_destroy(fused);
+
+    return ok;
+}
+
+static bool
+check_detections(image_u8_t *im, apriltag_family_t *tf, float factor)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = factor;
+    apriltag_detector_add_family(td, tf);
+
+    td->fused_decimate = false;
+    zarray_t *two_pass = apriltag_detector_detect(td, im);
+    td->fused_decimate = true;
+    zarray_t *fused = apriltag_detector_detect(td, im);
+
+    bool ok = detections_equal(two_pass, fused);
+    printf("decimate %.1f: %d detections two-pass, %d fused, %s\n",
+           factor, zarray_size(two_pass), zarray_size(fused), ok ? "equal" : "DIFFERENT");
+
+    apriltag_detections_destroy(two_pass);
+    apriltag_detections_destroy(fused);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    static const float factors[] = { 1.5, 2, 3, 4 };
+
+    bool ok = true;
+    for (int i = 0; i < 4; i++) {
+        // sizes with and without partial tiles after decimation.
+        for (int crop = 0; crop < 13; crop += 3)
+            ok &= check_buffers(im, im->width - crop, im->height - 2*crop, factors[i]);
+
+        ok &= check_detections(im, tf, factors[i]);
+    }
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
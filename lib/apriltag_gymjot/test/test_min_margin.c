@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <tagStandard41h12.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// With td->min_decision_margin set, the detector must report exactly the
+// detections it reports without it whose margin reaches the minimum,
+// however early the decoder gave up on the other quads.
+
+static bool
+check(image_u8_t *im, apriltag_family_t **families, int nfamilies,
+      float decimate, bool decode_float, float min_margin)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->decode_float = decode_float;
+    td->compact_decode_index = true;
+    for (int i = 0; i < nfamilies; i++)
+        apriltag_detector_add_family(td, families[i]);
+
+    zarray_t *all = apriltag_detector_detect(td, im);
+    bool ok = td->ndecodes_rejected_contrast == 0 && td->ndecodes_rejected_bits == 0 &&
+        td->ndecodes_rejected_margin == 0;
+
+    zarray_t *expected = zarray_create(sizeof(apriltag_detection_t*));
+    for (int i = 0; i < zarray_size(all); i++) {
+        apriltag_detection_t *det;
+        zarray_get(all, i, &det);
+        if (det->decision_margin >= min_margin)
+            zarray_add(expected, &det);
+    }
+
+    td->min_decision_margin = min_margin;
+    zarray_t *early = apriltag_detector_detect(td, im);
+
+    uint32_t nrejected = td->ndecodes_rejected_contrast + td->ndecodes_rejected_bits +
+        td->ndecodes_rejected_margin;
+    ok &= nrejected <= td->ndecodes;
+    ok &= detections_equal(expected, early);
+
+    printf("decimate %.1f%s, min margin %.0f: %d of %d decodes rejected (contrast %d, bits %d, margin %d), "
+           "%d detections, %d expected, %s\n",
+           decimate, decode_float ? " float" : "", min_margin, nrejected, td->ndecodes,
+           td->ndecodes_rejected_contrast, td->ndecodes_rejected_bits, td->ndecodes_rejected_margin,
+           zarray_size(early), zarray_size(expected), ok ? "ok" : "DIFFERENT");
+
+    zarray_destroy(expected);
+    apriltag_detections_destroy(all);
+    apriltag_detections_destroy(early);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *families[] = { tag36h11_create(), tagStandard41h12_create() };
+
+    static const float decimates[] = { 1, 2, 3 };
+    static const float margins[] = { 12, 50 };
+
+    bool ok = true;
+    for (int d = 0; d < 3; d++) {
+        for (int f = 0; f < 2; f++) {
+            for (int m = 0; m < 2; m++)
+                ok &= check(im, families, 2, decimates[d], f, margins[m]);
+        }
+    }
+
+    tag36h11_destroy(families[0]);
+    tagStandard41h12_destroy(families[1]);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h10.h>
+#include <tag36h11.h>
+#include <tagStandard41h12.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// Families sharing a sampling layout (tag36h10 and tag36h11) are decoded
+// from one sample of each quad. A detector with several families must
+// report exactly the union of what one detector per family reports.
+
+static zarray_t *
+detect(image_u8_t *im, apriltag_family_t **families, int nfamilies, bool decode_float)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->decode_float = decode_float;
+    td->compact_decode_index = true;
+    for (int i = 0; i < nfamilies; i++)
+        apriltag_detector_add_family(td, families[i]);
+
+    zarray_t *dets = apriltag_detector_detect(td, im);
+    apriltag_detector_destroy(td);
+
+    return dets;
+}
+
+static bool
+check(image_u8_t *im, apriltag_family_t **families, int nfamilies, bool decode_float)
+{
+    zarray_t *all = detect(im, families, nfamilies, decode_float);
+
+    zarray_t *separate = zarray_create(sizeof(apriltag_detection_t*));
+    for (int i = 0; i < nfamilies; i++) {
+        zarray_t *dets = detect(im, &families[i], 1, decode_float);
+        zarray_add_range(separate, dets, 0, zarray_size(dets));
+        zarray_destroy(dets);
+    }
+
+    bool ok = detections_equal(all, separate);
+    printf("%d families%s: %d detections together, %d separately, %s\n", nfamilies,
+           decode_float ? " (float)" : "", zarray_size(all), zarray_size(separate),
+           ok ? "equal" : "DIFFERENT");
+
+    apriltag_detections_destroy(all);
+    apriltag_detections_destroy(separate);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *families[] = { tag36h10_create(), tag36h11_create(), tagStandard41h12_create() };
+
+    bool ok = true;
+    ok &= check(im, families, 2, false);
+    ok &= check(im, families, 3, false);
+    ok &= check(im, families, 3, true);
+
+    tag36h10_destroy(families[0]);
+    tag36h11_destroy(families[1]);
+    tagStandard41h12_destroy(families[2]);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
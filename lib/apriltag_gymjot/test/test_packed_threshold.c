@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// The packed threshold image (td->qtp.packed_threshold) must give exactly
+// the detections of the byte one, for widths that end inside a 64-bit
+// word and inside a tile, with several threads, and with temporal tiles.
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, float decimate, int crop, int nthreads, bool temporal)
+{
+    // a view of the image 'crop' columns narrower.
+    image_u8_t view = { .width = im->width - crop, .height = im->height,
+                        .stride = im->stride, .buf = im->buf };
+
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->compact_decode_index = true;
+    td->nthreads = nthreads;
+    td->temporal_tiles = temporal;
+    apriltag_detector_add_family(td, tf);
+
+    td->qtp.packed_threshold = false;
+    zarray_t *bytes = apriltag_detector_detect(td, &view);
+    td->qtp.packed_threshold = true;
+    zarray_t *packed = apriltag_detector_detect(td, &view);
+
+    bool ok = detections_equal(bytes, packed);
+    printf("decimate %.1f, width %d, %d threads%s: %d detections bytes, %d packed, %s\n",
+           decimate, view.width, nthreads, temporal ? ", temporal" : "",
+           zarray_size(bytes), zarray_size(packed), ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(bytes);
+    apriltag_detections_destroy(packed);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    for (int decimate = 1; decimate <= 3; decimate++) {
+        ok &= check(im, tf, decimate, 0, 1, false);
+        ok &= check(im, tf, decimate, 37, 1, false);
+        ok &= check(im, tf, decimate, 66, 3, false);
+        ok &= check(im, tf, decimate, 0, 1, true);
+    }
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <apriltag_pose.h>
+
+// estimate_tag_pose_track() must search both poses for the first frame of
+// a tag, then follow a slowly moving tag by refining the last pose alone:
+// within 0.5% of the true distance from exact corners, and about as well
+// as estimate_tag_pose() from noisy ones. A jump of the tag, and a change
+// of tag id, must make it search both poses again.
+
+static void
+rotation_rpy(double roll, double pitch, double yaw, double R[9])
+{
+    double cr = cos(roll), sr = sin(roll), cp = cos(pitch), sp = sin(pitch);
+    double cy = cos(yaw), sy = sin(yaw);
+    double M[9] = {
+        cy*cp, cy*sp*sr - sy*cr, cy*sp*cr + sy*sr,
+        sy*cp, sy*sp*sr + cy*cr, sy*sp*cr - cy*sr,
+        -sp, cp*sr, cp*cr };
+    memcpy(R, M, sizeof(M));
+}
+
+// sets the corners and the homography of 'det' to those of a tag at pose
+// R, t, with up to 'noise' px added to the corners.
+static void
+project(apriltag_detection_info_t *info, const double R[9], const double t[3], double noise)
+{
+    apriltag_detection_t *det = info->det;
+    double s = info->tagsize / 2;
+    double K[9] = { info->fx, 0, info->cx, 0, info->fy, info->cy, 0, 0, 1 };
+    double B[9] = { s*R[0], s*R[1], t[0], s*R[3], s*R[4], t[1], s*R[6], s*R[7], t[2] };
+    double *H = det->H->data;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            H[3*i + j] = 0;
+            for (int l = 0; l < 3; l++)
+                H[3*i + j] += K[3*i + l] * B[3*l + j];
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        double x = (i == 1 || i == 2) ? 1 : -1, y = i < 2 ? 1 : -1;
+        double w = H[6]*x + H[7]*y + H[8];
+        det->p[i][0] = (H[0]*x + H[1]*y + H[2]) / w;
+        det->p[i][1] = (H[3]*x + H[4]*y + H[5]) / w;
+        det->p[i][0] += noise * sin(13.7 * (det->p[i][1] + i));
+        det->p[i][1] += noise * cos(17.3 * (det->p[i][0] + i));
+    }
+}
+
+static double
+distance(const double t[3])
+{
+    return sqrt(t[0]*t[0] + t[1]*t[1] + t[2]*t[2]);
+}
+
+// a tag swinging in front of the camera at 30 fps.
+static bool
+check_sequence(apriltag_detection_info_t *info, apriltag_pose_track_t *track, double noise)
+{
+    double max_dd = 0, sum_dd = 0, sum_oi_dd = 0, max_px = 0;
+    int nframes = 90, nfull = track->nfull, nwarm = track->nwarm;
+    for (int k = 0; k < nframes; k++) {
+        double a = k / 30.0;
+        double R[9], t[3] = { 0.05 * sin(a), 0.03 * cos(2*a), 0.4 + 0.2 * sin(0.5*a) };
+        rotation_rpy(0.4 * sin(a), 0.3 * cos(1.3*a), 0.2 * a, R);
+        project(info, R, t, noise);
+
+        estimate_tag_pose_track(info, track);
+        max_px = fmax(max_px, track->reproj_err);
+
+        apriltag_pose_t pose;
+        estimate_tag_pose(info, &pose);
+        double d = distance(t);
+        double dd = fabs(distance(track->t->data) - d) / d;
+        max_dd = fmax(max_dd, dd);
+        sum_dd += dd;
+        sum_oi_dd += fabs(distance(pose.t->data) - d) / d;
+        matd_destroy(pose.R);
+        matd_destroy(pose.t);
+    }
+
+    nfull = track->nfull - nfull;
+    nwarm = track->nwarm - nwarm;
+    bool ok = nfull + nwarm == nframes;
+    if (noise == 0)
+        ok &= nfull == 1 && max_dd < 0.005 && max_px < 0.5;
+    else
+        ok &= nfull <= nframes / 10 && sum_dd < 1.5 * sum_oi_dd;
+    printf("%d frames, %.1f px noise: %d full, %d refined, max reprojection error %.2g px, "
+           "mean relative distance error %.2g (%.2g estimate_tag_pose), %s\n",
+           nframes, noise, nfull, nwarm, max_px, sum_dd / nframes, sum_oi_dd / nframes,
+           ok ? "ok" : "WRONG");
+    return ok;
+}
+
+int
+main(void)
+{
+    apriltag_detection_t det;
+    memset(&det, 0, sizeof(det));
+    det.id = 7;
+    det.H = matd_create(3, 3);
+    apriltag_detection_info_t info = {
+        .det = &det, .tagsize = 0.05, .fx = 600, .fy = 610, .cx = 320, .cy = 240
+    };
+
+    apriltag_pose_track_t track;
+    apriltag_pose_track_init(&track);
+    bool ok = check_sequence(&info, &track, 0);
+
+    // the tag jumps to the other side of the image, and turns.
+    double R[9], t[3] = { -0.15, 0.1, 0.8 };
+    rotation_rpy(-0.6, 0.5, 2.0, R);
+    project(&info, R, t, 0);
+    int nfull = track.nfull;
+    estimate_tag_pose_track(&info, &track);
+    bool jump_ok = track.nfull == nfull + 1 && fabs(distance(track.t->data) - distance(t)) < 1e-6;
+    printf("jump: %s\n", jump_ok ? "ok" : "WRONG");
+
+    // another tag at the same pose.
+    det.id = 8;
+    estimate_tag_pose_track(&info, &track);
+    bool id_ok = track.nfull == nfull + 2 && track.id == 8;
+    printf("new id: %s\n", id_ok ? "ok" : "WRONG");
+
+    apriltag_pose_track_clear(&track);
+    ok &= jump_ok && id_ok && track.R == NULL && track.id == -1;
+    ok &= check_sequence(&info, &track, 0.5);
+    apriltag_pose_track_clear(&track);
+
+    matd_destroy(det.H);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+
+// The pyramid search (td->pyramid) must find every tag the decimated
+// search finds, and rerun the full-resolution search on part of the image
+// only. It may find tags the full-resolution search over the whole image
+// does not: the threshold tiles of a region differ from the image's.
+
+// whether detections has a tag of det's id centered within 2 px of it.
+static bool
+detection_near(const apriltag_detection_t *det, zarray_t *detections)
+{
+    for (int i = 0; i < zarray_size(detections); i++) {
+        apriltag_detection_t *other;
+        zarray_get(detections, i, &other);
+
+        if (other->id == det->id &&
+            hypot(other->c[0] - det->c[0], other->c[1] - det->c[1]) < 2)
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+check(image_u8_t *im, apriltag_detector_t *td, zarray_t *full, float decimate)
+{
+    td->quad_decimate = decimate;
+    td->pyramid = false;
+    zarray_t *coarse = apriltag_detector_detect(td, im);
+    td->pyramid = true;
+    zarray_t *pyramid = apriltag_detector_detect(td, im);
+    uint32_t npixels = td->npyramid_pixels;
+
+    bool ok = npixels < (uint32_t) (im->width * im->height);
+    for (int i = 0; i < zarray_size(coarse); i++) {
+        apriltag_detection_t *det;
+        zarray_get(coarse, i, &det);
+        ok &= detection_near(det, pyramid);
+    }
+
+    printf("decimate %.1f: %d detections decimated, %d pyramid, %d full resolution, "
+           "%.0f%% of the image at full resolution, %s\n",
+           decimate, zarray_size(coarse), zarray_size(pyramid), zarray_size(full),
+           100.0 * npixels / (im->width * im->height), ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(coarse);
+    apriltag_detections_destroy(pyramid);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    td->quad_decimate = 1;
+    zarray_t *full = apriltag_detector_detect(td, im);
+
+    bool ok = true;
+    ok &= check(im, td, full, 2);
+    ok &= check(im, td, full, 3);
+
+    apriltag_detections_destroy(full);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <apriltag.h>
+#include <tag16h5.h>
+#include <tag36h11.h>
+#include <tagStandard41h12.h>
+
+// The compact decode index must return the same id, hamming distance and
+// rotation as the hash table for valid codes with up to bits_corrected+2
+// flipped bits, in every rotation, and for random codes.
+
+static uint32_t rng_state = 12345;
+
+static uint64_t
+rng(void)
+{
+    rng_state = rng_state*1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+// rotate90() of apriltag.c: codes are laid out one quadrant at a time.
+static uint64_t
+rotate(apriltag_family_t *fam, uint64_t w)
+{
+    int p = fam->nbits;
+    uint64_t l = 0;
+    if (fam->nbits % 4 == 1) {
+        p = fam->nbits - 1;
+        l = 1;
+    }
+    w = ((w >> l) << (p/4 + l)) | (w >> (3 * p/ 4 + l) << l) | (w & l);
+    return w & ((1ULL << fam->nbits) - 1);
+}
+
+static bool
+check(apriltag_family_t *fam, int bits)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    enum { NQUERIES = 20000 };
+    uint64_t *queries = malloc(sizeof(uint64_t) * NQUERIES);
+    int *ref = malloc(sizeof(int) * NQUERIES * 3);
+
+    for (int q = 0; q < NQUERIES; q++) {
+        uint64_t code;
+        if (q % 8 == 7) {
+            code = ((rng() << 40) ^ (rng() << 20) ^ rng()) & ((1ULL << fam->nbits) - 1);
+        } else {
+            code = fam->codes[rng() % fam->ncodes];
+            int nflips = rng() % (bits + 3);
+            for (int f = 0; f < nflips; f++)
+                code ^= 1ULL << (rng() % fam->nbits);
+            for (int r = rng() % 4; r > 0; r--)
+                code = rotate(fam, code);
+        }
+        queries[q] = code;
+    }
+
+    td->compact_decode_index = false;
+    apriltag_detector_add_family_bits(td, fam, bits);
+    for (int q = 0; q < NQUERIES; q++)
+        ref[3*q] = apriltag_family_decode(fam, queries[q], &ref[3*q + 1], &ref[3*q + 2]);
+    apriltag_detector_remove_family(td, fam);
+
+    td->compact_decode_index = true;
+    apriltag_detector_add_family_bits(td, fam, bits);
+
+    bool ok = true;
+    int ndecoded = 0;
+    for (int q = 0; q < NQUERIES; q++) {
+        int hamming = -1, rotation = -1;
+        int id = apriltag_family_decode(fam, queries[q], &hamming, &rotation);
+
+        if (id != ref[3*q] || (id >= 0 && (hamming != ref[3*q + 1] || rotation != ref[3*q + 2]))) {
+            printf("%s, %d bits: code %llx decodes to %d/%d/%d, expected %d/%d/%d\n",
+                   fam->name, bits, (unsigned long long) queries[q], id, hamming, rotation,
+                   ref[3*q], ref[3*q + 1], ref[3*q + 2]);
+            ok = false;
+            break;
+        }
+        ndecoded += id >= 0;
+    }
+
+    printf("%s, %d bits: %d of %d decoded, %s\n", fam->name, bits, ndecoded, NQUERIES,
+           ok ? "ok" : "FAILED");
+
+    apriltag_detector_remove_family(td, fam);
+    apriltag_detector_destroy(td);
+    free(queries);
+    free(ref);
+
+    return ok;
+}
+
+int
+main(void)
+{
+    apriltag_family_t *tf16 = tag16h5_create();
+    apriltag_family_t *tf36 = tag36h11_create();
+    apriltag_family_t *tf41 = tagStandard41h12_create();
+
+    bool ok = true;
+    for (int bits = 0; bits <= 2; bits++) {
+        ok &= check(tf16, bits);
+        ok &= check(tf36, bits);
+    }
+    // the hash table of 41h12 at 2 bits does not fit comfortably in a test.
+    ok &= check(tf41, 0);
+    ok &= check(tf41, 1);
+
+    tag16h5_destroy(tf16);
+    tag36h11_destroy(tf36);
+    tagStandard41h12_destroy(tf41);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// Labeling the threshold image by runs (qtp.rle_components) must find the
+// same components as the per-pixel union-find: same quads, same
+// detections. Besides the test image, a synthetic image of random blocks
+// exercises the border columns and diagonal-only connections.
+//
+// The reference is always the single-threaded pixel path: its threaded
+// variant unions across row chunks concurrently and can lose merges.
+
+static bool
+run_config(const char *name, image_u8_t *im, apriltag_family_t *tf, float decimate, int nthreads)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    apriltag_detector_add_family(td, tf);
+
+    td->qtp.rle_components = false;
+    td->nthreads = 1;
+    zarray_t *pixels = apriltag_detector_detect(td, im);
+    uint32_t nquads_pixels = td->nquads;
+
+    td->qtp.rle_components = true;
+    td->nthreads = nthreads;
+    zarray_t *runs = apriltag_detector_detect(td, im);
+    uint32_t nquads_runs = td->nquads;
+
+    bool ok = nquads_pixels == nquads_runs && detections_equal(pixels, runs);
+
+    printf("%s, decimate %.1f, %d threads: pixels %d quads %d detections, runs %d quads %d detections, %s\n",
+           name, decimate, nthreads, nquads_pixels, zarray_size(pixels),
+           nquads_runs, zarray_size(runs), ok ? "equal" : "DIFFERENT");
+
+    apriltag_detections_destroy(pixels);
+    apriltag_detections_destroy(runs);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+static image_u8_t *
+random_blocks(int w, int h)
+{
+    image_u8_t *im = image_u8_create(w, h);
+    uint32_t state = 7;
+
+    for (int y = 0; y < h; y++)
+        memset(&im->buf[y*im->stride], 128, w);
+
+    for (int i = 0; i < 400; i++) {
+        state = state*1664525u + 1013904223u;
+        int x0 = (state >> 8) % w, y0 = (state >> 20) % h;
+        state = state*1664525u + 1013904223u;
+        int bw = 1 + (state >> 8) % 40, bh = 1 + (state >> 20) % 40;
+        uint8_t v = (state & 1) ? 250 : 5;
+
+        for (int y = y0; y < h && y < y0 + bh; y++) {
+            for (int x = x0; x < w && x < x0 + bw; x++)
+                im->buf[y*im->stride + x] = v;
+        }
+    }
+
+    return im;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+    image_u8_t *blocks = random_blocks(333, 211);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    ok &= run_config(path_img, im, tf, 1, 1);
+    ok &= run_config(path_img, im, tf, 1.5, 1);
+    ok &= run_config(path_img, im, tf, 2, 4);
+    ok &= run_config(path_img, im, tf, 3, 1);
+    ok &= run_config("blocks", blocks, tf, 1, 1);
+    ok &= run_config("blocks", blocks, tf, 1, 4);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(blocks);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
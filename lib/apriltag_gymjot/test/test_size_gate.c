@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+
+// With an expected tag size (qtp.min_tag_px, qtp.max_tag_px), the detector
+// must still find every tag whose longest edge is comfortably inside the
+// range, exactly as without it, and fit no quad when no tag can be that
+// size.
+
+static double
+longest_edge(const apriltag_detection_t *det)
+{
+    double side = 0;
+    for (int i = 0; i < 4; i++) {
+        int j = (i + 1) & 3;
+        side = fmax(side, hypot(det->p[j][0] - det->p[i][0], det->p[j][1] - det->p[i][1]));
+    }
+    return side;
+}
+
+static bool
+detection_in(const apriltag_detection_t *det, zarray_t *detections)
+{
+    for (int i = 0; i < zarray_size(detections); i++) {
+        apriltag_detection_t *other;
+        zarray_get(detections, i, &other);
+
+        if (other->id != det->id || other->hamming != det->hamming ||
+            other->decision_margin != det->decision_margin)
+            continue;
+
+        bool same = true;
+        for (int j = 0; j < 4; j++)
+            same &= other->p[j][0] == det->p[j][0] && other->p[j][1] == det->p[j][1];
+        if (same)
+            return true;
+    }
+
+    return false;
+}
+
+// detections of all whose longest edge is within [lo, hi] must be in gated,
+// and everything in gated must be in all.
+static bool
+check_range(apriltag_detector_t *td, image_u8_t *im, zarray_t *all, double lo, double hi)
+{
+    td->qtp.min_tag_px = lo / 1.25;
+    td->qtp.max_tag_px = hi * 1.25;
+    zarray_t *gated = apriltag_detector_detect(td, im);
+    uint32_t nquads = td->nquads;
+
+    bool ok = true;
+    int nexpected = 0;
+    for (int i = 0; i < zarray_size(all); i++) {
+        apriltag_detection_t *det;
+        zarray_get(all, i, &det);
+        double side = longest_edge(det);
+        if (side >= lo && side <= hi) {
+            nexpected++;
+            ok &= detection_in(det, gated);
+        }
+    }
+
+    for (int i = 0; i < zarray_size(gated); i++) {
+        apriltag_detection_t *det;
+        zarray_get(gated, i, &det);
+        ok &= detection_in(det, all);
+    }
+
+    printf("  %.0f-%.0f px: %d detections, %d expected, %u quads, %s\n",
+           td->qtp.min_tag_px, td->qtp.max_tag_px, zarray_size(gated), nexpected, nquads,
+           ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(gated);
+    return ok;
+}
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, float decimate)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    zarray_t *all = apriltag_detector_detect(td, im);
+    printf("decimate %.1f: %d detections, %u quads\n", decimate, zarray_size(all), td->nquads);
+
+    double lo = 1e9, hi = 0;
+    for (int i = 0; i < zarray_size(all); i++) {
+        apriltag_detection_t *det;
+        zarray_get(all, i, &det);
+        lo = fmin(lo, longest_edge(det));
+        hi = fmax(hi, longest_edge(det));
+    }
+
+    bool ok = true;
+    if (zarray_size(all) > 0) {
+        ok &= check_range(td, im, all, lo, hi);
+        ok &= check_range(td, im, all, lo, lo);
+        ok &= check_range(td, im, all, hi, hi);
+    }
+
+    td->qtp.min_tag_px = 4 * (im->width + im->height);
+    td->qtp.max_tag_px = 0;
+    zarray_t *none = apriltag_detector_detect(td, im);
+    ok &= td->nquads == 0 && zarray_size(none) == 0;
+    apriltag_detections_destroy(none);
+
+    apriltag_detections_destroy(all);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    ok &= check(im, tf, 1);
+    ok &= check(im, tf, 2);
+    ok &= check(im, tf, 3);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag16h5.h>
+#include <tag36h10.h>
+#include <tag36h11.h>
+#include <tagCircle49h12.h>
+#include <tagCustom48h12.h>
+#include <tagStandard41h12.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// The decoders specialized for a family layout (td->specialized_decode)
+// must give exactly the detections and decision margins of the generic
+// single-precision decoder, on the test image and on a synthetic image
+// of the family's own tags. A family whose decode index cannot be built
+// (more than 3 corrected bits) must decode nothing, on either path.
+
+// draws four tags of the family, sheared and at a non-integer scale, on
+// a white image.
+static image_u8_t *
+synthetic_image(apriltag_family_t *tf)
+{
+    image_u8_t *im = image_u8_create(480, 480);
+    memset(im->buf, 255, (size_t) im->stride * im->height);
+
+    for (int t = 0; t < 4; t++) {
+        image_u8_t *tag = apriltag_to_image(tf, (t * 37) % tf->ncodes);
+        int x0 = 40 + (t % 2) * 220, y0 = 40 + (t / 2) * 220;
+        double scale = 15.3, shear = 0.1 * (t - 1.5);
+
+        for (int y = y0; y < y0 + 180; y++) {
+            for (int x = x0; x < x0 + 200; x++) {
+                int u = (x - x0 - shear * (y - y0)) / scale;
+                int v = (y - y0) / scale;
+                if (x - x0 - shear * (y - y0) >= 0 && u < tag->width && v < tag->height)
+                    im->buf[y*im->stride + x] = tag->buf[v*tag->stride + u];
+            }
+        }
+        image_u8_destroy(tag);
+    }
+
+    return im;
+}
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, const char *what, int min_detections)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->decode_float = true;
+    td->compact_decode_index = true;
+    apriltag_detector_add_family(td, tf);
+
+    td->specialized_decode = false;
+    zarray_t *generic = apriltag_detector_detect(td, im);
+    td->specialized_decode = true;
+    zarray_t *specialized = apriltag_detector_detect(td, im);
+
+    bool ok = detections_equal(generic, specialized) && zarray_size(specialized) >= min_detections;
+    printf("%s, %s: %d detections generic, %d specialized, %s\n", tf->name, what,
+           zarray_size(generic), zarray_size(specialized), ok ? "ok" : "DIFFERENT");
+
+    apriltag_detections_destroy(generic);
+    apriltag_detections_destroy(specialized);
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+static bool
+check_no_index(image_u8_t *im, apriltag_family_t *tf, bool compact)
+{
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->decode_float = true;
+    td->specialized_decode = true;
+    td->compact_decode_index = compact;
+    apriltag_detector_add_family_bits(td, tf, 4);
+
+    bool ok = tf->impl == NULL && apriltag_family_decode_index_bytes(tf) == 0;
+    for (int decode_float = 0; decode_float < 2; decode_float++) {
+        td->decode_float = decode_float;
+        zarray_t *dets = apriltag_detector_detect(td, im);
+        ok &= zarray_size(dets) == 0;
+        apriltag_detections_destroy(dets);
+    }
+    printf("%s, 4 bits corrected, %s index: %s\n", tf->name, compact ? "compact" : "full",
+           ok ? "ok" : "WRONG");
+
+    apriltag_detector_destroy(td);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    // tag16h5 has no specialized decoder and checks the fallback.
+    apriltag_family_t *families[] = {
+        tag36h11_create(), tag36h10_create(), tagStandard41h12_create(),
+        tagCircle49h12_create(), tagCustom48h12_create(), tag16h5_create()
+    };
+    int nfamilies = sizeof(families) / sizeof(families[0]);
+
+    bool ok = true;
+    for (int i = 0; i < nfamilies; i++) {
+        ok &= check(im, families[i], "image", 0);
+
+        image_u8_t *synth = synthetic_image(families[i]);
+        ok &= check(synth, families[i], "synthetic", 1);
+        image_u8_destroy(synth);
+    }
+
+    image_u8_t *synth = synthetic_image(families[0]);
+    ok &= check_no_index(synth, families[0], true);
+    ok &= check_no_index(synth, families[0], false);
+    image_u8_destroy(synth);
+
+    tag36h11_destroy(families[0]);
+    tag36h10_destroy(families[1]);
+    tagStandard41h12_destroy(families[2]);
+    tagCircle49h12_destroy(families[3]);
+    tagCustom48h12_destroy(families[4]);
+    tag16h5_destroy(families[5]);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <apriltag_math.h>
+#include <common/homography.h>
+#include <common/zarray.h>
+
+// mat33_square_homography() must map the ideal tag's corners onto the
+// quad's, agree with the general homography_compute() up to scale, and
+// refuse degenerate quads.
+
+static uint32_t rng_state = 12345;
+
+static double
+rng(void)
+{
+    rng_state = rng_state*1664525u + 1013904223u;
+    return (rng_state >> 8) / (double) (1 << 24);
+}
+
+static const double ideal[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+static bool
+check_quad(double p[4][2], double *max_px, double *max_diff)
+{
+    double H[9];
+    if (mat33_square_homography(p, H) != 0 || H[8] != 1)
+        return false;
+
+    zarray_t *corr = zarray_create(sizeof(float[4]));
+    for (int i = 0; i < 4; i++) {
+        float c[4] = { ideal[i][0], ideal[i][1], p[i][0], p[i][1] };
+        zarray_add(corr, c);
+
+        double w = H[6]*ideal[i][0] + H[7]*ideal[i][1] + H[8];
+        double x = (H[0]*ideal[i][0] + H[1]*ideal[i][1] + H[2]) / w;
+        double y = (H[3]*ideal[i][0] + H[4]*ideal[i][1] + H[5]) / w;
+        *max_px = fmax(*max_px, hypot(x - p[i][0], y - p[i][1]));
+    }
+
+    // the float correspondences of homography_compute() limit the
+    // agreement; compare the projections of the tag's center and edges.
+    matd_t *G = homography_compute(corr, HOMOGRAPHY_COMPUTE_FLAG_SVD);
+    matd_t Hm = { 3, 3, H };
+    for (int k = 0; k < 9; k++) {
+        double tx = (k % 3) - 1, ty = (k / 3) - 1;
+        double hx, hy, gx, gy;
+        homography_project(&Hm, tx, ty, &hx, &hy);
+        homography_project(G, tx, ty, &gx, &gy);
+        *max_diff = fmax(*max_diff, hypot(hx - gx, hy - gy));
+    }
+
+    matd_destroy(G);
+    zarray_destroy(corr);
+    return true;
+}
+
+int
+main(void)
+{
+    bool ok = true;
+    double max_px = 0, max_diff = 0;
+
+    // tags from 10 to 400 px, rotated and seen at an angle.
+    for (int n = 0; n < 10000; n++) {
+        double size = 5 + 195 * rng(), theta = 2 * M_PI * rng();
+        double cx = 400 * rng() + 100, cy = 300 * rng() + 100;
+        double c = cos(theta), s = sin(theta);
+        double p[4][2];
+        for (int i = 0; i < 4; i++) {
+            double x = ideal[i][0] * size * (1 + 0.3 * (rng() - 0.5));
+            double y = ideal[i][1] * size * (1 + 0.3 * (rng() - 0.5));
+            p[i][0] = cx + c*x - s*y;
+            p[i][1] = cy + s*x + c*y;
+        }
+        ok &= check_quad(p, &max_px, &max_diff);
+    }
+    ok &= max_px < 1e-9 && max_diff < 1e-3;
+    printf("random quads: max corner error %.2g px, max difference to homography_compute %.2g px, %s\n",
+           max_px, max_diff, ok ? "ok" : "WRONG");
+
+    // all corners on a line, and on one point.
+    double line[4][2] = { { 0, 0 }, { 10, 10 }, { 30, 30 }, { 20, 20 } };
+    double point[4][2] = { { 5, 5 }, { 5, 5 }, { 5, 5 }, { 5, 5 } };
+    double H[9];
+    bool degenerate_ok = mat33_square_homography(line, H) != 0 && mat33_square_homography(point, H) != 0;
+    printf("degenerate quads: %s\n", degenerate_ok ? "ok" : "WRONG");
+
+    return ok && degenerate_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
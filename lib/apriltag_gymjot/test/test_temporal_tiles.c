@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+#include "test_util.h"
+
+// With td->temporal_tiles and a tolerance of 0, a sequence of frames must
+// give exactly the detections of a detector that thresholds every frame
+// from scratch, reusing every tile and most quad fits (not those touching
+// the partial tiles at the right and bottom) of a repeated frame, and
+// some of both in a frame in which only part of the scene moved. With a
+// tolerance, noise within it must not force any tile to be thresholded
+// again.
+
+// frame k of the sequence: the image with a gray block (someone walking
+// through) moved k * 16 px to the right, none for k < 0.
+static void
+make_frame(const image_u8_t *im, image_u8_t *frame, int k)
+{
+    for (int y = 0; y < im->height; y++)
+        memcpy(&frame->buf[y*frame->stride], &im->buf[y*im->stride], im->width);
+
+    if (k < 0)
+        return;
+
+    for (int y = im->height / 4; y < im->height * 3 / 4; y++) {
+        for (int x = k * 16; x < k * 16 + im->width / 8 && x < im->width; x++)
+            frame->buf[y*frame->stride + x] = 90;
+    }
+}
+
+static bool
+check(image_u8_t *im, apriltag_family_t *tf, float decimate)
+{
+    apriltag_detector_t *ref = apriltag_detector_create();
+    ref->quad_decimate = decimate;
+    ref->compact_decode_index = true;
+    apriltag_detector_add_family(ref, tf);
+
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = decimate;
+    td->compact_decode_index = true;
+    td->temporal_tiles = true;
+    apriltag_detector_add_family(td, tf);
+
+    image_u8_t *frame = image_u8_create(im->width, im->height);
+
+    // the first frame, repeated, then the block moving through.
+    int sequence[] = { -1, -1, 0, 1, 2, 2, 3 };
+    int nframes = sizeof(sequence) / sizeof(sequence[0]);
+
+    bool ok = true;
+    for (int i = 0; i < nframes; i++) {
+        make_frame(im, frame, sequence[i]);
+
+        zarray_t *expected = apriltag_detector_detect(ref, frame);
+        zarray_t *dets = apriltag_detector_detect(td, frame);
+
+        bool same = detections_equal(expected, dets);
+        bool repeated = i > 0 && sequence[i] == sequence[i-1];
+        bool reuse_ok = i == 0 ? td->nthresh_tiles_reused == 0 && td->nquad_fits_reused == 0 :
+            repeated ? td->nthresh_tiles_reused == td->nthresh_tiles &&
+                       td->nquad_fits_reused > td->nquad_fits / 2 :
+            td->nthresh_tiles_reused > 0 && td->nthresh_tiles_reused < td->nthresh_tiles &&
+            td->nquad_fits_reused > 0 && td->nquad_fits_reused < td->nquad_fits;
+
+        printf("decimate %.1f, frame %d: %d detections, %u/%u tiles and %u/%u fits reused, %s\n",
+               decimate, i, zarray_size(dets), td->nthresh_tiles_reused, td->nthresh_tiles,
+               td->nquad_fits_reused, td->nquad_fits, same && reuse_ok ? "ok" : "DIFFERENT");
+        ok &= same && reuse_ok;
+
+        apriltag_detections_destroy(expected);
+        apriltag_detections_destroy(dets);
+    }
+
+    // +-1 of noise on the last frame.
+    td->temporal_tile_tolerance = 2;
+    for (int y = 0; y < frame->height; y++) {
+        for (int x = 0; x < frame->width; x++) {
+            uint8_t *v = &frame->buf[y*frame->stride + x];
+            *v = (x + y) & 1 ? (*v < 255 ? *v + 1 : *v) : (*v > 0 ? *v - 1 : *v);
+        }
+    }
+    apriltag_detections_destroy(apriltag_detector_detect(td, frame));
+    bool noise_ok = td->nthresh_tiles_reused == td->nthresh_tiles;
+    printf("decimate %.1f, noise: %u/%u tiles reused, %s\n", decimate,
+           td->nthresh_tiles_reused, td->nthresh_tiles, noise_ok ? "ok" : "DIFFERENT");
+    ok &= noise_ok;
+
+    image_u8_destroy(frame);
+    apriltag_detector_destroy(td);
+    apriltag_detector_destroy(ref);
+
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+
+    bool ok = true;
+    ok &= check(im, tf, 1);
+    ok &= check(im, tf, 2);
+    ok &= check(im, tf, 3);
+
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
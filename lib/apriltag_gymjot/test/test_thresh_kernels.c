@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <common/thresh_kernels.h>
+
+// Every compiled threshold kernel must produce exactly the output of the
+// scalar reference, for any width (vector bodies plus scalar tails), any
+// contrast threshold and for flat, noisy and saturated content.
+
+#define MAX_TW 203
+#define STRIDE (MAX_TW*THRESH_TILESZ + 13)
+
+static uint32_t rng_state = 12345;
+
+static uint32_t
+rng(void)
+{
+    rng_state = rng_state*1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+static void
+fill(uint8_t *buf, size_t n, int pattern)
+{
+    for (size_t i = 0; i < n; i++) {
+        switch (pattern) {
+            case 0: buf[i] = rng() & 0xff; break;                   // noise
+            case 1: buf[i] = (rng() & 1) ? 255 : 0; break;          // saturated
+            case 2: buf[i] = 120 + (rng() % 8); break;              // flat
+            default: buf[i] = (i / 7) & 1 ? 200 + (rng() % 56) : rng() % 56; break;
+        }
+    }
+}
+
+static bool
+check(const thresh_kernels_t *ref, const thresh_kernels_t *k, int tw, int pattern)
+{
+    static uint8_t im[THRESH_TILESZ*STRIDE];
+    static uint8_t max_ref[3*MAX_TW], min_ref[3*MAX_TW], max_k[3*MAX_TW], min_k[3*MAX_TW];
+    static uint8_t bmax_ref[MAX_TW], bmin_ref[MAX_TW], bmax_k[MAX_TW], bmin_k[MAX_TW];
+    static uint8_t th_ref[THRESH_TILESZ*STRIDE], th_k[THRESH_TILESZ*STRIDE];
+
+    // min/max over three rows of tiles, used as blur input below.
+    for (int r = 0; r < 3; r++) {
+        fill(im, sizeof(im), pattern);
+        ref->minmax_row(im, STRIDE, tw, &max_ref[r*MAX_TW], &min_ref[r*MAX_TW]);
+        k->minmax_row(im, STRIDE, tw, &max_k[r*MAX_TW], &min_k[r*MAX_TW]);
+
+        if (memcmp(&max_ref[r*MAX_TW], &max_k[r*MAX_TW], tw) ||
+            memcmp(&min_ref[r*MAX_TW], &min_k[r*MAX_TW], tw)) {
+            printf("%s: minmax mismatch, tw %d, pattern %d\n", k->name, tw, pattern);
+            return false;
+        }
+    }
+
+    // center row with both, one or no neighbours.
+    for (int edge = 0; edge < 4; edge++) {
+        const uint8_t *mu = (edge & 1) ? NULL : &max_ref[0];
+        const uint8_t *nu = (edge & 1) ? NULL : &min_ref[0];
+        const uint8_t *md = (edge & 2) ? NULL : &max_ref[2*MAX_TW];
+        const uint8_t *nd = (edge & 2) ? NULL : &min_ref[2*MAX_TW];
+
+        ref->blur_row(mu, &max_ref[MAX_TW], md, nu, &min_ref[MAX_TW], nd, tw, bmax_ref, bmin_ref);
+        k->blur_row(mu, &max_ref[MAX_TW], md, nu, &min_ref[MAX_TW], nd, tw, bmax_k, bmin_k);
+
+        if (memcmp(bmax_ref, bmax_k, tw) || memcmp(bmin_ref, bmin_k, tw)) {
+            printf("%s: blur mismatch, tw %d, pattern %d, edge %d\n", k->name, tw, pattern, edge);
+            return false;
+        }
+    }
+
+    static const int diffs[] = { -1, 0, 1, 5, 64, 128, 255, 256, 1000 };
+    for (size_t d = 0; d < sizeof(diffs)/sizeof(diffs[0]); d++) {
+        memset(th_ref, 0x55, sizeof(th_ref));
+        memset(th_k, 0x55, sizeof(th_k));
+
+        ref->threshold_row(im, th_ref, STRIDE, bmax_ref, bmin_ref, tw, diffs[d]);
+        k->threshold_row(im, th_k, STRIDE, bmax_ref, bmin_ref, tw, diffs[d]);
+
+        // also catches writes past the last tile.
+        if (memcmp(th_ref, th_k, sizeof(th_ref))) {
+            printf("%s: threshold mismatch, tw %d, pattern %d, min_white_black_diff %d\n",
+                   k->name, tw, pattern, diffs[d]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int
+main(void)
+{
+    const thresh_kernels_t *ref = thresh_kernels_get(0);
+    bool ok = true;
+
+    printf("default: %s\n", thresh_kernels_default()->name);
+
+    for (int idx = 1; thresh_kernels_get(idx) != NULL; idx++) {
+        const thresh_kernels_t *k = thresh_kernels_get(idx);
+        bool kok = true;
+
+        for (int tw = 1; tw <= MAX_TW; tw++) {
+            for (int pattern = 0; pattern < 4; pattern++)
+                kok &= check(ref, k, tw, pattern);
+        }
+
+        printf("%s: %s\n", k->name, kok ? "ok" : "FAILED");
+        ok &= kok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
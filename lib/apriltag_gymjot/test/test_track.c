@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <apriltag.h>
+#include <tag36h11.h>
+#include <common/pjpeg.h>
+
+// apriltag_detector_track() must follow each tag of a full search to
+// where it is in a shifted copy of the frame, re-decoding it to the same
+// id and finding the same corners as in the original frame (moved by the
+// shift), and give up on a frame without the tag.
+
+// largest distance between corners of a and b, b shifted back by (dx, dy).
+static double
+corner_error(const apriltag_detection_t *a, const apriltag_detection_t *b, int dx, int dy)
+{
+    double err = 0;
+    for (int i = 0; i < 4; i++)
+        err = fmax(err, hypot(b->p[i][0] - dx - a->p[i][0], b->p[i][1] - dy - a->p[i][1]));
+    return err;
+}
+
+// im moved right by dx and down by dy, the uncovered border gray.
+static image_u8_t *
+shifted_image(image_u8_t *im, int dx, int dy)
+{
+    image_u8_t *out = image_u8_create(im->width, im->height);
+    for (int y = 0; y < im->height; y++) {
+        for (int x = 0; x < im->width; x++) {
+            int sx = x - dx, sy = y - dy;
+            out->buf[y*out->stride + x] = (sx >= 0 && sy >= 0 && sx < im->width && sy < im->height) ?
+                im->buf[sy*im->stride + sx] : 128;
+        }
+    }
+    return out;
+}
+
+static bool
+check(apriltag_detector_t *td, image_u8_t *im, zarray_t *dets, int dx, int dy, double reuse_px)
+{
+    image_u8_t *moved = shifted_image(im, dx, dy);
+
+    int ntracked = 0, nreused = 0;
+    double max_err = 0;
+    bool ok = true;
+
+    for (int i = 0; i < zarray_size(dets); i++) {
+        apriltag_detection_t *orig;
+        zarray_get(dets, i, &orig);
+
+        // follow a copy, as a caller keeping the tag across frames does.
+        apriltag_detection_t *prev = apriltag_detection_copy(orig);
+        if (prev->H == orig->H || memcmp(prev->H->data, orig->H->data, 9 * sizeof(double)) != 0)
+            ok = false;
+
+        apriltag_detection_t *det = apriltag_detector_track(td, moved, prev, 4, reuse_px);
+        if (det == NULL) {
+            apriltag_detection_destroy(prev);
+            continue;
+        }
+
+        ntracked++;
+        if (det->decision_margin == prev->decision_margin)
+            nreused++;
+        if (det->id != prev->id || det->family != prev->family)
+            ok = false;
+
+        // the corners differ from the full search's by its own fit, so
+        // compare with tracking in the original frame, relative to the
+        // tag's size: on the small, tightly packed tags of the test
+        // images the band reaches the edges of neighbouring tags.
+        double side = hypot(prev->p[0][0] - prev->p[1][0], prev->p[0][1] - prev->p[1][1]);
+        apriltag_detection_t *still = apriltag_detector_track(td, im, prev, 4, reuse_px);
+        if (still == NULL || corner_error(prev, det, dx, dy) > 0.2 * side)
+            ok = false;
+        else
+            max_err = fmax(max_err, corner_error(still, det, dx, dy) / side);
+
+        apriltag_detection_destroy(still);
+        apriltag_detection_destroy(det);
+        apriltag_detection_destroy(prev);
+    }
+
+    // tags whose edges are hard to fit (small, blurred, at the image
+    // border) may be lost, but most must be kept.
+    ok &= ntracked * 4 >= zarray_size(dets) * 3 && max_err < 0.1;
+    // past reuse_px, every tracked tag is decoded again.
+    ok &= reuse_px > 0 || nreused == 0;
+
+    printf("shift %d,%d reuse %.1f: %d of %d tracked, %d decodes reused, corner error %.3f of the side, %s\n",
+           dx, dy, reuse_px, ntracked, zarray_size(dets), nreused, max_err, ok ? "ok" : "FAILED");
+
+    image_u8_destroy(moved);
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        return EXIT_FAILURE;
+    }
+
+    char path_img[1024];
+    snprintf(path_img, sizeof(path_img), "%s.jpg", argv[1]);
+
+    pjpeg_t *pjpeg = pjpeg_create_from_file(path_img, 0, NULL);
+    if (pjpeg == NULL) {
+        return EXIT_FAILURE;
+    }
+    image_u8_t *im = pjpeg_to_u8_baseline(pjpeg);
+
+    apriltag_family_t *tf = tag36h11_create();
+    apriltag_detector_t *td = apriltag_detector_create();
+    td->quad_decimate = 2;
+    td->min_decision_margin = 12;
+    apriltag_detector_add_family(td, tf);
+
+    zarray_t *dets = apriltag_detector_detect(td, im);
+
+    bool ok = zarray_size(dets) > 0;
+    ok &= check(td, im, dets, 0, 0, 0);
+    ok &= check(td, im, dets, 2, -1, 0);
+    ok &= check(td, im, dets, -3, 2, 0);
+    ok &= check(td, im, dets, 0, 0, 10);
+
+    // nothing to find in a flat frame.
+    image_u8_t *flat = image_u8_create(im->width, im->height);
+    memset(flat->buf, 128, (size_t) flat->stride * flat->height);
+    for (int i = 0; i < zarray_size(dets); i++) {
+        apriltag_detection_t *prev;
+        zarray_get(dets, i, &prev);
+        apriltag_detection_t *det = apriltag_detector_track(td, flat, prev, 4, 0);
+        if (det != NULL) {
+            printf("tracked tag %d on a flat frame\n", det->id);
+            apriltag_detection_destroy(det);
+            ok = false;
+        }
+    }
+
+    image_u8_destroy(flat);
+    apriltag_detections_destroy(dets);
+    apriltag_detector_destroy(td);
+    tag36h11_destroy(tf);
+    image_u8_destroy(im);
+    pjpeg_destroy(pjpeg);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,51 @@
+#include <string.h>
+#include "test_util.h"
+
+int
+detection_order(const void *_a, const void *_b)
+{
+    const apriltag_detection_t *a = *(apriltag_detection_t**) _a;
+    const apriltag_detection_t *b = *(apriltag_detection_t**) _b;
+
+    if (a->family != b->family)
+        return strcmp(a->family->name, b->family->name);
+
+    if (a->id != b->id)
+        return a->id < b->id ? -1 : 1;
+
+    for (int j = 0; j < 4; j++) {
+        for (int c = 0; c < 2; c++) {
+            if (a->p[j][c] != b->p[j][c])
+                return a->p[j][c] < b->p[j][c] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+bool
+detections_equal(zarray_t *a, zarray_t *b)
+{
+    if (zarray_size(a) != zarray_size(b))
+        return false;
+
+    zarray_sort(a, detection_order);
+    zarray_sort(b, detection_order);
+
+    for (int i = 0; i < zarray_size(a); i++) {
+        apriltag_detection_t *da, *db;
+        zarray_get(a, i, &da);
+        zarray_get(b, i, &db);
+
+        if (da->family != db->family || da->id != db->id || da->hamming != db->hamming ||
+            da->decision_margin != db->decision_margin)
+            return false;
+
+        for (int j = 0; j < 4; j++) {
+            if (da->p[j][0] != db->p[j][0] || da->p[j][1] != db->p[j][1])
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <apriltag.h>
+
+// Orders detections by family name, id and corners, for zarray_sort().
+// With several threads, detections are reported in no particular order;
+// sort them before comparing.
+int detection_order(const void *_a, const void *_b);
+
+// Whether two lists of detections hold the same families, ids, hamming
+// distances, decision margins and corners, exactly. Sorts both lists.
+bool detections_equal(zarray_t *a, zarray_t *b);
@@ -82,6 +82,110 @@ static uint32_t g_lastAprilTagId = 0;
 static float g_lastAprilTagDistanceCm = 0.0f;
 static double g_lastAprilTagMargin = 0.0;
 
+// Search window for captureAprilTag(), seeded by the last accepted tag.
+struct AprilTagRoi {
+    bool valid;
+    float xmin, ymin, xmax, ymax;  // corner bounding box of the last tag
+    float pad;                     // current padding on every side, px
+    uint8_t misses;
+};
+static AprilTagRoi g_aprilTagRoi{false, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0};
+
+// Expected tag size for the quad search, seeded by the last accepted tag.
+struct AprilTagSizeGate {
+    bool valid;
+    float sidePx;     // longest edge of the last tag
+    float tolerance;  // accepted: sidePx / (1 + tolerance) .. sidePx * (1 + tolerance)
+    uint8_t misses;
+};
+static AprilTagSizeGate g_aprilTagSizeGate{false, 0.0f, 0.0f, 0};
+
+// quad_decimate factors the adaptive controller picks from, finest first.
+static constexpr float kAprilTagDecimateLevels[] = {1.0f, 1.5f, 2.0f, 3.0f, 4.0f};
+static constexpr int kAprilTagDecimateLevelCount = sizeof(kAprilTagDecimateLevels) / sizeof(kAprilTagDecimateLevels[0]);
+
+static int aprilTagDecimateDefaultLevel() {
+    int best = 0;
+    for (int i = 1; i < kAprilTagDecimateLevelCount; ++i) {
+        if (fabsf(kAprilTagDecimateLevels[i] - APRILTAG_QUAD_DECIMATE) <
+            fabsf(kAprilTagDecimateLevels[best] - APRILTAG_QUAD_DECIMATE)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Decimation picked for the next frame, and how often frames find a tag.
+struct AprilTagDecimate {
+    uint8_t level;   // index into kAprilTagDecimateLevels
+    uint8_t misses;  // frames in a row without a tag at this level
+    float hitRate;   // moving average of frames with an accepted tag
+};
+static AprilTagDecimate g_aprilTagDecimate{static_cast<uint8_t>(aprilTagDecimateDefaultLevel()), 0, 0.0f};
+
+// Last accepted tag for apriltag_detector_track(), and the number of frames
+// tracked since the last full-frame search.
+static apriltag_detection_t* g_aprilTagTrack = nullptr;
+static uint16_t g_aprilTagTrackFrames = 0;
+
+#if (APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_POSE && APRILTAG_POSE_TRACK) || \
+    APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_SIZE
+// Per-tag distance state is kept for APRILTAG_POSE_TRACK_SLOTS tag ids; the
+// least recently used slot goes to a new id. A slot never used has
+// lastUse 0.
+static int g_distanceSlotIds[APRILTAG_POSE_TRACK_SLOTS] = {};
+static uint32_t g_distanceSlotLastUse[APRILTAG_POSE_TRACK_SLOTS] = {};
+static uint32_t g_distanceSlotClock = 0;
+
+// Slot holding the state of tag id. *isNew is set when the slot was just
+// taken for it, so its state belongs to another tag or to none.
+static int distanceSlotFor(int id, bool* isNew) {
+    int slot = 0;
+    bool found = false;
+    for (int i = 0; i < APRILTAG_POSE_TRACK_SLOTS; ++i) {
+        if (g_distanceSlotLastUse[i] != 0 && g_distanceSlotIds[i] == id) {
+            slot = i;
+            found = true;
+            break;
+        }
+        if (g_distanceSlotLastUse[i] < g_distanceSlotLastUse[slot]) {
+            slot = i;
+        }
+    }
+    g_distanceSlotIds[slot] = id;
+    g_distanceSlotLastUse[slot] = ++g_distanceSlotClock;
+    if (isNew) {
+        *isNew = !found;
+    }
+    return slot;
+}
+#endif
+
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_POSE && APRILTAG_POSE_TRACK
+// Last poses for estimate_tag_pose_track(), by distance slot. The track
+// itself notices a new id and searches its pose again.
+static apriltag_pose_track_t g_poseTracks[APRILTAG_POSE_TRACK_SLOTS];
+static bool g_poseTracksInitialized = false;
+
+static apriltag_pose_track_t* poseTrackFor(int id) {
+    if (!g_poseTracksInitialized) {
+        for (int i = 0; i < APRILTAG_POSE_TRACK_SLOTS; ++i) {
+            apriltag_pose_track_init(&g_poseTracks[i]);
+        }
+        g_poseTracksInitialized = true;
+    }
+    return &g_poseTracks[distanceSlotFor(id, nullptr)];
+}
+#endif
+
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_SIZE
+// Correction of apparent-size distances, learned from full poses, and the
+// frames since each tag's last full pose, by distance slot.
+static apriltag_distance_calib_t g_distanceCalib;
+static bool g_distanceCalibInitialized = false;
+static uint32_t g_distanceFramesSinceFullPose[APRILTAG_POSE_TRACK_SLOTS] = {};
+#endif
+
 static camera_config_t g_grayscaleCameraConfig = {};
 static camera_config_t g_photoCameraConfig = {};
 static bool g_cameraConfigInitialized = false;
@@ -154,7 +258,11 @@ static gymjot::system::ResetScheduler g_resetScheduler(
     });
 
 static uint32_t g_aprilTagDetectionCount = 0;
-static constexpr uint32_t kDetectionsBeforeAutoReset = 600;
+// The detector now takes its per-frame scratch from an arena that is reused
+// between frames (see g_tagDetector->nscratch_heap_calls), so the periodic
+// "apriltag-rotation" reboot that used to mask heap fragmentation is off.
+// Set to a non-zero count to bring it back.
+static constexpr uint32_t kDetectionsBeforeAutoReset = 0;
 static constexpr uint64_t kNoDetectionLogIntervalMs = 15000;
 static constexpr uint64_t kWrongFamilyLogIntervalMs = 5000;
 
@@ -1333,6 +1441,9 @@ static void fillSnapshot(com_gymjot_cuff_SnapshotEvent& snapshot) {
         snapshot.active_tag_id = 0;
     }
 
+    snapshot.quad_decimate = g_tagDetector ? g_tagDetector->quad_decimate : APRILTAG_QUAD_DECIMATE;
+    snapshot.detection_hit_rate = g_aprilTagDecimate.hitRate;
+
     // Connection telemetry (uncomment after regenerating protobuf)
     // snapshot.ble_connected = g_clientConnected;
     // snapshot.ble_mtu = g_currentMtu;
@@ -1570,6 +1681,13 @@ static bool setupAprilTagDetector() {
     g_tagDetector->quad_sigma = APRILTAG_QUAD_SIGMA;
     g_tagDetector->refine_edges = APRILTAG_REFINE_EDGES;
     g_tagDetector->decode_sharpening = APRILTAG_DECODE_SHARPENING;
+    // Lets the decoder drop clutter quads early. The floor is below the
+    // accept threshold, so near misses still reach the low-margin log.
+    g_tagDetector->min_decision_margin = APRILTAG_DECODE_MIN_MARGIN;
+#if APRILTAG_TEMPORAL_TILES_ENABLE
+    g_tagDetector->temporal_tiles = true;
+    g_tagDetector->temporal_tile_tolerance = APRILTAG_TEMPORAL_TILE_TOLERANCE;
+#endif
     apriltag_detector_add_family_bits(g_tagDetector, g_tagFamily, APRILTAG_MAX_BITS_CORRECTED);
 
 #if APRILTAG_ENABLE_COMPAT_36H11
@@ -1591,6 +1709,9 @@ static bool setupAprilTagDetector() {
     Serial.println(selectedAprilTagFamilyName());
     Serial.print("  bits_corrected=");
     Serial.println(APRILTAG_MAX_BITS_CORRECTED);
+    Serial.print("  decode_index_bytes=");
+    Serial.println((unsigned long)(apriltag_family_decode_index_bytes(g_tagFamily) +
+                                   (g_tagFamilyCompat ? apriltag_family_decode_index_bytes(g_tagFamilyCompat) : 0)));
     return true;
 }
 
@@ -1729,24 +1850,14 @@ static void setupBLE() {
     Serial.println("===============================");
 }
 
-static float computeDetectionDistance(const apriltag_detection_t* det, int imgWidth, int imgHeight) {
-    apriltag_detection_info_t info;
-    info.det = const_cast<apriltag_detection_t*>(det);
-    info.tagsize = APRILTAG_TAG_SIZE_M;
-    const float kBaseW = 320.0f;
-    const float kBaseH = 240.0f;
-    const float sx = imgWidth  > 0 ? (static_cast<float>(imgWidth)  / kBaseW) : 1.0f;
-    const float sy = imgHeight > 0 ? (static_cast<float>(imgHeight) / kBaseH) : 1.0f;
-    info.fx = APRILTAG_FX * sx;
-    info.fy = APRILTAG_FY * sy;
-    info.cx = APRILTAG_CX * sx;
-    info.cy = APRILTAG_CY * sy;
-
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_SIZE || (!APRILTAG_POSE_FAST && !APRILTAG_POSE_TRACK)
+// Distance of the tag's center from estimate_tag_pose(), in cm.
+static float iterativePoseDistanceCm(apriltag_detection_info_t* info) {
+    float distanceCm = 0.0f;
     apriltag_pose_t pose;
-    double err = estimate_tag_pose(&info, &pose);
+    double err = estimate_tag_pose(info, &pose);
     (void)err;
 
-    float distanceCm = 0.0f;
     if (pose.t) {
         double tx = matd_get(pose.t, 0, 0);
         double ty = matd_get(pose.t, 1, 0);
@@ -1761,6 +1872,90 @@ static float computeDetectionDistance(const apriltag_detection_t* det, int imgWi
     if (pose.t) {
         matd_destroy(pose.t);
     }
+    return distanceCm;
+}
+#endif
+
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_POSE
+// Distance of the tag's center by the pose solver Config.h selects, in cm.
+static float poseDistanceCm(apriltag_detection_info_t* info) {
+#if APRILTAG_POSE_FAST
+    apriltag_pose_fast_t poses[2];
+    if (estimate_tag_pose_fast(info, poses) != 2) {
+        return 0.0f;
+    }
+    const double* t = poses[0].t;
+    return static_cast<float>(std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]) * 100.0);
+#elif APRILTAG_POSE_TRACK
+    apriltag_pose_track_t* track = poseTrackFor(info->det->id);
+    estimate_tag_pose_track(info, track);
+    const double* t = track->t->data;
+    return static_cast<float>(std::sqrt(t[0] * t[0] + t[1] * t[1] + t[2] * t[2]) * 100.0);
+#else
+    return iterativePoseDistanceCm(info);
+#endif
+}
+#endif
+
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_SIZE
+// Distance from the tag's apparent size, in cm. A new tag, and every
+// APRILTAG_DISTANCE_FULL_POSE_INTERVAL-th frame of each tag, takes the
+// distance of estimate_tag_pose() instead and adds it to the correction
+// table.
+static float sizeDistanceCm(apriltag_detection_info_t* info) {
+    if (!g_distanceCalibInitialized) {
+        apriltag_distance_calib_init(&g_distanceCalib, APRILTAG_DISTANCE_CALIB_MIN_M, APRILTAG_DISTANCE_CALIB_MAX_M);
+        g_distanceCalibInitialized = true;
+    }
+
+    bool isNew = false;
+    const int slot = distanceSlotFor(info->det->id, &isNew);
+    const double sizeDistance = estimate_tag_distance(info);
+    if (sizeDistance > 0.0 && !isNew &&
+        ++g_distanceFramesSinceFullPose[slot] < APRILTAG_DISTANCE_FULL_POSE_INTERVAL) {
+        return static_cast<float>(apriltag_distance_calib_apply(&g_distanceCalib, sizeDistance) * 100.0);
+    }
+
+    const float poseCm = iterativePoseDistanceCm(info);
+    g_distanceFramesSinceFullPose[slot] = 0;
+    if (sizeDistance > 0.0 && poseCm > 0.0f) {
+        apriltag_distance_calib_add(&g_distanceCalib, sizeDistance, poseCm / 100.0);
+#if DISTANCE_STREAM_DEBUG
+        Serial.print("[DIST] size=");
+        Serial.print(sizeDistance * 100.0, 1);
+        Serial.print("cm pose=");
+        Serial.print(poseCm, 1);
+        Serial.print("cm | table error mean=");
+        Serial.print(100.0 * g_distanceCalib.err_sum / g_distanceCalib.nchecked, 2);
+        Serial.print("% max=");
+        Serial.print(100.0 * g_distanceCalib.err_max, 2);
+        Serial.print("% over ");
+        Serial.print(g_distanceCalib.nchecked);
+        Serial.println(" poses");
+#endif
+    }
+    return poseCm;
+}
+#endif
+
+static float computeDetectionDistance(const apriltag_detection_t* det, int imgWidth, int imgHeight) {
+    apriltag_detection_info_t info;
+    info.det = const_cast<apriltag_detection_t*>(det);
+    info.tagsize = APRILTAG_TAG_SIZE_M;
+    const float kBaseW = 320.0f;
+    const float kBaseH = 240.0f;
+    const float sx = imgWidth  > 0 ? (static_cast<float>(imgWidth)  / kBaseW) : 1.0f;
+    const float sy = imgHeight > 0 ? (static_cast<float>(imgHeight) / kBaseH) : 1.0f;
+    info.fx = APRILTAG_FX * sx;
+    info.fy = APRILTAG_FY * sy;
+    info.cx = APRILTAG_CX * sx;
+    info.cy = APRILTAG_CY * sy;
+
+#if APRILTAG_DISTANCE_MODE == APRILTAG_DISTANCE_MODE_SIZE
+    float distanceCm = sizeDistanceCm(&info);
+#else
+    float distanceCm = poseDistanceCm(&info);
+#endif
     // Apply optional calibration
     distanceCm = distanceCm * APRILTAG_DISTANCE_SCALE + APRILTAG_DISTANCE_OFFSET_CM;
     if (distanceCm < 0.0f) distanceCm = 0.0f;
@@ -1768,6 +1963,174 @@ static float computeDetectionDistance(const apriltag_detection_t* det, int imgWi
 }
 
 
+#if APRILTAG_ROI_ENABLE
+static void aprilTagRoiLock(const apriltag_detection_t* det) {
+    AprilTagRoi& roi = g_aprilTagRoi;
+    roi.xmin = roi.xmax = static_cast<float>(det->p[0][0]);
+    roi.ymin = roi.ymax = static_cast<float>(det->p[0][1]);
+    for (int i = 1; i < 4; ++i) {
+        roi.xmin = std::min(roi.xmin, static_cast<float>(det->p[i][0]));
+        roi.xmax = std::max(roi.xmax, static_cast<float>(det->p[i][0]));
+        roi.ymin = std::min(roi.ymin, static_cast<float>(det->p[i][1]));
+        roi.ymax = std::max(roi.ymax, static_cast<float>(det->p[i][1]));
+    }
+    const float size = std::max(roi.xmax - roi.xmin, roi.ymax - roi.ymin);
+    roi.pad = std::max(static_cast<float>(APRILTAG_ROI_MIN_PAD_PX), size * APRILTAG_ROI_PAD_FRACTION);
+    roi.misses = 0;
+    roi.valid = true;
+}
+
+static void aprilTagRoiMiss() {
+    AprilTagRoi& roi = g_aprilTagRoi;
+    if (!roi.valid) {
+        return;
+    }
+    if (++roi.misses >= APRILTAG_ROI_MAX_MISSES) {
+        roi.valid = false;
+        return;
+    }
+    roi.pad *= APRILTAG_ROI_GROW_FACTOR;
+}
+#endif
+
+// Decode budget for this frame, from the controller's current frame rate.
+static uint32_t aprilTagDeadlineUs() {
+    const float fps = g_controller ? g_controller->targetFps() : DEFAULT_FPS;
+    if (APRILTAG_DEADLINE_PERCENT <= 0 || fps <= 0.0f) {
+        return 0;
+    }
+    return static_cast<uint32_t>(1e6f / fps * APRILTAG_DEADLINE_PERCENT / 100.0f);
+}
+
+#if APRILTAG_TRACK_ENABLE
+static void aprilTagTrackLock(const apriltag_detection_t* det) {
+    if (det == g_aprilTagTrack) {
+        return;
+    }
+    apriltag_detection_t* copy = apriltag_detection_copy(det);
+    if (!copy) {
+        return;
+    }
+    if (g_aprilTagTrack) {
+        apriltag_detection_destroy(g_aprilTagTrack);
+    }
+    g_aprilTagTrack = copy;
+}
+
+static void aprilTagTrackDrop() {
+    if (g_aprilTagTrack) {
+        apriltag_detection_destroy(g_aprilTagTrack);
+        g_aprilTagTrack = nullptr;
+    }
+    g_aprilTagTrackFrames = 0;
+}
+
+// Verifies the locked tag in the new frame. Returns it, moved, as the only
+// detection, or NULL when there is nothing to track, the tag was lost, or a
+// full-frame search is due.
+static zarray_t* trackAprilTag(image_u8_t* image) {
+    if (!g_aprilTagTrack) {
+        return nullptr;
+    }
+    if (g_aprilTagTrackFrames >= APRILTAG_TRACK_REACQUIRE_FRAMES) {
+        g_aprilTagTrackFrames = 0;
+        return nullptr;
+    }
+    apriltag_detection_t* det = apriltag_detector_track(g_tagDetector, image, g_aprilTagTrack,
+                                                        APRILTAG_TRACK_BAND_PX, APRILTAG_TRACK_REUSE_PX);
+    if (!det) {
+        return nullptr;
+    }
+    ++g_aprilTagTrackFrames;
+    zarray_t* detections = zarray_create(sizeof(apriltag_detection_t*));
+    zarray_add(detections, &det);
+    return detections;
+}
+#endif
+
+// Longest edge of a detected tag, in pixels.
+static float aprilTagEdgePx(const apriltag_detection_t* det) {
+    float side = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        const int j = (i + 1) & 3;
+        side = std::max(side, static_cast<float>(hypot(det->p[j][0] - det->p[i][0], det->p[j][1] - det->p[i][1])));
+    }
+    return side;
+}
+
+#if APRILTAG_SIZE_GATE_ENABLE
+static void aprilTagSizeGateLock(const apriltag_detection_t* det) {
+    AprilTagSizeGate& gate = g_aprilTagSizeGate;
+    gate.sidePx = aprilTagEdgePx(det);
+    gate.tolerance = APRILTAG_SIZE_GATE_TOLERANCE;
+    gate.misses = 0;
+    gate.valid = true;
+}
+
+static void aprilTagSizeGateMiss() {
+    AprilTagSizeGate& gate = g_aprilTagSizeGate;
+    if (!gate.valid) {
+        return;
+    }
+    if (++gate.misses >= APRILTAG_SIZE_GATE_MAX_MISSES) {
+        gate.valid = false;
+        return;
+    }
+    gate.tolerance *= APRILTAG_SIZE_GATE_GROW_FACTOR;
+}
+#endif
+
+// Picks the decimation for the next frame from the tag accepted in this one
+// (NULL for none) and updates the hit rate.
+static void aprilTagDecimateUpdate(const apriltag_detection_t* det) {
+    AprilTagDecimate& dc = g_aprilTagDecimate;
+    dc.hitRate += ((det ? 1.0f : 0.0f) - dc.hitRate) * APRILTAG_HIT_RATE_ALPHA;
+#if APRILTAG_ADAPTIVE_DECIMATE
+    if (det) {
+        // the coarsest level the tag stays large enough at; moving to a
+        // coarser one than now needs some margin.
+        const float edge = aprilTagEdgePx(det);
+        int level = 0;
+        for (int i = kAprilTagDecimateLevelCount - 1; i > 0; --i) {
+            const float minEdge = APRILTAG_DECIMATE_MIN_EDGE_PX * (i > dc.level ? APRILTAG_DECIMATE_HYSTERESIS : 1.0f);
+            if (edge / kAprilTagDecimateLevels[i] >= minEdge) {
+                level = i;
+                break;
+            }
+        }
+        dc.level = static_cast<uint8_t>(level);
+        dc.misses = 0;
+    } else if (++dc.misses >= APRILTAG_DECIMATE_MISS_FRAMES) {
+        // maybe the tag is too far for this level: try finer ones, then
+        // start over from the default.
+        dc.level = dc.level > 0 ? dc.level - 1 : static_cast<uint8_t>(aprilTagDecimateDefaultLevel());
+        dc.misses = 0;
+    }
+#endif
+}
+
+// Full-frame search, or only the tracked region (and tag size) when a tag
+// is locked, unless fullFrame.
+static zarray_t* detectAprilTags(image_u8_t* image, bool fullFrame) {
+#if APRILTAG_SIZE_GATE_ENABLE
+    const AprilTagSizeGate& gate = g_aprilTagSizeGate;
+    const bool gated = gate.valid && !fullFrame;
+    g_tagDetector->qtp.min_tag_px = gated ? gate.sidePx / (1.0f + gate.tolerance) : 0.0f;
+    g_tagDetector->qtp.max_tag_px = gated ? gate.sidePx * (1.0f + gate.tolerance) : 0.0f;
+#endif
+#if APRILTAG_ROI_ENABLE
+    const AprilTagRoi& roi = g_aprilTagRoi;
+    if (roi.valid && !fullFrame) {
+        const int x0 = static_cast<int>(floorf(roi.xmin - roi.pad));
+        const int y0 = static_cast<int>(floorf(roi.ymin - roi.pad));
+        const int x1 = static_cast<int>(ceilf(roi.xmax + roi.pad));
+        const int y1 = static_cast<int>(ceilf(roi.ymax + roi.pad));
+        return apriltag_detector_detect_roi(g_tagDetector, image, x0, y0, x1 - x0, y1 - y0);
+    }
+#endif
+    return apriltag_detector_detect(g_tagDetector, image);
+}
+
 static bool captureAprilTag(AprilTagDetection& detection) {
     if (!g_cameraReady || !g_tagDetector) {
         static uint64_t lastWarn = 0;
@@ -1809,13 +2172,39 @@ static bool captureAprilTag(AprilTagDetection& detection) {
         Serial.print("x");
         Serial.print(fb->height);
         Serial.print(" len=");
-        Serial.println(fb->len);
+        Serial.print(fb->len);
+        Serial.print(" scratch_heap_calls=");
+        Serial.print(g_tagDetector->nscratch_heap_calls);
+        Serial.print(" scratch_kb=");
+        Serial.print(static_cast<uint32_t>(g_tagDetector->scratch_bytes / 1024));
+        Serial.print(" quads_skipped=");
+        Serial.print(g_tagDetector->nquads_skipped);
+        Serial.print(" tiles_reused=");
+        Serial.print(g_tagDetector->nthresh_tiles_reused);
+        Serial.print("/");
+        Serial.print(g_tagDetector->nthresh_tiles);
+        Serial.print(" decimate=");
+        Serial.print(g_tagDetector->quad_decimate);
+        Serial.print(" hit_rate=");
+        Serial.println(g_aprilTagDecimate.hitRate);
         s_lastFrameLog = nowLog;
     }
 #endif
 #endif
     esp_task_wdt_reset();
-    zarray_t* detections = apriltag_detector_detect(g_tagDetector, &image);
+    g_tagDetector->deadline_us = aprilTagDeadlineUs();
+#if APRILTAG_ADAPTIVE_DECIMATE
+    g_tagDetector->quad_decimate = kAprilTagDecimateLevels[g_aprilTagDecimate.level];
+#endif
+#if APRILTAG_TRACK_ENABLE
+    const bool reacquire = g_aprilTagTrack && g_aprilTagTrackFrames >= APRILTAG_TRACK_REACQUIRE_FRAMES;
+    zarray_t* detections = trackAprilTag(&image);
+    if (!detections) {
+        detections = detectAprilTags(&image, reacquire);
+    }
+#else
+    zarray_t* detections = detectAprilTags(&image, false);
+#endif
 
     apriltag_detection_t* best = nullptr;
     double bestMargin = 0.0;
@@ -1857,6 +2246,29 @@ static bool captureAprilTag(AprilTagDetection& detection) {
     static int stableFrameCount = 0;
     static uint64_t lastLowMarginLogMs = 0;
 
+#if APRILTAG_ROI_ENABLE
+    if (best && bestMargin >= APRILTAG_MIN_DECISION_MARGIN) {
+        aprilTagRoiLock(best);
+    } else {
+        aprilTagRoiMiss();
+    }
+#endif
+    aprilTagDecimateUpdate(best && bestMargin >= APRILTAG_MIN_DECISION_MARGIN ? best : nullptr);
+#if APRILTAG_SIZE_GATE_ENABLE
+    if (best && bestMargin >= APRILTAG_MIN_DECISION_MARGIN) {
+        aprilTagSizeGateLock(best);
+    } else {
+        aprilTagSizeGateMiss();
+    }
+#endif
+#if APRILTAG_TRACK_ENABLE
+    if (best && bestMargin >= APRILTAG_MIN_DECISION_MARGIN) {
+        aprilTagTrackLock(best);
+    } else {
+        aprilTagTrackDrop();
+    }
+#endif
+
     if (best && bestMargin >= APRILTAG_MIN_DECISION_MARGIN) {
         uint32_t detectedId = static_cast<uint32_t>(best->id);
 
@@ -208,6 +208,9 @@ typedef struct _com_gymjot_cuff_SnapshotEvent {
     uint32_t supervision_timeout_ms; /* Supervision timeout in milliseconds */
     uint32_t last_disconnect_reason; /* Last HCI disconnect reason code */
     uint32_t bonded_count; /* Number of bonded devices */
+    /* AprilTag detector telemetry */
+    float quad_decimate; /* Decimation picked for the current frame */
+    float detection_hit_rate; /* Moving average of frames with a detection, 0..1 */
 } com_gymjot_cuff_SnapshotEvent;
 
 typedef struct _com_gymjot_cuff_OtaStatusEvent {
@@ -377,7 +380,7 @@ extern "C" {
 #define com_gymjot_cuff_ExerciseReadyEvent_init_default {0}
 #define com_gymjot_cuff_ScanEvent_init_default   {0, 0, _com_gymjot_cuff_DeviceMode_MIN, 0, 0, ""}
 #define com_gymjot_cuff_RepEvent_init_default    {0, 0, 0, ""}
-#define com_gymjot_cuff_SnapshotEvent_init_default {0, "", _com_gymjot_cuff_DeviceMode_MIN, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+#define com_gymjot_cuff_SnapshotEvent_init_default {0, "", _com_gymjot_cuff_DeviceMode_MIN, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 #define com_gymjot_cuff_OtaStatusEvent_init_default {_com_gymjot_cuff_OtaPhase_MIN, "", 0, 0, 0}
 #define com_gymjot_cuff_PhotoMetaEvent_init_default {0, 0, 0, 0, ""}
 #define com_gymjot_cuff_PhotoChunkEvent_init_default {0, 0, {0, {0}}, 0}
@@ -412,7 +415,7 @@ extern "C" {
 #define com_gymjot_cuff_ExerciseReadyEvent_init_zero {0}
 #define com_gymjot_cuff_ScanEvent_init_zero      {0, 0, _com_gymjot_cuff_DeviceMode_MIN, 0, 0, ""}
 #define com_gymjot_cuff_RepEvent_init_zero       {0, 0, 0, ""}
-#define com_gymjot_cuff_SnapshotEvent_init_zero  {0, "", _com_gymjot_cuff_DeviceMode_MIN, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+#define com_gymjot_cuff_SnapshotEvent_init_zero  {0, "", _com_gymjot_cuff_DeviceMode_MIN, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 #define com_gymjot_cuff_OtaStatusEvent_init_zero {_com_gymjot_cuff_OtaPhase_MIN, "", 0, 0, 0}
 #define com_gymjot_cuff_PhotoMetaEvent_init_zero {0, 0, 0, 0, ""}
 #define com_gymjot_cuff_PhotoChunkEvent_init_zero {0, 0, {0, {0}}, 0}
@@ -515,6 +518,8 @@ extern "C" {
 #define com_gymjot_cuff_SnapshotEvent_supervision_timeout_ms_tag 16
 #define com_gymjot_cuff_SnapshotEvent_last_disconnect_reason_tag 17
 #define com_gymjot_cuff_SnapshotEvent_bonded_count_tag 18
+#define com_gymjot_cuff_SnapshotEvent_quad_decimate_tag 19
+#define com_gymjot_cuff_SnapshotEvent_detection_hit_rate_tag 20
 #define com_gymjot_cuff_OtaStatusEvent_phase_tag 1
 #define com_gymjot_cuff_OtaStatusEvent_message_tag 2
 #define com_gymjot_cuff_OtaStatusEvent_bytes_transferred_tag 3
@@ -826,7 +831,9 @@ X(a, STATIC,   SINGULAR, UINT32,   conn_interval_ms,  14) \
 X(a, STATIC,   SINGULAR, UINT32,   conn_latency,     15) \
 X(a, STATIC,   SINGULAR, UINT32,   supervision_timeout_ms,  16) \
 X(a, STATIC,   SINGULAR, UINT32,   last_disconnect_reason,  17) \
-X(a, STATIC,   SINGULAR, UINT32,   bonded_count,     18)
+X(a, STATIC,   SINGULAR, UINT32,   bonded_count,     18) \
+X(a, STATIC,   SINGULAR, FLOAT,    quad_decimate,    19) \
+X(a, STATIC,   SINGULAR, FLOAT,    detection_hit_rate,  20)
 #define com_gymjot_cuff_SnapshotEvent_CALLBACK NULL
 #define com_gymjot_cuff_SnapshotEvent_DEFAULT NULL
 
@@ -996,7 +1003,7 @@ extern const pb_msgdesc_t com_gymjot_cuff_MotionDetectedEvent_msg;
 #define com_gymjot_cuff_ScanEvent_size           86
 #define com_gymjot_cuff_SetTargetFpsCommand_size 5
 #define com_gymjot_cuff_SetTestModeCommand_size  2
-#define com_gymjot_cuff_SnapshotEvent_size       153
+#define com_gymjot_cuff_SnapshotEvent_size       165
 #define com_gymjot_cuff_SnapshotRequestCommand_size 0
 #define com_gymjot_cuff_StartVideoCommand_size   9
 #define com_gymjot_cuff_StatusEvent_size         43